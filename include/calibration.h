@@ -0,0 +1,94 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkanmanager.h"
+#include "tracking.h"
+
+// Must match shaders/color_histogram.comp
+#define COLOR_HISTOGRAM_CHANNEL_BINS 256
+#define COLOR_HISTOGRAM_JOINT_LEVELS 8
+#define COLOR_HISTOGRAM_JOINT_BINS (COLOR_HISTOGRAM_JOINT_LEVELS * COLOR_HISTOGRAM_JOINT_LEVELS * COLOR_HISTOGRAM_JOINT_LEVELS)
+// Workgroups striding over the frame, bounds the global atomics of the final flush
+#define COLOR_HISTOGRAM_MAX_WORKGROUPS 64
+
+// One histogram as written by color_histogram.comp, std430 layout
+typedef struct ColorHistogramGPU
+{
+    uint32_t pixelCount;
+    uint32_t reserved[3];
+    uint32_t channels[3][COLOR_HISTOGRAM_CHANNEL_BINS]; // R, G, B or Y, U, V
+    uint32_t joint[COLOR_HISTOGRAM_JOINT_BINS];         // Top 3 bits of each channel, first channel most significant
+} ColorHistogramGPU;
+
+// Push constant block of color_histogram.comp
+typedef struct ColorHistogramPushConstants
+{
+    uint32_t regionOrigin[2];
+    uint32_t regionExtent[2];
+    uint32_t sampleStep;
+} ColorHistogramPushConstants;
+
+typedef struct ColorCalibrationResult
+{
+    MarkerColorRange range;     // In the tracker's pixel format, RGB or YUV
+    uint32_t regionPixels;      // Samples inside the selected region
+    uint32_t framePixels;       // Samples of the whole frame
+    float regionCoverage;       // Estimated fraction of region samples the range classifies as marker
+    float backgroundLeak;       // Estimated fraction of samples outside the region it classifies as marker
+} ColorCalibrationResult;
+
+typedef struct ColorCalibrator
+{
+    ComputeApplication app;
+    BlobTracker tracker;
+    Buffer histogramBuffer;     // Binding 1, host visible ColorHistogramGPU[2], region then frame
+    VkDescriptorPool descriptorPool;
+    DescriptorSetForBuffers descriptors[TRACKING_FRAMES_IN_FLIGHT];  // Frame of each tracker slot and the histograms
+    VkShaderModule shaderModule;
+    ComputePipeline pipeline;
+    uint32_t workgroupSize;
+    CommandBuffer commandBuffer;
+    ComputeTicket ticket;       // Last calibration submission, 0 before the first one
+} *ColorCalibrator;
+
+/**
+ * @brief Creates the colour histogram pipeline for the frames of one tracker.
+ *
+ * @param spirv SPIR-V of shaders/color_histogram.comp, see GetBuiltinShader.
+ */
+ColorCalibrator CreateColorCalibrator(ComputeApplication app, BlobTracker tracker, const void* spirv, size_t spirvSize);
+
+/**
+ * @brief Submits histogram construction over the frame uploaded to a tracker slot.
+ *
+ * Runs as its own small submission after the tracking work already queued, so tracking is never
+ * re-recorded or delayed. Call after the slot's frame was uploaded, usually right after
+ * FrameGraphSubmit. The ticket is stored as the slot's readTicket, so the next upload into the
+ * slot waits for the histograms instead of overwriting the frame they read. A request made
+ * while the previous one is still running is refused.
+ *
+ * @param frame Tracker slot holding the frame, usually the one submitted last.
+ * @param region Selected object, clamped to the frame.
+ * @param sampleStep Samples every sampleStep-th column and row, 1 for every pixel.
+ * @return Ticket of the submission, 0 when refused.
+ */
+ComputeTicket RequestColorCalibration(ColorCalibrator calibrator, uint32_t frame, TrackingWindow region, uint32_t sampleStep);
+
+/**
+ * @brief Derives the marker range once the calibration submission completed, without waiting.
+ *
+ * Per channel, the range is the interval maximizing the difference between the fraction of
+ * region samples and the fraction of background samples inside it. Apply the range with
+ * SetBlobTrackerMarkerRange, it is already in the tracker's pixel format.
+ *
+ * @return false while the submission is running or when no calibration was requested.
+ */
+bool GetColorCalibrationResult(ColorCalibrator calibrator, ColorCalibrationResult* out);
+
+/**
+ * @brief Derives the separation-maximizing range from a region and a whole frame histogram.
+ */
+ColorCalibrationResult DeriveColorCalibration(const ColorHistogramGPU* region, const ColorHistogramGPU* frame);
+void DestroyColorCalibrator(ColorCalibrator calibrator);
+#endif
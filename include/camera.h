@@ -391,6 +391,48 @@ typedef struct
     frame_rate_fraction* fps;
 } camera_format;
 
+// Mode table limits, mode indices are 16 bit and sampled stepwise or continuous ranges stay small
+#define CAMERA_MAX_MODES 4096
+#define CAMERA_MODE_NONE 0xFFFFu
+
+// One capture mode, a pixel format at one size and one frame interval
+typedef struct
+{
+    uint32_t pixel_format;              // camera_pixel_format
+    uint16_t width;
+    uint16_t height;
+    uint32_t interval_numerator;        // Seconds per frame like camera_format.fps, fps is denominator / numerator
+    uint32_t interval_denominator;
+} camera_mode;
+
+// Modes of one pixel format within a camera_mode_table
+typedef struct
+{
+    uint32_t pixel_format;              // camera_pixel_format
+    uint32_t first_mode;                // modes[first_mode, first_mode + mode_count)
+    uint32_t mode_count;
+    uint32_t first_size;                // sizes[first_size], width_count widths then height_count heights, ascending
+    uint16_t width_count;
+    uint16_t height_count;
+    uint32_t first_fastest;             // fastest[first_fastest + w * height_count + h]
+} camera_mode_format;
+
+// Every mode of a camera sorted by format, width, height and fastest first. One relocatable
+// allocation with offsets from its start, so it is copied as is into the flat list. fastest is a
+// grid over the distinct widths and heights of each format holding the fastest mode at least that
+// large, which turns "max fps at >= WxH" into two binary searches.
+typedef struct
+{
+    uint32_t size;                      // Bytes of the whole table
+    uint32_t mode_count;
+    uint32_t format_count;
+    uint32_t modes_offset;              // camera_mode[mode_count]
+    uint32_t formats_offset;            // camera_mode_format[format_count], ascending pixel_format
+    uint32_t sizes_offset;              // uint16_t
+    uint32_t fastest_offset;            // uint16_t mode indices, CAMERA_MODE_NONE when no mode is that large
+    uint32_t reserved;
+} camera_mode_table;
+
 // Controls
 typedef struct
 {
@@ -458,6 +500,7 @@ typedef struct
     camera_streaming_params streaming_params;
     uint32_t tuning_count;
     camera_status_tuning* tuning;
+    camera_mode_table* modes;           // Built from formats, NULL when the device reported none
 } camera_desc;
 
 // List of Cameras
@@ -467,13 +510,117 @@ typedef struct {
     size_t count;
 } camera_list;
 
+// Flat, relocatable camera_list: one allocation, offsets from the start of the blob instead of
+// pointers, fixed width fields only. It can be copied to shared memory or a file and read in
+// place by another process. Offset 0 is the header, so it doubles as "absent".
+#define CAMERA_FLAT_MAGIC 0x56524344u   // "VRCD"
+#define CAMERA_FLAT_VERSION 2
+#define CAMERA_FLAT_ALIGNMENT 8
+
+// Bits of camera_flat_desc.capability_flags, mirroring camera_capabilities
+enum camera_flat_capability
+{
+    camera_flat_capability_CAPTURE = 1 << 0,
+    camera_flat_capability_STREAMING = 1 << 1,
+    camera_flat_capability_ASYNC_IO = 1 << 2,
+    camera_flat_capability_TUNER = 1 << 3,
+    camera_flat_capability_MODULATOR = 1 << 4,
+    camera_flat_capability_HARDWARE_ACCELERATION = 1 << 5
+};
+
+typedef struct
+{
+    uint32_t pixel_format;              // camera_pixel_format
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps_count;
+    uint32_t fps_offset;                // frame_rate_fraction[fps_count]
+    uint32_t reserved;
+} camera_flat_format;
+
+typedef struct
+{
+    uint32_t signal_locked;
+    uint32_t is_capturing;
+    uint32_t tuning_standard;           // tuning_standard
+    uint32_t reserved;
+    double input_frequency;
+} camera_flat_tuning;
+
+typedef struct
+{
+    // NUL terminated strings, 0 when the field was NULL
+    uint32_t card_offset;
+    uint32_t device_name_offset;
+    uint32_t driver_info_offset;
+    uint32_t version_offset;
+    uint32_t manufacturer_offset;
+    uint32_t bus_offset;
+    uint32_t serial_number_offset;
+    uint32_t dev_path_offset;
+    uint32_t capabilities;              // camera_device_id.capabilities
+    uint32_t capability_flags;          // camera_flat_capability bits
+    camera_controls controls;
+    uint32_t io_method;                 // camera_io_method
+    uint32_t formats_count;
+    uint32_t formats_offset;            // camera_flat_format[formats_count]
+    uint32_t buffers_count;
+    uint32_t buffers_offset;            // camera_buffer_description[buffers_count]
+    uint32_t tuning_count;
+    uint32_t tuning_offset;             // camera_flat_tuning[tuning_count]
+    camera_streaming_params streaming_params;
+    uint32_t modes_offset;              // camera_mode_table copied verbatim, 0 when absent
+    uint32_t modes_size;
+} camera_flat_desc;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      // Bytes of the whole blob
+    uint32_t camera_count;
+    uint32_t cameras_offset;            // camera_flat_desc[camera_count]
+    uint32_t reserved;
+} camera_flat_list;
+
+// Exposure values of camera_capture_settings besides a manual exposure in 100 us units
+#define CAMERA_EXPOSURE_UNCHANGED 0
+#define CAMERA_EXPOSURE_AUTO -1
+
+// Capture parameters that can change while streaming
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    int32_t exposure;   // CAMERA_EXPOSURE_UNCHANGED leaves the device's exposure mode alone
+} camera_capture_settings;
+
+// CLOCK_MONOTONIC nanoseconds of the frame being handed to the callback, 0 for skipped steps
+typedef struct
+{
+    uint64_t capture_ns;    // Driver timestamp, 0 unless the driver stamps with CLOCK_MONOTONIC
+    uint64_t dequeue_ns;    // VIDIOC_DQBUF returned
+    uint64_t decode_ns;     // H264 frame out of the decoder, raw captures skip it
+    uint64_t convert_ns;    // RGB conversion done, raw captures skip it
+} camera_frame_times;
+
 typedef void (*decoded_rgb_frame_buffer_callback)(const uint8_t *rgb_buffer, uint32_t width, uint32_t height);
+typedef void (*raw_frame_buffer_callback)(const uint8_t *frame_buffer, size_t size, uint32_t width, uint32_t height, camera_pixel_format format, void *user_data);
+
+/**
+ * @brief Called between two frames with the settings the capture is running with.
+ *
+ * @param settings Modify in place to reconfigure the running capture.
+ * @return true when settings was modified.
+ */
+typedef bool (*capture_control_callback)(camera_capture_settings *settings, void *user_data);
 
 /**
  * @brief Lists all available camera devices on the system and returns them in a list_cameras struct.
  * 
  * This function scans the system for all camera devices that are compatible
- * with the Platform Specific API. It allocates and fills a `list_cameras` struct, which
+ * with the Platform Specific API, see list_all_camera_devices_parallel for how. It allocates and fills a `list_cameras` struct, which
  * contains an array of `camera_desc` structs, each representing a different
  * camera device. The `list_cameras` struct also contains the total number of
  * devices found.
@@ -486,6 +633,90 @@ typedef void (*decoded_rgb_frame_buffer_callback)(const uint8_t *rgb_buffer, uin
  */
 camera_list* list_all_camera_devices();
 
+// Defaults of list_all_camera_devices, a UVC device answers its probe well within the timeout
+#define CAMERA_PROBE_THREADS 4
+#define CAMERA_PROBE_TIMEOUT_MS 3000
+// Directory scanned and watched for video nodes instead of /dev, for tests with fake devices
+#define CAMERA_DEVICE_DIRECTORY_ENVIRONMENT_VARIABLE "VRWEBTRACK_DEVICE_DIR"
+
+/**
+ * @brief list_all_camera_devices probing the devices on up to thread_count threads.
+ *
+ * Devices are probed concurrently so the scan takes about as long as the slowest device rather
+ * than all of them together. A device whose probe does not finish within timeout_ms, e.g. one
+ * hanging in a driver ioctl, is left out and its thread left to finish on its own. The list is
+ * in device node order whatever the order the probes finished in.
+ *
+ * @return NULL if /dev cannot be read or no probe thread could be started.
+ */
+camera_list* list_all_camera_devices_parallel(uint32_t thread_count, uint32_t timeout_ms);
+
+// Keeps the device list current across hotplug, see create_camera_enumerator
+typedef struct camera_enumerator camera_enumerator;
+
+/**
+ * @brief Called for every device plugged in or removed after the enumerator was created.
+ *
+ * @param camera Valid until the callback returns when removed, until the device is removed
+ *               otherwise.
+ * @param added false when the device node went away.
+ */
+typedef void (*camera_hotplug_callback)(const camera_desc *camera, bool added, void *user_data);
+
+/**
+ * @brief Enumerates the camera devices once and keeps the list current through hotplug events.
+ *
+ * Devices are recognised by driver, driver version, bus, serial number, card and capabilities,
+ * which VIDIOC_QUERYCAP and sysfs give in microseconds. A device recognised this way reuses its
+ * description from the cache instead of being probed, only new devices get the full probe of
+ * list_all_camera_devices. The cache is loaded from and saved to cache_path, so it also survives
+ * restarts, and keeps unplugged devices so reconnecting them is as fast.
+ *
+ * /dev is watched with inotify, poll_camera_enumerator handles the events without rescanning.
+ *
+ * @param cache_path Cache file, NULL to keep the cache in memory only.
+ * @param callback Called from poll_camera_enumerator and refresh_camera_enumerator, may be NULL.
+ * @return NULL on allocation failure. Without inotify the enumerator still works through
+ *         refresh_camera_enumerator.
+ */
+camera_enumerator *create_camera_enumerator(const char *cache_path, camera_hotplug_callback callback, void *user_data);
+
+/**
+ * @brief The devices currently plugged in, owned by the enumerator.
+ */
+const camera_list *camera_enumerator_devices(const camera_enumerator *enumerator);
+
+/**
+ * @brief Descriptor that becomes readable on hotplug events, for poll or epoll. -1 without inotify.
+ */
+int camera_enumerator_fd(const camera_enumerator *enumerator);
+
+/**
+ * @brief Applies pending hotplug events without blocking, probing only added devices.
+ *
+ * @return The number of devices added or removed.
+ */
+int poll_camera_enumerator(camera_enumerator *enumerator);
+
+/**
+ * @brief Rescans /dev through the cache, e.g. when inotify is unavailable.
+ *
+ * @return The number of devices added or removed.
+ */
+int refresh_camera_enumerator(camera_enumerator *enumerator);
+
+/**
+ * @brief Writes the cache file when devices were probed since the last save.
+ *
+ * @return 0 on success or when there was nothing to save, 1 on failure.
+ */
+int save_camera_enumerator_cache(camera_enumerator *enumerator);
+
+/**
+ * @brief Saves the cache and frees the enumerator and its device list.
+ */
+void destroy_camera_enumerator(camera_enumerator *enumerator);
+
 /**
  * @brief Frees the memory allocated for a given `camera_desc` struct.
  * 
@@ -499,6 +730,11 @@ camera_list* list_all_camera_devices();
  */
 void free_camera_desc(camera_desc* camera);
 
+/**
+ * @brief Frees a list returned by list_all_camera_devices and every camera in it.
+ */
+void free_camera_list(camera_list* cameras);
+
 /**
  * @brief Convert YUYV pixel format to RGB pixel format.
  *
@@ -554,6 +790,58 @@ int write_rgb_to_bmp(const char *file_path, unsigned char *rgb_buffer, int width
  */
 int start_capture(const char *pathToCamera, uint32_t width, uint32_t height, uint32_t fps, decoded_rgb_frame_buffer_callback callback, atomic_int *quit);
 
+/**
+ * @brief Like start_capture but reconfigurable while running through a control callback.
+ *
+ * The control callback runs after every frame. Changes it makes are applied in place before the
+ * next frame: the device stays open and the H264 decoder is kept, exposure is only a control
+ * write, a new frame rate restarts streaming only when the driver refuses it while streaming,
+ * and only a new resolution remaps the driver buffers and resizes the colour conversion.
+ * Settings the device rejects are reverted and the capture continues with the previous ones.
+ *
+ * @param settings Initial resolution, frame rate and exposure.
+ * @param control Called at every frame boundary, may be NULL.
+ * @param user_data Passed through to control.
+ * @param times Filled with the frame's timestamps before each callback, may be NULL.
+ *
+ * @return 0 on success, or a non-zero error code on failure.
+ */
+int start_capture_controlled(const char *pathToCamera, const camera_capture_settings *settings, decoded_rgb_frame_buffer_callback callback, capture_control_callback control, void *user_data, camera_frame_times *times, atomic_int *quit);
+
+/**
+ * @brief Start capturing uncompressed frames and hand the raw V4L2 payload to the callback.
+ *
+ * Unlike start_capture no decoding or colour conversion takes place, the buffer passed to the
+ * callback is the memory mapped driver buffer itself. It is meant to be uploaded as is to the
+ * GPU tracking kernels, which unpack YUYV and NV12 themselves, so the CPU never touches the
+ * pixels. The buffer is only valid for the duration of the callback.
+ *
+ * @param pathToCamera Path to the camera device (e.g., "/dev/video0").
+ * @param width Desired width of the capture in pixels, must be supported exactly by the device.
+ * @param height Desired height of the capture in pixels, must be supported exactly by the device.
+ * @param fps Desired frames per second (fps) for video capture.
+ * @param format camera_pixel_format_YUYV or camera_pixel_format_NV12.
+ * @param callback Invoked with every complete frame.
+ * @param user_data Passed through to the callback.
+ * @param quit Atomic flag to indicate if capturing should stop; if set to non-zero, capturing stops.
+ *
+ * @return 0 on success, or a non-zero error code on failure.
+ *
+ * Error codes:
+ * 1 - Unsupported format, device setup failure or a capture error.
+ */
+int start_raw_capture(const char *pathToCamera, uint32_t width, uint32_t height, uint32_t fps, camera_pixel_format format, raw_frame_buffer_callback callback, void *user_data, atomic_int *quit);
+
+/**
+ * @brief start_raw_capture reconfigurable at frame boundaries, see start_capture_controlled.
+ *
+ * After a resolution change the callback receives frames of the new size.
+ *
+ * @param user_data Passed through to both callback and control.
+ * @param times Filled with the frame's timestamps before each callback, may be NULL.
+ */
+int start_raw_capture_controlled(const char *pathToCamera, const camera_capture_settings *settings, camera_pixel_format format, raw_frame_buffer_callback callback, capture_control_callback control, void *user_data, camera_frame_times *times, atomic_int *quit);
+
 /**
  * @brief Converts a camera_pixel_format enumeration value to its corresponding string representation.
  *
@@ -588,4 +876,142 @@ void print_camera_desc(camera_desc* camera);
  * @param[in] list Pointer to the `camera_list` structure containing the list of cameras.
  */
 void print_list_camera_desc(camera_list* list);
+
+/**
+ * @brief Returns the number of bytes flatten_camera_list needs for a list.
+ *
+ * @return 0 when the list is NULL or would not fit the 32 bit offsets.
+ */
+size_t camera_list_flat_size(const camera_list *list);
+
+/**
+ * @brief Writes a list into buffer as a single flat blob, see camera_flat_list.
+ *
+ * The strings, formats, frame rates, buffers and tuning of every camera are packed after the
+ * fixed size records, each section aligned to CAMERA_FLAT_ALIGNMENT. Padding is zeroed so equal
+ * lists produce equal blobs.
+ *
+ * @param buffer Destination, aligned to CAMERA_FLAT_ALIGNMENT, e.g. a shared memory mapping.
+ * @param size Bytes available in buffer.
+ * @return Bytes written, 0 when buffer is too small or the list cannot be flattened.
+ */
+size_t flatten_camera_list(const camera_list *list, void *buffer, size_t size);
+
+/**
+ * @brief Validates a blob once and returns it typed, without copying or allocating.
+ *
+ * Every offset and count is bounds checked and every string checked for its terminator, so the
+ * accessors below can be used without further checks on a blob read from a file or another
+ * process.
+ *
+ * @return NULL when the blob is truncated, corrupt or of another version.
+ */
+const camera_flat_list *camera_flat_list_view(const void *buffer, size_t size);
+
+/**
+ * @brief Maps a blob written by write_camera_flat_list read only and validates it.
+ *
+ * @param out_size Receives the mapping size for unmap_camera_flat_list.
+ * @return NULL when the file is missing or invalid.
+ */
+const camera_flat_list *map_camera_flat_list(const char *path, size_t *out_size);
+void unmap_camera_flat_list(const camera_flat_list *list, size_t size);
+
+/**
+ * @brief Writes a blob to a file atomically, through a temporary file renamed over path.
+ *
+ * @return 0 on success, 1 on failure.
+ */
+int write_camera_flat_list(const char *path, const camera_flat_list *list);
+
+/**
+ * @brief Rebuilds a heap allocated camera_desc from a validated flat one.
+ *
+ * @return NULL when out of memory, free with free_camera_desc otherwise.
+ */
+camera_desc *camera_desc_from_flat(const camera_flat_list *list, const camera_flat_desc *camera);
+
+/**
+ * @brief Deep copies a camera_desc, free with free_camera_desc.
+ */
+camera_desc *clone_camera_desc(const camera_desc *camera);
+
+static inline const camera_flat_desc *camera_flat_list_camera(const camera_flat_list *list, uint32_t index)
+{
+    return (const camera_flat_desc *)((const uint8_t *)list + list->cameras_offset) + index;
+}
+
+// NULL for absent strings
+static inline const char *camera_flat_string(const camera_flat_list *list, uint32_t offset)
+{
+    return offset ? (const char *)list + offset : NULL;
+}
+
+static inline const camera_flat_format *camera_flat_desc_formats(const camera_flat_list *list, const camera_flat_desc *camera)
+{
+    return (const camera_flat_format *)((const uint8_t *)list + camera->formats_offset);
+}
+
+static inline const frame_rate_fraction *camera_flat_format_fps(const camera_flat_list *list, const camera_flat_format *format)
+{
+    return (const frame_rate_fraction *)((const uint8_t *)list + format->fps_offset);
+}
+
+static inline const camera_buffer_description *camera_flat_desc_buffers(const camera_flat_list *list, const camera_flat_desc *camera)
+{
+    return (const camera_buffer_description *)((const uint8_t *)list + camera->buffers_offset);
+}
+
+static inline const camera_flat_tuning *camera_flat_desc_tuning(const camera_flat_list *list, const camera_flat_desc *camera)
+{
+    return (const camera_flat_tuning *)((const uint8_t *)list + camera->tuning_offset);
+}
+
+// NULL when the camera has no mode table
+static inline const camera_mode_table *camera_flat_desc_modes(const camera_flat_list *list, const camera_flat_desc *camera)
+{
+    return camera->modes_offset ? (const camera_mode_table *)((const uint8_t *)list + camera->modes_offset) : NULL;
+}
+
+/**
+ * @brief Builds the sorted mode table of every size and frame interval in formats.
+ *
+ * Duplicates are dropped, as are sizes over 65535 and modes past CAMERA_MAX_MODES.
+ *
+ * @return NULL when there are no modes or out of memory, release with free otherwise.
+ */
+camera_mode_table *build_camera_mode_table(const camera_format *formats, uint32_t formats_count);
+
+/**
+ * @brief Checks the offsets and counts of a table read from untrusted memory, e.g. a cache file.
+ */
+bool camera_mode_table_valid(const void *table, size_t size);
+
+/**
+ * @brief Modes of a pixel format, sorted by width, height and fastest first.
+ *
+ * @return NULL with count 0 when the format is not supported.
+ */
+const camera_mode *camera_format_modes(const camera_mode_table *table, camera_pixel_format format, uint32_t *count);
+
+/**
+ * @brief Fastest mode of a format at least min_width x min_height, O(log n).
+ *
+ * Ties go to the smallest such size, it needs the least bandwidth.
+ *
+ * @return NULL when no mode of the format is that large.
+ */
+const camera_mode *camera_fastest_mode(const camera_mode_table *table, camera_pixel_format format, uint32_t min_width, uint32_t min_height);
+
+/**
+ * @brief Slowest mode of exactly width x height reaching at least min_fps, O(log n).
+ *
+ * @return NULL when the size is not supported or never reaches min_fps.
+ */
+const camera_mode *find_camera_mode(const camera_mode_table *table, camera_pixel_format format, uint32_t width, uint32_t height, uint32_t min_fps);
+
+static inline double camera_mode_fps(const camera_mode *mode)
+{
+    return mode->interval_numerator ? (double)mode->interval_denominator / mode->interval_numerator : 0.0;
+}
 #endif
\ No newline at end of file
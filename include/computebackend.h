@@ -0,0 +1,171 @@
+#ifndef COMPUTEBACKEND_H
+#define COMPUTEBACKEND_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "vulkanmanager.h"
+#include "tracking.h"
+#include "calibration.h"
+#include "network.h"
+
+// Selects the backend at startup: "vulkan", "cpu" or "auto"
+#define COMPUTE_BACKEND_ENVIRONMENT_VARIABLE "VRWEBTRACK_COMPUTE_BACKEND"
+// Threads used by the CPU backend, defaults to the number of online processors
+#define COMPUTE_THREADS_ENVIRONMENT_VARIABLE "VRWEBTRACK_COMPUTE_THREADS"
+#define MAX_CPU_COMPUTE_THREADS 64
+// Set to 1 to time the Vulkan backend's upload and passes, summarized on stderr once per interval
+#define GPU_PROFILE_ENVIRONMENT_VARIABLE "VRWEBTRACK_GPU_PROFILE"
+#define GPU_PROFILE_REPORT_INTERVAL_NS 1000000000ull
+// Smallest edge of a predicted marker window, keeps tiny markers from being lost between frames
+#define BACKEND_MINIMUM_WINDOW_SIZE 16
+
+enum ComputeBackendType
+{
+    ComputeBackendAuto,     // Vulkan when a usable device exists, CPU otherwise
+    ComputeBackendVulkan,
+    ComputeBackendCPU
+};
+
+typedef struct ComputeBackend* ComputeBackend;
+typedef struct BackendTracker* BackendTracker;
+
+// Kernels every backend implements, all operate on one camera's tracker
+typedef struct ComputeBackendOps
+{
+    const char* name;
+    bool (*createTracker)(BackendTracker tracker);
+    // Classification and reduction of a whole frame, may complete asynchronously. Only called
+    // with fewer than TRACKING_FRAMES_IN_FLIGHT frames pending.
+    bool (*submitFrame)(BackendTracker tracker, const void* frame, size_t frameSize);
+    // Centroids of the oldest pending frame, false while it is running unless wait is set
+    bool (*collectResults)(BackendTracker tracker, bool wait, MarkerCentroid* out);
+    // Starts the region and whole frame histograms of the last submitted frame, may complete
+    // asynchronously. Only called when no request is waiting to be collected.
+    bool (*requestHistograms)(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep);
+    // Histograms of the request, false while it is running unless wait is set
+    bool (*collectHistograms)(BackendTracker tracker, bool wait, ColorHistogramGPU out[2]);
+    // Hot reload of blob_centroid.comp, NULL for backends without shaders
+    bool (*updateShader)(BackendTracker tracker, const UpdateGLSLCode* code);
+    void (*destroyTracker)(BackendTracker tracker);
+    void (*destroyBackend)(ComputeBackend backend);
+} ComputeBackendOps;
+
+typedef struct ComputeBackend
+{
+    enum ComputeBackendType type;
+    const ComputeBackendOps* ops;
+    ComputeApplication app;         // Vulkan backend only
+    uint32_t threadCount;           // CPU backend only
+    void* state;                    // Owned by the backend implementation
+} *ComputeBackend;
+
+typedef struct BackendTracker
+{
+    ComputeBackend backend;
+    uint32_t width;
+    uint32_t height;
+    uint32_t markerCount;
+    enum TrackingPixelFormat pixelFormat;
+    size_t frameSize;
+    MarkerColorRange ranges[MAX_TRACKING_MARKERS];  // In the frame's colour space, empty (min above max) until set
+    bool rangesChanged;             // Set when ranges changed since the backend last consumed them
+    uint32_t roiMargin;             // Pixels around each marker's previous bounding box, 0 tracks whole frames
+    uint32_t pendingFrames;         // Submitted and not collected yet, at most TRACKING_FRAMES_IN_FLIGHT
+    bool histogramsRequested;       // Histograms requested and not collected yet
+    void* state;                    // Owned by the backend implementation
+} *BackendTracker;
+
+/**
+ * @brief Creates the compute backend running the tracking kernels.
+ *
+ * With ComputeBackendAuto, VRWEBTRACK_COMPUTE_BACKEND decides when set. Otherwise Vulkan is
+ * used when initialization succeeds and the multithreaded CPU backend when there is no loader,
+ * no device with a compute queue or device creation fails, so the worker keeps tracking on
+ * machines without a usable GPU. Both backends produce the same results, which makes A/B
+ * latency comparisons per machine a matter of switching the variable.
+ *
+ * @param info Vulkan options, may be NULL.
+ * @return The backend, NULL only when Vulkan was explicitly requested and is unavailable.
+ */
+ComputeBackend CreateComputeBackend(enum ComputeBackendType type, const ComputeApplicationCreateInfo* info);
+BackendTracker CreateBackendTracker(ComputeBackend backend, uint32_t width, uint32_t height, enum TrackingPixelFormat pixelFormat, uint32_t markerCount);
+
+/**
+ * @brief Sets a marker's RGB range, converted for YUV frames like SetBlobTrackerMarkerColor.
+ */
+bool BackendTrackerSetMarkerColor(BackendTracker tracker, uint32_t marker, MarkerColorRange range);
+
+/**
+ * @brief Sets a marker's range in the frame's colour space, e.g. from DeriveColorCalibration.
+ */
+bool BackendTrackerSetMarkerRange(BackendTracker tracker, uint32_t marker, MarkerColorRange range);
+
+/**
+ * @brief Restricts each marker to a window predicted from its bounding box in the previous
+ * frame, grown by margin pixels, the whole frame when it was lost. 0 processes whole frames.
+ *
+ * The Vulkan backend predicts on the GPU with roi_predict.comp, the CPU backend with
+ * PredictTrackingWindow, so neither waits for a readback to decide where to look.
+ */
+void BackendTrackerSetRoiMargin(BackendTracker tracker, uint32_t margin);
+
+/**
+ * @brief Queues a frame for tracking, the frame is copied before returning.
+ *
+ * Up to TRACKING_FRAMES_IN_FLIGHT frames may be pending, so the capture thread can submit frame
+ * N and then collect frame N-1 while the GPU works on N.
+ *
+ * @return false when TRACKING_FRAMES_IN_FLIGHT frames are still to be collected.
+ */
+bool BackendTrackerSubmitFrame(BackendTracker tracker, const void* frame, size_t frameSize);
+
+/**
+ * @brief Returns the centroids of the oldest pending frame, frames are collected in submission order.
+ *
+ * @param wait Block until the frame completes, otherwise return false while it is running.
+ * @return false when no frame is pending, it is still running or the backend failed.
+ */
+bool BackendTrackerCollectResults(BackendTracker tracker, bool wait, MarkerCentroid* out);
+
+/**
+ * @brief Starts building the calibration histograms over the last submitted frame, without waiting.
+ *
+ * The Vulkan backend queues them behind the tracking work, so the capture thread keeps going and
+ * picks them up with BackendTrackerCollectHistograms once they completed.
+ *
+ * @param region Selected object, clamped to the frame.
+ * @param sampleStep Samples every sampleStep-th column and row, 1 for every pixel.
+ * @return false when no frame was submitted, the region is outside the frame or the previous
+ *         request was not collected yet.
+ */
+bool BackendTrackerRequestHistograms(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep);
+
+/**
+ * @brief Returns the histograms of the last request, like BackendTrackerCollectResults.
+ *
+ * @param wait Block until the histograms are built, otherwise return false while they are running.
+ * @param out Region histogram followed by the whole frame histogram, as for DeriveColorCalibration.
+ * @return false when nothing was requested, it is still running or the backend failed.
+ */
+bool BackendTrackerCollectHistograms(BackendTracker tracker, bool wait, ColorHistogramGPU out[2]);
+
+/**
+ * @brief Requests and collects the calibration histograms in one call, blocking. For tools and
+ * tests, the capture thread should poll with BackendTrackerCollectHistograms instead.
+ */
+bool BackendTrackerComputeHistograms(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep, ColorHistogramGPU out[2]);
+/**
+ * @brief Replaces the tracking kernel with a hot reloaded blob_centroid.comp. The pipeline is
+ * built off the capture thread and swapped in by a later BackendTrackerSubmitFrame, a shader
+ * that fails to compile or is rejected by the driver leaves the current one running.
+ *
+ * @return false when the backend has no shaders, e.g. the CPU backend, or the message is invalid.
+ */
+bool BackendTrackerUpdateShader(BackendTracker tracker, const UpdateGLSLCode* code);
+void DestroyBackendTracker(BackendTracker tracker);
+void DestroyComputeBackend(ComputeBackend backend);
+
+// Implementations, selected by CreateComputeBackend
+bool InitializeVulkanComputeBackend(ComputeBackend backend, const ComputeApplicationCreateInfo* info);
+bool InitializeCPUComputeBackend(ComputeBackend backend);
+#endif
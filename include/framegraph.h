@@ -0,0 +1,126 @@
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkanmanager.h"
+#include "gpuprofiler.h"
+
+// Buffers a single pass may declare
+#define MAX_FRAME_GRAPH_ACCESSES 8
+// Frame slot of a pass recorded into every command buffer
+#define FRAME_GRAPH_ALL_FRAMES UINT32_MAX
+
+// Records the commands of one pass, barriers are inserted by the frame graph
+typedef void (*FrameGraphRecordCallback)(CommandBuffer cmdbuf, void* userData);
+
+// How a pass uses a buffer, stage and access masks as passed to vkCmdPipelineBarrier
+typedef struct FrameGraphBufferAccess
+{
+    Buffer buffer;
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+} FrameGraphBufferAccess;
+
+typedef struct FrameGraphPass
+{
+    const char* name;
+    FrameGraphRecordCallback record;    // NULL for a pass that only declares accesses, e.g. a host readback
+    void* userData;
+    uint32_t frame;                     // Only recorded into this frame slot's command buffer, or FRAME_GRAPH_ALL_FRAMES
+    uint32_t accessCount;
+    FrameGraphBufferAccess accesses[MAX_FRAME_GRAPH_ACCESSES];
+} FrameGraphPass;
+
+// Last synchronisation scope seen for a buffer while walking the passes
+typedef struct FrameGraphBufferState
+{
+    Buffer buffer;
+    VkPipelineStageFlags writeStages;
+    VkAccessFlags writeAccess;
+    VkPipelineStageFlags readStages;    // Stages that read since the last write
+    VkPipelineStageFlags visibleStages; // Stages the last write has been made visible to
+    VkAccessFlags visibleAccess;
+} FrameGraphBufferState;
+
+typedef struct FrameGraph
+{
+    ComputeApplication app;
+    uint32_t passCount;
+    uint32_t passCapacity;
+    FrameGraphPass* passes;
+    uint32_t bufferCount;
+    uint32_t bufferCapacity;
+    FrameGraphBufferState* buffers;
+    uint64_t generation;                // Bumped whenever the recorded commands go stale
+    uint32_t framesInFlight;
+    uint32_t nextFrame;
+    CommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+    uint64_t recordedGeneration[MAX_FRAMES_IN_FLIGHT];
+    ComputeTicket tickets[MAX_FRAMES_IN_FLIGHT];
+    GpuProfiler profiler;               // Times each group of same-named passes, NULL when not profiling
+} *FrameGraph;
+
+/**
+ * @brief Creates a frame graph that records the work of every camera into one command buffer
+ * per tick and submits it once.
+ *
+ * Passes declare the buffers they read and write and the graph generates the pipeline barriers
+ * between them, batching the barriers of consecutive independent passes (for example the same
+ * stage of different cameras) into a single vkCmdPipelineBarrier. Command buffers are kept
+ * recorded and resubmitted as is until FrameGraphInvalidate is called.
+ *
+ * @param framesInFlight Number of ticks that may be queued on the GPU, at most MAX_FRAMES_IN_FLIGHT.
+ */
+FrameGraph CreateFrameGraph(ComputeApplication app, uint32_t framesInFlight);
+
+/**
+ * @brief Appends a pass. Passes run in the order they are added.
+ *
+ * @return false when accessCount exceeds MAX_FRAME_GRAPH_ACCESSES.
+ */
+bool FrameGraphAddPass(FrameGraph graph, const char* name, FrameGraphRecordCallback record, void* userData,
+    uint32_t accessCount, const FrameGraphBufferAccess* accesses);
+
+/**
+ * @brief Appends a pass recorded only into the command buffer of one frame slot, for work on
+ * per-frame resources such as a tracker's frame and result buffers of that slot.
+ *
+ * Barriers against the other slots come from walking their passes first, in submission order,
+ * so a slot reading the results of the slot before it is ordered after that slot's writes.
+ *
+ * @return false when frame is not below framesInFlight or accessCount exceeds MAX_FRAME_GRAPH_ACCESSES.
+ */
+bool FrameGraphAddFramePass(FrameGraph graph, const char* name, FrameGraphRecordCallback record, void* userData,
+    uint32_t frame, uint32_t accessCount, const FrameGraphBufferAccess* accesses);
+
+/**
+ * @brief Marks the recorded command buffers stale, call after changing anything a pass bakes
+ * into its commands such as push constants or dispatch windows.
+ */
+void FrameGraphInvalidate(FrameGraph graph);
+
+/**
+ * @brief Times every group of consecutive passes sharing a name as one profiler stage, e.g. the
+ * "blob_reduce" pass of every camera.
+ *
+ * @return false when the profiler was created for fewer frames in flight than the graph.
+ */
+bool FrameGraphSetProfiler(FrameGraph graph, GpuProfiler profiler);
+
+/**
+ * @brief Waits for the submission that last used the next frame slot and returns the slot, so
+ * its per-frame resources can be refilled, e.g. uploaded into, before FrameGraphSubmit.
+ */
+uint32_t FrameGraphAcquireFrame(FrameGraph graph);
+
+/**
+ * @brief Re-records the next command buffer if stale and submits it.
+ *
+ * Waits for the submission that last used the command buffer, so at most framesInFlight ticks
+ * are queued. Staging uploads made since the previous tick are submitted ahead of it.
+ *
+ * @return Ticket of the submission.
+ */
+ComputeTicket FrameGraphSubmit(FrameGraph graph);
+void DestroyFrameGraph(FrameGraph graph);
+#endif
@@ -0,0 +1,105 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkanmanager.h"
+
+#define MAX_PROFILER_STAGES 16
+// Samples kept per stage for the rolling statistics
+#define PROFILER_HISTORY_LENGTH 128
+#define INVALID_PROFILER_STAGE 0xFFFFFFFFu
+
+typedef struct GpuProfilerStageStats
+{
+    const char* name;
+    uint64_t samples[PROFILER_HISTORY_LENGTH];  // Nanoseconds, ring buffer
+    uint32_t sampleCount;
+    uint32_t nextSample;
+    uint64_t totalSamples;
+} GpuProfilerStageStats;
+
+// Summary of the samples currently in a stage's window
+typedef struct GpuProfilerSummary
+{
+    uint32_t sampleCount;
+    uint64_t lastNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+    uint64_t meanNs;
+    uint64_t p95Ns;
+} GpuProfilerSummary;
+
+typedef struct GpuProfiler
+{
+    ComputeApplication app;
+    bool supported;
+    double timestampPeriod;             // Nanoseconds per timestamp tick
+    uint64_t timestampMask;             // Valid bits of the compute queue family
+    uint64_t transferTimestampMask;     // Valid bits of the transfer queue family, 0 when unsupported
+    VkQueryPool queryPool;
+    uint32_t framesInFlight;
+    uint32_t recordedStages[MAX_FRAMES_IN_FLIGHT]; // Bit per stage timed by the commands of each frame slot
+    bool pending[MAX_FRAMES_IN_FLIGHT];            // Submitted and not yet collected
+    uint32_t stageCount;
+    GpuProfilerStageStats stages[MAX_PROFILER_STAGES];
+} *GpuProfiler;
+
+/**
+ * @brief Creates a profiler that times recorded stages with timestamp queries.
+ *
+ * Each frame slot owns a begin/end query pair per stage, the slot of a frame is the index of the
+ * command buffer it is recorded into. Results are collected without waiting, typically when the
+ * slot comes around again, so profiling never stalls the CPU on the GPU. A command buffer
+ * recorded once and submitted many times yields a sample per submission.
+ *
+ * Per frame: GpuProfilerCollectFrame once the slot's previous submission completed, record
+ * GpuProfilerResetFrame and the stages when (re)recording, submit, GpuProfilerFrameSubmitted.
+ * On devices without timestamp support every call is a no-op and supported is false.
+ */
+GpuProfiler CreateGpuProfiler(ComputeApplication app, uint32_t framesInFlight);
+
+/**
+ * @brief Returns the stage with the given name, registering it on first use.
+ *
+ * @return Stage index, or INVALID_PROFILER_STAGE when MAX_PROFILER_STAGES are in use.
+ */
+uint32_t GpuProfilerStage(GpuProfiler profiler, const char* name);
+
+/**
+ * @brief Records the reset of a frame slot's queries, must come before any stage of the slot
+ * in the command buffer.
+ */
+void GpuProfilerResetFrame(GpuProfiler profiler, CommandBuffer cmdbuf, uint32_t frame);
+
+/**
+ * @brief Records the begin and end timestamps of a stage, a stage is timed once per frame.
+ */
+void GpuProfilerBeginStage(GpuProfiler profiler, CommandBuffer cmdbuf, uint32_t frame, uint32_t stage);
+void GpuProfilerEndStage(GpuProfiler profiler, CommandBuffer cmdbuf, uint32_t frame, uint32_t stage);
+void GpuProfilerFrameSubmitted(GpuProfiler profiler, uint32_t frame);
+
+/**
+ * @brief Turns the results of a submitted frame slot into samples without blocking.
+ *
+ * @return false when the results are not available yet.
+ */
+bool GpuProfilerCollectFrame(GpuProfiler profiler, uint32_t frame);
+
+/**
+ * @brief Collects every submitted frame slot whose results are available.
+ */
+void GpuProfilerCollect(GpuProfiler profiler);
+
+/**
+ * @brief Adds a duration measured elsewhere, e.g. by the staging ring on the transfer queue.
+ */
+void GpuProfilerAddSample(GpuProfiler profiler, uint32_t stage, uint64_t nanoseconds);
+
+/**
+ * @brief Converts a pair of raw timestamps written on a queue with the given valid bit mask.
+ */
+uint64_t GpuProfilerTicksToNanoseconds(GpuProfiler profiler, uint64_t begin, uint64_t end, uint64_t mask);
+bool GpuProfilerGetSummary(GpuProfiler profiler, uint32_t stage, GpuProfilerSummary* summary);
+void PrintGpuProfilerStats(GpuProfiler profiler);
+void DestroyGpuProfiler(GpuProfiler profiler);
+#endif
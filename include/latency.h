@@ -0,0 +1,130 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include "network.h"
+
+// Shared memory object holding a camera's latency budget, formatted with the camera ID
+#define LATENCY_BOARD_NAME_FORMAT "/vrwebtrack-latency-%u"
+#define LATENCY_BOARD_MAGIC 0x5652424cu     // "VRBL"
+#define LATENCY_BOARD_VERSION 1
+// Percentiles are computed over windows of this length and published when one closes
+#define LATENCY_WINDOW_NS 1000000000ull
+// Histogram resolution, each power of two is split into 2^bits buckets, about 12% wide at 3 bits
+#define LATENCY_SUB_BUCKET_BITS 3
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BUCKET_BITS)
+// Covers up to 2^32 ns, anything slower lands in the last bucket
+#define LATENCY_BUCKET_COUNT ((32 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+// Points a frame passes on its way from the sensor to the clients, in order. Every stamp is
+// CLOCK_MONOTONIC, which the worker and the monitor share, so stamps from both compare directly.
+typedef enum LatencyStage
+{
+    LatencyStageCapture,                    // Sensor timestamp from the V4L2 buffer
+    LatencyStageDequeue,                    // VIDIOC_DQBUF returned
+    LatencyStageDecode,                     // H264 decoder produced the frame, raw captures skip it
+    LatencyStageConvert,                    // sws_scale to RGB done, raw captures skip it
+    LatencyStageTrack,                      // Centroids collected from the tracker
+    LatencyStageSend,                       // Pushed into the coordinate ring
+    LatencyStageReceive,                    // Popped by the monitor
+    LatencyStageFusion,                     // Combined with the other cameras
+    LatencyStageOutput,                     // Sent to the clients
+    LatencyStageCount
+} LatencyStage;
+
+// Stamps of one frame, 0 for stages it skipped
+typedef struct LatencyStamps
+{
+    uint64_t stampNs[LatencyStageCount];
+} LatencyStamps;
+
+// Percentiles of one window, seqlock protected since the overlay reads it from another process
+typedef struct LatencySummary
+{
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t sequence;
+    uint32_t count;                         // Frames in the window, 0 when the stage never ran
+    uint64_t windowEndNs;
+    uint64_t p50Ns;
+    uint64_t p90Ns;
+    uint64_t p99Ns;
+    uint64_t maxNs;
+} LatencySummary;
+
+// Layout of the shared memory object. Each stage is written by the one process that stamps it,
+// stages[s] is the time from the previous stamped stage to s, total is capture to output.
+typedef struct LatencyBoard
+{
+    _Atomic uint32_t magic;
+    uint32_t version;
+    uint32_t cameraID;
+    LatencySummary stages[LatencyStageCount];
+    LatencySummary total;
+} LatencyBoard;
+
+// One process's share of a camera's stages, aggregated locally and published once per window
+typedef struct LatencyRecorder
+{
+    LatencyBoard* board;
+    bool owner;                             // Unlinks the board on destroy
+    LatencyStage first;                     // Stages after first up to last are recorded
+    LatencyStage last;
+    uint64_t windowStartNs;
+    uint32_t counts[LatencyStageCount + 1][LATENCY_BUCKET_COUNT];   // Last row is the total
+    uint64_t maxNs[LatencyStageCount + 1];
+    char name[64];
+} *LatencyRecorder;
+
+/**
+ * @brief Stamps a stage of a frame with the current CLOCK_MONOTONIC time.
+ */
+void StampLatency(LatencyStamps* stamps, LatencyStage stage);
+
+/**
+ * @brief Converts a V4L2 buffer timestamp to CLOCK_MONOTONIC nanoseconds.
+ *
+ * @param monotonic Whether the buffer had V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC set.
+ * @return 0 when the driver stamps with another clock, the capture stage is then skipped.
+ */
+uint64_t LatencyCaptureTimestamp(uint64_t seconds, uint64_t microseconds, bool monotonic);
+
+/**
+ * @brief Opens the camera's latency board, creating it when neither process has yet.
+ *
+ * The worker records the stages after first up to last it stamps, e.g. Capture to Send, the
+ * monitor the rest, e.g. Send to Output. Both map the same board and never write the same stage.
+ *
+ * @param owner Unlinks the board on destroy, the monitor owns it since workers come and go.
+ * @return NULL on failure.
+ */
+LatencyRecorder CreateLatencyRecorder(uint32_t cameraID, LatencyStage first, LatencyStage last, bool owner);
+
+/**
+ * @brief Adds a frame's stage durations to the current window, publishing it once it is over.
+ *
+ * Stages with a 0 stamp are skipped, the next stamped stage is measured from the one before.
+ * Never blocks and makes no syscalls besides the publication once per window.
+ */
+void RecordFrameLatency(LatencyRecorder recorder, const LatencyStamps* stamps, uint64_t nowNs);
+void DestroyLatencyRecorder(LatencyRecorder recorder);
+
+/**
+ * @brief Maps a camera's board read only, e.g. for an overlay. NULL until a recorder created it.
+ */
+const LatencyBoard* OpenLatencyBoard(uint32_t cameraID);
+
+/**
+ * @brief Copies a consistent summary of a stage, LatencyStageCount for the total.
+ *
+ * @return false when the writer kept changing it, retry on the next overlay frame.
+ */
+bool ReadLatencySummary(const LatencyBoard* board, uint32_t stage, LatencySummary* out);
+void CloseLatencyBoard(const LatencyBoard* board);
+
+/**
+ * @brief Restores the worker's stamps the monitor needs from a received record.
+ */
+void LatencyStampsFromRecord(const CoordinateRecord* record, LatencyStamps* stamps);
+const char* LatencyStageName(uint32_t stage);
+#endif
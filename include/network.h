@@ -1,6 +1,10 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 
 typedef struct CoordinationDatagram
 {
@@ -22,4 +26,390 @@ typedef struct UpdateGLSLCode
     GLSLPurpose purpose;
 } UpdateGLSLCode;
 
-#endif
\ No newline at end of file
+#define CACHE_LINE_SIZE 64
+// Shared memory object of a camera's ring, formatted with the camera ID
+#define COORDINATE_RING_NAME_FORMAT "/vrwebtrack-coordinates-%u"
+#define COORDINATE_RING_MAGIC 0x56525452u   // "VRTR"
+#define COORDINATE_RING_VERSION 2
+// Records, must be a power of two. A 100 FPS camera with 8 markers fills it in 320 ms.
+#define COORDINATE_RING_CAPACITY 256
+
+enum CoordinateRecordFlags
+{
+    CoordinateRecordFound = 1 << 0,         // The marker was seen, otherwise only sequence and time are valid
+    CoordinateRecordEndOfFrame = 1 << 1     // Last record of the frame
+};
+
+// One marker of one frame, exactly one cache line so producer and consumer never share a line
+typedef struct CoordinateRecord
+{
+    alignas(CACHE_LINE_SIZE) uint64_t frameSequence;
+    uint64_t timestampNs;                   // CLOCK_MONOTONIC when the frame was captured
+    uint32_t cameraID;
+    uint32_t marker;
+    uint32_t flags;                         // CoordinateRecordFlags
+    uint32_t pixelCount;
+    float x;                                // Centroid in pixels
+    float y;
+    uint16_t minX;
+    uint16_t minY;
+    uint16_t maxX;
+    uint16_t maxY;
+    uint32_t sendDelayNs;                   // Capture to the push into the ring, see LatencyStageSend
+    uint32_t reserved;
+} CoordinateRecord;
+_Static_assert(sizeof(CoordinateRecord) == CACHE_LINE_SIZE, "CoordinateRecord must be one cache line");
+
+// Layout of the shared memory object, indices increase forever and are masked on access
+typedef struct CoordinateRingShared
+{
+    _Atomic uint32_t magic;                 // Stored last by the creator
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t recordSize;
+    // Written by the producer only
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t head;
+    _Atomic uint64_t dropped;               // Records rejected because the consumer fell behind
+    // Written by the consumer only
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t tail;
+    // Futex word, bumped by the producer only while the consumer sleeps on it
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t wakeSequence;
+    _Atomic uint32_t consumerWaiting;
+    alignas(CACHE_LINE_SIZE) CoordinateRecord records[COORDINATE_RING_CAPACITY];
+} CoordinateRingShared;
+
+typedef struct CoordinateRing
+{
+    CoordinateRingShared* shared;
+    int fd;
+    bool owner;                             // Created the object, unlinks it on close
+    uint64_t cachedHead;                    // Consumer: last head seen, avoids touching the producer line
+    uint64_t cachedTail;                    // Producer: last tail seen
+    char name[64];
+} *CoordinateRing;
+
+/**
+ * @brief Creates the shared memory ring a camera worker publishes its coordinates through.
+ *
+ * The object is created under /dev/shm with the given name, replacing a stale one left by a
+ * crashed worker. Publishing and polling are plain loads and stores on the mapping, the futex is
+ * only touched when the consumer sleeps in WaitCoordinateRecords.
+ *
+ * @param name shm_open name, e.g. formatted with COORDINATE_RING_NAME_FORMAT.
+ * @return NULL on failure.
+ */
+CoordinateRing CreateCoordinateRing(const char* name);
+
+/**
+ * @brief Maps an existing ring as its consumer, NULL if missing or of another version.
+ */
+CoordinateRing OpenCoordinateRing(const char* name);
+
+/**
+ * @brief Publishes records with a single release store, the consumer sees all of them or none.
+ *
+ * Never blocks. When the consumer is behind and not all records fit, none are written and the
+ * dropped counter grows, a stale frame is worth less than the next one.
+ *
+ * @return false when the ring is full.
+ */
+bool PushCoordinateRecords(CoordinateRing ring, uint32_t count, const CoordinateRecord* records);
+
+/**
+ * @brief Copies out up to maxCount published records without blocking or syscalls.
+ *
+ * @return The number of records copied.
+ */
+uint32_t PopCoordinateRecords(CoordinateRing ring, uint32_t maxCount, CoordinateRecord* out);
+
+/**
+ * @brief Like PopCoordinateRecords but sleeps on the ring's futex while it is empty.
+ *
+ * @param timeoutNs Longest sleep, UINT64_MAX waits forever.
+ * @return The number of records copied, 0 on timeout.
+ */
+uint32_t WaitCoordinateRecords(CoordinateRing ring, uint32_t maxCount, CoordinateRecord* out, uint64_t timeoutNs);
+void CloseCoordinateRing(CoordinateRing ring);
+
+/**
+ * @brief Rounds a record's centroid to the integer CoordinationDatagram.
+ */
+CoordinationDatagram CoordinateRecordToDatagram(const CoordinateRecord* record);
+
+// UDP coordinate protocol, one datagram per camera frame carrying every marker. All fields are
+// little endian and packed, the header is 24 bytes and each marker 16 bytes:
+//   u16 magic, u8 version, u8 markerCount, u32 cameraID, u64 frameSequence, u64 timestampNs
+//   u8 marker, u8 flags, u16 reserved, f32 x, f32 y, f32 confidence
+#define COORDINATE_PACKET_MAGIC 0x5756             // "VW"
+#define COORDINATE_PACKET_VERSION 1
+#define COORDINATE_PACKET_MAX_MARKERS 16
+#define COORDINATE_PACKET_HEADER_SIZE 24
+#define COORDINATE_PACKET_MARKER_SIZE 16
+#define COORDINATE_PACKET_MAX_SIZE (COORDINATE_PACKET_HEADER_SIZE + COORDINATE_PACKET_MAX_MARKERS * COORDINATE_PACKET_MARKER_SIZE)
+#define COORDINATE_DEFAULT_PORT 47610
+// Datagrams moved per sendmmsg or recvmmsg call
+#define COORDINATE_SOCKET_BATCH 64
+// Cameras whose sequence numbers a receiver follows to count lost packets
+#define COORDINATE_RECEIVER_MAX_CAMERAS 32
+
+typedef struct CoordinatePacketMarker
+{
+    uint8_t marker;
+    uint8_t flags;                          // CoordinateRecordFlags
+    float x;                                // Sub-pixel centroid
+    float y;
+    float confidence;                       // 0 to 1
+} CoordinatePacketMarker;
+
+typedef struct CoordinatePacket
+{
+    uint32_t cameraID;
+    uint64_t frameSequence;
+    uint64_t timestampNs;                   // CLOCK_MONOTONIC of the camera box at capture
+    uint32_t markerCount;
+    CoordinatePacketMarker markers[COORDINATE_PACKET_MAX_MARKERS];
+} CoordinatePacket;
+
+typedef struct CoordinateSocket
+{
+    int fd;
+    bool receiver;
+    uint64_t invalidPackets;                // Receiver: wrong magic, version or length
+    uint64_t lostPackets;                   // Receiver: sequence gaps over all followed cameras
+    uint32_t followedCameras;
+    uint32_t cameraIDs[COORDINATE_RECEIVER_MAX_CAMERAS];
+    uint64_t nextSequence[COORDINATE_RECEIVER_MAX_CAMERAS];
+} *CoordinateSocket;
+
+/**
+ * @brief Serializes a packet in the wire format.
+ *
+ * @return The datagram size, 0 if the buffer is too small or there are too many markers.
+ */
+size_t EncodeCoordinatePacket(const CoordinatePacket* packet, uint8_t* buffer, size_t size);
+
+/**
+ * @brief Parses and validates a datagram, false for anything not produced by EncodeCoordinatePacket.
+ */
+bool DecodeCoordinatePacket(const uint8_t* buffer, size_t size, CoordinatePacket* packet);
+
+/**
+ * @brief Opens a UDP socket sending to host:port, loopback or a monitor on the LAN.
+ *
+ * @param host Name or numeric IPv4/IPv6 address.
+ * @return NULL when the address does not resolve or the socket cannot be created.
+ */
+CoordinateSocket CreateCoordinateSender(const char* host, uint16_t port);
+
+/**
+ * @brief Opens a UDP socket receiving on address:port.
+ *
+ * @param address Local address to bind, NULL for every interface.
+ * @param port 0 picks a free port, see CoordinateSocketPort.
+ */
+CoordinateSocket CreateCoordinateReceiver(const char* address, uint16_t port);
+uint16_t CoordinateSocketPort(CoordinateSocket socket);
+
+/**
+ * @brief Sends packets with one sendmmsg call per COORDINATE_SOCKET_BATCH packets.
+ *
+ * @return The number of packets handed to the kernel, less than count when the send buffer is full.
+ */
+uint32_t SendCoordinatePackets(CoordinateSocket socket, uint32_t count, const CoordinatePacket* packets);
+
+/**
+ * @brief Drains up to maxCount datagrams with recvmmsg, waiting up to timeoutMs for the first.
+ *
+ * Invalid datagrams are skipped and counted. Sequence gaps of the first
+ * COORDINATE_RECEIVER_MAX_CAMERAS cameras seen are added to lostPackets.
+ *
+ * @param timeoutMs 0 polls, -1 waits forever.
+ * @return The number of valid packets written to packets.
+ */
+uint32_t ReceiveCoordinatePackets(CoordinateSocket socket, uint32_t maxCount, CoordinatePacket* packets, int timeoutMs);
+void CloseCoordinateSocket(CoordinateSocket socket);
+
+// Abstract Unix datagram socket a worker receives WorkerCommands on, formatted with the camera ID
+#define WORKER_CONTROL_NAME_FORMAT "vrwebtrack-control-%u"
+#define WORKER_COMMAND_VERSION 1
+#define WORKER_MAX_MARKERS 8
+// Largest GLSL or SPIR-V payload of WorkerCommandUpdateShader, fits the default Unix socket send buffer
+#define WORKER_MAX_SHADER_SIZE (128 * 1024)
+// Exposure values of WorkerCommandSetExposure besides a manual exposure in 100 us units
+#define WORKER_EXPOSURE_UNCHANGED 0
+#define WORKER_EXPOSURE_AUTO -1
+
+// Monitor to worker commands, applied between two frames
+typedef enum WorkerCommandType
+{
+    WorkerCommandSetResolution = 1,         // Restarts streaming, keeps the device and decoder open
+    WorkerCommandSetFrameRate,              // Changes the frame interval, restarts streaming only if the driver requires it
+    WorkerCommandSetExposure,               // Device control only
+    WorkerCommandSetMarkerColor,            // RGB range, converted for YUV frames by the worker
+    WorkerCommandSetMarkerCount,
+    WorkerCommandSetRoiMargin,              // Pixels added around the predicted marker windows
+    WorkerCommandStop,
+    WorkerCommandUpdateShader,              // Followed by the shader in the same datagram, see SendWorkerShader
+    WorkerCommandCalibrateMarker            // Derives a marker's range from a region of the next frame, see DeriveColorCalibration
+} WorkerCommandType;
+
+typedef struct WorkerCommand
+{
+    uint16_t version;                       // WORKER_COMMAND_VERSION
+    uint16_t type;                          // WorkerCommandType
+    uint32_t sequence;                      // Chosen by the monitor, echoed in logs
+    union
+    {
+        struct { uint32_t width; uint32_t height; } resolution;
+        struct { uint32_t fps; } frameRate;
+        struct { int32_t exposure; } exposure;
+        struct { uint32_t marker; uint8_t min[3]; uint8_t max[3]; } markerColor;
+        struct { uint32_t count; } markerCount;
+        struct { uint32_t margin; } roiMargin;
+        struct { uint32_t length; uint32_t purpose; } shader;   // Payload bytes and GLSLPurpose
+        struct { uint32_t marker; uint16_t x; uint16_t y; uint16_t width; uint16_t height; } calibration;   // Region in frame pixels
+    };
+} WorkerCommand;
+
+// Changes reported by ApplyWorkerCommand, from cheapest to most expensive to apply
+enum WorkerSettingsChange
+{
+    WorkerChangedMarkerColors = 1 << 0,
+    WorkerChangedRoiMargin = 1 << 1,
+    WorkerChangedExposure = 1 << 2,
+    WorkerChangedFrameRate = 1 << 3,
+    WorkerChangedMarkerCount = 1 << 4,      // Tracker rebuilt, the capture keeps running
+    WorkerChangedResolution = 1 << 5,       // Capture buffers and tracker rebuilt
+    WorkerChangedStop = 1 << 6,
+    WorkerChangedShader = 1 << 7,           // Pipelines rebuilt off the capture thread, see WorkerControlShader
+    WorkerChangedCalibration = 1 << 8       // Not a setting either, the worker keeps the command's region
+};
+
+// Everything a monitor can change on a running worker
+typedef struct WorkerSettings
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    int32_t exposure;                       // WORKER_EXPOSURE_UNCHANGED, WORKER_EXPOSURE_AUTO or 100 us units
+    uint32_t markerCount;
+    uint8_t markerMin[WORKER_MAX_MARKERS][3];
+    uint8_t markerMax[WORKER_MAX_MARKERS][3];
+    uint32_t roiMargin;
+} WorkerSettings;
+
+/**
+ * @brief Fills a sockaddr_un (passed as void* to keep sys/un.h out of this header) for an
+ * abstract socket name, which disappears with its last descriptor instead of leaving a file.
+ *
+ * @return The address length to pass to bind or connect, 0 if the name is too long.
+ */
+uint32_t AbstractSocketAddress(const char* name, void* address);
+
+typedef struct WorkerControl
+{
+    int fd;
+    bool worker;                            // Bound end, otherwise connected to a worker
+    uint8_t* receiveBuffer;                 // Worker end, payload of the datagram being received
+    UpdateGLSLCode shader;                  // Worker end, latest shader received, length 0 until one arrives
+} *WorkerControl;
+
+/**
+ * @brief Binds the worker's end of the control channel.
+ *
+ * The abstract socket is reachable by every user on the machine, so commands from a process of
+ * another user are dropped, checked through SO_PASSCRED.
+ *
+ * @param name Abstract socket name, e.g. formatted with WORKER_CONTROL_NAME_FORMAT.
+ */
+WorkerControl CreateWorkerControl(const char* name);
+
+/**
+ * @brief Connects a monitor to a running worker's control channel, NULL if none listens.
+ */
+WorkerControl ConnectWorkerControl(const char* name);
+bool SendWorkerCommand(WorkerControl control, const WorkerCommand* command);
+
+/**
+ * @brief Sends a hot reloaded tracking shader, GLSL or SPIR-V, as one WorkerCommandUpdateShader
+ * datagram, so the worker never sees a partial shader.
+ *
+ * @return false when the shader is empty, larger than WORKER_MAX_SHADER_SIZE or was not sent.
+ */
+bool SendWorkerShader(WorkerControl control, uint32_t sequence, const UpdateGLSLCode* code);
+
+/**
+ * @brief Reads the commands queued since the last call without blocking, for the worker's frame loop.
+ *
+ * The payload of a WorkerCommandUpdateShader is kept by the control, see WorkerControlShader.
+ *
+ * @return The number of commands written to out, malformed ones are dropped.
+ */
+uint32_t PollWorkerCommands(WorkerControl control, uint32_t maxCount, WorkerCommand* out);
+
+/**
+ * @brief The latest shader received by PollWorkerCommands, valid until the next poll. NULL
+ * before the first one.
+ */
+const UpdateGLSLCode* WorkerControlShader(WorkerControl control);
+void CloseWorkerControl(WorkerControl control);
+
+/**
+ * @brief Folds a command into the settings the worker should run with.
+ *
+ * Several commands received between two frames fold into one settings update, so a burst of
+ * colour picks or resolution clicks costs at most one reconfiguration.
+ *
+ * @return WorkerSettingsChange bits of what actually differs, 0 for a no-op or invalid command.
+ */
+uint32_t ApplyWorkerCommand(WorkerSettings* settings, const WorkerCommand* command);
+
+/**
+ * @brief Marks every marker range empty, min above max, so nothing matches until a colour is set.
+ */
+void ClearWorkerMarkerColors(WorkerSettings* settings);
+
+enum WorkerState
+{
+    WorkerStateStarting,                    // Opening the device and creating the tracker
+    WorkerStateRunning,                     // Beating once per tracked frame
+    WorkerStateStopped                      // Exiting on purpose, not to be respawned
+};
+
+// Liveness and configuration of one worker, in a memfd created by the supervisor and inherited
+typedef struct WorkerHeartbeat
+{
+    alignas(CACHE_LINE_SIZE) _Atomic uint64_t lastBeatNs;    // CLOCK_MONOTONIC of the last tracked frame
+    _Atomic uint64_t frameCount;
+    _Atomic uint32_t state;                 // WorkerState
+    // Seqlock over settings, odd while the worker writes them
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t settingsSequence;
+    WorkerSettings settings;                // Last configuration the device and tracker accepted
+} WorkerHeartbeat;
+
+/**
+ * @brief Creates an anonymous heartbeat block, inherited by a worker through exec.
+ *
+ * @param outFd Receives the memfd. It is close-on-exec so workers do not inherit each other's
+ *              blocks, clear the flag in the child that should keep it.
+ * @return The mapping, NULL on failure.
+ */
+WorkerHeartbeat* CreateWorkerHeartbeat(int* outFd);
+
+/**
+ * @brief Maps the heartbeat block a worker was started with, NULL if fd is not one.
+ */
+WorkerHeartbeat* MapWorkerHeartbeat(int fd);
+void UnmapWorkerHeartbeat(WorkerHeartbeat* heartbeat);
+void BeatWorkerHeartbeat(WorkerHeartbeat* heartbeat, uint64_t nowNs);
+
+/**
+ * @brief Records the configuration the worker is running with, for the supervisor to respawn with.
+ */
+void PublishWorkerSettings(WorkerHeartbeat* heartbeat, const WorkerSettings* settings);
+
+/**
+ * @brief Reads a consistent copy of the published settings, false if none were published.
+ */
+bool ReadWorkerSettings(const WorkerHeartbeat* heartbeat, WorkerSettings* settings);
+#endif
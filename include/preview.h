@@ -0,0 +1,145 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include "network.h"
+
+// Abstract Unix socket a worker hands its preview buffers out on, formatted with the camera ID
+#define PREVIEW_SOCKET_NAME_FORMAT "vrwebtrack-preview-%u"
+#define PREVIEW_CHANNEL_MAGIC 0x56525056u   // "VRPV"
+#define PREVIEW_CHANNEL_VERSION 1
+// Three slots let the worker always write one that is neither the latest nor being displayed
+#define PREVIEW_SLOT_COUNT 3
+#define PREVIEW_NO_SLOT UINT32_MAX
+// Longest wait for a worker to answer ConnectPreviewReader
+#define PREVIEW_CONNECT_TIMEOUT_MS 1000
+// Default preview rate, independent of the tracking rate
+#define PREVIEW_DEFAULT_INTERVAL_NS (1000000000ull / 30)
+
+// Sent once with the memfds, control block first then one per slot
+typedef struct PreviewChannelInfo
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelFormat;                   // TrackingPixelFormat value
+    uint32_t stride;                        // Bytes per row of the first plane
+    uint64_t frameSize;                     // Bytes per slot
+    uint32_t slotCount;
+} PreviewChannelInfo;
+
+// Seqlock protected description of a slot, odd sequence while the worker writes it
+typedef struct PreviewSlotState
+{
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t sequence;
+    uint64_t frameNumber;
+    uint64_t timestampNs;                   // CLOCK_MONOTONIC at capture
+} PreviewSlotState;
+
+// Control block shared by the worker and the monitor
+typedef struct PreviewShared
+{
+    // Written by the worker
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t latestSlot;    // PREVIEW_NO_SLOT until the first frame
+    // Written by the monitor
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t readerSlot;    // Slot being displayed, skipped by the worker
+    _Atomic uint64_t intervalNs;            // Shortest time between published previews
+    PreviewSlotState slots[PREVIEW_SLOT_COUNT];
+} PreviewShared;
+
+typedef struct PreviewWriter
+{
+    PreviewChannelInfo info;
+    int listenFd;
+    int controlFd;
+    int slotFds[PREVIEW_SLOT_COUNT];
+    PreviewShared* shared;
+    uint8_t* slots[PREVIEW_SLOT_COUNT];
+    uint32_t writingSlot;                   // PREVIEW_NO_SLOT outside Begin/EndPreviewFrame
+    uint64_t lastPublishNs;
+} *PreviewWriter;
+
+typedef struct PreviewReader
+{
+    PreviewChannelInfo info;
+    int controlFd;
+    int slotFds[PREVIEW_SLOT_COUNT];
+    PreviewShared* shared;
+    const uint8_t* slots[PREVIEW_SLOT_COUNT];
+    uint64_t nextFrameNumber;               // One past the last frame acquired
+} *PreviewReader;
+
+// A frame borrowed from the worker's memory, valid until ReleasePreviewFrame says otherwise
+typedef struct PreviewFrame
+{
+    const uint8_t* data;
+    uint32_t slot;
+    uint32_t sequence;
+    uint64_t frameNumber;
+    uint64_t timestampNs;
+} PreviewFrame;
+
+/**
+ * @brief Allocates the worker's preview slots in sealed memfds and listens for monitors.
+ *
+ * @param socketName Abstract socket name, e.g. formatted with PREVIEW_SOCKET_NAME_FORMAT.
+ * @param pixelFormat TrackingPixelFormat of the frames written to the slots.
+ * @return NULL on failure.
+ */
+PreviewWriter CreatePreviewWriter(const char* socketName, uint32_t width, uint32_t height, uint32_t pixelFormat, uint32_t stride, size_t frameSize);
+
+/**
+ * @brief Hands the memfds to every monitor waiting on the socket, without blocking.
+ *
+ * Call from the worker loop. Each connection gets the descriptors once and is closed, from then
+ * on frames only move through the shared control block. Connections from processes of another
+ * user are closed without the descriptors.
+ *
+ * @return The number of monitors served.
+ */
+uint32_t ServePreviewClients(PreviewWriter writer);
+
+/**
+ * @brief Returns the slot to write the next preview into, e.g. as the sws_scale destination.
+ *
+ * @return NULL when the monitor's interval has not elapsed since the last published preview.
+ */
+uint8_t* BeginPreviewFrame(PreviewWriter writer, uint64_t nowNs);
+
+/**
+ * @brief Publishes the slot returned by BeginPreviewFrame as the latest preview.
+ */
+void EndPreviewFrame(PreviewWriter writer, uint64_t frameNumber, uint64_t timestampNs);
+void DestroyPreviewWriter(PreviewWriter writer);
+
+/**
+ * @brief Connects to a worker's preview socket and maps its slots read only.
+ *
+ * @return NULL when no worker listens on the name or the channel is incompatible.
+ */
+PreviewReader ConnectPreviewReader(const char* socketName);
+
+/**
+ * @brief Borrows the latest preview newer than the last one acquired, without copying.
+ *
+ * @return false when there is no new frame.
+ */
+bool AcquirePreviewFrame(PreviewReader reader, PreviewFrame* frame);
+
+/**
+ * @brief Ends the borrow and checks the worker did not overwrite the slot meanwhile.
+ *
+ * @return false when whatever was read from frame->data may be torn and should be dropped.
+ */
+bool ReleasePreviewFrame(PreviewReader reader, const PreviewFrame* frame);
+
+/**
+ * @brief Sets how often the worker publishes previews, e.g. lower while the window is hidden.
+ */
+void SetPreviewInterval(PreviewReader reader, uint64_t intervalNs);
+void DestroyPreviewReader(PreviewReader reader);
+#endif
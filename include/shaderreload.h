@@ -0,0 +1,83 @@
+#ifndef SHADERRELOAD_H
+#define SHADERRELOAD_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "vulkanmanager.h"
+#include "tracking.h"
+#include "framegraph.h"
+#include "network.h"
+
+// Pipelines replaced by a reload that in-flight submissions may still use
+#define MAX_RETIRED_SHADER_RELOADS 8
+
+// One pipeline per tracker built by the reload thread
+typedef struct ShaderReloadResult
+{
+    uint32_t pipelineCount;
+    ComputePipeline* pipelines;
+} *ShaderReloadResult;
+
+// Pipelines swapped out, destroyed once ticket completes
+typedef struct RetiredShaderReload
+{
+    ComputeTicket ticket;
+    ShaderReloadResult result;
+} RetiredShaderReload;
+
+typedef struct ShaderReloader
+{
+    ComputeApplication app;
+    uint32_t trackerCount;
+    BlobTracker* trackers;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    bool stopping;                      // Guarded by mutex
+    uint8_t* pendingSource;             // Latest request not yet picked up, guarded by mutex
+    size_t pendingLength;
+    _Atomic(ShaderReloadResult) ready;  // Built and waiting for ApplyShaderReload
+    atomic_uint completedReloads;
+    atomic_uint failedReloads;
+    uint32_t retiredCount;
+    RetiredShaderReload retired[MAX_RETIRED_SHADER_RELOADS];
+} *ShaderReloader;
+
+/**
+ * @brief Starts a thread that turns UpdateGLSLCode messages into new tracking pipelines.
+ *
+ * Sources are compiled to SPIR-V in-process with shaderc when built with HAVE_SHADERC, with
+ * NO_SUBGROUP_ARITHMETIC defined on devices lacking subgroup arithmetic. Without shaderc the
+ * message must carry SPIR-V. The shader module and pipelines are built off the capture thread,
+ * through the pipeline cache, and swapped in by ApplyShaderReload between frames.
+ *
+ * @param trackers Trackers whose blob_centroid.comp pipeline is replaced, must outlive the reloader.
+ */
+ShaderReloader CreateShaderReloader(ComputeApplication app, uint32_t trackerCount, BlobTracker* trackers);
+
+/**
+ * @brief Queues a received UpdateGLSLCode message, the buffer is copied. A request that has not
+ * been picked up yet is replaced, so only the latest of a burst of edits is built.
+ *
+ * @return false when the purpose is not UpdateTrackingCompute or the message is empty.
+ */
+bool SubmitShaderReload(ShaderReloader reloader, const UpdateGLSLCode* message);
+
+/**
+ * @brief Swaps in the most recent successfully built pipelines, call on the recording thread
+ * between frames. Never waits on the GPU: replaced pipelines are destroyed once the last
+ * submission that may use them completes, and the frame graph is invalidated so its command
+ * buffers are re-recorded with the new pipelines before their next submission.
+ *
+ * @param graph Frame graph recording the trackers, NULL when recording them manually.
+ * @return true when new pipelines were swapped in.
+ */
+bool ApplyShaderReload(ShaderReloader reloader, FrameGraph graph);
+
+/**
+ * @brief Stops the reload thread and destroys every pipeline it still owns. The trackers keep
+ * their current pipelines.
+ */
+void DestroyShaderReloader(ShaderReloader reloader);
+#endif
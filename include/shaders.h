@@ -0,0 +1,42 @@
+#ifndef SHADERS_H
+#define SHADERS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "vulkanmanager.h"
+
+// Directory of .spv files replacing the embedded shaders, for shader development only
+#define SHADER_DIRECTORY_ENVIRONMENT_VARIABLE "VRWEBTRACK_SHADER_DIR"
+
+// Shaders compiled at build time and linked into the camera library
+enum BuiltinShader
+{
+    BlobCentroidShader,                 // shaders/blob_centroid.comp
+    BlobCentroidNoSubgroupShader,       // shaders/blob_centroid.comp built with NO_SUBGROUP_ARITHMETIC
+    RoiPredictShader,                   // shaders/roi_predict.comp
+    ColorHistogramShader,               // shaders/color_histogram.comp
+    BUILTIN_SHADER_COUNT
+};
+
+typedef struct ShaderCode
+{
+    const uint32_t* code;
+    size_t size;                        // Bytes
+    uint32_t* overrideCode;             // Owned copy read from the override directory, NULL when embedded
+} ShaderCode;
+
+/**
+ * @brief Returns the SPIR-V of a builtin shader, ready for LoadShader or CreateBlobTracker.
+ *
+ * When VRWEBTRACK_SHADER_DIR is set and holds <name>.spv for the shader, e.g.
+ * blob_centroid_no_subgroup.spv, that file is used instead. A missing or malformed override
+ * falls back to the embedded code, so this never fails.
+ */
+ShaderCode GetBuiltinShader(enum BuiltinShader shader);
+
+/**
+ * @brief Picks the blob_centroid.comp variant the device can run.
+ */
+enum BuiltinShader BlobCentroidShaderForDevice(ComputeApplication app);
+void ReleaseShaderCode(ShaderCode* shader);
+#endif
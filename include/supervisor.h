@@ -0,0 +1,97 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "network.h"
+
+#define MAX_SUPERVISED_CAMERAS 16
+#define WORKER_PATH_LENGTH 256
+// A running worker without a tracked frame for this long is killed and respawned
+#define WORKER_STALL_TIMEOUT_NS 500000000ull
+// Time a starting worker gets to open its device and build its tracker
+#define WORKER_STARTUP_TIMEOUT_NS 5000000000ull
+// Respawn delay after a worker that never got running, doubled up to the maximum
+#define WORKER_RESPAWN_BACKOFF_NS 100000000ull
+#define WORKER_RESPAWN_MAX_BACKOFF_NS 2000000000ull
+// Grace period between SIGTERM and SIGKILL when stopping workers
+#define WORKER_STOP_TIMEOUT_NS 1000000000ull
+// Wait for killed workers to be reaped, SIGKILL only takes effect once they leave the kernel
+#define WORKER_KILL_TIMEOUT_NS 200000000ull
+#define WORKER_NO_CPU -1
+
+// Pixel format a worker captures in, see the camera executable's --format option
+typedef enum WorkerCaptureFormat
+{
+    WorkerCaptureH264,
+    WorkerCaptureYUYV,
+    WorkerCaptureNV12
+} WorkerCaptureFormat;
+
+typedef struct WorkerConfig
+{
+    uint32_t cameraID;
+    char devicePath[WORKER_PATH_LENGTH];
+    WorkerCaptureFormat format;
+    int cpu;                                // Core the worker is pinned to, WORKER_NO_CPU to let it float
+    WorkerSettings settings;                // Initial settings, replaced by the last good ones on respawn
+} WorkerConfig;
+
+typedef struct SupervisedWorker
+{
+    WorkerConfig config;
+    pid_t pid;                              // 0 while not running
+    int heartbeatFd;
+    WorkerHeartbeat* heartbeat;
+    uint64_t spawnNs;
+    uint64_t nextSpawnNs;                   // Earliest respawn after a failed start
+    uint64_t backoffNs;
+    uint32_t restarts;
+    bool stopped;                           // Exited on purpose or removed, never respawned
+} SupervisedWorker;
+
+typedef struct Supervisor
+{
+    char workerPath[WORKER_PATH_LENGTH];
+    uint32_t workerCount;
+    SupervisedWorker workers[MAX_SUPERVISED_CAMERAS];
+} *Supervisor;
+
+/**
+ * @brief Creates a supervisor running one camera worker process per device.
+ *
+ * Each worker runs in its own process so a camera whose driver hangs or crashes only takes
+ * itself down. Workers beat a heartbeat in shared memory once per tracked frame and publish the
+ * configuration they run with, PollSupervisor respawns dead or stalled ones with it.
+ *
+ * @param workerPath The camera executable, NULL for the one next to the running executable.
+ */
+Supervisor CreateSupervisor(const char* workerPath);
+
+/**
+ * @brief Starts supervising a camera, spawning its worker right away.
+ *
+ * @return The worker index, -1 when full or the heartbeat cannot be created.
+ */
+int AddSupervisedCamera(Supervisor supervisor, const WorkerConfig* config);
+
+/**
+ * @brief Reaps exited workers, kills stalled ones and respawns both. Never blocks.
+ *
+ * Call a few times per second or more, e.g. once per monitor frame. A crashed worker is
+ * respawned on the first call after its exit, a stalled one after WORKER_STALL_TIMEOUT_NS.
+ *
+ * @return The number of workers respawned.
+ */
+uint32_t PollSupervisor(Supervisor supervisor, uint64_t nowNs);
+
+/**
+ * @brief Stops one worker for good, e.g. when its camera was unplugged.
+ */
+void StopSupervisedCamera(Supervisor supervisor, uint32_t index);
+
+/**
+ * @brief Stops every worker, SIGKILL after WORKER_STOP_TIMEOUT_NS, and frees the supervisor.
+ */
+void DestroySupervisor(Supervisor supervisor);
+#endif
@@ -0,0 +1,266 @@
+#ifndef TRACKING_H
+#define TRACKING_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkanmanager.h"
+#include "framegraph.h"
+
+// Must match MAX_TRACKING_MARKERS in shaders/blob_centroid.comp
+#define MAX_TRACKING_MARKERS 8
+// Frames a tracker may have queued on the GPU. Each slot owns its frame and results, so the next
+// frame is uploaded while the previous one is still being reduced and read back.
+#define TRACKING_FRAMES_IN_FLIGHT 2
+
+// Specialization constant IDs shared by the tracking shaders
+enum TrackingSpecializationConstant
+{
+    WorkgroupSizeXConstantID = 0,
+    WorkgroupSizeYConstantID = 1,
+    MarkerCountConstantID = 2,
+    FrameWidthConstantID = 3,
+    FrameHeightConstantID = 4,
+    PixelFormatConstantID = 5
+};
+#define TRACKING_SPECIALIZATION_CONSTANT_COUNT 6
+
+// Frame layouts the tracking shaders read directly from the uploaded buffer
+enum TrackingPixelFormat
+{
+    TrackingPixelFormatRGB24 = 0,  // Packed R, G, B bytes as produced by the H264 decode path
+    TrackingPixelFormatYUYV = 1,   // Packed 4:2:2 Y0 U Y1 V, the raw payload of most UVC webcams
+    TrackingPixelFormatNV12 = 2    // Y plane followed by an interleaved UV plane at half resolution
+};
+
+// Inclusive RGB range classifying a pixel as belonging to a marker
+typedef struct MarkerColorRange
+{
+    uint8_t minR, minG, minB;
+    uint8_t maxR, maxG, maxB;
+} MarkerColorRange;
+
+// Selects the window from the push constants instead of the window buffer
+#define NO_TRACKING_WINDOW_SLOT 0xFFFFFFFFu
+
+// Push constant block of blob_centroid.comp, colours packed as 0x00BBGGRR or 0x00VVUUYY
+typedef struct TrackingPushConstants
+{
+    uint32_t colorMin[MAX_TRACKING_MARKERS];
+    uint32_t colorMax[MAX_TRACKING_MARKERS];
+    uint32_t windowOrigin[2];
+    uint32_t windowExtent[2];
+    uint32_t markerMask;    // Bit per marker accumulated by this dispatch
+    uint32_t windowSlot;    // Window buffer entry, or NO_TRACKING_WINDOW_SLOT
+} TrackingPushConstants;
+
+// Push constant block of roi_predict.comp
+typedef struct TrackingPredictPushConstants
+{
+    uint32_t margin;
+    uint32_t minimumSize;
+} TrackingPredictPushConstants;
+
+// Rectangle of the frame processed by one dispatch
+typedef struct TrackingWindow
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} TrackingWindow;
+
+// Window written by roi_predict.comp, starts with the VkDispatchIndirectCommand for it
+typedef struct TrackingWindowGPU
+{
+    uint32_t groupCountX;
+    uint32_t groupCountY;
+    uint32_t groupCountZ;
+    uint32_t originX;
+    uint32_t originY;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+} TrackingWindowGPU;
+
+// Per marker reduction written by blob_centroid.comp, std430 layout
+typedef struct MarkerResultGPU
+{
+    uint32_t count;
+    uint32_t sumXLow;
+    uint32_t sumXHigh;
+    uint32_t sumYLow;
+    uint32_t sumYHigh;
+    uint32_t invertedMinX;
+    uint32_t invertedMinY;
+    uint32_t maxX;
+    uint32_t maxY;
+    uint32_t reserved[3];
+} MarkerResultGPU;
+
+typedef struct MarkerCentroid
+{
+    bool found;
+    uint32_t pixelCount;
+    float x;
+    float y;
+    uint32_t minX;
+    uint32_t minY;
+    uint32_t maxX;
+    uint32_t maxY;
+} MarkerCentroid;
+
+// Buffers and descriptors of one frame slot
+typedef struct BlobTrackerFrame
+{
+    Buffer frameBuffer;     // Binding 0, device local frame filled with StagingRingUpload
+    Buffer resultBuffer;    // Binding 1, host visible MarkerResultGPU[MAX_TRACKING_MARKERS]
+    Buffer windowBuffer;    // Binding 2, device local TrackingWindowGPU[MAX_TRACKING_MARKERS]
+    DescriptorSetForBuffers descriptors;
+    DescriptorSetForBuffers predictDescriptors; // Results of the previous slot and windows of this one
+    struct BlobTracker* tracker;    // Owner, passed to the frame graph passes with the slot
+    uint32_t index;
+    ComputeTicket readTicket;       // Last submission besides tracking reading frameBuffer, e.g. a calibration
+} BlobTrackerFrame;
+
+typedef struct BlobTracker
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t markerCount;
+    uint32_t workgroupSizeX;
+    uint32_t workgroupSizeY;
+    enum TrackingPixelFormat pixelFormat;
+    size_t frameSize;       // Bytes of one frame in pixelFormat
+    BlobTrackerFrame frames[TRACKING_FRAMES_IN_FLIGHT];
+    VkDescriptorPool descriptorPool;
+    VkShaderModule shaderModule;
+    ComputePipeline pipeline;
+    VkShaderModule predictShaderModule;
+    ComputePipeline predictPipeline;    // NULL when created without roi_predict.comp
+    TrackingPushConstants pushConstants;
+    uint32_t predictMargin;
+    uint32_t predictMinimumSize;
+} *BlobTracker;
+
+/**
+ * @brief Creates the colour blob centroid pipeline for one camera.
+ *
+ * Buffers and descriptor sets exist once per frame slot, every recording function takes the
+ * slot to use. A slot must not be uploaded into or recorded again before the submission that
+ * last used it and the slot's readTicket completed. Frame size, pixel format, marker count and a device tuned workgroup size are baked in as
+ * specialization constants, marker colours are pushed with every dispatch so they can change
+ * each frame. With the YUYV and NV12 formats the raw camera payload is uploaded unchanged and
+ * classified in YUV space, so no colour conversion runs on the CPU.
+ *
+ * @param pixelFormat Layout of the uploaded frames, width must be even for YUYV and width and
+ *                    height must be even for NV12.
+ * @param spirv SPIR-V of shaders/blob_centroid.comp, the NO_SUBGROUP_ARITHMETIC variant on
+ *              devices where subgroupArithmeticSupported is false. Both are embedded, see
+ *              GetBuiltinShader and BlobCentroidShaderForDevice.
+ * @param predictSpirv SPIR-V of shaders/roi_predict.comp, NULL when RecordBlobTrackingPredicted
+ *                     is not used.
+ *
+ * @return The tracker, or NULL on invalid arguments.
+ */
+BlobTracker CreateBlobTracker(ComputeApplication app, uint32_t width, uint32_t height, enum TrackingPixelFormat pixelFormat, uint32_t markerCount,
+    const void* spirv, size_t spirvSize, const void* predictSpirv, size_t predictSpirvSize);
+
+/**
+ * @brief Builds a blob_centroid.comp pipeline specialized for the tracker from another shader
+ * module, e.g. a hot reloaded variant. Safe to call from a thread other than the one recording.
+ *
+ * @return The pipeline, or NULL when the driver rejects the shader.
+ */
+ComputePipeline CreateBlobTrackerPipeline(ComputeApplication app, BlobTracker tracker, VkShaderModule shaderModule);
+
+/**
+ * @brief Computes the smallest BT.601 limited range YUV box containing an RGB box.
+ *
+ * The returned range reuses the R, G and B fields for Y, U and V.
+ */
+MarkerColorRange ConvertMarkerColorRangeToYUV(MarkerColorRange rgbRange);
+
+/**
+ * @brief Sets the RGB colour range of a marker, takes effect at the next RecordBlobTracking.
+ * Trackers reading YUV frames convert the range with ConvertMarkerColorRangeToYUV.
+ */
+bool SetBlobTrackerMarkerColor(BlobTracker tracker, uint32_t marker, MarkerColorRange range);
+
+/**
+ * @brief Sets a marker range already expressed in the tracker's pixel format, e.g. one derived
+ * by a ColorCalibrator.
+ */
+bool SetBlobTrackerMarkerRange(BlobTracker tracker, uint32_t marker, MarkerColorRange range);
+
+/**
+ * @brief Records clearing the results, a 2D reduction dispatch over the whole frame and a
+ * barrier making the results visible to the host. The frame must already be uploaded into the
+ * frameBuffer of the slot.
+ *
+ * @param frame Slot whose buffers are used, below TRACKING_FRAMES_IN_FLIGHT.
+ */
+void RecordBlobTracking(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame);
+
+/**
+ * @brief Like RecordBlobTracking but only processes the given windows, one dispatch each.
+ *
+ * @param markerMasks Bit per marker accumulated from each window. A marker should appear in
+ *                    the mask of one window only or its pixels are counted more than once.
+ */
+void RecordBlobTrackingWindows(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame, uint32_t windowCount, const TrackingWindow* windows, const uint32_t* markerMasks);
+
+/**
+ * @brief Records window prediction on the GPU followed by one indirect dispatch per marker.
+ *
+ * roi_predict.comp grows the bounding box found in the previous frame by margin pixels, or
+ * falls back to the whole frame for a marker that was lost, and writes the dispatch arguments,
+ * so tracking never waits for a CPU readback to decide where to look. The previous frame is the
+ * one of the slot before, submitted earlier on the same queue. Requires the tracker to be
+ * created with predictSpirv.
+ */
+void RecordBlobTrackingPredicted(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame, uint32_t margin, uint32_t minimumSize);
+
+/**
+ * @brief Sets the margin and minimum size of the windows predicted by the frame graph passes,
+ * a margin of 0 or a tracker without the prediction shader tracks whole frames. Call
+ * FrameGraphInvalidate afterwards.
+ */
+void SetBlobTrackerPrediction(BlobTracker tracker, uint32_t margin, uint32_t minimumSize);
+
+/**
+ * @brief Adds the tracking passes of several cameras to a frame graph, so all cameras are
+ * recorded into one command buffer and submitted once per tick.
+ *
+ * The graph must have TRACKING_FRAMES_IN_FLIGHT frames in flight, each of its frame slots
+ * records the passes using the tracker buffers of the same slot. Upload each frame into the
+ * frameBuffer of the slot returned by FrameGraphAcquireFrame with StagingRingUpload, then call
+ * FrameGraphSubmit. Call FrameGraphInvalidate after changing marker colours or the prediction.
+ */
+bool AddBlobTrackersToFrameGraph(FrameGraph graph, uint32_t trackerCount, BlobTracker* trackers);
+
+/**
+ * @brief CPU counterpart of roi_predict.comp for RecordBlobTrackingWindows and the CPU backend.
+ *
+ * @return The bounding box of the centroid grown by margin and clamped to the width x height
+ *         frame, or the whole frame when the marker was not found.
+ */
+TrackingWindow PredictTrackingWindow(uint32_t width, uint32_t height, const MarkerCentroid* previous, uint32_t margin, uint32_t minimumSize);
+
+/**
+ * @brief Reads the per marker results once the submission recorded with RecordBlobTracking has
+ * completed and turns them into centroids.
+ *
+ * @param out Array of at least markerCount entries.
+ */
+void ReadBlobTrackingResults(ComputeApplication app, BlobTracker tracker, uint32_t frame, MarkerCentroid* out);
+
+/**
+ * @brief Turns raw per marker reductions into centroids, shared by every compute backend.
+ */
+void ConvertMarkerResults(const MarkerResultGPU* results, uint32_t markerCount, MarkerCentroid* out);
+
+/**
+ * @brief Bytes of one frame in the given layout, 0 when the dimensions do not suit the layout.
+ */
+size_t TrackingFrameSize(uint32_t width, uint32_t height, enum TrackingPixelFormat pixelFormat);
+void DestroyBlobTracker(ComputeApplication app, BlobTracker tracker);
+#endif
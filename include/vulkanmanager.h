@@ -0,0 +1,409 @@
+#ifndef VULKANMANAGER_H
+#define VULKANMANAGER_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vulkan/vulkan_core.h>
+
+#define VK_CHECK_RESULT(f)                                                                              \
+{                                                                                                       \
+    VkResult res = (f);                                                                                 \
+    if (res != VK_SUCCESS)                                                                              \
+    {                                                                                                   \
+        fprintf(stderr, "Fatal : VkResult is %d in %s at line %d\n", res, __FILE__, __LINE__);         \
+        assert(res == VK_SUCCESS);                                                                      \
+    }                                                                                                   \
+}
+
+// Maximum number of staging uploads that may be waiting for the next compute submission
+#define MAX_PENDING_UPLOADS 16
+// Number of pooled fences, and so submissions in flight, when timeline semaphores are unavailable
+#define MAX_FRAMES_IN_FLIGHT 8
+
+// Returned by getComputeQueueFamilyIndex when the device has no compute queue
+#define INVALID_QUEUE_FAMILY_INDEX UINT32_MAX
+
+// Monotonic submission identifier, 0 is always complete
+typedef uint64_t ComputeTicket;
+
+enum ComputeBufferType
+{
+    ReadOnlyBufferType,
+    ReadOnlyDynamicBufferType,
+    ReadAndWriteBufferType,
+    ReadAndWriteDynamicBufferType,
+    DeviceLocalBufferType,      // Storage buffer in device local memory, filled through a StagingRing
+    StagingBufferType           // Host visible transfer source, not bindable to a descriptor set
+};
+
+typedef struct StagingRingSlot* StagingRingSlot;
+typedef struct GpuProfiler* GpuProfiler;
+
+// Size of the device memory blocks buffers are sub-allocated from
+#define DEFAULT_MEMORY_BLOCK_SIZE (64ull << 20)
+
+typedef struct MemoryFreeRange
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MemoryFreeRange;
+
+// One vkAllocateMemory allocation shared by many buffers
+typedef struct MemoryBlock
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize linearOffset;      // Nothing at or above this offset has been handed out
+    uint32_t memoryTypeIndex;
+    bool dedicated;                 // Holds a single large allocation
+    void* mapped;                   // Persistent mapping of host visible blocks
+    uint32_t liveAllocations;
+    uint32_t freeRangeCount;
+    uint32_t freeRangeCapacity;
+    MemoryFreeRange* freeRanges;    // Sorted by offset and coalesced, all below linearOffset
+    struct MemoryBlock* next;
+} *MemoryBlock;
+
+typedef struct MemoryAllocator
+{
+    VkDeviceSize blockSize;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    MemoryBlock blocks[VK_MAX_MEMORY_TYPES];
+    uint32_t blockCount;
+} *MemoryAllocator;
+
+typedef struct MemoryAllocation
+{
+    MemoryBlock block;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MemoryAllocation;
+
+typedef struct ComputeApplicationCreateInfo
+{
+    // Case insensitive substring of the device name or the device UUID in hex, NULL to pick the
+    // best scored device. The VRWEBTRACK_VULKAN_DEVICE environment variable is used when unset.
+    const char* deviceOverride;
+    // Only consider CPU implementations such as lavapipe, for benchmarking and regression testing
+    // on machines without a GPU. Also enabled by setting VRWEBTRACK_VULKAN_CPU=1.
+    bool forceCPUDevice;
+    // Pipeline cache file, NULL for $XDG_CACHE_HOME/vrwebtrack/pipeline-<device uuid>-<driver version>.bin
+    const char* pipelineCachePath;
+} ComputeApplicationCreateInfo;
+
+typedef struct ComputeApplication
+{
+    VkInstance instance;
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    uint8_t deviceUUID[VK_UUID_SIZE];
+    uint32_t subgroupSize;
+    bool subgroupArithmeticSupported;
+    const char* deviceOverride;
+    bool forceCPUDevice;
+    VkDevice device;
+    MemoryAllocator memoryAllocator;
+    VkPipelineCache pipelineCache;
+    char* pipelineCachePath;
+    VkQueue queue;
+    uint32_t queueFamilyIndex;
+    VkQueue transferQueue;
+    uint32_t transferQueueFamilyIndex;
+    uint32_t pendingUploadCount;
+    StagingRingSlot pendingUploads[MAX_PENDING_UPLOADS];
+    bool timelineSemaphoreSupported;
+    bool hostQueryResetSupported;
+    VkSemaphore timelineSemaphore;
+    VkFence submitFences[MAX_FRAMES_IN_FLIGHT];
+    ComputeTicket submitFenceTickets[MAX_FRAMES_IN_FLIGHT];
+    ComputeTicket lastSubmittedTicket;
+    ComputeTicket lastCompletedTicket;
+} *ComputeApplication;
+
+typedef struct Buffer
+{
+    const char* name;
+    enum ComputeBufferType typeOfBuffer;
+    size_t size;
+    uint64_t binding;
+    VkBuffer buffer;
+    VkDeviceMemory memory;          // Block the buffer is bound to, shared with other buffers
+    VkDeviceSize memoryOffset;
+    void* mapped;                   // Host pointer to the buffer contents, NULL for device local memory
+    MemoryAllocation allocation;
+} *Buffer;
+
+typedef struct DescriptorSetForBuffers
+{
+    size_t numBuffersAndDescriptorSets;
+    Buffer* buffers;
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet descriptorSet;
+} *DescriptorSetForBuffers;
+
+typedef struct ComputePipeline
+{
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkShaderModule shaderModule;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline computePipeline;
+    uint32_t pushConstantSize;
+} *ComputePipeline;
+
+// A 32-bit specialization constant, declared in GLSL as layout(constant_id = N)
+typedef struct SpecializationConstant
+{
+    uint32_t constantID;
+    uint32_t value;
+} SpecializationConstant;
+
+typedef struct CommandBuffer
+{
+    VkDevice device;
+    VkCommandPool pool;
+    VkCommandBuffer cmdbuffer;
+} *CommandBuffer;
+
+struct StagingRingSlot
+{
+    VkDeviceSize offset;
+    VkCommandBuffer transferCommandBuffer;  // Copy and release barrier, recorded on the transfer queue family
+    VkCommandBuffer acquireCommandBuffer;   // Acquire barrier (or copy when families match), recorded on the compute queue family
+    VkSemaphore uploadSemaphore;
+    bool inFlight;                          // Recorded but not yet handed to a compute submission
+    ComputeTicket consumerTicket;           // Submission that consumes the slot, the slot is reusable once it completes
+    bool timed;                             // The copy is bracketed by timestamps in the ring's query pool
+    bool timedOnTransferQueue;
+};
+
+typedef struct StagingRing
+{
+    Buffer stagingBuffer;
+    void* mappedMemory;
+    VkDeviceSize slotSize;
+    uint32_t slotCount;
+    uint32_t nextSlot;
+    VkCommandPool transferPool;
+    VkCommandPool acquirePool;
+    struct StagingRingSlot* slots;
+    GpuProfiler profiler;
+    uint32_t profilerStage;
+    VkQueryPool timestampPool;              // Begin/end pair per slot
+} *StagingRing;
+
+void InitializeVulkanInstance(ComputeApplication this);
+
+/**
+ * @brief Ranks a physical device for tracking workloads, 0 when it cannot run compute work.
+ *
+ * Device type dominates (discrete > integrated > virtual > CPU), ties are broken by subgroup
+ * arithmetic support and size, dedicated compute and transfer queue families, and the size of
+ * device local memory heaps.
+ */
+uint64_t ScorePhysicalDevice(VkPhysicalDevice device);
+
+/**
+ * @brief Picks the highest scored physical device, honouring the name/UUID override and the
+ * CPU device mode. Leaves physicalDevice NULL when nothing suitable exists.
+ */
+void SelectPhysicalDevice(ComputeApplication this);
+
+/**
+ * @brief Finds the first queue family with compute support, INVALID_QUEUE_FAMILY_INDEX when none.
+ */
+uint32_t getComputeQueueFamilyIndex(ComputeApplication this);
+
+/**
+ * @brief Finds a queue family for buffer uploads.
+ *
+ * Prefers a dedicated transfer family (no graphics or compute bit), which maps to the DMA
+ * engines on discrete GPUs, then any other family with transfer support, and finally falls
+ * back to the compute queue family.
+ */
+uint32_t getTransferQueueFamilyIndex(ComputeApplication this);
+
+/**
+ * @brief Creates the logical device and its queues, leaves device NULL on failure.
+ */
+void InitializeVulkanDevice(ComputeApplication this);
+
+/**
+ * @brief Creates the timeline semaphore, or the fence pool on devices without timeline
+ * semaphore support, that backs ComputeTicket values.
+ */
+void InitializeSubmissionTracking(ComputeApplication this);
+/**
+ * @brief Creates the pipeline cache used by CreatePipeline, seeded from disk.
+ *
+ * The file is discarded when its header does not match the device UUID, vendor/device ID,
+ * driver version and pipeline cache UUID, or when its checksum is wrong, so a driver update
+ * silently rebuilds the cache instead of handing stale data to the driver.
+ *
+ * @param pipelineCachePath Cache file to use, NULL for the per-user default location.
+ */
+void InitializePipelineCache(ComputeApplication this, const char* pipelineCachePath);
+
+/**
+ * @brief Writes the pipeline cache to disk through a temporary file and rename.
+ *
+ * @return true when the cache was written.
+ */
+bool SavePipelineCache(ComputeApplication this);
+void DestroyPipelineCache(ComputeApplication this);
+uint32_t RetrieveMemoryType(ComputeApplication this, uint32_t memoryTypeBits, VkMemoryPropertyFlags properties);
+
+/**
+ * @brief Creates the block based sub-allocator that CreateBuffer draws from.
+ *
+ * Each memory type keeps a list of blocks of blockSize bytes. Allocations are served first fit
+ * from a block's free list and otherwise by bumping its linear head, freed ranges are coalesced
+ * and given back to the linear head when they touch it. Requests above half a block get a
+ * dedicated block. Host visible blocks are mapped once for their whole lifetime.
+ *
+ * @param blockSize Block size in bytes, 0 for DEFAULT_MEMORY_BLOCK_SIZE.
+ */
+MemoryAllocator CreateMemoryAllocator(ComputeApplication this, VkDeviceSize blockSize);
+bool AllocateDeviceMemory(ComputeApplication this, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, MemoryAllocation* out);
+void FreeDeviceMemory(ComputeApplication this, MemoryAllocation* allocation);
+void DestroyMemoryAllocator(ComputeApplication this);
+
+void CleanUpVulkan(ComputeApplication this);
+
+/**
+ * @brief Creates the instance, device and submission tracking.
+ *
+ * @return NULL when there is no Vulkan loader, no suitable device or device creation fails.
+ */
+ComputeApplication initializeComputeApplication();
+ComputeApplication initializeComputeApplicationWithInfo(const ComputeApplicationCreateInfo* info);
+
+VkDescriptorPool CreatePoolForDescriptors(ComputeApplication this, size_t numOfDescriptorSets, size_t numBufferInfos, Buffer bufferInfos[numBufferInfos]);
+DescriptorSetForBuffers CreateDescriptorsForBuffers(ComputeApplication this, VkDescriptorPool pool, size_t numBufferInfos, Buffer bufferInfos[numBufferInfos]);
+bool GetBufferUsageAndMemoryProperties(enum ComputeBufferType typeOfBuffer, VkBufferUsageFlags* usage, VkMemoryPropertyFlags* properties);
+Buffer CreateBuffer(ComputeApplication this, const char* name, enum ComputeBufferType typeOfBuffer, size_t size, uint64_t binding);
+
+void DestroyBuffer(ComputeApplication this, Buffer buffer);
+// VK_NULL_HANDLE when the code is missing or rejected
+VkShaderModule LoadShader(ComputeApplication this, void* shaderCode, size_t sharderCodeSize);
+ComputePipeline CreatePipeline(ComputeApplication this, DescriptorSetForBuffers descSetForBuffs, VkShaderModule shaderModule, const char* mainShaderFunction);
+
+/**
+ * @brief Creates a compute pipeline with specialization constants and a push constant range.
+ *
+ * Specialization constants are baked in when the pipeline is built, use them for values that
+ * are fixed per device or per camera such as workgroup size, marker count and frame size so the
+ * driver can constant fold them. Per dispatch parameters such as thresholds and ROI windows go
+ * through the push constant range and are updated with AddPushConstantsToCommandBufferQueue
+ * without touching descriptor sets.
+ *
+ * @param specializationCount Number of entries in specializationConstants, may be 0.
+ * @param pushConstantSize Size in bytes of the push constant block starting at offset 0, a
+ *                         multiple of 4 no larger than maxPushConstantsSize. 0 for none.
+ *
+ * @return The pipeline, or NULL when the arguments are invalid or the driver rejects the shader.
+ */
+ComputePipeline CreatePipelineWithConstants(ComputeApplication this, DescriptorSetForBuffers descSetForBuffs, VkShaderModule shaderModule, const char* mainShaderFunction,
+    uint32_t specializationCount, const SpecializationConstant* specializationConstants, uint32_t pushConstantSize);
+void DestroyPipeline(ComputeApplication this, ComputePipeline pipeline);
+
+/**
+ * @brief Suggests a 1D workgroup size for the selected device: a multiple of the subgroup size
+ * of at least 128 invocations, clamped to maxComputeWorkGroupInvocations.
+ */
+uint32_t RecommendedWorkgroupSize(ComputeApplication this);
+CommandBuffer CreateCommandBuffer(ComputeApplication this);
+void BeginCommand(CommandBuffer cmdbuf);
+void EndCommand(CommandBuffer cmdbuf);
+
+/**
+ * @brief Returns a command buffer to the initial state so it can be recorded again. Its last
+ * submission must have completed.
+ */
+void ResetCommand(CommandBuffer cmdbuf);
+void DestroyCommandBuffer(ComputeApplication this, CommandBuffer cmdbuf);
+void AddDispatchComputeShaderToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, uint64_t workgroupSize, DescriptorSetForBuffers descSetForBuffs);
+
+/**
+ * @brief Records a dispatch of groupCountX * groupCountY * groupCountZ workgroups, for kernels
+ * that walk 2D frames or windows of them. Empty dispatches are skipped.
+ */
+void AddDispatch3DComputeShaderToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, DescriptorSetForBuffers descSetForBuffs);
+
+/**
+ * @brief Records a dispatch whose workgroup counts are read on the GPU from a
+ * VkDispatchIndirectCommand in argumentBuffer, written by an earlier pass.
+ *
+ * The pass writing the arguments must be followed by a barrier to
+ * VK_ACCESS_INDIRECT_COMMAND_READ_BIT at VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT.
+ */
+void AddDispatchIndirectComputeShaderToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, Buffer argumentBuffer, size_t argumentOffset, DescriptorSetForBuffers descSetForBuffs);
+
+/**
+ * @brief Records a buffer to buffer copy followed by a barrier making the result visible to
+ * compute shaders and later transfers. Used to read back a device local buffer into a host
+ * visible one.
+ */
+void AddCopyBufferToCommandBufferQueue(CommandBuffer cmdbuf, Buffer src, Buffer dst, size_t size);
+void AddPushConstantsToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, uint32_t offset, uint32_t size, const void* data);
+void CopyDataToBuffer(ComputeApplication this, Buffer dst, size_t dataLen, void* src);
+void CopyBufferToData(ComputeApplication this, Buffer src, size_t dataLen, void* dst);
+void ExecuteCommandBufferSync(ComputeApplication this, CommandBuffer cmdbuf);
+
+/**
+ * @brief Submits a recorded command buffer without waiting for the GPU.
+ *
+ * Pending staging uploads are submitted ahead of the command buffer. The command buffer must
+ * not be re-recorded until its ticket completes, so keep one command buffer per frame in flight.
+ * Without timeline semaphores at most MAX_FRAMES_IN_FLIGHT submissions are outstanding and the
+ * call waits for the oldest one when the fence pool wraps around.
+ *
+ * @return Ticket to poll with IsComputeTicketComplete or wait on with WaitForComputeTicket.
+ */
+ComputeTicket SubmitCommandBufferAsync(ComputeApplication this, CommandBuffer cmdbuf);
+
+/**
+ * @brief Polls a ticket without blocking.
+ *
+ * @return false for a ticket that has not been submitted yet.
+ */
+bool IsComputeTicketComplete(ComputeApplication this, ComputeTicket ticket);
+
+/**
+ * @brief Blocks until the submission behind the ticket completes or the timeout elapses.
+ *
+ * @return true when the submission completed, false on timeout, device loss or an unsubmitted ticket.
+ */
+bool WaitForComputeTicket(ComputeApplication this, ComputeTicket ticket, uint64_t timeoutNanoseconds);
+
+/**
+ * @brief Creates a ring of persistently mapped staging slots used to fill device local buffers.
+ *
+ * Each upload takes one slot. When the device exposes a separate transfer queue family the copy
+ * is submitted on the transfer queue immediately, so the upload of frame N+1 overlaps compute
+ * work of frame N, and the queue family ownership transfer is recorded on both sides. The
+ * matching acquire is submitted ahead of the next compute submission.
+ *
+ * @param slotSize Largest single upload in bytes, usually the size of one camera frame.
+ * @param slotCount Number of uploads that may be in flight at once.
+ */
+StagingRing CreateStagingRing(ComputeApplication this, size_t slotSize, uint32_t slotCount);
+
+/**
+ * @brief Copies host data into a device local buffer through the staging ring.
+ *
+ * @return false when the data does not fit in a slot or the next slot is still in use by a
+ *         submission that has not completed.
+ */
+bool StagingRingUpload(ComputeApplication this, StagingRing ring, Buffer dst, size_t dstOffset, size_t dataLen, const void* src);
+
+/**
+ * @brief Times every copy made through the ring as the "upload" stage of the profiler.
+ *
+ * The copy is timed on whichever queue performs it, the sample is taken when the slot is reused.
+ * Copies on a dedicated transfer queue are only timed when the device supports host query reset.
+ */
+void StagingRingSetProfiler(ComputeApplication this, StagingRing ring, GpuProfiler profiler);
+void DestroyStagingRing(ComputeApplication this, StagingRing ring);
+#endif
@@ -4,6 +4,7 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 void yuyv_to_rgb(unsigned char *yuyv_buffer, unsigned char *rgb_buffer, int width, int height) {
     int yuyv_index = 0;
@@ -735,4 +736,651 @@ void print_list_camera_desc(camera_list* list)
                 afterFirst = true;
         }
     }
-}
\ No newline at end of file
+}
+
+_Static_assert(sizeof(camera_flat_list) % CAMERA_FLAT_ALIGNMENT == 0, "camera_flat_list must keep the sections aligned");
+_Static_assert(sizeof(camera_flat_desc) % CAMERA_FLAT_ALIGNMENT == 0, "camera_flat_desc must keep the sections aligned");
+_Static_assert(sizeof(camera_flat_format) % CAMERA_FLAT_ALIGNMENT == 0, "camera_flat_format must keep the sections aligned");
+_Static_assert(sizeof(camera_flat_tuning) % CAMERA_FLAT_ALIGNMENT == 0, "camera_flat_tuning must keep the sections aligned");
+
+// Lays the blob out, only measuring while base is NULL, so sizing and writing cannot disagree
+typedef struct
+{
+    uint8_t *base;
+    size_t size;
+} flat_writer;
+
+static inline size_t flat_align(size_t offset)
+{
+    return (offset + CAMERA_FLAT_ALIGNMENT - 1) & ~(size_t)(CAMERA_FLAT_ALIGNMENT - 1);
+}
+
+static uint32_t flat_reserve(flat_writer *writer, const void *data, size_t count, size_t element_size)
+{
+    if (count == 0)
+        return 0;
+    size_t offset = flat_align(writer->size);
+    writer->size = offset + count * element_size;
+    if (writer->base && data)
+        memcpy(writer->base + offset, data, count * element_size);
+    return (uint32_t)offset;
+}
+
+static uint32_t flat_string(flat_writer *writer, const char *string)
+{
+    if (string == NULL)
+        return 0;
+    // Strings need no alignment, they are packed back to back
+    size_t offset = writer->size;
+    size_t length = strlen(string) + 1;
+    writer->size += length;
+    if (writer->base)
+        memcpy(writer->base + offset, string, length);
+    return (uint32_t)offset;
+}
+
+static void flat_camera(flat_writer *writer, const camera_desc *camera, uint32_t desc_offset)
+{
+    camera_flat_desc flat;
+    memset(&flat, 0, sizeof(flat));
+    flat.capabilities = camera->device_id.capabilities;
+    flat.capability_flags = (camera->capabilities.can_capture ? camera_flat_capability_CAPTURE : 0) |
+        (camera->capabilities.supports_streaming ? camera_flat_capability_STREAMING : 0) |
+        (camera->capabilities.supports_async_io ? camera_flat_capability_ASYNC_IO : 0) |
+        (camera->capabilities.has_tuner ? camera_flat_capability_TUNER : 0) |
+        (camera->capabilities.has_modulator ? camera_flat_capability_MODULATOR : 0) |
+        (camera->capabilities.has_hardware_acceleration ? camera_flat_capability_HARDWARE_ACCELERATION : 0);
+    flat.controls = camera->controls;
+    flat.io_method = (uint32_t)camera->io_method;
+    flat.streaming_params = camera->streaming_params;
+
+    flat.formats_count = camera->formats ? camera->formats_count : 0;
+    flat.formats_offset = flat_reserve(writer, NULL, flat.formats_count, sizeof(camera_flat_format));
+    for (uint32_t i = 0; i < flat.formats_count; ++i)
+    {
+        const camera_format *format = &camera->formats[i];
+        camera_flat_format flat_format;
+        memset(&flat_format, 0, sizeof(flat_format));
+        flat_format.pixel_format = (uint32_t)format->pixel_format;
+        flat_format.width = format->width;
+        flat_format.height = format->height;
+        flat_format.fps_count = format->fps ? format->fps_count : 0;
+        flat_format.fps_offset = flat_reserve(writer, format->fps, flat_format.fps_count, sizeof(frame_rate_fraction));
+        if (writer->base)
+            memcpy(writer->base + flat.formats_offset + i * sizeof(camera_flat_format), &flat_format, sizeof(flat_format));
+    }
+    flat.buffers_count = camera->buffers ? camera->buffers_count : 0;
+    flat.buffers_offset = flat_reserve(writer, camera->buffers, flat.buffers_count, sizeof(camera_buffer_description));
+    flat.tuning_count = camera->tuning ? camera->tuning_count : 0;
+    flat.tuning_offset = flat_reserve(writer, NULL, flat.tuning_count, sizeof(camera_flat_tuning));
+    for (uint32_t i = 0; i < flat.tuning_count && writer->base; ++i)
+    {
+        camera_flat_tuning tuning;
+        memset(&tuning, 0, sizeof(tuning));
+        tuning.signal_locked = camera->tuning[i].signal_locked;
+        tuning.is_capturing = camera->tuning[i].is_capturing;
+        tuning.tuning_standard = (uint32_t)camera->tuning[i].tuning_standard;
+        tuning.input_frequency = camera->tuning[i].input_frequency;
+        memcpy(writer->base + flat.tuning_offset + i * sizeof(camera_flat_tuning), &tuning, sizeof(tuning));
+    }
+    // Already relocatable, copied as is
+    flat.modes_size = camera->modes ? camera->modes->size : 0;
+    flat.modes_offset = flat_reserve(writer, camera->modes, camera->modes ? 1 : 0, flat.modes_size);
+
+    const camera_device_id *id = &camera->device_id;
+    flat.card_offset = flat_string(writer, id->card);
+    flat.device_name_offset = flat_string(writer, id->device_name);
+    flat.driver_info_offset = flat_string(writer, id->driver_info);
+    flat.version_offset = flat_string(writer, id->version);
+    flat.manufacturer_offset = flat_string(writer, id->manufacturer);
+    flat.bus_offset = flat_string(writer, id->bus);
+    flat.serial_number_offset = flat_string(writer, id->serial_number);
+    flat.dev_path_offset = flat_string(writer, id->devPath);
+    if (writer->base)
+        memcpy(writer->base + desc_offset, &flat, sizeof(flat));
+}
+
+static size_t flat_layout(const camera_list *list, uint8_t *base)
+{
+    flat_writer writer = { base, 0 };
+    uint32_t camera_count = 0;
+    for (size_t i = 0; i < list->count; ++i)
+        camera_count += list->cameras[i] != NULL;
+    flat_reserve(&writer, NULL, 1, sizeof(camera_flat_list));
+    uint32_t cameras_offset = flat_reserve(&writer, NULL, camera_count, sizeof(camera_flat_desc));
+    uint32_t index = 0;
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        if (list->cameras[i])
+            flat_camera(&writer, list->cameras[i], cameras_offset + index++ * sizeof(camera_flat_desc));
+        // Stop measuring before the offsets could wrap, camera_list_flat_size reports it
+        if (writer.size > UINT32_MAX / 2)
+            return 0;
+    }
+    size_t size = flat_align(writer.size);
+    if (base)
+    {
+        camera_flat_list header = { CAMERA_FLAT_MAGIC, CAMERA_FLAT_VERSION, (uint32_t)size, camera_count, cameras_offset, 0 };
+        memcpy(base, &header, sizeof(header));
+    }
+    return size;
+}
+
+size_t camera_list_flat_size(const camera_list *list)
+{
+    if (list == NULL || (list->count > 0 && list->cameras == NULL))
+        return 0;
+    return flat_layout(list, NULL);
+}
+
+size_t flatten_camera_list(const camera_list *list, void *buffer, size_t size)
+{
+    size_t needed = camera_list_flat_size(list);
+    if (needed == 0 || buffer == NULL || size < needed || ((uintptr_t)buffer % CAMERA_FLAT_ALIGNMENT) != 0)
+        return 0;
+    // Padding included, equal lists give byte identical blobs
+    memset(buffer, 0, needed);
+    return flat_layout(list, (uint8_t *)buffer);
+}
+
+static inline bool flat_range_valid(size_t size, uint32_t offset, uint32_t count, size_t element_size)
+{
+    if (count == 0)
+        return true;
+    return offset != 0 && offset % CAMERA_FLAT_ALIGNMENT == 0 && (uint64_t)offset + (uint64_t)count * element_size <= size;
+}
+
+static inline bool flat_string_valid(const uint8_t *base, size_t size, uint32_t offset)
+{
+    return offset == 0 || (offset < size && memchr(base + offset, '\0', size - offset) != NULL);
+}
+
+const camera_flat_list *camera_flat_list_view(const void *buffer, size_t size)
+{
+    if (buffer == NULL || size < sizeof(camera_flat_list) || ((uintptr_t)buffer % CAMERA_FLAT_ALIGNMENT) != 0)
+        return NULL;
+    const camera_flat_list *list = (const camera_flat_list *)buffer;
+    if (list->magic != CAMERA_FLAT_MAGIC || list->version != CAMERA_FLAT_VERSION || list->size > size || list->size < sizeof(camera_flat_list))
+        return NULL;
+    // Everything below is checked against the blob's own size, trailing bytes of a mapping are ignored
+    size = list->size;
+    const uint8_t *base = (const uint8_t *)buffer;
+    if (!flat_range_valid(size, list->cameras_offset, list->camera_count, sizeof(camera_flat_desc)))
+        return NULL;
+    for (uint32_t i = 0; i < list->camera_count; ++i)
+    {
+        const camera_flat_desc *camera = camera_flat_list_camera(list, i);
+        const uint32_t strings[] = { camera->card_offset, camera->device_name_offset, camera->driver_info_offset, camera->version_offset,
+            camera->manufacturer_offset, camera->bus_offset, camera->serial_number_offset, camera->dev_path_offset };
+        for (size_t j = 0; j < sizeof(strings) / sizeof(strings[0]); ++j)
+        {
+            if (!flat_string_valid(base, size, strings[j]))
+                return NULL;
+        }
+        if (!flat_range_valid(size, camera->formats_offset, camera->formats_count, sizeof(camera_flat_format)) ||
+            !flat_range_valid(size, camera->buffers_offset, camera->buffers_count, sizeof(camera_buffer_description)) ||
+            !flat_range_valid(size, camera->tuning_offset, camera->tuning_count, sizeof(camera_flat_tuning)) ||
+            (camera->modes_offset == 0) != (camera->modes_size == 0))
+            return NULL;
+        if (camera->modes_offset && (!flat_range_valid(size, camera->modes_offset, 1, camera->modes_size) ||
+            !camera_mode_table_valid(base + camera->modes_offset, camera->modes_size)))
+            return NULL;
+        const camera_flat_format *formats = camera_flat_desc_formats(list, camera);
+        for (uint32_t j = 0; j < camera->formats_count; ++j)
+        {
+            if (!flat_range_valid(size, formats[j].fps_offset, formats[j].fps_count, sizeof(frame_rate_fraction)))
+                return NULL;
+        }
+    }
+    return list;
+}
+
+static char *flat_string_clone(const camera_flat_list *list, uint32_t offset)
+{
+    const char *string = camera_flat_string(list, offset);
+    if (string == NULL)
+        return NULL;
+    size_t length = strlen(string) + 1;
+    char *clone = (char *)malloc(length);
+    if (clone)
+        memcpy(clone, string, length);
+    return clone;
+}
+
+camera_desc *camera_desc_from_flat(const camera_flat_list *list, const camera_flat_desc *flat)
+{
+    camera_desc *camera = (camera_desc *)calloc(1, sizeof(camera_desc));
+    if (camera == NULL)
+        return NULL;
+    camera_device_id *id = &camera->device_id;
+    id->card = flat_string_clone(list, flat->card_offset);
+    id->device_name = flat_string_clone(list, flat->device_name_offset);
+    id->driver_info = flat_string_clone(list, flat->driver_info_offset);
+    id->version = flat_string_clone(list, flat->version_offset);
+    id->manufacturer = flat_string_clone(list, flat->manufacturer_offset);
+    id->bus = flat_string_clone(list, flat->bus_offset);
+    id->serial_number = flat_string_clone(list, flat->serial_number_offset);
+    id->devPath = flat_string_clone(list, flat->dev_path_offset);
+    id->capabilities = flat->capabilities;
+    camera->capabilities.can_capture = (flat->capability_flags & camera_flat_capability_CAPTURE) != 0;
+    camera->capabilities.supports_streaming = (flat->capability_flags & camera_flat_capability_STREAMING) != 0;
+    camera->capabilities.supports_async_io = (flat->capability_flags & camera_flat_capability_ASYNC_IO) != 0;
+    camera->capabilities.has_tuner = (flat->capability_flags & camera_flat_capability_TUNER) != 0;
+    camera->capabilities.has_modulator = (flat->capability_flags & camera_flat_capability_MODULATOR) != 0;
+    camera->capabilities.has_hardware_acceleration = (flat->capability_flags & camera_flat_capability_HARDWARE_ACCELERATION) != 0;
+    camera->controls = flat->controls;
+    camera->io_method = (camera_io_method)flat->io_method;
+    camera->streaming_params = flat->streaming_params;
+
+    bool failed = false;
+    if (flat->formats_count)
+    {
+        const camera_flat_format *formats = camera_flat_desc_formats(list, flat);
+        camera->formats = (camera_format *)calloc(flat->formats_count, sizeof(camera_format));
+        failed |= camera->formats == NULL;
+        for (uint32_t i = 0; camera->formats && i < flat->formats_count; ++i)
+        {
+            camera_format *format = &camera->formats[i];
+            format->pixel_format = (camera_pixel_format)formats[i].pixel_format;
+            format->width = formats[i].width;
+            format->height = formats[i].height;
+            camera->formats_count = i + 1;
+            if (formats[i].fps_count == 0)
+                continue;
+            format->fps = (frame_rate_fraction *)malloc(formats[i].fps_count * sizeof(frame_rate_fraction));
+            failed |= format->fps == NULL;
+            if (format->fps)
+            {
+                memcpy(format->fps, camera_flat_format_fps(list, &formats[i]), formats[i].fps_count * sizeof(frame_rate_fraction));
+                format->fps_count = formats[i].fps_count;
+            }
+        }
+    }
+    if (flat->buffers_count)
+    {
+        camera->buffers = (camera_buffer_description *)malloc(flat->buffers_count * sizeof(camera_buffer_description));
+        failed |= camera->buffers == NULL;
+        if (camera->buffers)
+        {
+            memcpy(camera->buffers, camera_flat_desc_buffers(list, flat), flat->buffers_count * sizeof(camera_buffer_description));
+            camera->buffers_count = flat->buffers_count;
+        }
+    }
+    if (flat->tuning_count)
+    {
+        const camera_flat_tuning *tuning = camera_flat_desc_tuning(list, flat);
+        camera->tuning = (camera_status_tuning *)calloc(flat->tuning_count, sizeof(camera_status_tuning));
+        failed |= camera->tuning == NULL;
+        for (uint32_t i = 0; camera->tuning && i < flat->tuning_count; ++i)
+        {
+            camera->tuning[i].signal_locked = tuning[i].signal_locked != 0;
+            camera->tuning[i].is_capturing = tuning[i].is_capturing != 0;
+            camera->tuning[i].tuning_standard = (tuning_standard)tuning[i].tuning_standard;
+            camera->tuning[i].input_frequency = tuning[i].input_frequency;
+            camera->tuning_count = i + 1;
+        }
+    }
+    if (flat->modes_size)
+    {
+        camera->modes = (camera_mode_table *)malloc(flat->modes_size);
+        failed |= camera->modes == NULL;
+        if (camera->modes)
+            memcpy(camera->modes, camera_flat_desc_modes(list, flat), flat->modes_size);
+    }
+    if (failed)
+    {
+        free_camera_desc(camera);
+        return NULL;
+    }
+    return camera;
+}
+
+camera_desc *clone_camera_desc(const camera_desc *camera)
+{
+    if (camera == NULL)
+        return NULL;
+    camera_desc *cameras[1] = { (camera_desc *)camera };
+    camera_list list = { cameras, 1, 1 };
+    size_t size = camera_list_flat_size(&list);
+    // malloc alignment covers CAMERA_FLAT_ALIGNMENT
+    void *buffer = size ? malloc(size) : NULL;
+    camera_desc *clone = NULL;
+    if (buffer && flatten_camera_list(&list, buffer, size) == size)
+    {
+        const camera_flat_list *flat = (const camera_flat_list *)buffer;
+        clone = camera_desc_from_flat(flat, camera_flat_list_camera(flat, 0));
+    }
+    free(buffer);
+    return clone;
+}
+
+_Static_assert(sizeof(camera_mode_table) % CAMERA_FLAT_ALIGNMENT == 0, "camera_mode_table must keep the sections aligned");
+
+static int compare_size_values(const void *a, const void *b)
+{
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+// Sorts values and drops duplicates, returns how many are left
+static uint16_t unique_size_values(uint16_t *values, uint32_t count)
+{
+    qsort(values, count, sizeof(uint16_t), compare_size_values);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (unique == 0 || values[unique - 1] != values[i])
+            values[unique++] = values[i];
+    }
+    return (uint16_t)unique;
+}
+
+// Index of the first value not below value, count when there is none
+static uint32_t lower_bound_size(const uint16_t *values, uint32_t count, uint32_t value)
+{
+    uint32_t low = 0;
+    while (low < count)
+    {
+        uint32_t middle = low + (count - low) / 2;
+        if (values[middle] < value)
+            low = middle + 1;
+        else
+            count = middle;
+    }
+    return low;
+}
+
+// Compares frame intervals by cross multiplying, so 1/30 and 2/60 are the same mode
+static int compare_mode_intervals(const camera_mode *a, const camera_mode *b)
+{
+    uint64_t left = (uint64_t)a->interval_numerator * b->interval_denominator;
+    uint64_t right = (uint64_t)b->interval_numerator * a->interval_denominator;
+    return left < right ? -1 : left > right;
+}
+
+static int compare_camera_modes(const void *a, const void *b)
+{
+    const camera_mode *left = (const camera_mode *)a;
+    const camera_mode *right = (const camera_mode *)b;
+    if (left->pixel_format != right->pixel_format)
+        return left->pixel_format < right->pixel_format ? -1 : 1;
+    if (left->width != right->width)
+        return left->width < right->width ? -1 : 1;
+    if (left->height != right->height)
+        return left->height < right->height ? -1 : 1;
+    return compare_mode_intervals(left, right);
+}
+
+// Faster wins, equally fast modes go to the smaller size
+static bool camera_mode_better(const camera_mode *mode, const camera_mode *than)
+{
+    int interval = compare_mode_intervals(mode, than);
+    if (interval != 0)
+        return interval < 0;
+    return (uint32_t)mode->width * mode->height < (uint32_t)than->width * than->height;
+}
+
+static inline bool camera_mode_reaches(const camera_mode *mode, uint32_t fps)
+{
+    return (uint64_t)mode->interval_denominator >= (uint64_t)fps * mode->interval_numerator;
+}
+
+// Fills the distinct widths and heights of a format's modes into sizes, returns their counts
+static void collect_mode_sizes(const camera_mode *modes, uint32_t count, uint16_t *sizes, uint16_t *width_count, uint16_t *height_count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        sizes[i] = modes[i].width;
+    *width_count = unique_size_values(sizes, count);
+    uint16_t *heights = sizes + *width_count;
+    for (uint32_t i = 0; i < count; ++i)
+        heights[i] = modes[i].height;
+    *height_count = unique_size_values(heights, count);
+}
+
+static void fill_fastest_modes(const camera_mode *modes, const camera_mode_format *format, const uint16_t *sizes, uint16_t *fastest)
+{
+    const uint16_t *widths = sizes + format->first_size;
+    const uint16_t *heights = widths + format->width_count;
+    uint32_t height_count = format->height_count;
+    for (uint32_t i = 0; i < (uint32_t)format->width_count * height_count; ++i)
+        fastest[i] = CAMERA_MODE_NONE;
+    for (uint32_t i = format->first_mode; i < format->first_mode + format->mode_count; ++i)
+    {
+        uint16_t *cell = &fastest[lower_bound_size(widths, format->width_count, modes[i].width) * height_count +
+            lower_bound_size(heights, height_count, modes[i].height)];
+        if (*cell == CAMERA_MODE_NONE || camera_mode_better(&modes[i], &modes[*cell]))
+            *cell = (uint16_t)i;
+    }
+    // Suffix maximum over both axes, each cell then covers every mode at least that large
+    for (uint32_t w = format->width_count; w-- > 0;)
+    {
+        for (uint32_t h = height_count; h-- > 0;)
+        {
+            uint16_t *cell = &fastest[w * height_count + h];
+            uint16_t candidates[2] = {
+                w + 1 < format->width_count ? fastest[(w + 1) * height_count + h] : CAMERA_MODE_NONE,
+                h + 1 < height_count ? fastest[w * height_count + h + 1] : CAMERA_MODE_NONE
+            };
+            for (int c = 0; c < 2; ++c)
+            {
+                if (candidates[c] != CAMERA_MODE_NONE && (*cell == CAMERA_MODE_NONE || camera_mode_better(&modes[candidates[c]], &modes[*cell])))
+                    *cell = candidates[c];
+            }
+        }
+    }
+}
+
+camera_mode_table *build_camera_mode_table(const camera_format *formats, uint32_t formats_count)
+{
+    uint32_t capacity = 0;
+    for (uint32_t i = 0; formats && i < formats_count; ++i)
+        capacity += formats[i].fps ? formats[i].fps_count : 0;
+    if (capacity == 0)
+        return NULL;
+    if (capacity > CAMERA_MAX_MODES)
+        capacity = CAMERA_MAX_MODES;
+
+    camera_mode *modes = (camera_mode *)malloc(capacity * sizeof(camera_mode));
+    uint16_t *scratch = (uint16_t *)malloc(capacity * 2 * sizeof(uint16_t));
+    camera_mode_table *table = NULL;
+    if (modes == NULL || scratch == NULL)
+        goto cleanup;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < formats_count && count < capacity; ++i)
+    {
+        const camera_format *format = &formats[i];
+        if (format->width == 0 || format->height == 0 || format->width > UINT16_MAX || format->height > UINT16_MAX || format->fps == NULL)
+            continue;
+        for (uint32_t j = 0; j < format->fps_count && count < capacity; ++j)
+        {
+            if (format->fps[j].frame_rate_numerator == 0 || format->fps[j].frame_rate_denominator == 0)
+                continue;
+            modes[count++] = (camera_mode){ (uint32_t)format->pixel_format, (uint16_t)format->width, (uint16_t)format->height,
+                format->fps[j].frame_rate_numerator, format->fps[j].frame_rate_denominator };
+        }
+    }
+    qsort(modes, count, sizeof(camera_mode), compare_camera_modes);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (unique == 0 || compare_camera_modes(&modes[unique - 1], &modes[i]) != 0)
+            modes[unique++] = modes[i];
+    }
+    count = unique;
+    if (count == 0)
+        goto cleanup;
+
+    // Measure the sections first, the table is a single allocation
+    uint32_t format_count = 0;
+    size_t size_count = 0;
+    size_t fastest_count = 0;
+    for (uint32_t begin = 0, end = 0; begin < count; begin = end)
+    {
+        while (end < count && modes[end].pixel_format == modes[begin].pixel_format)
+            end++;
+        uint16_t width_count, height_count;
+        collect_mode_sizes(&modes[begin], end - begin, scratch, &width_count, &height_count);
+        format_count++;
+        size_count += (size_t)width_count + height_count;
+        fastest_count += (size_t)width_count * height_count;
+    }
+    size_t modes_offset = flat_align(sizeof(camera_mode_table));
+    size_t formats_offset = flat_align(modes_offset + count * sizeof(camera_mode));
+    size_t sizes_offset = flat_align(formats_offset + format_count * sizeof(camera_mode_format));
+    size_t fastest_offset = flat_align(sizes_offset + size_count * sizeof(uint16_t));
+    size_t size = flat_align(fastest_offset + fastest_count * sizeof(uint16_t));
+    if (size > UINT32_MAX)
+        goto cleanup;
+    table = (camera_mode_table *)calloc(1, size);
+    if (table == NULL)
+        goto cleanup;
+    table->size = (uint32_t)size;
+    table->mode_count = count;
+    table->format_count = format_count;
+    table->modes_offset = (uint32_t)modes_offset;
+    table->formats_offset = (uint32_t)formats_offset;
+    table->sizes_offset = (uint32_t)sizes_offset;
+    table->fastest_offset = (uint32_t)fastest_offset;
+
+    uint8_t *base = (uint8_t *)table;
+    memcpy(base + modes_offset, modes, count * sizeof(camera_mode));
+    camera_mode_format *mode_formats = (camera_mode_format *)(base + formats_offset);
+    uint16_t *sizes = (uint16_t *)(base + sizes_offset);
+    uint16_t *fastest = (uint16_t *)(base + fastest_offset);
+    uint32_t next_size = 0;
+    uint32_t next_fastest = 0;
+    format_count = 0;
+    for (uint32_t begin = 0, end = 0; begin < count; begin = end)
+    {
+        while (end < count && modes[end].pixel_format == modes[begin].pixel_format)
+            end++;
+        camera_mode_format *format = &mode_formats[format_count++];
+        format->pixel_format = modes[begin].pixel_format;
+        format->first_mode = begin;
+        format->mode_count = end - begin;
+        format->first_size = next_size;
+        format->first_fastest = next_fastest;
+        collect_mode_sizes(&modes[begin], end - begin, scratch, &format->width_count, &format->height_count);
+        memcpy(sizes + next_size, scratch, ((size_t)format->width_count + format->height_count) * sizeof(uint16_t));
+        fill_fastest_modes(modes, format, sizes, fastest + next_fastest);
+        next_size += format->width_count + format->height_count;
+        next_fastest += (uint32_t)format->width_count * format->height_count;
+    }
+
+cleanup:
+    free(modes);
+    free(scratch);
+    return table;
+}
+
+bool camera_mode_table_valid(const void *buffer, size_t size)
+{
+    if (buffer == NULL || size < sizeof(camera_mode_table) || ((uintptr_t)buffer % CAMERA_FLAT_ALIGNMENT) != 0)
+        return false;
+    const camera_mode_table *table = (const camera_mode_table *)buffer;
+    if (table->size != size || table->mode_count == 0 || table->mode_count > CAMERA_MAX_MODES ||
+        !flat_range_valid(size, table->modes_offset, table->mode_count, sizeof(camera_mode)) ||
+        !flat_range_valid(size, table->formats_offset, table->format_count, sizeof(camera_mode_format)) ||
+        !flat_range_valid(size, table->sizes_offset, 1, 0) || !flat_range_valid(size, table->fastest_offset, 1, 0) ||
+        table->sizes_offset > table->fastest_offset)
+        return false;
+    // Sizes run up to the fastest grid, the grid to the end of the table
+    size_t size_count = (table->fastest_offset - table->sizes_offset) / sizeof(uint16_t);
+    size_t fastest_count = (size - table->fastest_offset) / sizeof(uint16_t);
+    const camera_mode_format *formats = (const camera_mode_format *)((const uint8_t *)table + table->formats_offset);
+    const uint16_t *fastest = (const uint16_t *)((const uint8_t *)table + table->fastest_offset);
+    for (uint32_t i = 0; i < table->format_count; ++i)
+    {
+        const camera_mode_format *format = &formats[i];
+        size_t cells = (size_t)format->width_count * format->height_count;
+        if ((uint64_t)format->first_mode + format->mode_count > table->mode_count ||
+            (uint64_t)format->first_size + format->width_count + format->height_count > size_count ||
+            (uint64_t)format->first_fastest + cells > fastest_count ||
+            (i > 0 && formats[i - 1].pixel_format >= format->pixel_format))
+            return false;
+        for (size_t j = 0; j < cells; ++j)
+        {
+            uint16_t mode = fastest[format->first_fastest + j];
+            if (mode != CAMERA_MODE_NONE && (mode < format->first_mode || mode >= format->first_mode + format->mode_count))
+                return false;
+        }
+    }
+    return true;
+}
+
+static const camera_mode_format *find_mode_format(const camera_mode_table *table, camera_pixel_format pixel_format)
+{
+    if (table == NULL)
+        return NULL;
+    const camera_mode_format *formats = (const camera_mode_format *)((const uint8_t *)table + table->formats_offset);
+    uint32_t low = 0;
+    uint32_t high = table->format_count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (formats[middle].pixel_format < (uint32_t)pixel_format)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low < table->format_count && formats[low].pixel_format == (uint32_t)pixel_format ? &formats[low] : NULL;
+}
+
+static inline const camera_mode *mode_table_modes(const camera_mode_table *table)
+{
+    return (const camera_mode *)((const uint8_t *)table + table->modes_offset);
+}
+
+const camera_mode *camera_format_modes(const camera_mode_table *table, camera_pixel_format pixel_format, uint32_t *count)
+{
+    const camera_mode_format *format = find_mode_format(table, pixel_format);
+    *count = format ? format->mode_count : 0;
+    return format ? mode_table_modes(table) + format->first_mode : NULL;
+}
+
+const camera_mode *camera_fastest_mode(const camera_mode_table *table, camera_pixel_format pixel_format, uint32_t min_width, uint32_t min_height)
+{
+    const camera_mode_format *format = find_mode_format(table, pixel_format);
+    if (format == NULL)
+        return NULL;
+    const uint16_t *widths = (const uint16_t *)((const uint8_t *)table + table->sizes_offset) + format->first_size;
+    const uint16_t *heights = widths + format->width_count;
+    uint32_t w = lower_bound_size(widths, format->width_count, min_width);
+    uint32_t h = lower_bound_size(heights, format->height_count, min_height);
+    if (w == format->width_count || h == format->height_count)
+        return NULL;
+    const uint16_t *fastest = (const uint16_t *)((const uint8_t *)table + table->fastest_offset) + format->first_fastest;
+    uint16_t mode = fastest[w * format->height_count + h];
+    return mode == CAMERA_MODE_NONE ? NULL : mode_table_modes(table) + mode;
+}
+
+const camera_mode *find_camera_mode(const camera_mode_table *table, camera_pixel_format pixel_format, uint32_t width, uint32_t height, uint32_t min_fps)
+{
+    uint32_t count = 0;
+    const camera_mode *modes = camera_format_modes(table, pixel_format, &count);
+    if (width > UINT16_MAX || height > UINT16_MAX)
+        return NULL;
+    // First mode of the size, they are ordered by width then height
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (modes[middle].width < width || (modes[middle].width == width && modes[middle].height < height))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    uint32_t first = low;
+    // Fastest first, so the modes reaching min_fps are a prefix of the size's run
+    high = count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (modes[middle].width == width && modes[middle].height == height && camera_mode_reaches(&modes[middle], min_fps))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low > first ? &modes[low - 1] : NULL;
+}
@@ -1,17 +1,24 @@
+#define _GNU_SOURCE
 #define CAMERA_IMPLEMENTATION
 #include "camera.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <linux/videodev2.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <stdalign.h>
+#include <sys/inotify.h>
+#include <pthread.h>
+#include <time.h>
 
 /**
  * @brief Clones a substring of the given C-string into a newly allocated string.
@@ -112,6 +119,13 @@ static char* read_file_content(const char* path)
     return buffer;
 }
 
+static inline uint64_t monotonic_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
 static camera_pixel_format v4l2_to_camera_pixel_format(uint32_t v4l2_pixfmt)
 {
     switch (v4l2_pixfmt)
@@ -580,6 +594,8 @@ void free_camera_desc(camera_desc* camera)
         free(camera->device_id.manufacturer);
     if (camera->device_id.serial_number)
         free(camera->device_id.serial_number);
+    if (camera->device_id.devPath)
+        free(camera->device_id.devPath);
     if (camera->buffers)
         free(camera->buffers);
     for (uint32_t formatId = 0; formatId < camera->formats_count; ++formatId)
@@ -592,6 +608,7 @@ void free_camera_desc(camera_desc* camera)
 
     if (camera->tuning)
         free(camera->tuning);
+    free(camera->modes);
     free(camera);
 }
 
@@ -606,7 +623,16 @@ void free_camera_list(camera_list* cameras)
     }
 }
 
-static camera_desc* get_camera_device_desc(int fd, const char* devName)
+/**
+ * @brief Fills the identity of a device from VIDIOC_QUERYCAP and sysfs, without any probing.
+ *
+ * This is all the enumeration cache needs to recognise a device, it takes microseconds where the
+ * full probe in get_camera_device_desc takes up to seconds.
+ *
+ * @return NULL when the node cannot be queried or is not a video capture node, e.g. the
+ *         metadata node UVC cameras expose next to the capture one.
+ */
+static camera_desc* get_camera_device_identity(int fd, const char* devName, struct v4l2_capability* out_cap)
 {
     if (fd < 0)
     {
@@ -614,18 +640,20 @@ static camera_desc* get_camera_device_desc(int fd, const char* devName)
         return NULL;
     }
 
-    camera_desc* camera = (camera_desc*)calloc(1, sizeof(camera_desc));
-    if (camera == NULL)
-    {
-        fprintf(stderr, "Failed to allocate camera_desc!\n");
-        return NULL;
-    }
-
     // Obtain device informations
     struct v4l2_capability cap;
     if (ioctl(fd, VIDIOC_QUERYCAP, &cap) == -1) {
         fprintf(stderr,"Failed to query capabilities\n");
-        free(camera);
+        return NULL;
+    }
+    uint32_t device_caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(device_caps & V4L2_CAP_VIDEO_CAPTURE))
+        return NULL;
+
+    camera_desc* camera = (camera_desc*)calloc(1, sizeof(camera_desc));
+    if (camera == NULL)
+    {
+        fprintf(stderr, "Failed to allocate camera_desc!\n");
         return NULL;
     }
 
@@ -643,7 +671,158 @@ static camera_desc* get_camera_device_desc(int fd, const char* devName)
     if (devName)
         camera->device_id.devPath = strclone(devName, strlen(devName));
     else
-        camera->device_id.devPath = "";
+        camera->device_id.devPath = strclone("", 0);
+    camera->device_id.capabilities = device_caps;
+    *out_cap = cap;
+    return camera;
+}
+
+// Sizes sampled from stepwise and continuous ranges besides their bounds, the usual sensor modes
+static const uint16_t common_frame_sizes[][2] = {
+    { 160, 120 }, { 320, 240 }, { 352, 288 }, { 424, 240 }, { 640, 360 }, { 640, 480 }, { 800, 600 },
+    { 848, 480 }, { 960, 540 }, { 1024, 768 }, { 1280, 720 }, { 1280, 800 }, { 1280, 960 }, { 1280, 1024 },
+    { 1600, 1200 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }
+};
+
+// Frame rates sampled from stepwise and continuous interval ranges besides their bounds
+static const uint32_t common_frame_rates[] = { 15, 30, 60, 90, 120, 180, 240 };
+
+static int append_frame_interval(camera_format* format, uint32_t* capacity, uint32_t numerator, uint32_t denominator)
+{
+    if (numerator == 0 || denominator == 0)
+        return 0;
+    for (uint32_t i = 0; i < format->fps_count; ++i)
+    {
+        if ((uint64_t)format->fps[i].frame_rate_numerator * denominator == (uint64_t)numerator * format->fps[i].frame_rate_denominator)
+            return 0;
+    }
+    if (format->fps_count >= *capacity)
+    {
+        uint32_t grown_capacity = *capacity ? *capacity * 2 : 8;
+        frame_rate_fraction* grown = (frame_rate_fraction*)realloc(format->fps, grown_capacity * sizeof(frame_rate_fraction));
+        if (grown == NULL)
+            return 1;
+        format->fps = grown;
+        *capacity = grown_capacity;
+    }
+    format->fps[format->fps_count++] = (frame_rate_fraction){ numerator, denominator };
+    return 0;
+}
+
+// Whether 1/rate seconds lies in the interval range and, unless it is continuous, on its step
+static bool frame_rate_in_range(const struct v4l2_frmival_stepwise* range, uint32_t rate, bool continuous)
+{
+    uint64_t min_num = range->min.numerator, min_den = range->min.denominator;
+    if (min_num * rate > min_den || (uint64_t)range->max.denominator > (uint64_t)range->max.numerator * rate)
+        return false;
+    if (continuous || range->step.numerator == 0 || range->step.denominator == 0)
+        return true;
+    // (1/rate - min) / step = (min_den - min_num * rate) * step_den / (min_den * rate * step_num)
+    uint64_t offset = (min_den - min_num * rate) * range->step.denominator;
+    uint64_t step = min_den * rate * range->step.numerator;
+    return step != 0 && offset % step == 0;
+}
+
+/**
+ * @brief Fills the frame intervals of a size, discrete ones as listed, ranges as their bounds plus
+ * the common rates inside.
+ */
+static int probe_frame_intervals(int fd, uint32_t pixelformat, uint32_t width, uint32_t height, camera_format* format)
+{
+    uint32_t capacity = 0;
+    struct v4l2_frmivalenum frmival = {0};
+    frmival.pixel_format = pixelformat;
+    frmival.width = width;
+    frmival.height = height;
+    for (frmival.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0; frmival.index++)
+    {
+        if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE)
+        {
+            if (append_frame_interval(format, &capacity, frmival.discrete.numerator, frmival.discrete.denominator))
+                return 1;
+            continue;
+        }
+        // Ranges are only reported at index 0, the shortest interval is the fastest mode
+        const struct v4l2_frmival_stepwise* range = &frmival.stepwise;
+        if (append_frame_interval(format, &capacity, range->min.numerator, range->min.denominator))
+            return 1;
+        for (size_t i = 0; i < sizeof(common_frame_rates) / sizeof(common_frame_rates[0]); ++i)
+        {
+            if (frame_rate_in_range(range, common_frame_rates[i], frmival.type == V4L2_FRMIVAL_TYPE_CONTINUOUS) && append_frame_interval(format, &capacity, 1, common_frame_rates[i]))
+                return 1;
+        }
+        if (append_frame_interval(format, &capacity, range->max.numerator, range->max.denominator))
+            return 1;
+        break;
+    }
+    return 0;
+}
+
+static int append_frame_size(int fd, uint32_t pixelformat, uint32_t width, uint32_t height, camera_desc* camera, uint32_t* capacity)
+{
+    if (camera->formats_count >= *capacity)
+    {
+        uint32_t grown_capacity = *capacity ? *capacity * 2 : 16;
+        camera_format* grown = (camera_format*)realloc(camera->formats, grown_capacity * sizeof(camera_format));
+        if (grown == NULL)
+            return 1;
+        camera->formats = grown;
+        *capacity = grown_capacity;
+    }
+    // Counted before the intervals so free_camera_desc releases them if probing fails
+    camera_format* format = &camera->formats[camera->formats_count++];
+    *format = (camera_format){ v4l2_to_camera_pixel_format(pixelformat), width, height, 0, NULL };
+    return probe_frame_intervals(fd, pixelformat, width, height, format);
+}
+
+/**
+ * @brief Appends one camera_format per size of a pixel format, discrete sizes as listed, stepwise
+ * and continuous ranges as their bounds plus the common sizes inside.
+ */
+static int probe_frame_sizes(int fd, uint32_t pixelformat, camera_desc* camera, uint32_t* capacity)
+{
+    struct v4l2_frmsizeenum frmsize = {0};
+    frmsize.pixel_format = pixelformat;
+    for (frmsize.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) == 0; frmsize.index++)
+    {
+        if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE)
+        {
+            if (append_frame_size(fd, pixelformat, frmsize.discrete.width, frmsize.discrete.height, camera, capacity))
+                return 1;
+            continue;
+        }
+        const struct v4l2_frmsize_stepwise* range = &frmsize.stepwise;
+        uint32_t step_width = range->step_width ? range->step_width : 1;
+        uint32_t step_height = range->step_height ? range->step_height : 1;
+        if (append_frame_size(fd, pixelformat, range->min_width, range->min_height, camera, capacity))
+            return 1;
+        for (size_t i = 0; i < sizeof(common_frame_sizes) / sizeof(common_frame_sizes[0]); ++i)
+        {
+            uint32_t width = common_frame_sizes[i][0];
+            uint32_t height = common_frame_sizes[i][1];
+            if (width < range->min_width || width > range->max_width || height < range->min_height || height > range->max_height ||
+                (width - range->min_width) % step_width != 0 || (height - range->min_height) % step_height != 0 ||
+                (width == range->min_width && height == range->min_height) || (width == range->max_width && height == range->max_height))
+                continue;
+            if (append_frame_size(fd, pixelformat, width, height, camera, capacity))
+                return 1;
+        }
+        if ((range->max_width != range->min_width || range->max_height != range->min_height) &&
+            append_frame_size(fd, pixelformat, range->max_width, range->max_height, camera, capacity))
+            return 1;
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Probes buffers, formats, controls and tuners of a device whose identity is filled in.
+ *
+ * @return camera on success, NULL after freeing it when the device cannot stream.
+ */
+static camera_desc* probe_camera_device(int fd, const char* devName, const struct v4l2_capability* capability, camera_desc* camera)
+{
+    struct v4l2_capability cap = *capability;
 
     uint32_t attempt = 4;
     struct v4l2_requestbuffers req;
@@ -712,56 +891,18 @@ static camera_desc* get_camera_device_desc(int fd, const char* devName)
     camera->capabilities.has_modulator = (cap.capabilities & V4L2_CAP_MODULATOR) != 0;
     camera->capabilities.has_hardware_acceleration = (cap.capabilities & V4L2_CAP_HW_FREQ_SEEK) != 0;
 
-    uint32_t format_count = 0;
-    struct v4l2_fmtdesc fmtdesc;
+    struct v4l2_fmtdesc fmtdesc = {0};
     fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmtdesc.index = 0;
-    while (ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
-        format_count++;
-        fmtdesc.index++;
-    }
-
-    camera->formats_count = format_count;
-    camera->formats = (camera_format*)calloc(format_count, sizeof(camera_format));
-
-    fmtdesc.index = 0;
-    for (uint32_t i = 0; i < format_count; ++i) {
-        ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc);
-
-        camera->formats[i].pixel_format = v4l2_to_camera_pixel_format(fmtdesc.pixelformat);
-
-        struct v4l2_frmsizeenum frmsize;
-        frmsize.pixel_format = fmtdesc.pixelformat;
-        frmsize.index = 0;
-        if (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) == 0) {
-            camera->formats[i].width = frmsize.discrete.width;
-            camera->formats[i].height = frmsize.discrete.height;
-
-            uint32_t fps_count = 0;
-            struct v4l2_frmivalenum frmival;
-            frmival.pixel_format = fmtdesc.pixelformat;
-            frmival.width = frmsize.discrete.width;
-            frmival.height = frmsize.discrete.height;
-            frmival.index = 0;
-            while (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0) {
-                fps_count++;
-                frmival.index++;
-            }
-
-            camera->formats[i].fps_count = fps_count;
-            camera->formats[i].fps = (frame_rate_fraction*)calloc(fps_count, sizeof(frame_rate_fraction));
-
-            frmival.index = 0;
-            for (uint32_t j = 0; j < fps_count; ++j) {
-                ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival);
-                camera->formats[i].fps[j].frame_rate_numerator = frmival.discrete.numerator;
-                camera->formats[i].fps[j].frame_rate_denominator = frmival.discrete.denominator;
-                frmival.index++;
-            }
+    uint32_t formats_capacity = 0;
+    for (fmtdesc.index = 0; ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0; fmtdesc.index++) {
+        if (probe_frame_sizes(fd, fmtdesc.pixelformat, camera, &formats_capacity)) {
+            fprintf(stderr, "Failed to allocate camera formats!\n");
+            free_camera_desc(camera);
+            return NULL;
         }
-
-        fmtdesc.index++;
     }
+    // NULL as well when the driver lists no frame intervals, mode selection then falls back to formats
+    camera->modes = build_camera_mode_table(camera->formats, camera->formats_count);
 
     struct v4l2_queryctrl queryctrl;
 
@@ -867,255 +1008,1171 @@ static camera_desc* get_camera_device_desc(int fd, const char* devName)
     return camera;
 }
 
-camera_list* list_all_camera_devices()
+static camera_desc* get_camera_device_desc(int fd, const char* devName)
 {
-    int fd;
-    DIR *dir;
-    struct dirent *ent;
-
-    camera_list* cameras = malloc(sizeof(camera_list));
-    cameras->count = 0;
-    cameras->capacity = 8;
-    cameras->cameras = (camera_desc**) calloc(8, sizeof(camera_desc*));
-
-    if ((dir = opendir("/dev/")) != NULL) {
-        while ((ent = readdir(dir)) != NULL) {
-            if (strstr(ent->d_name, "video") == ent->d_name) {  // Filtering for names that start with "video"
-                char dev_name[261];
-                snprintf(dev_name, sizeof(dev_name), "/dev/%s", ent->d_name);
-
-                if ((fd = open(dev_name, O_RDWR)) == -1) {
-                    continue;
-                }
-
-                if (cameras->count >= cameras->capacity)
-                {
-                    cameras->capacity *= 2;
-                    camera_desc** reallocated_cameras = (camera_desc**) realloc(cameras->cameras, cameras->capacity);
-                    if (!reallocated_cameras)
-                    {
-                        free_camera_list(cameras);
-                        close(fd);
-                        break;
-                    }
-                    cameras->cameras = reallocated_cameras;
-                }
-                
-                camera_desc* desc = get_camera_device_desc(fd, ent->d_name);
-                if (desc)
-                    cameras->cameras[cameras->count++] = desc;
-                close(fd);
-            }
-        }
-        closedir(dir);
-    } else {
-        fprintf(stderr, "Could not open directory\n");
-        free_camera_list(cameras);
-        return NULL;
+    struct v4l2_capability cap;
+    camera_desc* camera = get_camera_device_identity(fd, devName, &cap);
+    return camera ? probe_camera_device(fd, devName, &cap, camera) : NULL;
+}
+
+static int camera_list_append(camera_list* list, camera_desc* camera)
+{
+    if (list->count >= list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 8;
+        camera_desc** cameras = (camera_desc**)realloc(list->cameras, capacity * sizeof(camera_desc*));
+        if (cameras == NULL)
+            return 1;
+        list->cameras = cameras;
+        list->capacity = capacity;
     }
+    list->cameras[list->count++] = camera;
+    return 0;
+}
 
-    return cameras;
+// Orders video2 before video10 so the list does not depend on readdir
+static int compare_video_nodes(const void* a, const void* b)
+{
+    const char* name_a = *(const char* const*)a;
+    const char* name_b = *(const char* const*)b;
+    size_t length_a = strlen(name_a);
+    size_t length_b = strlen(name_b);
+    return length_a != length_b ? (length_a < length_b ? -1 : 1) : strcmp(name_a, name_b);
+}
+
+static const char* camera_device_directory()
+{
+    const char* directory = getenv(CAMERA_DEVICE_DIRECTORY_ENVIRONMENT_VARIABLE);
+    return directory && directory[0] != '\0' ? directory : "/dev";
 }
 
 /**
- * @brief Decode an AV packet and convert it to RGB format.
+ * @brief Lists the names of the /dev/video* nodes, sorted.
  *
- * @param codec_context Pointer to the AVCodecContext.
- * @param sws_ctx Pointer to the SwsContext for pixel format conversion.
- * @param packet Pointer to the AVPacket to decode.
- * @param frame Pointer to the AVFrame to store the decoded frame.
- * @param rgb_frame Pointer to the AVFrame to store the RGB frame.
- * @param rgb_buffer Pointer to the buffer to store RGB data.
- * @param width Width of the image in pixels.
- * @param height Height of the image in pixels.
- * @return 0 on success, or error code on failure.
+ * @return The number of names, -1 when /dev cannot be read. Free with free_video_nodes.
  */
-static inline int decode_packet(AVCodecContext *codec_context, struct SwsContext* sws_ctx, AVPacket *packet, AVFrame *frame, AVFrame *rgb_frame, unsigned char *rgb_buffer, int width, int height) {
-    int response = avcodec_send_packet(codec_context, packet);
-    if (response < 0) {
-        fprintf(stderr,"Error while sending a packet to the decoder");
-        return response;
+static int list_video_nodes(char*** out_names)
+{
+    DIR* dir = opendir(camera_device_directory());
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Could not open directory\n");
+        return -1;
     }
-    while (response >= 0) {
-        response = avcodec_receive_frame(codec_context, frame);
-        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-            break;
-        } else if (response < 0) {
-            fprintf(stderr,"Error while receiving a frame from the decoder");
-            return response;
-        }
-
-        if (response >= 0) {
-            // Perform the scaling.
-            sws_scale(sws_ctx, (const uint8_t* const*) frame->data, frame->linesize, 0, height, rgb_frame->data, rgb_frame->linesize);
-
-            // Now rgb_frame contains the image in RGB format. You can copy it to your buffer.
-            int numBytes = av_image_get_buffer_size(rgb_frame->format, rgb_frame->width, rgb_frame->height, 1);
-            av_image_copy_to_buffer(rgb_buffer, numBytes, (const uint8_t * const *)rgb_frame->data, rgb_frame->linesize, rgb_frame->format, rgb_frame->width, rgb_frame->height, 1);
+    char** names = NULL;
+    int count = 0;
+    int capacity = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (strncmp(ent->d_name, "video", 5) != 0)
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            char** grown = (char**)realloc(names, capacity * sizeof(char*));
+            if (grown == NULL)
+                break;
+            names = grown;
         }
+        names[count] = strclone(ent->d_name, strlen(ent->d_name));
+        if (names[count])
+            count++;
     }
-    return 0;
+    closedir(dir);
+    if (count > 1)
+        qsort(names, count, sizeof(char*), compare_video_nodes);
+    *out_names = names;
+    return count;
 }
 
-static inline int initialize_avcodec(AVCodec** outVidCodec, AVCodecContext** outVidCodecContext)
+static void free_video_nodes(char** names, int count)
 {
-    *outVidCodec = (AVCodec*) avcodec_find_decoder(AV_CODEC_ID_H264);
-    if (*outVidCodec == NULL) {
-        fprintf(stderr,"Unable to find codec!\n");
-        return 1;
-    }
-
-    *outVidCodecContext = avcodec_alloc_context3(*outVidCodec);
-    if (avcodec_open2(*outVidCodecContext, *outVidCodec, NULL) < 0) {
-        fprintf(stderr,"Unable to open codec!\n");
-        return 1;
-    }
-    return 0;
+    for (int i = 0; i < count; ++i)
+        free(names[i]);
+    free(names);
 }
 
-static inline int initialize_swscale(uint32_t width, uint32_t height, AVCodecContext* vidcodecContext, struct SwsContext** outSwsContext)
+static camera_desc* probe_camera_node(const char* name)
 {
-    *outSwsContext = sws_getContext(width, height, vidcodecContext->pix_fmt,
-                                        width, height, AV_PIX_FMT_RGB24,
-                                        SWS_BILINEAR, NULL, NULL, NULL);
+    char dev_name[512];
+    snprintf(dev_name, sizeof(dev_name), "%s/%s", camera_device_directory(), name);
+    int fd = open(dev_name, O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    camera_desc* camera = get_camera_device_desc(fd, name);
+    close(fd);
+    return camera;
+}
 
-    if (*outSwsContext == NULL) {
-        fprintf(stderr,"Could not initialize the conversion context\n");
-        return 1;
+// One node to probe, results are only touched under the scan's lock
+typedef struct
+{
+    char* name;
+    camera_desc* result;
+    uint64_t started_ns;                // 0 until a thread picked it up
+    bool done;
+} camera_probe_job;
+
+// Shared by the caller and the probe threads, freed by whoever leaves last since threads stuck in
+// a driver ioctl outlive the scan
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    camera_probe_job* jobs;
+    uint32_t job_count;
+    uint32_t next_job;
+    uint32_t references;
+    bool abandoned;                     // The caller returned, late results are dropped
+} camera_probe_scan;
+
+static void release_probe_scan(camera_probe_scan* scan)
+{
+    pthread_mutex_lock(&scan->lock);
+    bool last = --scan->references == 0;
+    pthread_mutex_unlock(&scan->lock);
+    if (!last)
+        return;
+    for (uint32_t i = 0; i < scan->job_count; ++i)
+    {
+        free(scan->jobs[i].name);
+        free_camera_desc(scan->jobs[i].result);
     }
-    return 0;
+    free(scan->jobs);
+    pthread_cond_destroy(&scan->finished);
+    pthread_mutex_destroy(&scan->lock);
+    free(scan);
 }
 
-static inline int set_v4l2_videocapture_format_fps(int fd, uint32_t width, uint32_t height, uint32_t fps)
+static void* probe_thread(void* argument)
 {
-    struct v4l2_format format;
-    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    format.fmt.pix.pixelformat = V4L2_PIX_FMT_H264;
-    //format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    //format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
-    format.fmt.pix.width = width;
-    format.fmt.pix.height = height;
-    if (ioctl(fd, VIDIOC_S_FMT, &format) == -1) {
-        fprintf(stderr,"Fail to set Pixel Format\n");
-        return 1;
-    }
+    camera_probe_scan* scan = (camera_probe_scan*)argument;
+    pthread_mutex_lock(&scan->lock);
+    while (!scan->abandoned && scan->next_job < scan->job_count)
+    {
+        camera_probe_job* job = &scan->jobs[scan->next_job++];
+        job->started_ns = monotonic_now_ns();
+        pthread_mutex_unlock(&scan->lock);
 
-    struct v4l2_streamparm setfps;
-    memset(&setfps, 0, sizeof(struct v4l2_streamparm));
-    setfps.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    setfps.parm.capture.timeperframe.numerator = 1;
-    setfps.parm.capture.timeperframe.denominator = fps;
+        camera_desc* camera = probe_camera_node(job->name);
 
-    if (ioctl(fd, VIDIOC_S_PARM, &setfps) == -1) {
-        fprintf(stderr,"Fail to set frame rate\n");
-        return 1;
+        pthread_mutex_lock(&scan->lock);
+        job->result = camera;
+        job->done = true;
+        pthread_cond_broadcast(&scan->finished);
     }
-    return 0;
+    pthread_mutex_unlock(&scan->lock);
+    release_probe_scan(scan);
+    return NULL;
 }
 
-int start_capture(const char* pathToCamera, uint32_t width, uint32_t height, uint32_t fps, decoded_rgb_frame_buffer_callback callback, atomic_int *quit)
+/**
+ * @brief Whether the caller can stop waiting: every job is done or overran its timeout, and the
+ * ones not started yet have no thread left that is not stuck.
+ */
+static bool probe_scan_settled(const camera_probe_scan* scan, uint32_t thread_count, uint64_t now_ns, uint64_t timeout_ns, uint64_t* next_deadline_ns)
 {
-    int ret = 0;
-
-    if (callback == NULL)
+    uint32_t stuck = 0;
+    bool waiting = false;
+    *next_deadline_ns = UINT64_MAX;
+    for (uint32_t i = 0; i < scan->job_count; ++i)
     {
-        fprintf(stderr, "Callback for processing rgb frame buffer cannot be null!\n");
-        return 1;
+        const camera_probe_job* job = &scan->jobs[i];
+        if (job->done)
+            continue;
+        if (job->started_ns == 0)
+        {
+            waiting = true;
+            continue;
+        }
+        uint64_t deadline = job->started_ns + timeout_ns;
+        if (now_ns >= deadline)
+            stuck++;
+        else
+        {
+            waiting = true;
+            *next_deadline_ns = deadline < *next_deadline_ns ? deadline : *next_deadline_ns;
+        }
     }
+    // Unstarted jobs wait for a free thread, unless all of them hang in a driver
+    bool unstarted = scan->next_job < scan->job_count;
+    return !waiting || (unstarted && stuck >= thread_count && *next_deadline_ns == UINT64_MAX);
+}
 
-    if (quit == NULL)
+/**
+ * @brief Probes nodes on up to thread_count threads, results in the order of names.
+ *
+ * @param out_results Receives one camera_desc or NULL per name, NULL for nodes that failed or
+ *                    did not answer within timeout_ms.
+ * @return 0 on success, 1 when no thread could be started.
+ */
+static int probe_camera_nodes(char* const* names, uint32_t count, uint32_t thread_count, uint32_t timeout_ms, camera_desc** out_results)
+{
+    memset(out_results, 0, count * sizeof(camera_desc*));
+    if (count == 0)
+        return 0;
+    camera_probe_scan* scan = (camera_probe_scan*)calloc(1, sizeof(camera_probe_scan));
+    camera_probe_job* jobs = (camera_probe_job*)calloc(count, sizeof(camera_probe_job));
+    if (scan == NULL || jobs == NULL)
     {
-        fprintf(stderr, "Atomic quit integer reference cannot be null!\n");
+        free(scan);
+        free(jobs);
         return 1;
     }
-
-    // Initialize FFmpeg and V4L2 related variables
-    AVCodec *vidCodec = NULL;
-    AVCodecContext *vidcodec_context = NULL;
-    struct SwsContext* sws_ctx = NULL;
-    int fd = -1;
-    struct v4l2_requestbuffers req = {0};
-    struct v4l2_buffer buf = {0};
-    unsigned char* buffer = NULL;
-    AVPacket *packet = NULL;
-    AVFrame *frame = NULL;
-    AVFrame *rgb_frame = NULL;
-
-    // Allocate RGB buffer
-    unsigned char* rgb_buffer = (unsigned char*) malloc(width * height * 3);
-    if (!rgb_buffer)
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&scan->finished, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&scan->lock, NULL);
+    scan->jobs = jobs;
+    scan->job_count = count;
+    scan->references = 1;
+    for (uint32_t i = 0; i < count; ++i)
+        jobs[i].name = strclone(names[i], strlen(names[i]));
+
+    if (thread_count == 0)
+        thread_count = 1;
+    if (thread_count > count)
+        thread_count = count;
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < thread_count; ++i)
     {
-        fprintf(stderr, "Failed to allocate rgb_buffer\n");
-        ret = 1;
-        goto fail;
+        pthread_t thread;
+        pthread_mutex_lock(&scan->lock);
+        scan->references++;
+        pthread_mutex_unlock(&scan->lock);
+        if (pthread_create(&thread, NULL, probe_thread, scan) != 0)
+        {
+            pthread_mutex_lock(&scan->lock);
+            scan->references--;
+            pthread_mutex_unlock(&scan->lock);
+            break;
+        }
+        pthread_detach(thread);
+        started++;
     }
 
-    // Initialize video codec
-    if (initialize_avcodec(&vidCodec, &vidcodec_context))
+    uint64_t timeout_ns = (uint64_t)timeout_ms * 1000000ull;
+    pthread_mutex_lock(&scan->lock);
+    for (;;)
     {
-        fprintf(stderr,"Failed to initialize avcodec!\n");
-        ret = 1;
-        goto cleanup_avcodec;
+        uint64_t now = monotonic_now_ns();
+        uint64_t next_deadline = UINT64_MAX;
+        if (started == 0 || probe_scan_settled(scan, started, now, timeout_ns, &next_deadline))
+            break;
+        // Nothing running yet, a job picked up meanwhile is rechecked within its timeout
+        if (next_deadline == UINT64_MAX)
+            next_deadline = now + timeout_ns;
+        struct timespec until = { (time_t)(next_deadline / 1000000000ull), (long)(next_deadline % 1000000000ull) };
+        pthread_cond_timedwait(&scan->finished, &scan->lock, &until);
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (jobs[i].done)
+        {
+            out_results[i] = jobs[i].result;
+            jobs[i].result = NULL;
+        }
+        else if (jobs[i].started_ns != 0)
+            fprintf(stderr, "Probing %s/%s timed out after %u ms, skipping it\n", camera_device_directory(), jobs[i].name, timeout_ms);
     }
+    scan->abandoned = true;
+    pthread_mutex_unlock(&scan->lock);
+    release_probe_scan(scan);
+    return started == 0;
+}
 
-    // Set pixel format
-    vidcodec_context->pix_fmt = AV_PIX_FMT_YUV420P;
+camera_list* list_all_camera_devices()
+{
+    return list_all_camera_devices_parallel(CAMERA_PROBE_THREADS, CAMERA_PROBE_TIMEOUT_MS);
+}
 
-    // Initialize scaling context
-    if (initialize_swscale(width, height, vidcodec_context, &sws_ctx))
+camera_list* list_all_camera_devices_parallel(uint32_t thread_count, uint32_t timeout_ms)
+{
+    char** names = NULL;
+    int count = list_video_nodes(&names);
+    if (count < 0)
+        return NULL;
+
+    camera_list* cameras = (camera_list*)calloc(1, sizeof(camera_list));
+    camera_desc** results = (camera_desc**)calloc(count ? count : 1, sizeof(camera_desc*));
+    if (cameras == NULL || results == NULL || probe_camera_nodes(names, (uint32_t)count, thread_count, timeout_ms, results))
     {
-        fprintf(stderr,"Failed to initialize swscale\n");
-        ret = 1;
-        goto cleanup_swscale;
+        fprintf(stderr, "Failed to probe camera devices\n");
+        free(results);
+        free(cameras);
+        free_video_nodes(names, count);
+        return NULL;
+    }
+    // Merged in node order, whichever thread finished first
+    for (int i = 0; i < count; ++i)
+    {
+        if (results[i] && camera_list_append(cameras, results[i]))
+            free_camera_desc(results[i]);
     }
+    free(results);
+    free_video_nodes(names, count);
+    return cameras;
+}
 
-    // Open video device
-    fd = open(pathToCamera, O_RDWR);
-    if (fd == -1) {
-        fprintf(stderr,"Opening video device\n");
+const camera_flat_list* map_camera_flat_list(const char* path, size_t* out_size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(camera_flat_list))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return NULL;
+    const camera_flat_list* list = camera_flat_list_view(mapping, size);
+    if (list == NULL)
+    {
+        fprintf(stderr, "Camera cache %s is invalid or of another version\n", path);
+        munmap(mapping, size);
+        return NULL;
+    }
+    if (out_size)
+        *out_size = size;
+    return list;
+}
+
+void unmap_camera_flat_list(const camera_flat_list* list, size_t size)
+{
+    if (list)
+        munmap((void*)list, size);
+}
+
+int write_camera_flat_list(const char* path, const camera_flat_list* list)
+{
+    if (path == NULL || list == NULL)
+        return 1;
+    // Readers mapping the old file keep it, the rename swaps in a complete one
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp.%d", path, (int)getpid()) >= (int)sizeof(temporary))
+        return 1;
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Failed to write camera cache %s: %s\n", temporary, strerror(errno));
+        return 1;
+    }
+    const uint8_t* data = (const uint8_t*)list;
+    size_t written = 0;
+    while (written < list->size)
+    {
+        ssize_t result = write(fd, data + written, list->size - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            break;
+        written += (size_t)result;
+    }
+    int ret = written == list->size && fsync(fd) == 0 ? 0 : 1;
+    close(fd);
+    if (ret == 0 && rename(temporary, path) == -1)
         ret = 1;
-        goto cleanup_fd;
+    if (ret)
+    {
+        fprintf(stderr, "Failed to write camera cache %s: %s\n", path, strerror(errno));
+        unlink(temporary);
+    }
+    return ret;
+}
+
+// Cached descriptions of devices seen before, the oldest is dropped beyond this
+#define CAMERA_CACHE_MAX_ENTRIES 64
+#define CAMERA_INOTIFY_BUFFER_SIZE 4096
+
+struct camera_enumerator
+{
+    char* cache_path;
+    camera_list known;              // Every device probed, plugged in or not, persisted to cache_path
+    camera_list present;            // Devices plugged in right now
+    int inotify_fd;
+    camera_hotplug_callback callback;
+    void* user_data;
+    bool cache_dirty;
+};
+
+// Removes without freeing, keeps the order
+static void camera_list_remove(camera_list* list, size_t index)
+{
+    memmove(&list->cameras[index], &list->cameras[index + 1], (list->count - index - 1) * sizeof(camera_desc*));
+    list->count--;
+}
+
+static void clear_camera_list(camera_list* list)
+{
+    for (size_t i = 0; i < list->count; ++i)
+        free_camera_desc(list->cameras[i]);
+    free(list->cameras);
+    *list = (camera_list){0};
+}
+
+static inline bool same_string(const char* a, const char* b)
+{
+    return a == NULL || b == NULL ? a == b : strcmp(a, b) == 0;
+}
+
+static bool same_camera_identity(const camera_desc* a, const camera_desc* b)
+{
+    return a->device_id.capabilities == b->device_id.capabilities && same_string(a->device_id.driver_info, b->device_id.driver_info) &&
+        same_string(a->device_id.version, b->device_id.version) && same_string(a->device_id.bus, b->device_id.bus) &&
+        same_string(a->device_id.serial_number, b->device_id.serial_number) && same_string(a->device_id.card, b->device_id.card);
+}
+
+static camera_desc* find_present_camera(const camera_enumerator* enumerator, const char* name, size_t* out_index)
+{
+    for (size_t i = 0; i < enumerator->present.count; ++i)
+    {
+        if (same_string(enumerator->present.cameras[i]->device_id.devPath, name))
+        {
+            if (out_index)
+                *out_index = i;
+            return enumerator->present.cameras[i];
+        }
+    }
+    return NULL;
+}
+
+static void cache_camera_desc(camera_enumerator* enumerator, const camera_desc* camera)
+{
+    camera_desc* cached = clone_camera_desc(camera);
+    if (cached == NULL)
+        return;
+    if (enumerator->known.count >= CAMERA_CACHE_MAX_ENTRIES)
+    {
+        free_camera_desc(enumerator->known.cameras[0]);
+        camera_list_remove(&enumerator->known, 0);
+    }
+    if (camera_list_append(&enumerator->known, cached))
+        free_camera_desc(cached);
+    else
+        enumerator->cache_dirty = true;
+}
+
+/**
+ * @brief Describes /dev/<name> from the cache, NULL when its identity is unknown.
+ */
+static camera_desc* find_cached_camera(camera_enumerator* enumerator, const char* name)
+{
+    char dev_name[512];
+    snprintf(dev_name, sizeof(dev_name), "%s/%s", camera_device_directory(), name);
+    int fd = open(dev_name, O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    struct v4l2_capability cap;
+    camera_desc* camera = get_camera_device_identity(fd, name, &cap);
+    close(fd);
+    if (camera == NULL)
+        return NULL;
+    camera_desc* cached = NULL;
+    for (size_t i = 0; i < enumerator->known.count && cached == NULL; ++i)
+    {
+        if (!same_camera_identity(camera, enumerator->known.cameras[i]))
+            continue;
+        cached = clone_camera_desc(enumerator->known.cameras[i]);
+        if (cached == NULL)
+            break;
+        // Node numbers change between plugs, the identity does not
+        free(cached->device_id.devPath);
+        cached->device_id.devPath = camera->device_id.devPath;
+        camera->device_id.devPath = NULL;
+    }
+    free_camera_desc(camera);
+    return cached;
+}
+
+static camera_desc* enumerate_camera_node(camera_enumerator* enumerator, const char* name)
+{
+    camera_desc* camera = find_cached_camera(enumerator, name);
+    if (camera)
+        return camera;
+    // A hanging device must not stall hotplug handling any more than a scan
+    char* names[1] = { (char*)name };
+    if (probe_camera_nodes(names, 1, 1, CAMERA_PROBE_TIMEOUT_MS, &camera))
+        return NULL;
+    if (camera)
+        cache_camera_desc(enumerator, camera);
+    return camera;
+}
+
+static int add_present_camera(camera_enumerator* enumerator, const char* name)
+{
+    if (find_present_camera(enumerator, name, NULL))
+        return 0;
+    camera_desc* camera = enumerate_camera_node(enumerator, name);
+    if (camera == NULL)
+        return 0;
+    if (camera_list_append(&enumerator->present, camera))
+    {
+        free_camera_desc(camera);
+        return 0;
+    }
+    if (enumerator->callback)
+        enumerator->callback(camera, true, enumerator->user_data);
+    return 1;
+}
+
+static int remove_present_camera(camera_enumerator* enumerator, const char* name)
+{
+    size_t index = 0;
+    camera_desc* camera = find_present_camera(enumerator, name, &index);
+    if (camera == NULL)
+        return 0;
+    camera_list_remove(&enumerator->present, index);
+    if (enumerator->callback)
+        enumerator->callback(camera, false, enumerator->user_data);
+    free_camera_desc(camera);
+    return 1;
+}
+
+static int rescan_camera_devices(camera_enumerator* enumerator, bool notify)
+{
+    char** names = NULL;
+    int count = list_video_nodes(&names);
+    if (count < 0)
+        return 0;
+    camera_desc** results = (camera_desc**)calloc(count ? count : 1, sizeof(camera_desc*));
+    char** misses = (char**)calloc(count ? count : 1, sizeof(char*));
+    camera_desc** probed = (camera_desc**)calloc(count ? count : 1, sizeof(camera_desc*));
+    camera_list found = {0};
+    if (results && misses && probed)
+    {
+        // Known devices first, only the unknown ones pay for a probe, all of them concurrently
+        uint32_t miss_count = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            results[i] = find_cached_camera(enumerator, names[i]);
+            if (results[i] == NULL)
+                misses[miss_count++] = names[i];
+        }
+        probe_camera_nodes(misses, miss_count, CAMERA_PROBE_THREADS, CAMERA_PROBE_TIMEOUT_MS, probed);
+        for (int i = 0, miss = 0; i < count; ++i)
+        {
+            if (results[i] == NULL && (uint32_t)miss < miss_count && misses[miss] == names[i])
+            {
+                results[i] = probed[miss++];
+                if (results[i])
+                    cache_camera_desc(enumerator, results[i]);
+            }
+            if (results[i] && camera_list_append(&found, results[i]))
+                free_camera_desc(results[i]);
+        }
+    }
+    free(probed);
+    free(misses);
+    free(results);
+    free_video_nodes(names, count);
+
+    camera_hotplug_callback callback = enumerator->callback;
+    if (!notify)
+        enumerator->callback = NULL;
+    int changes = 0;
+    // Gone, or another device took the node over
+    for (size_t i = enumerator->present.count; i-- > 0;)
+    {
+        const camera_desc* camera = enumerator->present.cameras[i];
+        bool kept = false;
+        for (size_t j = 0; j < found.count && !kept; ++j)
+            kept = same_string(found.cameras[j]->device_id.devPath, camera->device_id.devPath) && same_camera_identity(found.cameras[j], camera);
+        if (!kept)
+            changes += remove_present_camera(enumerator, camera->device_id.devPath);
+    }
+    for (size_t i = 0; i < found.count; ++i)
+    {
+        camera_desc* camera = found.cameras[i];
+        found.cameras[i] = NULL;
+        if (find_present_camera(enumerator, camera->device_id.devPath, NULL) || camera_list_append(&enumerator->present, camera))
+        {
+            free_camera_desc(camera);
+            continue;
+        }
+        if (enumerator->callback)
+            enumerator->callback(camera, true, enumerator->user_data);
+        changes++;
+    }
+    free(found.cameras);
+    enumerator->callback = callback;
+    return changes;
+}
+
+static void load_camera_cache(camera_enumerator* enumerator)
+{
+    size_t size = 0;
+    const camera_flat_list* flat = map_camera_flat_list(enumerator->cache_path, &size);
+    if (flat == NULL)
+        return;
+    for (uint32_t i = 0; i < flat->camera_count && enumerator->known.count < CAMERA_CACHE_MAX_ENTRIES; ++i)
+    {
+        camera_desc* camera = camera_desc_from_flat(flat, camera_flat_list_camera(flat, i));
+        if (camera && camera_list_append(&enumerator->known, camera))
+            free_camera_desc(camera);
+    }
+    unmap_camera_flat_list(flat, size);
+}
+
+camera_enumerator* create_camera_enumerator(const char* cache_path, camera_hotplug_callback callback, void* user_data)
+{
+    camera_enumerator* enumerator = (camera_enumerator*)calloc(1, sizeof(camera_enumerator));
+    if (enumerator == NULL)
+    {
+        fprintf(stderr, "Failed to allocate camera_enumerator!\n");
+        return NULL;
+    }
+    enumerator->callback = callback;
+    enumerator->user_data = user_data;
+    if (cache_path)
+    {
+        enumerator->cache_path = strclone(cache_path, strlen(cache_path));
+        load_camera_cache(enumerator);
+    }
+
+    // Watching before the scan, a device plugged in meanwhile shows up in one or the other
+    enumerator->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (enumerator->inotify_fd == -1 ||
+        inotify_add_watch(enumerator->inotify_fd, camera_device_directory(), IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO) == -1)
+    {
+        fprintf(stderr, "Failed to watch %s for cameras: %s\n", camera_device_directory(), strerror(errno));
+        if (enumerator->inotify_fd != -1)
+            close(enumerator->inotify_fd);
+        enumerator->inotify_fd = -1;
+    }
+    rescan_camera_devices(enumerator, false);
+    save_camera_enumerator_cache(enumerator);
+    return enumerator;
+}
+
+const camera_list* camera_enumerator_devices(const camera_enumerator* enumerator)
+{
+    return &enumerator->present;
+}
+
+int camera_enumerator_fd(const camera_enumerator* enumerator)
+{
+    return enumerator->inotify_fd;
+}
+
+int poll_camera_enumerator(camera_enumerator* enumerator)
+{
+    if (enumerator->inotify_fd == -1)
+        return 0;
+    alignas(struct inotify_event) char buffer[CAMERA_INOTIFY_BUFFER_SIZE];
+    int changes = 0;
+    bool overflowed = false;
+    for (;;)
+    {
+        ssize_t length = read(enumerator->inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        for (char* position = buffer; position < buffer + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)position;
+            position += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+                overflowed = true;
+            if (event->len == 0 || strncmp(event->name, "video", 5) != 0)
+                continue;
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                changes += remove_present_camera(enumerator, event->name);
+            // Nodes appear before udev grants access, IN_ATTRIB retries the ones that failed to open
+            else if (event->mask & (IN_CREATE | IN_ATTRIB | IN_MOVED_TO))
+                changes += add_present_camera(enumerator, event->name);
+        }
+    }
+    // Events were lost, only a scan can tell what changed
+    if (overflowed)
+        changes += rescan_camera_devices(enumerator, true);
+    return changes;
+}
+
+int refresh_camera_enumerator(camera_enumerator* enumerator)
+{
+    return rescan_camera_devices(enumerator, true);
+}
+
+int save_camera_enumerator_cache(camera_enumerator* enumerator)
+{
+    if (enumerator->cache_path == NULL || !enumerator->cache_dirty)
+        return 0;
+    size_t size = camera_list_flat_size(&enumerator->known);
+    void* buffer = size ? malloc(size) : NULL;
+    int ret = 1;
+    if (buffer && flatten_camera_list(&enumerator->known, buffer, size) == size)
+        ret = write_camera_flat_list(enumerator->cache_path, (const camera_flat_list*)buffer);
+    free(buffer);
+    if (ret == 0)
+        enumerator->cache_dirty = false;
+    return ret;
+}
+
+void destroy_camera_enumerator(camera_enumerator* enumerator)
+{
+    if (enumerator == NULL)
+        return;
+    save_camera_enumerator_cache(enumerator);
+    if (enumerator->inotify_fd != -1)
+        close(enumerator->inotify_fd);
+    clear_camera_list(&enumerator->present);
+    clear_camera_list(&enumerator->known);
+    free(enumerator->cache_path);
+    free(enumerator);
+}
+
+/**
+ * @brief Stamps a dequeued buffer, the decode and conversion stamps are left to the H264 path.
+ *
+ * The driver timestamp is only kept when it is on CLOCK_MONOTONIC, UVC drivers can be switched
+ * to the realtime clock which would not compare with the other stamps.
+ */
+static inline void stamp_dequeued_frame(const struct v4l2_buffer *buf, camera_frame_times *times)
+{
+    if (times == NULL)
+        return;
+    times->dequeue_ns = monotonic_now_ns();
+    times->capture_ns = 0;
+    times->decode_ns = 0;
+    times->convert_ns = 0;
+    if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    {
+        uint64_t capture_ns = (uint64_t)buf->timestamp.tv_sec * 1000000000ull + (uint64_t)buf->timestamp.tv_usec * 1000ull;
+        times->capture_ns = capture_ns <= times->dequeue_ns ? capture_ns : 0;
+    }
+}
+
+/**
+ * @brief Decode an AV packet and convert it to RGB format.
+ *
+ * @param codec_context Pointer to the AVCodecContext.
+ * @param sws_ctx Pointer to the SwsContext for pixel format conversion.
+ * @param packet Pointer to the AVPacket to decode.
+ * @param frame Pointer to the AVFrame to store the decoded frame.
+ * @param rgb_frame Pointer to the AVFrame to store the RGB frame.
+ * @param rgb_buffer Pointer to the buffer to store RGB data.
+ * @param width Width of the image in pixels.
+ * @param height Height of the image in pixels.
+ * @param times Receives the decode and conversion times of the frame, may be NULL.
+ * @return 0 on success, or error code on failure.
+ */
+static inline int decode_packet(AVCodecContext *codec_context, struct SwsContext* sws_ctx, AVPacket *packet, AVFrame *frame, AVFrame *rgb_frame, unsigned char *rgb_buffer, int width, int height, camera_frame_times *times) {
+    int response = avcodec_send_packet(codec_context, packet);
+    if (response < 0) {
+        fprintf(stderr,"Error while sending a packet to the decoder");
+        return response;
+    }
+    while (response >= 0) {
+        response = avcodec_receive_frame(codec_context, frame);
+        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+            break;
+        } else if (response < 0) {
+            fprintf(stderr,"Error while receiving a frame from the decoder");
+            return response;
+        }
+
+        if (response >= 0) {
+            // Frames still in flight from before a resolution change
+            if (frame->width != width || frame->height != height)
+                continue;
+            if (times)
+                times->decode_ns = monotonic_now_ns();
+
+            // Perform the scaling.
+            sws_scale(sws_ctx, (const uint8_t* const*) frame->data, frame->linesize, 0, height, rgb_frame->data, rgb_frame->linesize);
+
+            // Now rgb_frame contains the image in RGB format. You can copy it to your buffer.
+            int numBytes = av_image_get_buffer_size(rgb_frame->format, rgb_frame->width, rgb_frame->height, 1);
+            av_image_copy_to_buffer(rgb_buffer, numBytes, (const uint8_t * const *)rgb_frame->data, rgb_frame->linesize, rgb_frame->format, rgb_frame->width, rgb_frame->height, 1);
+            if (times)
+                times->convert_ns = monotonic_now_ns();
+        }
+    }
+    return 0;
+}
+
+static inline int initialize_avcodec(AVCodec** outVidCodec, AVCodecContext** outVidCodecContext)
+{
+    *outVidCodec = (AVCodec*) avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (*outVidCodec == NULL) {
+        fprintf(stderr,"Unable to find codec!\n");
+        return 1;
+    }
+
+    *outVidCodecContext = avcodec_alloc_context3(*outVidCodec);
+    if (avcodec_open2(*outVidCodecContext, *outVidCodec, NULL) < 0) {
+        fprintf(stderr,"Unable to open codec!\n");
+        return 1;
+    }
+    return 0;
+}
+
+static inline int initialize_swscale(uint32_t width, uint32_t height, AVCodecContext* vidcodecContext, struct SwsContext** outSwsContext)
+{
+    *outSwsContext = sws_getContext(width, height, vidcodecContext->pix_fmt,
+                                        width, height, AV_PIX_FMT_RGB24,
+                                        SWS_BILINEAR, NULL, NULL, NULL);
+
+    if (*outSwsContext == NULL) {
+        fprintf(stderr,"Could not initialize the conversion context\n");
+        return 1;
+    }
+    return 0;
+}
+
+static inline int set_v4l2_frame_rate(int fd, uint32_t fps)
+{
+    struct v4l2_streamparm setfps;
+    memset(&setfps, 0, sizeof(struct v4l2_streamparm));
+    setfps.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    setfps.parm.capture.timeperframe.numerator = 1;
+    setfps.parm.capture.timeperframe.denominator = fps;
+
+    if (ioctl(fd, VIDIOC_S_PARM, &setfps) == -1) {
+        fprintf(stderr,"Fail to set frame rate\n");
+        return 1;
+    }
+    return 0;
+}
+
+static inline int set_v4l2_videocapture_format_fps(int fd, uint32_t width, uint32_t height, uint32_t fps, uint32_t v4l2_pixfmt)
+{
+    struct v4l2_format format;
+    memset(&format, 0, sizeof(struct v4l2_format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.pixelformat = v4l2_pixfmt;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (ioctl(fd, VIDIOC_S_FMT, &format) == -1) {
+        fprintf(stderr,"Fail to set Pixel Format\n");
+        return 1;
+    }
+
+    // Drivers silently substitute what they cannot deliver, raw consumers depend on the exact layout
+    if (format.fmt.pix.pixelformat != v4l2_pixfmt || format.fmt.pix.width != width || format.fmt.pix.height != height)
+    {
+        fprintf(stderr,"Device does not support the requested format, got %ux%u\n", format.fmt.pix.width, format.fmt.pix.height);
+        return 1;
+    }
+    return set_v4l2_frame_rate(fd, fps);
+}
+
+static inline int set_v4l2_control(int fd, uint32_t id, int32_t value)
+{
+    struct v4l2_control control = {0};
+    control.id = id;
+    control.value = value;
+    return ioctl(fd, VIDIOC_S_CTRL, &control) == -1 ? 1 : 0;
+}
+
+static int set_v4l2_exposure(int fd, int32_t exposure)
+{
+    if (exposure == CAMERA_EXPOSURE_UNCHANGED)
+        return 0;
+    if (exposure == CAMERA_EXPOSURE_AUTO)
+    {
+        // UVC webcams usually only offer aperture priority as their automatic mode
+        if (set_v4l2_control(fd, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_APERTURE_PRIORITY) &&
+            set_v4l2_control(fd, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_AUTO))
+        {
+            fprintf(stderr,"Fail to enable automatic exposure\n");
+            return 1;
+        }
+        return 0;
+    }
+    if (set_v4l2_control(fd, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL) ||
+        set_v4l2_control(fd, V4L2_CID_EXPOSURE_ABSOLUTE, exposure))
+    {
+        fprintf(stderr,"Fail to set exposure to %d\n", exposure);
+        return 1;
     }
+    return 0;
+}
 
-    // Set video format and framerate
-    if (set_v4l2_videocapture_format_fps(fd, width, height, fps))
+#define CAPTURE_BUFFER_COUNT 4
+
+// Memory mapped driver buffers of a capture, rebuilt when the resolution changes
+typedef struct
+{
+    unsigned char* buffers[CAPTURE_BUFFER_COUNT];
+    size_t lengths[CAPTURE_BUFFER_COUNT];
+    uint32_t count;
+    bool streaming;
+} capture_buffers;
+
+static int queue_capture_buffers(int fd, capture_buffers* capture)
+{
+    for (uint32_t i = 0; i < capture->count; ++i)
     {
-        fprintf(stderr,"Fail to set video capture format and fps\n");
-        ret = 1;
-        goto cleanup_fd;
+        struct v4l2_buffer buf = {0};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (ioctl(fd, VIDIOC_QBUF, &buf) == -1) {
+            fprintf(stderr,"Fail to queue buffer\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int stream_on(int fd, capture_buffers* capture)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd, VIDIOC_STREAMON, &type) == -1) {
+        fprintf(stderr,"Fail to start capture\n");
+        return 1;
     }
+    capture->streaming = true;
+    return 0;
+}
+
+// Also returns every buffer to the application, queue_capture_buffers hands them back
+static void stream_off(int fd, capture_buffers* capture)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (capture->streaming)
+        ioctl(fd, VIDIOC_STREAMOFF, &type);
+    capture->streaming = false;
+}
 
-    // Request buffer for mmap
-    req.count = 1;
+/**
+ * @brief Requests, maps and queues the driver buffers for the current format.
+ *
+ * Several buffers let the driver fill the next frame while the callback processes the current one.
+ */
+static int map_capture_buffers(int fd, capture_buffers* capture)
+{
+    struct v4l2_requestbuffers req = {0};
+    req.count = CAPTURE_BUFFER_COUNT;
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
-    if (ioctl(fd, VIDIOC_REQBUFS, &req) == -1) {
+    if (ioctl(fd, VIDIOC_REQBUFS, &req) == -1 || req.count == 0) {
         fprintf(stderr,"Fail to request buffer\n");
+        return 1;
+    }
+    capture->count = req.count > CAPTURE_BUFFER_COUNT ? CAPTURE_BUFFER_COUNT : req.count;
+
+    for (uint32_t i = 0; i < capture->count; ++i)
+    {
+        struct v4l2_buffer buf = {0};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (ioctl(fd, VIDIOC_QUERYBUF, &buf) == -1) {
+            fprintf(stderr,"Fail to query buffer\n");
+            return 1;
+        }
+        capture->buffers[i] = (unsigned char*)mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+        if (capture->buffers[i] == MAP_FAILED)
+        {
+            capture->buffers[i] = NULL;
+            fprintf(stderr, "Failed to allocate mmap for buffer\n");
+            return 1;
+        }
+        capture->lengths[i] = buf.length;
+    }
+    return queue_capture_buffers(fd, capture);
+}
+
+static void unmap_capture_buffers(int fd, capture_buffers* capture)
+{
+    stream_off(fd, capture);
+    for (uint32_t i = 0; i < CAPTURE_BUFFER_COUNT; ++i)
+    {
+        if (capture->buffers[i] != NULL && munmap(capture->buffers[i], capture->lengths[i]) == -1)
+            fprintf(stderr, "Failed to unmap memory\n");
+        capture->buffers[i] = NULL;
+        capture->lengths[i] = 0;
+    }
+    // Releasing the buffers is required before the format can change
+    struct v4l2_requestbuffers req = {0};
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    ioctl(fd, VIDIOC_REQBUFS, &req);
+    capture->count = 0;
+}
+
+/**
+ * @brief Moves a streaming capture from current to requested settings at a frame boundary.
+ *
+ * Only what differs is touched: exposure is a control write, a new frame rate is applied while
+ * streaming when the driver allows it and with a stream restart otherwise, and only a new
+ * resolution remaps the buffers. The device stays open throughout. A setting the device rejects
+ * is reverted, current always describes what the device is running with.
+ *
+ * @return 0 when capturing can continue, 1 when the device was left unusable.
+ */
+static int reconfigure_capture(int fd, uint32_t v4l2_pixfmt, capture_buffers* capture, camera_capture_settings* current, const camera_capture_settings* requested)
+{
+    if (requested->exposure != current->exposure && !set_v4l2_exposure(fd, requested->exposure))
+        current->exposure = requested->exposure;
+
+    if (requested->width != current->width || requested->height != current->height)
+    {
+        unmap_capture_buffers(fd, capture);
+        if (set_v4l2_videocapture_format_fps(fd, requested->width, requested->height, requested->fps, v4l2_pixfmt) == 0)
+        {
+            current->width = requested->width;
+            current->height = requested->height;
+            current->fps = requested->fps;
+        }
+        else
+        {
+            fprintf(stderr,"Keeping %ux%u at %u fps\n", current->width, current->height, current->fps);
+            if (set_v4l2_videocapture_format_fps(fd, current->width, current->height, current->fps, v4l2_pixfmt))
+                return 1;
+        }
+        if (map_capture_buffers(fd, capture) || stream_on(fd, capture))
+            return 1;
+    }
+    else if (requested->fps != current->fps)
+    {
+        struct v4l2_streamparm setfps = {0};
+        setfps.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        setfps.parm.capture.timeperframe.numerator = 1;
+        setfps.parm.capture.timeperframe.denominator = requested->fps;
+        if (ioctl(fd, VIDIOC_S_PARM, &setfps) == 0)
+        {
+            current->fps = requested->fps;
+        }
+        else if (errno == EBUSY)
+        {
+            // Most UVC drivers refuse a new interval while streaming, the buffers stay mapped
+            stream_off(fd, capture);
+            if (set_v4l2_frame_rate(fd, requested->fps) == 0)
+                current->fps = requested->fps;
+            if (queue_capture_buffers(fd, capture) || stream_on(fd, capture))
+                return 1;
+        }
+        else
+        {
+            fprintf(stderr,"Fail to set frame rate, keeping %u fps\n", current->fps);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Asks the control callback for new settings and applies them between two frames.
+ *
+ * @return 0 when capturing can continue, 1 on a fatal device error.
+ */
+static int poll_capture_control(int fd, uint32_t v4l2_pixfmt, capture_buffers* capture, camera_capture_settings* current, capture_control_callback control, void* user_data)
+{
+    if (control == NULL)
+        return 0;
+    camera_capture_settings requested = *current;
+    if (!control(&requested, user_data))
+        return 0;
+    if (requested.width == 0 || requested.height == 0 || requested.fps == 0)
+        return 0;
+    return reconfigure_capture(fd, v4l2_pixfmt, capture, current, &requested);
+}
+
+int start_capture(const char* pathToCamera, uint32_t width, uint32_t height, uint32_t fps, decoded_rgb_frame_buffer_callback callback, atomic_int *quit)
+{
+    camera_capture_settings settings = { width, height, fps, CAMERA_EXPOSURE_UNCHANGED };
+    return start_capture_controlled(pathToCamera, &settings, callback, NULL, NULL, NULL, quit);
+}
+
+int start_capture_controlled(const char* pathToCamera, const camera_capture_settings* initial_settings, decoded_rgb_frame_buffer_callback callback, capture_control_callback control, void* user_data, camera_frame_times *times, atomic_int *quit)
+{
+    int ret = 0;
+
+    if (callback == NULL)
+    {
+        fprintf(stderr, "Callback for processing rgb frame buffer cannot be null!\n");
+        return 1;
+    }
+
+    if (quit == NULL || initial_settings == NULL)
+    {
+        fprintf(stderr, "Atomic quit integer reference cannot be null!\n");
+        return 1;
+    }
+
+    // Initialize FFmpeg and V4L2 related variables
+    camera_capture_settings settings = *initial_settings;
+    uint32_t width = settings.width;
+    uint32_t height = settings.height;
+    AVCodec *vidCodec = NULL;
+    AVCodecContext *vidcodec_context = NULL;
+    struct SwsContext* sws_ctx = NULL;
+    int fd = -1;
+    capture_buffers capture = {0};
+    AVPacket *packet = NULL;
+    AVFrame *frame = NULL;
+    AVFrame *rgb_frame = NULL;
+
+    // Allocate RGB buffer
+    unsigned char* rgb_buffer = (unsigned char*) malloc(width * height * 3);
+    if (!rgb_buffer)
+    {
+        fprintf(stderr, "Failed to allocate rgb_buffer\n");
         ret = 1;
-        goto cleanup_fd;
+        goto fail;
+    }
+
+    // Initialize video codec
+    if (initialize_avcodec(&vidCodec, &vidcodec_context))
+    {
+        fprintf(stderr,"Failed to initialize avcodec!\n");
+        ret = 1;
+        goto cleanup_avcodec;
+    }
+
+    // Set pixel format
+    vidcodec_context->pix_fmt = AV_PIX_FMT_YUV420P;
+
+    // Initialize scaling context
+    if (initialize_swscale(width, height, vidcodec_context, &sws_ctx))
+    {
+        fprintf(stderr,"Failed to initialize swscale\n");
+        ret = 1;
+        goto cleanup_swscale;
     }
 
-    // Query buffer properties
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    buf.index = 0;
-    if (ioctl(fd, VIDIOC_QUERYBUF, &buf) == -1) {
-        fprintf(stderr,"Fail to query buffer\n");
+    // Open video device
+    fd = open(pathToCamera, O_RDWR);
+    if (fd == -1) {
+        fprintf(stderr,"Opening video device\n");
         ret = 1;
         goto cleanup_fd;
     }
 
-    // Memory map the buffer
-    buffer = (unsigned char*)mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
-    if (buffer == MAP_FAILED)
+    // Set video format and framerate
+    if (set_v4l2_videocapture_format_fps(fd, width, height, settings.fps, V4L2_PIX_FMT_H264))
     {
-        fprintf(stderr, "Failed to allocate mmap for buffer\n");
+        fprintf(stderr,"Fail to set video capture format and fps\n");
         ret = 1;
         goto cleanup_fd;
     }
+    set_v4l2_exposure(fd, settings.exposure);
+
+    // Request, map and queue the buffers
+    if (map_capture_buffers(fd, &capture))
+    {
+        ret = 1;
+        goto cleanup_frame;
+    }
 
     // Initialize AVPacket
-    //av_init_packet(&packet);
+    packet = av_packet_alloc();
+    if (!packet)
+    {
+        fprintf(stderr,"Could not allocate packet\n");
+        ret = 1;
+        goto cleanup_frame;
+    }
 
     // Allocate YUV and RGB frames
     frame = av_frame_alloc();
@@ -1139,33 +2196,33 @@ int start_capture(const char* pathToCamera, uint32_t width, uint32_t height, uin
     rgb_frame->height = height;
 
     av_image_alloc(rgb_frame->data, rgb_frame->linesize, width, height, AV_PIX_FMT_RGB24, 1);
-    while (!*quit){
 
-        // Queue buffer for capture
-        if (ioctl(fd, VIDIOC_QBUF, &buf) == -1) {
-            fprintf(stderr,"Fail to queue buffer\n");
-            ret = 1;
-            goto cleanup_rgb_frame;
-        }
+    // Start capturing
+    if (stream_on(fd, &capture))
+    {
+        ret = 1;
+        goto cleanup_rgb_frame;
+    }
+
+    while (!*quit){
 
-        // Start capturing
-        if (ioctl(fd, VIDIOC_STREAMON, &buf.type) == -1) {
-            fprintf(stderr,"Fail to start capture\n");
-            ret = 1;
-            goto cleanup_rgb_frame;
-        }
-        
         // Dequeue the filled buffer
+        struct v4l2_buffer buf = {0};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
         if (ioctl(fd, VIDIOC_DQBUF, &buf) == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
             fprintf(stderr,"Fail to retrieve frame\n");
             ret = 1;
             goto cleanup_rgb_frame;
         }
+        stamp_dequeued_frame(&buf, times);
 
         // Decode the received packet
-        packet->data = buffer;
+        packet->data = capture.buffers[buf.index];
         packet->size = buf.bytesused;
-        if (decode_packet(vidcodec_context, sws_ctx, packet, frame, rgb_frame, rgb_buffer, width, height))
+        if (decode_packet(vidcodec_context, sws_ctx, packet, frame, rgb_frame, rgb_buffer, width, height, times))
         {
             fprintf(stderr,"Failed to decode packet!\n");
             ret = 1;
@@ -1174,6 +2231,40 @@ int start_capture(const char* pathToCamera, uint32_t width, uint32_t height, uin
 
         // Run the callback for further processing
         callback(rgb_buffer, width, height);
+
+        // Queue buffer for capture
+        if (ioctl(fd, VIDIOC_QBUF, &buf) == -1) {
+            fprintf(stderr,"Fail to queue buffer\n");
+            ret = 1;
+            goto cleanup_rgb_frame;
+        }
+
+        // Frame boundary, apply new settings before the next frame is dequeued
+        if (poll_capture_control(fd, V4L2_PIX_FMT_H264, &capture, &settings, control, user_data))
+        {
+            ret = 1;
+            goto cleanup_rgb_frame;
+        }
+        if (settings.width != width || settings.height != height)
+        {
+            // The decoder is kept and only flushed, the restarted stream begins with a new key frame
+            width = settings.width;
+            height = settings.height;
+            avcodec_flush_buffers(vidcodec_context);
+            sws_ctx = sws_getCachedContext(sws_ctx, width, height, AV_PIX_FMT_YUV420P, width, height, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
+            unsigned char* resized = (unsigned char*)realloc(rgb_buffer, width * height * 3);
+            if (sws_ctx == NULL || resized == NULL)
+            {
+                fprintf(stderr,"Failed to resize the conversion for %ux%u\n", width, height);
+                ret = 1;
+                goto cleanup_rgb_frame;
+            }
+            rgb_buffer = resized;
+            av_freep(&rgb_frame->data[0]);
+            rgb_frame->width  = width;
+            rgb_frame->height = height;
+            av_image_alloc(rgb_frame->data, rgb_frame->linesize, width, height, AV_PIX_FMT_RGB24, 1);
+        }
     }
 cleanup_rgb_frame:
     if (rgb_frame) {
@@ -1189,12 +2280,7 @@ cleanup_frame:
     }
 
     av_packet_free(&packet);
-    if (buffer != NULL && buffer != MAP_FAILED) {
-        if (munmap(buffer, buf.length) == -1) {
-            fprintf(stderr, "Failed to unmap memory\n");
-        }
-        buffer = NULL;
-    }
+    unmap_capture_buffers(fd, &capture);
 
 cleanup_fd:
     if (fd != -1) {
@@ -1220,4 +2306,102 @@ cleanup_avcodec:
 
 fail:
     return ret;
-}
\ No newline at end of file
+}
+
+static size_t raw_frame_size(camera_pixel_format format, uint32_t width, uint32_t height)
+{
+    return format == camera_pixel_format_NV12 ? (size_t)width * height * 3 / 2 : (size_t)width * height * 2;
+}
+
+int start_raw_capture(const char* pathToCamera, uint32_t width, uint32_t height, uint32_t fps, camera_pixel_format format, raw_frame_buffer_callback callback, void* user_data, atomic_int *quit)
+{
+    camera_capture_settings settings = { width, height, fps, CAMERA_EXPOSURE_UNCHANGED };
+    return start_raw_capture_controlled(pathToCamera, &settings, format, callback, NULL, user_data, NULL, quit);
+}
+
+int start_raw_capture_controlled(const char* pathToCamera, const camera_capture_settings* initial_settings, camera_pixel_format format, raw_frame_buffer_callback callback, capture_control_callback control, void* user_data, camera_frame_times *times, atomic_int *quit)
+{
+    int ret = 0;
+    int fd = -1;
+    uint32_t v4l2_pixfmt = 0;
+    capture_buffers capture = {0};
+
+    if (callback == NULL || quit == NULL || initial_settings == NULL)
+    {
+        fprintf(stderr, "Callback and atomic quit integer reference cannot be null!\n");
+        return 1;
+    }
+    camera_capture_settings settings = *initial_settings;
+
+    switch (format)
+    {
+        case camera_pixel_format_YUYV:
+            v4l2_pixfmt = V4L2_PIX_FMT_YUYV;
+            break;
+        case camera_pixel_format_NV12:
+            v4l2_pixfmt = V4L2_PIX_FMT_NV12;
+            break;
+        default:
+            fprintf(stderr, "Raw capture supports YUYV and NV12 only, got %s\n", camera_pixel_format_to_str(format));
+            return 1;
+    }
+
+    fd = open(pathToCamera, O_RDWR);
+    if (fd == -1) {
+        fprintf(stderr,"Opening video device\n");
+        return 1;
+    }
+
+    if (set_v4l2_videocapture_format_fps(fd, settings.width, settings.height, settings.fps, v4l2_pixfmt))
+    {
+        fprintf(stderr,"Fail to set video capture format and fps\n");
+        ret = 1;
+        goto cleanup;
+    }
+    set_v4l2_exposure(fd, settings.exposure);
+
+    if (map_capture_buffers(fd, &capture) || stream_on(fd, &capture))
+    {
+        ret = 1;
+        goto cleanup;
+    }
+
+    while (!*quit)
+    {
+        struct v4l2_buffer buf = {0};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(fd, VIDIOC_DQBUF, &buf) == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            fprintf(stderr,"Fail to retrieve frame\n");
+            ret = 1;
+            goto cleanup;
+        }
+        stamp_dequeued_frame(&buf, times);
+
+        // Short frames happen when the device drops data, hand over complete frames only
+        size_t frame_size = raw_frame_size(format, settings.width, settings.height);
+        if (buf.bytesused >= frame_size && !(buf.flags & V4L2_BUF_FLAG_ERROR))
+            callback(capture.buffers[buf.index], frame_size, settings.width, settings.height, format, user_data);
+
+        if (ioctl(fd, VIDIOC_QBUF, &buf) == -1) {
+            fprintf(stderr,"Fail to queue buffer\n");
+            ret = 1;
+            goto cleanup;
+        }
+
+        // Frame boundary, apply new settings before the next frame is dequeued
+        if (poll_capture_control(fd, v4l2_pixfmt, &capture, &settings, control, user_data))
+        {
+            ret = 1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    unmap_capture_buffers(fd, &capture);
+    if (fd != -1)
+        close(fd);
+    return ret;
+}
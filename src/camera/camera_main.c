@@ -1,6 +1,483 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
 #include "camera.h"
+#include "computebackend.h"
+#include "network.h"
+#include "preview.h"
+#include "latency.h"
 
-int main(int argc, const char* argv[argc])
+#define WORKER_MAX_PENDING_COMMANDS 32
+// Every other column and row of the calibration region is enough for its histograms
+#define WORKER_CALIBRATION_SAMPLE_STEP 2
+
+_Static_assert(CAMERA_EXPOSURE_UNCHANGED == WORKER_EXPOSURE_UNCHANGED && CAMERA_EXPOSURE_AUTO == WORKER_EXPOSURE_AUTO,
+    "Worker exposure values are passed through to the capture");
+_Static_assert(WORKER_MAX_MARKERS <= MAX_TRACKING_MARKERS, "Worker markers must fit the tracker");
+
+// State of the single camera this process tracks
+typedef struct
+{
+    uint32_t camera_id;
+    const char* device;
+    camera_pixel_format capture_format;
+    enum TrackingPixelFormat tracking_format;
+    WorkerSettings settings;            // Requested by the command line and the monitor
+    WorkerSettings published;           // Last settings written to the heartbeat
+    bool colors_changed;
+    bool shader_changed;                // The control holds a shader the tracker has not been given
+    bool calibration_requested;         // The histograms of calibration are to be requested with the next frame
+    WorkerCommand calibration;          // Latest WorkerCommandCalibrateMarker
+    uint32_t calibrating_marker;        // Marker of the histograms the tracker is building
+    MarkerColorRange calibrated[WORKER_MAX_MARKERS];    // Derived ranges, already in the tracking format
+    uint32_t calibrated_markers;        // Bit per marker tracked with its calibrated range instead of the settings
+    ComputeBackend backend;
+    BackendTracker tracker;
+    MarkerCentroid centroids[MAX_TRACKING_MARKERS];
+    CoordinateRing ring;
+    WorkerControl control;
+    PreviewWriter preview;              // NULL when the channel could not be created for this frame size
+    uint32_t preview_width;             // Frame size the preview channel was last created for
+    uint32_t preview_height;
+    WorkerHeartbeat* heartbeat;
+    LatencyRecorder latency;
+    camera_frame_times times;           // Filled by the capture before each frame callback
+    camera_frame_times pending_times[TRACKING_FRAMES_IN_FLIGHT];  // Of the frames still in the tracker
+    uint64_t submitted_frames;
+    uint64_t frame_sequence;            // Frames published, the next one collected is this one
+} camera_worker;
+
+// start_capture's decoded frame callback carries no user data, one worker per process anyway
+static camera_worker worker;
+static atomic_int quit;
+
+static void handle_quit_signal(int signal)
+{
+    (void)signal;
+    atomic_store(&quit, 1);
+}
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void publish_settings()
+{
+    if (worker.heartbeat && memcmp(&worker.published, &worker.settings, sizeof(worker.settings)) != 0)
+    {
+        PublishWorkerSettings(worker.heartbeat, &worker.settings);
+        worker.published = worker.settings;
+    }
+}
+
+/**
+ * @brief Creates the tracker on the first frame and recreates it when the frame size or the
+ * marker count changed, everything else is updated in place.
+ */
+static bool ensure_tracker(uint32_t width, uint32_t height)
+{
+    BackendTracker tracker = worker.tracker;
+    if (tracker && tracker->width == width && tracker->height == height && tracker->markerCount == worker.settings.markerCount)
+        return true;
+    // Frames still pending in the old tracker are dropped with it
+    DestroyBackendTracker(tracker);
+    worker.submitted_frames = worker.frame_sequence;
+    worker.tracker = CreateBackendTracker(worker.backend, width, height, worker.tracking_format, worker.settings.markerCount);
+    worker.colors_changed = true;
+    // A rebuilt tracker starts from the shipped shader, the last reloaded one is applied again
+    worker.shader_changed = WorkerControlShader(worker.control) != NULL;
+    if (worker.tracker == NULL)
+    {
+        fprintf(stderr, "Camera %u: failed to create a %ux%u tracker\n", worker.camera_id, width, height);
+        return false;
+    }
+    return true;
+}
+
+static void apply_marker_colors()
+{
+    for (uint32_t i = 0; i < worker.settings.markerCount; ++i)
+    {
+        if (worker.calibrated_markers & (1u << i))
+        {
+            BackendTrackerSetMarkerRange(worker.tracker, i, worker.calibrated[i]);
+            continue;
+        }
+        const uint8_t* min = worker.settings.markerMin[i];
+        const uint8_t* max = worker.settings.markerMax[i];
+        MarkerColorRange range = { min[0], min[1], min[2], max[0], max[1], max[2] };
+        // Unset markers keep their empty range, the YUV conversion would widen it
+        if (min[0] > max[0] || min[1] > max[1] || min[2] > max[2])
+            BackendTrackerSetMarkerRange(worker.tracker, i, range);
+        else
+            BackendTrackerSetMarkerColor(worker.tracker, i, range);
+    }
+    worker.colors_changed = false;
+}
+
+/**
+ * @brief Requests the calibration histograms over the frame just submitted and applies the range
+ * derived from them once the backend built them, polled once per frame so tracking never waits.
+ */
+static void update_calibration()
+{
+    BackendTracker tracker = worker.tracker;
+    if (worker.calibration_requested && !tracker->histogramsRequested)
+    {
+        uint32_t marker = worker.calibration.calibration.marker;
+        TrackingWindow region = { worker.calibration.calibration.x, worker.calibration.calibration.y,
+            worker.calibration.calibration.width, worker.calibration.calibration.height };
+        worker.calibrating_marker = marker;
+        if (!BackendTrackerRequestHistograms(tracker, region, WORKER_CALIBRATION_SAMPLE_STEP))
+            fprintf(stderr, "Camera %u: cannot calibrate marker %u from %ux%u at (%u, %u) in a %ux%u frame\n", worker.camera_id, marker,
+                region.width, region.height, region.x, region.y, tracker->width, tracker->height);
+        worker.calibration_requested = false;
+    }
+    ColorHistogramGPU histograms[2];
+    if (!tracker->histogramsRequested || !BackendTrackerCollectHistograms(tracker, false, histograms))
+        return;
+    uint32_t marker = worker.calibrating_marker;
+    ColorCalibrationResult result = DeriveColorCalibration(&histograms[0], &histograms[1]);
+    if (result.regionPixels == 0)
+        return;
+    worker.calibrated[marker] = result.range;
+    worker.calibrated_markers |= 1u << marker;
+    worker.colors_changed = true;
+    printf("Camera %u: marker %u calibrated to %u,%u,%u-%u,%u,%u, covering %.0f%% of the region and %.1f%% of the background\n",
+        worker.camera_id, marker, result.range.minR, result.range.minG, result.range.minB, result.range.maxR, result.range.maxG, result.range.maxB,
+        result.regionCoverage * 100.0f, result.backgroundLeak * 100.0f);
+}
+
+/**
+ * @brief Publishes the centroids of a collected frame with the stamps it was captured with.
+ */
+static void publish_frame(const camera_frame_times* times)
+{
+    LatencyStamps stamps = { 0 };
+    stamps.stampNs[LatencyStageCapture] = times->capture_ns;
+    stamps.stampNs[LatencyStageDequeue] = times->dequeue_ns;
+    stamps.stampNs[LatencyStageDecode] = times->decode_ns;
+    stamps.stampNs[LatencyStageConvert] = times->convert_ns;
+    StampLatency(&stamps, LatencyStageTrack);
+    // Drivers not stamping with CLOCK_MONOTONIC leave the capture out, the dequeue is the closest
+    uint64_t timestamp = stamps.stampNs[LatencyStageCapture] ? stamps.stampNs[LatencyStageCapture] :
+        stamps.stampNs[LatencyStageDequeue] ? stamps.stampNs[LatencyStageDequeue] : stamps.stampNs[LatencyStageTrack];
+
+    uint32_t marker_count = worker.settings.markerCount;
+    CoordinateRecord records[MAX_TRACKING_MARKERS];
+    for (uint32_t i = 0; i < marker_count; ++i)
+    {
+        const MarkerCentroid* centroid = &worker.centroids[i];
+        CoordinateRecord* record = &records[i];
+        memset(record, 0, sizeof(*record));
+        record->frameSequence = worker.frame_sequence;
+        record->timestampNs = timestamp;
+        record->cameraID = worker.camera_id;
+        record->marker = i;
+        record->flags = (centroid->found ? CoordinateRecordFound : 0) | (i + 1 == marker_count ? CoordinateRecordEndOfFrame : 0);
+        record->pixelCount = centroid->pixelCount;
+        record->x = centroid->x;
+        record->y = centroid->y;
+        record->minX = (uint16_t)centroid->minX;
+        record->minY = (uint16_t)centroid->minY;
+        record->maxX = (uint16_t)centroid->maxX;
+        record->maxY = (uint16_t)centroid->maxY;
+    }
+    StampLatency(&stamps, LatencyStageSend);
+    uint64_t send_delay = stamps.stampNs[LatencyStageSend] - timestamp;
+    for (uint32_t i = 0; i < marker_count; ++i)
+        records[i].sendDelayNs = send_delay < UINT32_MAX ? (uint32_t)send_delay : UINT32_MAX;
+    if (worker.ring)
+        PushCoordinateRecords(worker.ring, marker_count, records);
+    worker.frame_sequence++;
+    RecordFrameLatency(worker.latency, &stamps, stamps.stampNs[LatencyStageSend]);
+
+    if (worker.heartbeat)
+    {
+        atomic_store(&worker.heartbeat->state, WorkerStateRunning);
+        BeatWorkerHeartbeat(worker.heartbeat, monotonic_ns());
+    }
+}
+
+/**
+ * @brief Hands the frame to monitors at the rate they asked for, in the tracking format.
+ *
+ * The channel is recreated when the frame size changes, monitors notice through the published
+ * settings and connect again.
+ */
+static void publish_preview(const uint8_t* frame, size_t size, uint32_t width, uint32_t height)
+{
+    if (worker.preview_width != width || worker.preview_height != height)
+    {
+        DestroyPreviewWriter(worker.preview);
+        uint32_t stride = worker.tracking_format == TrackingPixelFormatRGB24 ? width * 3 :
+            worker.tracking_format == TrackingPixelFormatYUYV ? width * 2 : width;
+        char name[64];
+        snprintf(name, sizeof(name), PREVIEW_SOCKET_NAME_FORMAT, worker.camera_id);
+        // Tracking does not depend on it, a failure is only retried with the next frame size
+        worker.preview = CreatePreviewWriter(name, width, height, (uint32_t)worker.tracking_format, stride, worker.tracker->frameSize);
+        worker.preview_width = width;
+        worker.preview_height = height;
+    }
+    if (worker.preview == NULL || size < worker.preview->info.frameSize)
+        return;
+    ServePreviewClients(worker.preview);
+    uint8_t* slot = BeginPreviewFrame(worker.preview, monotonic_ns());
+    if (slot == NULL)
+        return;
+    memcpy(slot, frame, worker.preview->info.frameSize);
+    EndPreviewFrame(worker.preview, worker.submitted_frames, worker.times.capture_ns ? worker.times.capture_ns : worker.times.dequeue_ns);
+}
+
+static void track_frame(const uint8_t* frame, size_t size, uint32_t width, uint32_t height)
+{
+    if (!ensure_tracker(width, height))
+        return;
+    publish_preview(frame, size, width, height);
+    if (worker.colors_changed)
+        apply_marker_colors();
+    if (worker.shader_changed)
+    {
+        if (!BackendTrackerUpdateShader(worker.tracker, WorkerControlShader(worker.control)))
+            fprintf(stderr, "Camera %u: the %s backend cannot reload the tracking shader\n", worker.camera_id, worker.backend->ops->name);
+        worker.shader_changed = false;
+    }
+    if (worker.tracker->roiMargin != worker.settings.roiMargin)
+        BackendTrackerSetRoiMargin(worker.tracker, worker.settings.roiMargin);
+    if (!BackendTrackerSubmitFrame(worker.tracker, frame, size))
+        return;
+    worker.pending_times[worker.submitted_frames % TRACKING_FRAMES_IN_FLIGHT] = worker.times;
+    worker.submitted_frames++;
+    update_calibration();
+
+    // Frame N-1 is collected after submitting frame N, so the GPU tracks while the capture waits
+    // for the next frame. Only a full tracker waits, frames already done are published right away.
+    while (worker.tracker->pendingFrames > 0)
+    {
+        bool wait = worker.tracker->pendingFrames == TRACKING_FRAMES_IN_FLIGHT;
+        if (!BackendTrackerCollectResults(worker.tracker, wait, worker.centroids))
+        {
+            if (wait)
+                fprintf(stderr, "Camera %u: tracking frame %lu failed\n", worker.camera_id, (unsigned long)worker.frame_sequence);
+            break;
+        }
+        publish_frame(&worker.pending_times[worker.frame_sequence % TRACKING_FRAMES_IN_FLIGHT]);
+    }
+}
+
+static void on_decoded_frame(const uint8_t* rgb_buffer, uint32_t width, uint32_t height)
+{
+    track_frame(rgb_buffer, (size_t)width * height * 3, width, height);
+}
+
+static void on_raw_frame(const uint8_t* frame_buffer, size_t size, uint32_t width, uint32_t height, camera_pixel_format format, void* user_data)
+{
+    (void)format;
+    (void)user_data;
+    track_frame(frame_buffer, size, width, height);
+}
+
+/**
+ * @brief Frame boundary: applies the monitor's commands, tracker changes here and capture
+ * changes through the returned settings.
+ */
+static bool on_frame_boundary(camera_capture_settings* capture, void* user_data)
+{
+    (void)user_data;
+    // The capture reverts what the device rejected, so this is what actually runs
+    worker.settings.width = capture->width;
+    worker.settings.height = capture->height;
+    worker.settings.fps = capture->fps;
+    worker.settings.exposure = capture->exposure;
+    publish_settings();
+
+    if (worker.control == NULL)
+        return false;
+    WorkerCommand commands[WORKER_MAX_PENDING_COMMANDS];
+    uint32_t count = PollWorkerCommands(worker.control, WORKER_MAX_PENDING_COMMANDS, commands);
+    uint32_t changes = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t change = ApplyWorkerCommand(&worker.settings, &commands[i]);
+        changes |= change;
+        if (change & WorkerChangedCalibration)
+            worker.calibration = commands[i];
+        // An explicit colour replaces a calibrated range, even when the settings already held it
+        if (commands[i].type == WorkerCommandSetMarkerColor && commands[i].markerColor.marker < WORKER_MAX_MARKERS &&
+            (worker.calibrated_markers & (1u << commands[i].markerColor.marker)))
+        {
+            worker.calibrated_markers &= ~(1u << commands[i].markerColor.marker);
+            worker.colors_changed = true;
+        }
+    }
+    if (changes == 0)
+        return false;
+
+    if (changes & WorkerChangedStop)
+        atomic_store(&quit, 1);
+    if (changes & WorkerChangedMarkerColors)
+        worker.colors_changed = true;
+    if (changes & WorkerChangedShader)
+        worker.shader_changed = true;
+    if (changes & WorkerChangedCalibration)
+        worker.calibration_requested = true;
+    // Marker count and frame size changes rebuild the tracker, the ROI margin and shader are
+    // applied with the next frame
+    if (!(changes & (WorkerChangedResolution | WorkerChangedFrameRate | WorkerChangedExposure)))
+    {
+        publish_settings();
+        return false;
+    }
+    capture->width = worker.settings.width;
+    capture->height = worker.settings.height;
+    capture->fps = worker.settings.fps;
+    capture->exposure = worker.settings.exposure;
+    return true;
+}
+
+static void print_usage(const char* program)
 {
+    fprintf(stderr,
+        "Usage: %s --camera-id ID --device PATH [options]\n"
+        "  --format h264|yuyv|nv12   Capture format, default h264\n"
+        "  --width W --height H      Capture size, default 640x480\n"
+        "  --fps F                   Frame rate, default 60\n"
+        "  --exposure E              -1 for automatic, 100 us units otherwise, default unchanged\n"
+        "  --markers N               Tracked markers, default 1\n"
+        "  --color I:R,G,B,R,G,B     RGB minimum and maximum of marker I\n"
+        "  --roi-margin M            Margin around predicted marker windows in pixels, 0 tracks whole frames\n"
+        "  --heartbeat-fd FD         Heartbeat block inherited from the supervisor\n",
+        program);
+}
+
+static int parse_arguments(int argc, const char* argv[argc], int* heartbeat_fd)
+{
+    worker.capture_format = camera_pixel_format_H264;
+    worker.settings.width = 640;
+    worker.settings.height = 480;
+    worker.settings.fps = 60;
+    worker.settings.exposure = WORKER_EXPOSURE_UNCHANGED;
+    worker.settings.markerCount = 1;
+    ClearWorkerMarkerColors(&worker.settings);
+    bool has_camera_id = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL)
+            return 1;
+        ++i;
+        if (strcmp(option, "--camera-id") == 0)
+        {
+            worker.camera_id = (uint32_t)strtoul(value, NULL, 10);
+            has_camera_id = true;
+        }
+        else if (strcmp(option, "--device") == 0)
+            worker.device = value;
+        else if (strcmp(option, "--format") == 0)
+        {
+            if (strcmp(value, "h264") == 0)
+                worker.capture_format = camera_pixel_format_H264;
+            else if (strcmp(value, "yuyv") == 0)
+                worker.capture_format = camera_pixel_format_YUYV;
+            else if (strcmp(value, "nv12") == 0)
+                worker.capture_format = camera_pixel_format_NV12;
+            else
+                return 1;
+        }
+        else if (strcmp(option, "--width") == 0)
+            worker.settings.width = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--height") == 0)
+            worker.settings.height = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--fps") == 0)
+            worker.settings.fps = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--exposure") == 0)
+            worker.settings.exposure = (int32_t)strtol(value, NULL, 10);
+        else if (strcmp(option, "--markers") == 0)
+            worker.settings.markerCount = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--roi-margin") == 0)
+            worker.settings.roiMargin = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--heartbeat-fd") == 0)
+            *heartbeat_fd = (int)strtol(value, NULL, 10);
+        else if (strcmp(option, "--color") == 0)
+        {
+            unsigned marker, c[6];
+            if (sscanf(value, "%u:%u,%u,%u,%u,%u,%u", &marker, &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) != 7 || marker >= WORKER_MAX_MARKERS)
+                return 1;
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                worker.settings.markerMin[marker][channel] = (uint8_t)c[channel];
+                worker.settings.markerMax[marker][channel] = (uint8_t)c[channel + 3];
+            }
+        }
+        else
+            return 1;
+    }
+    if (!has_camera_id || worker.device == NULL || worker.settings.width == 0 || worker.settings.height == 0 || worker.settings.fps == 0 ||
+        worker.settings.markerCount == 0 || worker.settings.markerCount > WORKER_MAX_MARKERS)
+        return 1;
+    worker.tracking_format = worker.capture_format == camera_pixel_format_YUYV ? TrackingPixelFormatYUYV :
+        worker.capture_format == camera_pixel_format_NV12 ? TrackingPixelFormatNV12 : TrackingPixelFormatRGB24;
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, const char* argv[argc])
+{
+    int heartbeat_fd = -1;
+    if (parse_arguments(argc, argv, &heartbeat_fd))
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = handle_quit_signal;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    int ret = 1;
+    if (heartbeat_fd >= 0)
+    {
+        worker.heartbeat = MapWorkerHeartbeat(heartbeat_fd);
+        if (worker.heartbeat == NULL)
+            fprintf(stderr, "Camera %u: descriptor %d is not a heartbeat block\n", worker.camera_id, heartbeat_fd);
+    }
+    publish_settings();
+
+    char name[64];
+    snprintf(name, sizeof(name), COORDINATE_RING_NAME_FORMAT, worker.camera_id);
+    worker.ring = CreateCoordinateRing(name);
+    snprintf(name, sizeof(name), WORKER_CONTROL_NAME_FORMAT, worker.camera_id);
+    worker.control = CreateWorkerControl(name);
+    worker.backend = CreateComputeBackend(ComputeBackendAuto, NULL);
+    // The budget is diagnostics only, track without it rather than not at all
+    worker.latency = CreateLatencyRecorder(worker.camera_id, LatencyStageCapture, LatencyStageSend, false);
+    if (worker.ring == NULL || worker.backend == NULL)
+        goto cleanup;
+
+    camera_capture_settings capture = { worker.settings.width, worker.settings.height, worker.settings.fps, worker.settings.exposure };
+    if (worker.capture_format == camera_pixel_format_H264)
+        ret = start_capture_controlled(worker.device, &capture, on_decoded_frame, on_frame_boundary, NULL, &worker.times, &quit);
+    else
+        ret = start_raw_capture_controlled(worker.device, &capture, worker.capture_format, on_raw_frame, on_frame_boundary, NULL, &worker.times, &quit);
+
+cleanup:
+    // A clean exit tells the supervisor not to respawn this worker
+    if (worker.heartbeat && ret == 0)
+        atomic_store(&worker.heartbeat->state, WorkerStateStopped);
+    DestroyBackendTracker(worker.tracker);
+    DestroyComputeBackend(worker.backend);
+    CloseWorkerControl(worker.control);
+    DestroyPreviewWriter(worker.preview);
+    CloseCoordinateRing(worker.ring);
+    DestroyLatencyRecorder(worker.latency);
+    UnmapWorkerHeartbeat(worker.heartbeat);
+    return ret;
+}
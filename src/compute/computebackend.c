@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "computebackend.h"
+
+static enum ComputeBackendType BackendTypeFromEnvironment(enum ComputeBackendType type)
+{
+    if (type != ComputeBackendAuto)
+        return type;
+    const char* value = getenv(COMPUTE_BACKEND_ENVIRONMENT_VARIABLE);
+    if (value == NULL)
+        return ComputeBackendAuto;
+    if (strcmp(value, "vulkan") == 0)
+        return ComputeBackendVulkan;
+    if (strcmp(value, "cpu") == 0)
+        return ComputeBackendCPU;
+    if (value[0] != '\0' && strcmp(value, "auto") != 0)
+        fprintf(stderr, "Unknown %s value \"%s\", expected vulkan, cpu or auto\n", COMPUTE_BACKEND_ENVIRONMENT_VARIABLE, value);
+    return ComputeBackendAuto;
+}
+
+ComputeBackend CreateComputeBackend(enum ComputeBackendType type, const ComputeApplicationCreateInfo* info)
+{
+    type = BackendTypeFromEnvironment(type);
+    ComputeBackend backend = (ComputeBackend)calloc(sizeof(struct ComputeBackend), 1);
+    if (type != ComputeBackendCPU)
+    {
+        if (InitializeVulkanComputeBackend(backend, info))
+        {
+            printf("Using the Vulkan compute backend\n");
+            return backend;
+        }
+        if (type == ComputeBackendVulkan)
+        {
+            fprintf(stderr, "Vulkan compute backend requested but unavailable\n");
+            free(backend);
+            return NULL;
+        }
+        fprintf(stderr, "No usable Vulkan device, falling back to the CPU compute backend\n");
+    }
+    memset(backend, 0, sizeof(*backend));
+    if (!InitializeCPUComputeBackend(backend))
+    {
+        free(backend);
+        return NULL;
+    }
+    printf("Using the CPU compute backend with %u threads\n", backend->threadCount);
+    return backend;
+}
+
+BackendTracker CreateBackendTracker(ComputeBackend backend, uint32_t width, uint32_t height, enum TrackingPixelFormat pixelFormat, uint32_t markerCount)
+{
+    if (backend == NULL || width == 0 || height == 0 || markerCount == 0 || markerCount > MAX_TRACKING_MARKERS)
+        return NULL;
+    size_t frameSize = TrackingFrameSize(width, height, pixelFormat);
+    if (frameSize == 0)
+    {
+        fprintf(stderr, "Unsupported %ux%u frame for tracking pixel format %d\n", width, height, (int)pixelFormat);
+        return NULL;
+    }
+    BackendTracker tracker = (BackendTracker)calloc(sizeof(struct BackendTracker), 1);
+    tracker->backend = backend;
+    tracker->width = width;
+    tracker->height = height;
+    tracker->markerCount = markerCount;
+    tracker->pixelFormat = pixelFormat;
+    tracker->frameSize = frameSize;
+    for (uint32_t i = 0; i < MAX_TRACKING_MARKERS; ++i)
+        tracker->ranges[i] = (MarkerColorRange){ 255, 255, 255, 0, 0, 0 };
+    tracker->rangesChanged = true;
+    if (!backend->ops->createTracker(tracker))
+    {
+        free(tracker);
+        return NULL;
+    }
+    return tracker;
+}
+
+bool BackendTrackerSetMarkerColor(BackendTracker tracker, uint32_t marker, MarkerColorRange range)
+{
+    if (tracker == NULL)
+        return false;
+    if (tracker->pixelFormat != TrackingPixelFormatRGB24)
+        range = ConvertMarkerColorRangeToYUV(range);
+    return BackendTrackerSetMarkerRange(tracker, marker, range);
+}
+
+bool BackendTrackerSetMarkerRange(BackendTracker tracker, uint32_t marker, MarkerColorRange range)
+{
+    if (tracker == NULL || marker >= tracker->markerCount)
+        return false;
+    tracker->ranges[marker] = range;
+    tracker->rangesChanged = true;
+    return true;
+}
+
+void BackendTrackerSetRoiMargin(BackendTracker tracker, uint32_t margin)
+{
+    if (tracker)
+        tracker->roiMargin = margin;
+}
+
+bool BackendTrackerSubmitFrame(BackendTracker tracker, const void* frame, size_t frameSize)
+{
+    if (tracker == NULL || frame == NULL || frameSize < tracker->frameSize || tracker->pendingFrames == TRACKING_FRAMES_IN_FLIGHT)
+        return false;
+    if (!tracker->backend->ops->submitFrame(tracker, frame, frameSize))
+        return false;
+    tracker->pendingFrames++;
+    return true;
+}
+
+bool BackendTrackerCollectResults(BackendTracker tracker, bool wait, MarkerCentroid* out)
+{
+    if (tracker == NULL || out == NULL || tracker->pendingFrames == 0)
+        return false;
+    if (!tracker->backend->ops->collectResults(tracker, wait, out))
+        return false;
+    tracker->pendingFrames--;
+    return true;
+}
+
+bool BackendTrackerRequestHistograms(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep)
+{
+    if (tracker == NULL || tracker->histogramsRequested)
+        return false;
+    if (region.x >= tracker->width || region.y >= tracker->height || region.width == 0 || region.height == 0)
+        return false;
+    if (region.width > tracker->width - region.x)
+        region.width = tracker->width - region.x;
+    if (region.height > tracker->height - region.y)
+        region.height = tracker->height - region.y;
+    if (!tracker->backend->ops->requestHistograms(tracker, region, sampleStep > 0 ? sampleStep : 1))
+        return false;
+    tracker->histogramsRequested = true;
+    return true;
+}
+
+bool BackendTrackerCollectHistograms(BackendTracker tracker, bool wait, ColorHistogramGPU out[2])
+{
+    if (tracker == NULL || out == NULL || !tracker->histogramsRequested)
+        return false;
+    if (!tracker->backend->ops->collectHistograms(tracker, wait, out))
+        return false;
+    tracker->histogramsRequested = false;
+    return true;
+}
+
+bool BackendTrackerComputeHistograms(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep, ColorHistogramGPU out[2])
+{
+    if (out == NULL || !BackendTrackerRequestHistograms(tracker, region, sampleStep))
+        return false;
+    return BackendTrackerCollectHistograms(tracker, true, out);
+}
+
+bool BackendTrackerUpdateShader(BackendTracker tracker, const UpdateGLSLCode* code)
+{
+    if (tracker == NULL || code == NULL || tracker->backend->ops->updateShader == NULL)
+        return false;
+    return tracker->backend->ops->updateShader(tracker, code);
+}
+
+void DestroyBackendTracker(BackendTracker tracker)
+{
+    if (tracker == NULL)
+        return;
+    tracker->backend->ops->destroyTracker(tracker);
+    free(tracker);
+}
+
+void DestroyComputeBackend(ComputeBackend backend)
+{
+    if (backend == NULL)
+        return;
+    backend->ops->destroyBackend(backend);
+    free(backend);
+}
@@ -0,0 +1,488 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "computebackend.h"
+
+// Work run on every thread of the pool, each handles rows [rowBegin, rowEnd)
+typedef void (*CpuJobFunction)(void* context, uint32_t worker, uint32_t rowBegin, uint32_t rowEnd);
+
+// Persistent workers woken per job, the calling thread takes the first band itself
+typedef struct CpuWorkerPool
+{
+    uint32_t threadCount;
+    pthread_t threads[MAX_CPU_COMPUTE_THREADS];
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint32_t remaining;
+    bool stopping;
+    CpuJobFunction job;
+    void* context;
+    uint32_t rowCount;
+} CpuWorkerPool;
+
+typedef struct CpuWorkerArgument
+{
+    CpuWorkerPool* pool;
+    uint32_t worker;
+} CpuWorkerArgument;
+
+// Marker reduction of one thread, widened to 64 bits until packed into a MarkerResultGPU
+typedef struct CpuMarkerPartial
+{
+    uint64_t count;
+    uint64_t sumX;
+    uint64_t sumY;
+    uint32_t minX;
+    uint32_t minY;
+    uint32_t maxX;
+    uint32_t maxY;
+} CpuMarkerPartial;
+
+typedef struct CpuTrackerState
+{
+    uint8_t* frame;                 // Copy of the last submitted frame, kept for the histograms
+    uint8_t* rowChannels;           // Per thread planar row and its marker labels, 4 * width bytes each
+    CpuMarkerPartial (*partials)[MAX_TRACKING_MARKERS];
+    ColorHistogramGPU (*histograms)[2];
+    ColorHistogramGPU requested[2]; // Merged histograms of the last request, built when it is made
+    MarkerResultGPU results[TRACKING_FRAMES_IN_FLIGHT][MAX_TRACKING_MARKERS];    // Per slot, like the GPU result buffers
+    uint32_t nextFrame;             // Slot of the next submission
+    bool hasFrame;
+    TrackingWindow windows[MAX_TRACKING_MARKERS];   // Rectangle each marker is searched in this frame
+    TrackingWindow region;
+    uint32_t sampleStep;
+} CpuTrackerState;
+
+static void BandForWorker(uint32_t rowCount, uint32_t threadCount, uint32_t worker, uint32_t* begin, uint32_t* end)
+{
+    *begin = (uint32_t)((uint64_t)rowCount * worker / threadCount);
+    *end = (uint32_t)((uint64_t)rowCount * (worker + 1) / threadCount);
+}
+
+static void* CpuWorkerThread(void* arg)
+{
+    CpuWorkerArgument* argument = (CpuWorkerArgument*)arg;
+    CpuWorkerPool* pool = argument->pool;
+    uint32_t worker = argument->worker;
+    free(argument);
+    uint64_t seenGeneration = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        while (!pool->stopping && pool->generation == seenGeneration)
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        if (pool->stopping)
+            break;
+        seenGeneration = pool->generation;
+        CpuJobFunction job = pool->job;
+        void* context = pool->context;
+        uint32_t begin, end;
+        BandForWorker(pool->rowCount, pool->threadCount, worker, &begin, &end);
+        pthread_mutex_unlock(&pool->mutex);
+        job(context, worker, begin, end);
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->remaining == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static void RunParallel(CpuWorkerPool* pool, CpuJobFunction job, void* context, uint32_t rowCount)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->job = job;
+    pool->context = context;
+    pool->rowCount = rowCount;
+    pool->remaining = pool->threadCount - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    uint32_t begin, end;
+    BandForWorker(rowCount, pool->threadCount, 0, &begin, &end);
+    job(context, 0, begin, end);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->remaining > 0)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static uint32_t DefaultThreadCount(void)
+{
+    const char* value = getenv(COMPUTE_THREADS_ENVIRONMENT_VARIABLE);
+    long count = value ? strtol(value, NULL, 10) : 0;
+    if (count <= 0)
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count <= 0)
+        count = 1;
+    return count > MAX_CPU_COMPUTE_THREADS ? MAX_CPU_COMPUTE_THREADS : (uint32_t)count;
+}
+
+/**
+ * @brief Splits row y of a frame into planar channels, R G B or Y U V, so the classification
+ * loops below run over contiguous bytes and vectorize.
+ */
+static void DecodeRow(BackendTracker tracker, const uint8_t* frame, uint32_t y, uint8_t* c0, uint8_t* c1, uint8_t* c2)
+{
+    uint32_t width = tracker->width;
+    switch (tracker->pixelFormat)
+    {
+        case TrackingPixelFormatRGB24:
+        {
+            const uint8_t* row = frame + (size_t)y * width * 3;
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                c0[x] = row[3 * x];
+                c1[x] = row[3 * x + 1];
+                c2[x] = row[3 * x + 2];
+            }
+            break;
+        }
+        case TrackingPixelFormatYUYV:
+        {
+            const uint8_t* row = frame + (size_t)y * width * 2;
+            for (uint32_t x = 0; x < width; x += 2)
+            {
+                c0[x] = row[2 * x];
+                c0[x + 1] = row[2 * x + 2];
+                c1[x] = c1[x + 1] = row[2 * x + 1];
+                c2[x] = c2[x + 1] = row[2 * x + 3];
+            }
+            break;
+        }
+        case TrackingPixelFormatNV12:
+        {
+            const uint8_t* luma = frame + (size_t)y * width;
+            const uint8_t* chroma = frame + (size_t)width * tracker->height + (size_t)(y >> 1) * width;
+            memcpy(c0, luma, width);
+            for (uint32_t x = 0; x < width; x += 2)
+            {
+                c1[x] = c1[x + 1] = chroma[x];
+                c2[x] = c2[x + 1] = chroma[x + 1];
+            }
+            break;
+        }
+    }
+}
+
+static void ClassifyRows(void* context, uint32_t worker, uint32_t rowBegin, uint32_t rowEnd)
+{
+    BackendTracker tracker = (BackendTracker)context;
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    uint32_t width = tracker->width;
+    uint8_t* c0 = state->rowChannels + (size_t)worker * width * 4;
+    uint8_t* c1 = c0 + width;
+    uint8_t* c2 = c1 + width;
+    uint8_t* labels = c2 + width;
+    CpuMarkerPartial* partials = state->partials[worker];
+    for (uint32_t m = 0; m < tracker->markerCount; ++m)
+        partials[m] = (CpuMarkerPartial){ 0, 0, 0, UINT32_MAX, UINT32_MAX, 0, 0 };
+
+    for (uint32_t y = rowBegin; y < rowEnd; ++y)
+    {
+        // Columns searched on this row, the union of the windows crossing it
+        uint32_t begin = width, end = 0;
+        for (uint32_t m = 0; m < tracker->markerCount; ++m)
+        {
+            TrackingWindow window = state->windows[m];
+            if (y - window.y >= window.height)
+                continue;
+            if (window.x < begin) begin = window.x;
+            if (window.x + window.width > end) end = window.x + window.width;
+        }
+        if (begin >= end)
+            continue;
+        DecodeRow(tracker, state->frame, y, c0, c1, c2);
+
+        // Like blob_centroid.comp each pixel belongs to the first marker whose range contains it.
+        // Markers are tested last to first so the lowest match is the one left in the label.
+        memset(labels + begin, MAX_TRACKING_MARKERS, end - begin);
+        for (uint32_t m = tracker->markerCount; m-- > 0;)
+        {
+            MarkerColorRange range = tracker->ranges[m];
+            if (range.minR > range.maxR || range.minG > range.maxG || range.minB > range.maxB)
+                continue;
+            // Unsigned distance from the minimum compared to the span tests both bounds at once
+            uint8_t span0 = range.maxR - range.minR, span1 = range.maxG - range.minG, span2 = range.maxB - range.minB;
+            for (uint32_t x = begin; x < end; ++x)
+            {
+                bool inside = ((uint8_t)(c0[x] - range.minR) <= span0) & ((uint8_t)(c1[x] - range.minG) <= span1) &
+                    ((uint8_t)(c2[x] - range.minB) <= span2);
+                labels[x] = inside ? (uint8_t)m : labels[x];
+            }
+        }
+
+        // Then each marker only counts its own pixels inside its window, as its masked dispatch does
+        for (uint32_t m = 0; m < tracker->markerCount; ++m)
+        {
+            TrackingWindow window = state->windows[m];
+            if (y - window.y >= window.height)
+                continue;
+            uint32_t count = 0, sumX = 0, minX = UINT32_MAX, maxX = 0;
+            for (uint32_t x = window.x; x < window.x + window.width; ++x)
+            {
+                uint32_t inside = labels[x] == m;
+                uint32_t mask = 0u - inside;
+                count += inside;
+                sumX += x & mask;
+                uint32_t candidateMin = (x & mask) | ~mask;
+                uint32_t candidateMax = x & mask;
+                minX = candidateMin < minX ? candidateMin : minX;
+                maxX = candidateMax > maxX ? candidateMax : maxX;
+            }
+            if (count == 0)
+                continue;
+            CpuMarkerPartial* partial = &partials[m];
+            partial->count += count;
+            partial->sumX += sumX;
+            partial->sumY += (uint64_t)count * y;
+            if (minX < partial->minX) partial->minX = minX;
+            if (maxX > partial->maxX) partial->maxX = maxX;
+            if (y < partial->minY) partial->minY = y;
+            if (y > partial->maxY) partial->maxY = y;
+        }
+    }
+}
+
+static void HistogramRows(void* context, uint32_t worker, uint32_t rowBegin, uint32_t rowEnd)
+{
+    BackendTracker tracker = (BackendTracker)context;
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    uint32_t width = tracker->width;
+    uint8_t* c0 = state->rowChannels + (size_t)worker * width * 4;
+    uint8_t* c1 = c0 + width;
+    uint8_t* c2 = c1 + width;
+    ColorHistogramGPU* histograms = state->histograms[worker];
+    memset(histograms, 0, sizeof(ColorHistogramGPU) * 2);
+    uint32_t step = state->sampleStep;
+    TrackingWindow region = state->region;
+    uint32_t shift = 5;     // Top 3 bits, COLOR_HISTOGRAM_JOINT_LEVELS levels
+
+    // Rows are sampled on the same grid as color_histogram.comp
+    for (uint32_t y = (rowBegin + step - 1) / step * step; y < rowEnd; y += step)
+    {
+        DecodeRow(tracker, state->frame, y, c0, c1, c2);
+        bool rowInRegion = y - region.y < region.height;
+        for (uint32_t x = 0; x < width; x += step)
+        {
+            uint32_t joint = ((uint32_t)(c0[x] >> shift) * COLOR_HISTOGRAM_JOINT_LEVELS + (c1[x] >> shift)) * COLOR_HISTOGRAM_JOINT_LEVELS + (c2[x] >> shift);
+            uint32_t histogram = 1;
+            if (rowInRegion && x - region.x < region.width)
+                histogram = 0;
+            // The frame histogram includes the region
+            for (uint32_t h = histogram; h < 2; ++h)
+            {
+                ++histograms[h].pixelCount;
+                ++histograms[h].channels[0][c0[x]];
+                ++histograms[h].channels[1][c1[x]];
+                ++histograms[h].channels[2][c2[x]];
+                ++histograms[h].joint[joint];
+            }
+        }
+    }
+}
+
+static void DestroyCPUTracker(BackendTracker tracker);
+
+static bool CreateCPUTracker(BackendTracker tracker)
+{
+    uint32_t threadCount = tracker->backend->threadCount;
+    CpuTrackerState* state = (CpuTrackerState*)calloc(sizeof(CpuTrackerState), 1);
+    if (state == NULL)
+        return false;
+    state->frame = (uint8_t*)malloc(tracker->frameSize);
+    state->rowChannels = (uint8_t*)malloc((size_t)threadCount * tracker->width * 4);
+    state->partials = calloc(sizeof(state->partials[0]), threadCount);
+    state->histograms = calloc(sizeof(state->histograms[0]), threadCount);
+    tracker->state = state;
+    if (state->frame == NULL || state->rowChannels == NULL || state->partials == NULL || state->histograms == NULL)
+    {
+        DestroyCPUTracker(tracker);
+        return false;
+    }
+    return true;
+}
+
+static bool SubmitCPUFrame(BackendTracker tracker, const void* frame, size_t frameSize)
+{
+    CpuWorkerPool* pool = (CpuWorkerPool*)tracker->backend->state;
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    memcpy(state->frame, frame, tracker->frameSize);
+    uint32_t threadCount = tracker->backend->threadCount;
+    // Windows are predicted from the previous frame's results, as roi_predict.comp does on the GPU
+    uint32_t previous = (state->nextFrame + TRACKING_FRAMES_IN_FLIGHT - 1) % TRACKING_FRAMES_IN_FLIGHT;
+    MarkerCentroid centroids[MAX_TRACKING_MARKERS];
+    ConvertMarkerResults(state->results[previous], tracker->markerCount, centroids);
+    for (uint32_t m = 0; m < tracker->markerCount; ++m)
+    {
+        state->windows[m] = tracker->roiMargin > 0 ?
+            PredictTrackingWindow(tracker->width, tracker->height, &centroids[m], tracker->roiMargin, BACKEND_MINIMUM_WINDOW_SIZE) :
+            (TrackingWindow){ 0, 0, tracker->width, tracker->height };
+    }
+    RunParallel(pool, ClassifyRows, tracker, tracker->height);
+    tracker->rangesChanged = false;
+
+    MarkerResultGPU* results = state->results[state->nextFrame];
+    memset(results, 0, sizeof(state->results[0]));
+    for (uint32_t m = 0; m < tracker->markerCount; ++m)
+    {
+        CpuMarkerPartial total = { 0, 0, 0, UINT32_MAX, UINT32_MAX, 0, 0 };
+        for (uint32_t t = 0; t < threadCount; ++t)
+        {
+            const CpuMarkerPartial* partial = &state->partials[t][m];
+            if (partial->count == 0)
+                continue;
+            total.count += partial->count;
+            total.sumX += partial->sumX;
+            total.sumY += partial->sumY;
+            if (partial->minX < total.minX) total.minX = partial->minX;
+            if (partial->minY < total.minY) total.minY = partial->minY;
+            if (partial->maxX > total.maxX) total.maxX = partial->maxX;
+            if (partial->maxY > total.maxY) total.maxY = partial->maxY;
+        }
+        if (total.count == 0)
+            continue;
+        // Same encoding as blob_centroid.comp so both backends share ConvertMarkerResults
+        MarkerResultGPU* result = &results[m];
+        result->count = (uint32_t)total.count;
+        result->sumXLow = (uint32_t)total.sumX;
+        result->sumXHigh = (uint32_t)(total.sumX >> 32);
+        result->sumYLow = (uint32_t)total.sumY;
+        result->sumYHigh = (uint32_t)(total.sumY >> 32);
+        result->invertedMinX = ~total.minX;
+        result->invertedMinY = ~total.minY;
+        result->maxX = total.maxX;
+        result->maxY = total.maxY;
+    }
+    state->nextFrame = (state->nextFrame + 1) % TRACKING_FRAMES_IN_FLIGHT;
+    state->hasFrame = true;
+    return true;
+}
+
+static bool CollectCPUResults(BackendTracker tracker, bool wait, MarkerCentroid* out)
+{
+    (void)wait;
+    // Frames are tracked synchronously by SubmitCPUFrame, pending ones are always complete
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    uint32_t slot = (state->nextFrame + TRACKING_FRAMES_IN_FLIGHT - tracker->pendingFrames) % TRACKING_FRAMES_IN_FLIGHT;
+    ConvertMarkerResults(state->results[slot], tracker->markerCount, out);
+    return true;
+}
+
+static bool RequestCPUHistograms(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep)
+{
+    CpuWorkerPool* pool = (CpuWorkerPool*)tracker->backend->state;
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    if (!state->hasFrame)
+        return false;
+    state->region = region;
+    state->sampleStep = sampleStep;
+    RunParallel(pool, HistogramRows, tracker, tracker->height);
+
+    ColorHistogramGPU* out = state->requested;
+    memset(out, 0, sizeof(ColorHistogramGPU) * 2);
+    for (uint32_t t = 0; t < tracker->backend->threadCount; ++t)
+    {
+        for (uint32_t h = 0; h < 2; ++h)
+        {
+            const ColorHistogramGPU* partial = &state->histograms[t][h];
+            out[h].pixelCount += partial->pixelCount;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                for (uint32_t bin = 0; bin < COLOR_HISTOGRAM_CHANNEL_BINS; ++bin)
+                    out[h].channels[c][bin] += partial->channels[c][bin];
+            }
+            for (uint32_t bin = 0; bin < COLOR_HISTOGRAM_JOINT_BINS; ++bin)
+                out[h].joint[bin] += partial->joint[bin];
+        }
+    }
+    return true;
+}
+
+static bool CollectCPUHistograms(BackendTracker tracker, bool wait, ColorHistogramGPU out[2])
+{
+    (void)wait;
+    // Built synchronously by RequestCPUHistograms
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    memcpy(out, state->requested, sizeof(ColorHistogramGPU) * 2);
+    return true;
+}
+
+static void DestroyCPUTracker(BackendTracker tracker)
+{
+    CpuTrackerState* state = (CpuTrackerState*)tracker->state;
+    if (state == NULL)
+        return;
+    free(state->frame);
+    free(state->rowChannels);
+    free(state->partials);
+    free(state->histograms);
+    free(state);
+    tracker->state = NULL;
+}
+
+static void DestroyCPUBackend(ComputeBackend backend)
+{
+    CpuWorkerPool* pool = (CpuWorkerPool*)backend->state;
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (uint32_t i = 1; i < pool->threadCount; ++i)
+        pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+    backend->state = NULL;
+}
+
+static const ComputeBackendOps cpuBackendOps = {
+    .name = "cpu",
+    .createTracker = CreateCPUTracker,
+    .submitFrame = SubmitCPUFrame,
+    .collectResults = CollectCPUResults,
+    .requestHistograms = RequestCPUHistograms,
+    .collectHistograms = CollectCPUHistograms,
+    .destroyTracker = DestroyCPUTracker,
+    .destroyBackend = DestroyCPUBackend
+};
+
+bool InitializeCPUComputeBackend(ComputeBackend backend)
+{
+    CpuWorkerPool* pool = (CpuWorkerPool*)calloc(sizeof(CpuWorkerPool), 1);
+    pool->threadCount = DefaultThreadCount();
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    backend->type = ComputeBackendCPU;
+    backend->ops = &cpuBackendOps;
+    backend->state = pool;
+    // Thread 0 is the caller of RunParallel
+    for (uint32_t i = 1; i < pool->threadCount; ++i)
+    {
+        CpuWorkerArgument* argument = (CpuWorkerArgument*)malloc(sizeof(CpuWorkerArgument));
+        argument->pool = pool;
+        argument->worker = i;
+        if (pthread_create(&pool->threads[i], NULL, CpuWorkerThread, argument) != 0)
+        {
+            // Run with the threads that did start
+            free(argument);
+            pool->threadCount = i;
+            break;
+        }
+    }
+    backend->threadCount = pool->threadCount;
+    return true;
+}
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <vulkan/vulkan_core.h>
+#include "computebackend.h"
+#include "framegraph.h"
+#include "gpuprofiler.h"
+#include "shaderreload.h"
+#include "shaders.h"
+
+// Uploads that may be queued per camera, one per frame in flight
+#define VULKAN_BACKEND_STAGING_SLOTS TRACKING_FRAMES_IN_FLIGHT
+
+typedef struct VulkanTrackerState
+{
+    BlobTracker blobTracker;
+    ColorCalibrator calibrator;
+    StagingRing stagingRing;
+    // Tracking passes of every slot, re-recorded when marker ranges or the margin change
+    FrameGraph graph;
+    uint32_t recordedMargin;        // ROI margin the graph is recorded with
+    ShaderReloader reloader;        // Created with the first hot reloaded shader
+    GpuProfiler profiler;           // NULL unless VRWEBTRACK_GPU_PROFILE is set and the device has timestamps
+    uint64_t profileReportNs;       // Last summary written to stderr
+} VulkanTrackerState;
+
+/**
+ * @brief Times the upload and the tracking passes when asked for, the profiler collects without
+ * waiting so it does not change the timing it measures.
+ */
+static void AttachVulkanProfiler(ComputeApplication app, VulkanTrackerState* state)
+{
+    const char* value = getenv(GPU_PROFILE_ENVIRONMENT_VARIABLE);
+    if (value == NULL || strcmp(value, "1") != 0)
+        return;
+    // A device without timestamps was already reported by CreateGpuProfiler
+    state->profiler = CreateGpuProfiler(app, TRACKING_FRAMES_IN_FLIGHT);
+    if (state->profiler == NULL || !state->profiler->supported || !FrameGraphSetProfiler(state->graph, state->profiler))
+    {
+        DestroyGpuProfiler(state->profiler);
+        state->profiler = NULL;
+        return;
+    }
+    StagingRingSetProfiler(app, state->stagingRing, state->profiler);
+}
+
+/**
+ * @brief Writes one line with every stage's rolling mean and p95 to stderr, once per interval.
+ */
+static void ReportVulkanProfile(BackendTracker tracker, VulkanTrackerState* state)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t nowNs = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    if (nowNs - state->profileReportNs < GPU_PROFILE_REPORT_INTERVAL_NS)
+        return;
+    state->profileReportNs = nowNs;
+    char text[512];
+    int length = snprintf(text, sizeof(text), "GPU %ux%u", tracker->width, tracker->height);
+    bool any = false;
+    for (uint32_t i = 0; i < state->profiler->stageCount && length < (int)sizeof(text); ++i)
+    {
+        GpuProfilerSummary summary;
+        if (!GpuProfilerGetSummary(state->profiler, i, &summary))
+            continue;
+        length += snprintf(text + length, sizeof(text) - (size_t)length, " | %s mean %.1f us p95 %.1f us",
+            state->profiler->stages[i].name, summary.meanNs / 1000.0, summary.p95Ns / 1000.0);
+        any = true;
+    }
+    if (any)
+        fprintf(stderr, "%s\n", text);
+}
+
+static bool CreateVulkanTracker(BackendTracker tracker)
+{
+    ComputeApplication app = tracker->backend->app;
+    VulkanTrackerState* state = (VulkanTrackerState*)calloc(sizeof(VulkanTrackerState), 1);
+    ShaderCode centroidShader = GetBuiltinShader(BlobCentroidShaderForDevice(app));
+    ShaderCode predictShader = GetBuiltinShader(RoiPredictShader);
+    ShaderCode histogramShader = GetBuiltinShader(ColorHistogramShader);
+    state->blobTracker = CreateBlobTracker(app, tracker->width, tracker->height, tracker->pixelFormat, tracker->markerCount,
+        centroidShader.code, centroidShader.size, predictShader.code, predictShader.size);
+    if (state->blobTracker)
+        state->calibrator = CreateColorCalibrator(app, state->blobTracker, histogramShader.code, histogramShader.size);
+    ReleaseShaderCode(&centroidShader);
+    ReleaseShaderCode(&predictShader);
+    ReleaseShaderCode(&histogramShader);
+    if (state->blobTracker == NULL || state->calibrator == NULL)
+    {
+        DestroyColorCalibrator(state->calibrator);
+        DestroyBlobTracker(app, state->blobTracker);
+        free(state);
+        return false;
+    }
+    state->stagingRing = CreateStagingRing(app, tracker->frameSize, VULKAN_BACKEND_STAGING_SLOTS);
+    state->graph = CreateFrameGraph(app, TRACKING_FRAMES_IN_FLIGHT);
+    if (state->stagingRing == NULL || state->graph == NULL || !AddBlobTrackersToFrameGraph(state->graph, 1, &state->blobTracker))
+    {
+        DestroyFrameGraph(state->graph);
+        DestroyStagingRing(app, state->stagingRing);
+        DestroyColorCalibrator(state->calibrator);
+        DestroyBlobTracker(app, state->blobTracker);
+        free(state);
+        return false;
+    }
+    AttachVulkanProfiler(app, state);
+    tracker->state = state;
+    return true;
+}
+
+static bool SubmitVulkanFrame(BackendTracker tracker, const void* frame, size_t frameSize)
+{
+    ComputeApplication app = tracker->backend->app;
+    VulkanTrackerState* state = (VulkanTrackerState*)tracker->state;
+    // The slot's buffers and command buffer are reused, so its previous frame and a calibration
+    // reading it must be done with them before the upload overwrites the frame, the transfer
+    // queue does not wait for compute
+    uint32_t slot = FrameGraphAcquireFrame(state->graph);
+    WaitForComputeTicket(app, state->blobTracker->frames[slot].readTicket, UINT64_MAX);
+    Buffer frameBuffer = state->blobTracker->frames[slot].frameBuffer;
+    if (!StagingRingUpload(app, state->stagingRing, frameBuffer, 0, tracker->frameSize, frame))
+    {
+        // Every staging slot is waiting for its consumer, at the latest the previous frame
+        WaitForComputeTicket(app, app->lastSubmittedTicket, UINT64_MAX);
+        if (!StagingRingUpload(app, state->stagingRing, frameBuffer, 0, tracker->frameSize, frame))
+            return false;
+    }
+    if (tracker->rangesChanged)
+    {
+        // The ranges are baked into the recorded push constants of every slot
+        for (uint32_t i = 0; i < tracker->markerCount; ++i)
+            SetBlobTrackerMarkerRange(state->blobTracker, i, tracker->ranges[i]);
+        FrameGraphInvalidate(state->graph);
+        tracker->rangesChanged = false;
+    }
+    if (state->recordedMargin != tracker->roiMargin)
+    {
+        state->recordedMargin = tracker->roiMargin;
+        SetBlobTrackerPrediction(state->blobTracker, state->recordedMargin, BACKEND_MINIMUM_WINDOW_SIZE);
+        FrameGraphInvalidate(state->graph);
+    }
+    ApplyShaderReload(state->reloader, state->graph);
+    if (FrameGraphSubmit(state->graph) == 0)
+        return false;
+    if (state->profiler)
+        ReportVulkanProfile(tracker, state);
+    return true;
+}
+
+static bool CollectVulkanResults(BackendTracker tracker, bool wait, MarkerCentroid* out)
+{
+    ComputeApplication app = tracker->backend->app;
+    VulkanTrackerState* state = (VulkanTrackerState*)tracker->state;
+    uint32_t slot = (state->graph->nextFrame + TRACKING_FRAMES_IN_FLIGHT - tracker->pendingFrames) % TRACKING_FRAMES_IN_FLIGHT;
+    ComputeTicket ticket = state->graph->tickets[slot];
+    if (wait ? !WaitForComputeTicket(app, ticket, UINT64_MAX) : !IsComputeTicketComplete(app, ticket))
+        return false;
+    ReadBlobTrackingResults(app, state->blobTracker, slot, out);
+    return true;
+}
+
+static bool RequestVulkanHistograms(BackendTracker tracker, TrackingWindow region, uint32_t sampleStep)
+{
+    VulkanTrackerState* state = (VulkanTrackerState*)tracker->state;
+    uint32_t slot = (state->graph->nextFrame + TRACKING_FRAMES_IN_FLIGHT - 1) % TRACKING_FRAMES_IN_FLIGHT;
+    if (state->graph->tickets[slot] == 0)
+        return false;
+    // The previous request was collected, so the calibrator is idle and this is never refused for it
+    return RequestColorCalibration(state->calibrator, slot, region, sampleStep) != 0;
+}
+
+static bool CollectVulkanHistograms(BackendTracker tracker, bool wait, ColorHistogramGPU out[2])
+{
+    ComputeApplication app = tracker->backend->app;
+    VulkanTrackerState* state = (VulkanTrackerState*)tracker->state;
+    ComputeTicket ticket = state->calibrator->ticket;
+    if (wait ? !WaitForComputeTicket(app, ticket, UINT64_MAX) : !IsComputeTicketComplete(app, ticket))
+        return false;
+    memcpy(out, state->calibrator->histogramBuffer->mapped, sizeof(ColorHistogramGPU) * 2);
+    return true;
+}
+
+static bool UpdateVulkanShader(BackendTracker tracker, const UpdateGLSLCode* code)
+{
+    VulkanTrackerState* state = (VulkanTrackerState*)tracker->state;
+    if (state->reloader == NULL)
+        state->reloader = CreateShaderReloader(tracker->backend->app, 1, &state->blobTracker);
+    return SubmitShaderReload(state->reloader, code);
+}
+
+static void DestroyVulkanTracker(BackendTracker tracker)
+{
+    ComputeApplication app = tracker->backend->app;
+    VulkanTrackerState* state = (VulkanTrackerState*)tracker->state;
+    if (state == NULL)
+        return;
+    DestroyFrameGraph(state->graph);
+    DestroyShaderReloader(state->reloader);
+    DestroyStagingRing(app, state->stagingRing);
+    DestroyGpuProfiler(state->profiler);
+    DestroyColorCalibrator(state->calibrator);
+    DestroyBlobTracker(app, state->blobTracker);
+    free(state);
+    tracker->state = NULL;
+}
+
+static void DestroyVulkanBackend(ComputeBackend backend)
+{
+    CleanUpVulkan(backend->app);
+    free(backend->app);
+    backend->app = NULL;
+}
+
+static const ComputeBackendOps vulkanBackendOps = {
+    .name = "vulkan",
+    .createTracker = CreateVulkanTracker,
+    .submitFrame = SubmitVulkanFrame,
+    .collectResults = CollectVulkanResults,
+    .requestHistograms = RequestVulkanHistograms,
+    .collectHistograms = CollectVulkanHistograms,
+    .updateShader = UpdateVulkanShader,
+    .destroyTracker = DestroyVulkanTracker,
+    .destroyBackend = DestroyVulkanBackend
+};
+
+bool InitializeVulkanComputeBackend(ComputeBackend backend, const ComputeApplicationCreateInfo* info)
+{
+    backend->app = initializeComputeApplicationWithInfo(info);
+    if (backend->app == NULL)
+        return false;
+    backend->type = ComputeBackendVulkan;
+    backend->ops = &vulkanBackendOps;
+    return true;
+}
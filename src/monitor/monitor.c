@@ -1,24 +1,963 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include "GLFW/glfw3.h"
 #include <stdatomic.h>
 #include <stdbool.h>
+#include "network.h"
+#include "preview.h"
+#include "latency.h"
+#include "supervisor.h"
+
+// Longest wait for window events between two ring drains, bounds how long a record sits unread
+#define MONITOR_POLL_INTERVAL_S 0.0005
+// Preview rate while nothing shows them, headless or iconified
+#define MONITOR_HIDDEN_PREVIEW_INTERVAL_NS 1000000000ull
+// Pause before connecting again to a worker that did not serve its preview
+#define MONITOR_PREVIEW_RETRY_NS 1000000000ull
+// Longest command line read from stdin
+#define MONITOR_COMMAND_LENGTH 256
+#define MONITOR_INOTIFY_BUFFER_SIZE 4096
 
 const uint32_t width = 800;
 const uint32_t height = 600;
 
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    GLFWwindow* window = glfwCreateWindow(width, height, "FreeTrack", NULL, NULL);
-    glfwMakeContextCurrent(window);
-    while (!glfwWindowShouldClose(window)){
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+typedef struct
+{
+    int worker;                             // Supervisor index
+    CoordinateRing ring;                    // NULL until the worker runs
+    pid_t ring_pid;                         // Worker the ring was opened for
+    uint32_t ring_restarts;
+    uint32_t pending_count;                 // Records of the frame being received
+    CoordinateRecord pending[WORKER_MAX_MARKERS];
+    uint32_t marker_count;                  // Records of the last complete frame
+    CoordinateRecord markers[WORKER_MAX_MARKERS];
+    LatencyRecorder latency;                // Send to Output, NULL when the board cannot be created
+    WorkerControl control;                  // NULL until a command is sent to the worker
+    pid_t control_pid;                      // Worker the control was connected to
+    uint32_t control_restarts;
+    pid_t shader_pid;                       // Worker the watched shader was last sent to, 0 to send it again
+    uint32_t shader_restarts;
+    PreviewReader preview;                  // NULL until the worker serves its preview channel
+    pid_t preview_pid;                      // Worker the preview was connected to
+    uint32_t preview_restarts;
+    uint64_t preview_retry_ns;              // No connection attempt before this
+    uint64_t preview_interval_ns;           // Interval last asked from the worker
+    uint32_t preview_count;                 // Intact previews since the last overlay update
+} monitored_camera;
+
+typedef struct
+{
+    const char* worker_path;            // NULL for the camera executable next to this one
+    WorkerSettings settings;            // Initial settings of every camera
+    uint32_t camera_count;
+    WorkerConfig cameras[MAX_SUPERVISED_CAMERAS];
+    monitored_camera monitored[MAX_SUPERVISED_CAMERAS];
+    Supervisor supervisor;
+    char output_host[256];                  // Empty when coordinates are not sent anywhere
+    uint16_t output_port;
+    uint16_t listen_port;                   // 0 when no remote camera boxes send to this monitor
+    CoordinateSocket output;
+    bool output_dropping;
+    CoordinateSocket receiver;
+    uint32_t outgoing_count;                // Packets sent together at the end of the loop
+    CoordinatePacket outgoing[COORDINATE_SOCKET_BATCH];
+    int outgoing_cameras[COORDINATE_SOCKET_BATCH];      // Index of the local camera, -1 when relayed
+    LatencyStamps outgoing_stamps[COORDINATE_SOCKET_BATCH];
+    uint64_t overlay_ns;                    // Last overlay update
+    char command_line[MONITOR_COMMAND_LENGTH];  // Start of a stdin line still being typed
+    size_t command_length;
+    bool command_dropped;                   // Skipping the rest of an overlong line
+    bool stdin_closed;
+    uint32_t command_sequence;              // Of the last command sent, echoed in the worker's logs
+    const char* shader_path;                // Watched tracking shader, NULL when the workers keep the shipped one
+    const char* shader_name;                // File name part of shader_path
+    int shader_watch;                       // inotify descriptor on the shader's directory, -1 without
+    UpdateGLSLCode shader;                  // Last content read from shader_path
+} camera_monitor;
+
+static camera_monitor monitor;
+static atomic_int quit;
+
+static void handle_quit_signal(int signal)
+{
+    (void)signal;
+    atomic_store(&quit, 1);
+}
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s --camera ID:DEVICE[:FORMAT][@CPU] [--camera ...] [options]\n"
+        "  --camera ID:DEVICE[:FORMAT][@CPU]\n"
+        "                              Runs a worker for the device, FORMAT is h264, yuyv or nv12, default h264,\n"
+        "                              CPU the core it is pinned to, default none\n"
+        "  --worker PATH               Camera executable, default the one next to this executable\n"
+        "  --width W --height H        Capture size of every camera, default 640x480\n"
+        "  --fps F                     Frame rate, default 60\n"
+        "  --exposure E                -1 for automatic, 100 us units otherwise, default unchanged\n"
+        "  --markers N                 Tracked markers, default 1\n"
+        "  --color I:R,G,B,R,G,B       RGB minimum and maximum of marker I\n"
+        "  --roi-margin M              Margin around predicted marker windows in pixels, 0 tracks whole frames\n"
+        "  --output HOST[:PORT]        Sends every frame's markers over UDP, default port %u, [ADDRESS]:PORT for IPv6\n"
+        "  --listen PORT               Forwards the frames of remote camera boxes sending to PORT to the output\n"
+        "  --shader PATH               Tracking shader, GLSL or SPIR-V, sent to every worker and again on every save\n"
+        "Commands on stdin, CAMERA is a camera ID or all:\n"
+        "  resolution CAMERA W H | fps CAMERA F | exposure CAMERA E | markers CAMERA N | roi CAMERA M\n"
+        "  color CAMERA I:R,G,B,R,G,B | calibrate CAMERA I X Y W H | shader CAMERA PATH | stop CAMERA\n",
+        program, COORDINATE_DEFAULT_PORT);
+}
+
+static bool parse_camera(const char* value, WorkerConfig* config)
+{
+    char* end = NULL;
+    unsigned long id = strtoul(value, &end, 10);
+    if (end == value || *end != ':' || end[1] == '\0')
+        return false;
+    memset(config, 0, sizeof(*config));
+    config->cameraID = (uint32_t)id;
+    config->format = WorkerCaptureH264;
+    config->cpu = WORKER_NO_CPU;
+    const char* device = end + 1;
+    size_t length = strlen(device);
+    const char* cpu = strrchr(device, '@');
+    if (cpu)
+    {
+        unsigned long core = strtoul(cpu + 1, &end, 10);
+        if (end == cpu + 1 || *end != '\0' || core >= CPU_SETSIZE)
+            return false;
+        config->cpu = (int)core;
+        length = (size_t)(cpu - device);
+    }
+    // by-path device names contain colons too, only a known format after the last one is split off
+    const char* format = memrchr(device, ':', length);
+    size_t format_length = format ? length - (size_t)(format - device) : 0;
+    if (format_length == 5 && strncmp(format, ":h264", 5) == 0)
+        length = (size_t)(format - device);
+    else if (format_length == 5 && strncmp(format, ":yuyv", 5) == 0)
+    {
+        config->format = WorkerCaptureYUYV;
+        length = (size_t)(format - device);
+    }
+    else if (format_length == 5 && strncmp(format, ":nv12", 5) == 0)
+    {
+        config->format = WorkerCaptureNV12;
+        length = (size_t)(format - device);
+    }
+    if (length == 0 || length >= sizeof(config->devicePath))
+        return false;
+    memcpy(config->devicePath, device, length);
+    return true;
+}
+
+static bool parse_output(const char* value)
+{
+    const char* host = value;
+    size_t length = strlen(value);
+    const char* port = NULL;
+    if (value[0] == '[')
+    {
+        const char* close = strchr(value, ']');
+        if (close == NULL || (close[1] != '\0' && close[1] != ':'))
+            return false;
+        host = value + 1;
+        length = (size_t)(close - host);
+        port = close[1] == ':' ? close + 2 : NULL;
     }
-    glfwTerminate();
+    else if (strchr(value, ':') == strrchr(value, ':') && strchr(value, ':'))
+    {
+        // A single colon separates the port, more make it a bare IPv6 address
+        port = strchr(value, ':') + 1;
+        length = (size_t)(port - 1 - value);
+    }
+    if (length == 0 || length >= sizeof(monitor.output_host))
+        return false;
+    memcpy(monitor.output_host, host, length);
+    monitor.output_host[length] = '\0';
+    monitor.output_port = COORDINATE_DEFAULT_PORT;
+    if (port)
+    {
+        char* end = NULL;
+        unsigned long number = strtoul(port, &end, 10);
+        if (end == port || *end != '\0' || number == 0 || number > UINT16_MAX)
+            return false;
+        monitor.output_port = (uint16_t)number;
+    }
+    return true;
+}
+
+static int parse_arguments(int argc, const char* argv[argc])
+{
+    monitor.settings.width = 640;
+    monitor.settings.height = 480;
+    monitor.settings.fps = 60;
+    monitor.settings.exposure = WORKER_EXPOSURE_UNCHANGED;
+    monitor.settings.markerCount = 1;
+    ClearWorkerMarkerColors(&monitor.settings);
+    monitor.shader_watch = -1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL)
+            return 1;
+        ++i;
+        if (strcmp(option, "--camera") == 0)
+        {
+            if (monitor.camera_count == MAX_SUPERVISED_CAMERAS || !parse_camera(value, &monitor.cameras[monitor.camera_count]))
+                return 1;
+            monitor.camera_count++;
+        }
+        else if (strcmp(option, "--worker") == 0)
+            monitor.worker_path = value;
+        else if (strcmp(option, "--width") == 0)
+            monitor.settings.width = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--height") == 0)
+            monitor.settings.height = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--fps") == 0)
+            monitor.settings.fps = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--exposure") == 0)
+            monitor.settings.exposure = (int32_t)strtol(value, NULL, 10);
+        else if (strcmp(option, "--markers") == 0)
+            monitor.settings.markerCount = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--roi-margin") == 0)
+            monitor.settings.roiMargin = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--output") == 0)
+        {
+            if (!parse_output(value))
+                return 1;
+        }
+        else if (strcmp(option, "--listen") == 0)
+        {
+            unsigned long port = strtoul(value, NULL, 10);
+            if (port == 0 || port > UINT16_MAX)
+                return 1;
+            monitor.listen_port = (uint16_t)port;
+        }
+        else if (strcmp(option, "--color") == 0)
+        {
+            unsigned marker, c[6];
+            if (sscanf(value, "%u:%u,%u,%u,%u,%u,%u", &marker, &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) != 7 || marker >= WORKER_MAX_MARKERS)
+                return 1;
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                monitor.settings.markerMin[marker][channel] = (uint8_t)c[channel];
+                monitor.settings.markerMax[marker][channel] = (uint8_t)c[channel + 3];
+            }
+        }
+        else if (strcmp(option, "--shader") == 0)
+            monitor.shader_path = value;
+        else
+            return 1;
+    }
+    // A monitor without cameras of its own only relays remote camera boxes
+    if ((monitor.camera_count == 0 && monitor.listen_port == 0) || (monitor.listen_port && monitor.output_host[0] == '\0'))
+        return 1;
+    if (monitor.settings.width == 0 || monitor.settings.height == 0 || monitor.settings.fps == 0 ||
+        monitor.settings.markerCount == 0 || monitor.settings.markerCount > WORKER_MAX_MARKERS)
+        return 1;
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Spawns a worker per camera, the supervisor keeps them running from then on.
+ */
+static bool start_workers()
+{
+    monitor.supervisor = CreateSupervisor(monitor.worker_path);
+    if (monitor.supervisor == NULL)
+        return false;
+    for (uint32_t i = 0; i < monitor.camera_count; ++i)
+    {
+        WorkerConfig* config = &monitor.cameras[i];
+        config->settings = monitor.settings;
+        monitor.monitored[i].worker = AddSupervisedCamera(monitor.supervisor, config);
+        if (monitor.monitored[i].worker < 0)
+        {
+            fprintf(stderr, "Failed to supervise camera %u on %s\n", config->cameraID, config->devicePath);
+            return false;
+        }
+        // The monitor owns the board since workers come and go, it is diagnostics only though
+        monitor.monitored[i].latency = CreateLatencyRecorder(config->cameraID, LatencyStageSend, LatencyStageOutput, true);
+    }
+    return true;
+}
+
+static void flush_packets()
+{
+    if (monitor.outgoing_count == 0)
+        return;
+    uint32_t sent = SendCoordinatePackets(monitor.output, monitor.outgoing_count, monitor.outgoing);
+    uint64_t now = monotonic_ns();
+    for (uint32_t i = 0; i < sent; ++i)
+    {
+        if (monitor.outgoing_cameras[i] < 0)
+            continue;
+        LatencyStamps* stamps = &monitor.outgoing_stamps[i];
+        stamps->stampNs[LatencyStageOutput] = now;
+        RecordFrameLatency(monitor.monitored[monitor.outgoing_cameras[i]].latency, stamps, now);
+    }
+    // A full send buffer or an unreachable client drops the rest, the next frame supersedes them
+    // anyway. Only the start of a run of drops is reported.
+    if (sent < monitor.outgoing_count && !monitor.output_dropping)
+        fprintf(stderr, "Dropping coordinate packets to %s:%u\n", monitor.output_host, monitor.output_port);
+    monitor.output_dropping = sent < monitor.outgoing_count;
+    monitor.outgoing_count = 0;
+}
+
+static void queue_packet(const CoordinatePacket* packet, int camera, const LatencyStamps* stamps)
+{
+    if (monitor.outgoing_count == COORDINATE_SOCKET_BATCH)
+        flush_packets();
+    monitor.outgoing_cameras[monitor.outgoing_count] = camera;
+    if (stamps)
+        monitor.outgoing_stamps[monitor.outgoing_count] = *stamps;
+    monitor.outgoing[monitor.outgoing_count++] = *packet;
+}
+
+/**
+ * @brief Packs a camera's last complete frame into one packet.
+ *
+ * The confidence is the share of the marker's bounding box its pixels cover, a solid blob scores
+ * close to 1 and a scatter of stray pixels close to 0.
+ */
+static void queue_frame(uint32_t index, uint64_t receivedNs)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    LatencyStamps stamps;
+    LatencyStampsFromRecord(&camera->markers[0], &stamps);
+    stamps.stampNs[LatencyStageReceive] = receivedNs;
+    CoordinatePacket packet = {0};
+    packet.cameraID = camera->markers[0].cameraID;
+    packet.frameSequence = camera->markers[0].frameSequence;
+    packet.timestampNs = camera->markers[0].timestampNs;
+    for (uint32_t i = 0; i < camera->marker_count && i < COORDINATE_PACKET_MAX_MARKERS; ++i)
+    {
+        const CoordinateRecord* record = &camera->markers[i];
+        CoordinatePacketMarker* marker = &packet.markers[packet.markerCount++];
+        marker->marker = (uint8_t)record->marker;
+        marker->flags = (uint8_t)record->flags;
+        marker->x = record->x;
+        marker->y = record->y;
+        if (record->flags & CoordinateRecordFound)
+        {
+            float area = (float)(record->maxX - record->minX + 1) * (float)(record->maxY - record->minY + 1);
+            marker->confidence = area > 0.0f && record->pixelCount < area ? (float)record->pixelCount / area : 1.0f;
+        }
+    }
+    StampLatency(&stamps, LatencyStageFusion);
+    if (monitor.output)
+    {
+        queue_packet(&packet, (int)index, &stamps);
+        return;
+    }
+    // Without clients the frame is output once the monitor holds it
+    stamps.stampNs[LatencyStageOutput] = stamps.stampNs[LatencyStageFusion];
+    RecordFrameLatency(camera->latency, &stamps, stamps.stampNs[LatencyStageOutput]);
+}
+
+/**
+ * @brief Forwards everything remote camera boxes sent since the last loop.
+ */
+static void read_receiver()
+{
+    static CoordinatePacket packets[COORDINATE_SOCKET_BATCH];
+    if (monitor.receiver == NULL)
+        return;
+    uint32_t count;
+    do
+    {
+        count = ReceiveCoordinatePackets(monitor.receiver, COORDINATE_SOCKET_BATCH, packets, 0);
+        for (uint32_t i = 0; i < count; ++i)
+            queue_packet(&packets[i], -1, NULL);
+    } while (count == COORDINATE_SOCKET_BATCH);
+}
+
+/**
+ * @brief Keeps a camera's ring mapped to the object its current worker publishes into.
+ *
+ * A respawned worker replaces the ring with a new object, so the old mapping is dropped as soon as
+ * the worker changes and the new one is only opened once the worker reports it is running, by
+ * then it has created the ring and pushed its first frame into it.
+ */
+static void update_ring(uint32_t index)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    const SupervisedWorker* worker = &monitor.supervisor->workers[camera->worker];
+    if (camera->ring && (worker->pid != camera->ring_pid || worker->restarts != camera->ring_restarts))
+    {
+        CloseCoordinateRing(camera->ring);
+        camera->ring = NULL;
+        camera->pending_count = 0;
+    }
+    if (camera->ring || worker->pid == 0 || atomic_load(&worker->heartbeat->state) != WorkerStateRunning)
+        return;
+    char name[64];
+    snprintf(name, sizeof(name), COORDINATE_RING_NAME_FORMAT, monitor.cameras[index].cameraID);
+    camera->ring = OpenCoordinateRing(name);
+    camera->ring_pid = worker->pid;
+    camera->ring_restarts = worker->restarts;
+}
+
+/**
+ * @brief Drains every published record of a camera, keeping the markers of its last complete frame.
+ */
+static void read_ring(uint32_t index)
+{
+    static CoordinateRecord records[COORDINATE_RING_CAPACITY];
+    monitored_camera* camera = &monitor.monitored[index];
+    if (camera->ring == NULL)
+        return;
+    uint32_t count = PopCoordinateRecords(camera->ring, COORDINATE_RING_CAPACITY, records);
+    uint64_t received = count ? monotonic_ns() : 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const CoordinateRecord* record = &records[i];
+        if (camera->pending_count > 0 && camera->pending[0].frameSequence != record->frameSequence)
+            camera->pending_count = 0;
+        if (camera->pending_count < WORKER_MAX_MARKERS)
+            camera->pending[camera->pending_count++] = *record;
+        if (record->flags & CoordinateRecordEndOfFrame)
+        {
+            memcpy(camera->markers, camera->pending, camera->pending_count * sizeof(CoordinateRecord));
+            camera->marker_count = camera->pending_count;
+            camera->pending_count = 0;
+            queue_frame(index, received);
+        }
+    }
+}
+
+/**
+ * @brief Keeps a camera's preview channel connected to its current worker and takes its latest frame.
+ *
+ * Like the ring, the channel is dropped when the worker changes, and also when its published frame
+ * size no longer matches since the worker then recreates the channel. ConnectPreviewReader waits
+ * for the worker's next frame, so connecting happens once per worker start or resize and a worker
+ * that does not answer is left alone for MONITOR_PREVIEW_RETRY_NS.
+ */
+static void update_preview(uint32_t index, GLFWwindow* window, uint64_t nowNs)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    const SupervisedWorker* worker = &monitor.supervisor->workers[camera->worker];
+    WorkerSettings settings;
+    if (camera->preview && (worker->pid != camera->preview_pid || worker->restarts != camera->preview_restarts ||
+        (ReadWorkerSettings(worker->heartbeat, &settings) && (settings.width != camera->preview->info.width || settings.height != camera->preview->info.height))))
+    {
+        DestroyPreviewReader(camera->preview);
+        camera->preview = NULL;
+    }
+    if (camera->preview == NULL)
+    {
+        if (worker->pid == 0 || atomic_load(&worker->heartbeat->state) != WorkerStateRunning || nowNs < camera->preview_retry_ns)
+            return;
+        char name[64];
+        snprintf(name, sizeof(name), PREVIEW_SOCKET_NAME_FORMAT, monitor.cameras[index].cameraID);
+        camera->preview = ConnectPreviewReader(name);
+        camera->preview_pid = worker->pid;
+        camera->preview_restarts = worker->restarts;
+        camera->preview_interval_ns = 0;
+        if (camera->preview == NULL)
+        {
+            camera->preview_retry_ns = monotonic_ns() + MONITOR_PREVIEW_RETRY_NS;
+            return;
+        }
+    }
+    // The window has no client API to draw the frames with yet, a visible window asks for the
+    // full rate so the latest intact frame is at hand
+    bool shown = window && !glfwGetWindowAttrib(window, GLFW_ICONIFIED);
+    uint64_t interval = shown ? PREVIEW_DEFAULT_INTERVAL_NS : MONITOR_HIDDEN_PREVIEW_INTERVAL_NS;
+    if (camera->preview_interval_ns != interval)
+    {
+        SetPreviewInterval(camera->preview, interval);
+        camera->preview_interval_ns = interval;
+    }
+    PreviewFrame frame;
+    if (!AcquirePreviewFrame(camera->preview, &frame))
+        return;
+    if (ReleasePreviewFrame(camera->preview, &frame))
+        camera->preview_count++;
+}
+
+/**
+ * @brief Returns the control channel of a camera's worker, connecting again when the worker
+ * changed since the last command. NULL when no worker listens.
+ */
+static WorkerControl worker_control(uint32_t index)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    const SupervisedWorker* worker = &monitor.supervisor->workers[camera->worker];
+    uint32_t camera_id = monitor.cameras[index].cameraID;
+    if (camera->control && (worker->pid != camera->control_pid || worker->restarts != camera->control_restarts))
+    {
+        CloseWorkerControl(camera->control);
+        camera->control = NULL;
+    }
+    if (camera->control == NULL && worker->pid != 0)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), WORKER_CONTROL_NAME_FORMAT, camera_id);
+        camera->control = ConnectWorkerControl(name);
+        camera->control_pid = worker->pid;
+        camera->control_restarts = worker->restarts;
+    }
+    if (camera->control == NULL)
+        fprintf(stderr, "Camera %u has no worker listening for commands\n", camera_id);
+    return camera->control;
+}
+
+static bool send_worker_command(uint32_t index, WorkerCommand* command)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    uint32_t camera_id = monitor.cameras[index].cameraID;
+    if (worker_control(index) == NULL)
+        return false;
+    command->version = WORKER_COMMAND_VERSION;
+    command->sequence = ++monitor.command_sequence;
+    if (!SendWorkerCommand(camera->control, command))
+    {
+        fprintf(stderr, "Camera %u did not take command %u\n", camera_id, command->sequence);
+        CloseWorkerControl(camera->control);
+        camera->control = NULL;
+        return false;
+    }
+    return true;
+}
+
+static bool send_worker_shader(uint32_t index, const UpdateGLSLCode* code)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    uint32_t camera_id = monitor.cameras[index].cameraID;
+    if (worker_control(index) == NULL)
+        return false;
+    if (!SendWorkerShader(camera->control, ++monitor.command_sequence, code))
+    {
+        fprintf(stderr, "Camera %u did not take shader command %u\n", camera_id, monitor.command_sequence);
+        CloseWorkerControl(camera->control);
+        camera->control = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a tracking shader, GLSL or SPIR-V, replacing code only when the whole file was read.
+ */
+static bool load_shader(const char* path, UpdateGLSLCode* code)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "Cannot read shader %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    if (info.st_size <= 0 || info.st_size > WORKER_MAX_SHADER_SIZE)
+    {
+        fprintf(stderr, "Shader %s is empty or larger than %u bytes\n", path, WORKER_MAX_SHADER_SIZE);
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+    uint8_t* buffer = (uint8_t*)malloc(size);
+    size_t done = 0;
+    while (buffer && done < size)
+    {
+        ssize_t count = read(fd, buffer + done, size - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        done += (size_t)count;
+    }
+    close(fd);
+    if (buffer == NULL || done != size)
+    {
+        fprintf(stderr, "Cannot read shader %s: it changed while being read\n", path);
+        free(buffer);
+        return false;
+    }
+    free(code->buffer);
+    code->buffer = buffer;
+    code->length = size;
+    code->purpose = UpdateTrackingCompute;
+    return true;
+}
+
+/**
+ * @brief Watches the directory of the --shader file, editors often save by renaming a new file
+ * over the old one, which a watch on the file itself would miss.
+ */
+static void watch_shader()
+{
+    const char* slash = strrchr(monitor.shader_path, '/');
+    char directory[4096] = ".";
+    monitor.shader_name = slash ? slash + 1 : monitor.shader_path;
+    if (slash)
+    {
+        size_t length = slash == monitor.shader_path ? 1 : (size_t)(slash - monitor.shader_path);
+        if (length >= sizeof(directory))
+            return;
+        memcpy(directory, monitor.shader_path, length);
+        directory[length] = '\0';
+    }
+    monitor.shader_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (monitor.shader_watch == -1 || inotify_add_watch(monitor.shader_watch, directory, IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+    {
+        fprintf(stderr, "Cannot watch %s, %s is only sent once per worker: %s\n", directory, monitor.shader_path, strerror(errno));
+        if (monitor.shader_watch != -1)
+            close(monitor.shader_watch);
+        monitor.shader_watch = -1;
+    }
+}
+
+/**
+ * @brief Reloads the --shader file after it was saved, every running worker then gets it again.
+ */
+static void read_shader_watch()
+{
+    if (monitor.shader_watch == -1)
+        return;
+    alignas(struct inotify_event) char buffer[MONITOR_INOTIFY_BUFFER_SIZE];
+    bool saved = false;
+    for (;;)
+    {
+        ssize_t length = read(monitor.shader_watch, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        for (char* position = buffer; position < buffer + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)position;
+            position += sizeof(struct inotify_event) + event->len;
+            if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && strcmp(event->name, monitor.shader_name) == 0))
+                saved = true;
+        }
+    }
+    if (!saved || !load_shader(monitor.shader_path, &monitor.shader))
+        return;
+    printf("Reloading %s\n", monitor.shader_path);
+    for (uint32_t i = 0; i < monitor.camera_count; ++i)
+        monitor.monitored[i].shader_pid = 0;
+}
+
+/**
+ * @brief Sends the watched shader once to every worker that runs, a respawned worker starts from
+ * the shipped shader and gets it again.
+ */
+static void update_shader(uint32_t index)
+{
+    monitored_camera* camera = &monitor.monitored[index];
+    const SupervisedWorker* worker = &monitor.supervisor->workers[camera->worker];
+    if (monitor.shader.length == 0 || worker->pid == 0 || atomic_load(&worker->heartbeat->state) != WorkerStateRunning)
+        return;
+    if (camera->shader_pid == worker->pid && camera->shader_restarts == worker->restarts)
+        return;
+    // One attempt per worker and saved version, a failure was reported
+    camera->shader_pid = worker->pid;
+    camera->shader_restarts = worker->restarts;
+    send_worker_shader(index, &monitor.shader);
+}
+
+/**
+ * @brief Parses a stdin command line and sends it to the cameras it names.
+ */
+static void run_command(const char* line)
+{
+    char verb[16], target[16];
+    int offset = 0;
+    if (sscanf(line, "%15s %15s %n", verb, target, &offset) < 2 || offset == 0)
+    {
+        if (line[strspn(line, " \t\r")] != '\0')
+            fprintf(stderr, "Expected a command and a camera, see --help\n");
+        return;
+    }
+    const char* arguments = line + offset;
+    WorkerCommand command;
+    memset(&command, 0, sizeof(command));
+    UpdateGLSLCode shader = { 0 };
+    unsigned v[7];
+    bool valid = false;
+    if (strcmp(verb, "shader") == 0)
+    {
+        char path[MONITOR_COMMAND_LENGTH];
+        size_t length = strcspn(arguments, "\r");
+        while (length > 0 && (arguments[length - 1] == ' ' || arguments[length - 1] == '\t'))
+            --length;
+        memcpy(path, arguments, length);
+        path[length] = '\0';
+        if (length > 0 && !load_shader(path, &shader))
+            return;
+        valid = length > 0;
+    }
+    else if (strcmp(verb, "resolution") == 0 && sscanf(arguments, "%u %u", &v[0], &v[1]) == 2)
+    {
+        command.type = WorkerCommandSetResolution;
+        command.resolution.width = v[0];
+        command.resolution.height = v[1];
+        valid = v[0] > 0 && v[1] > 0;
+    }
+    else if (strcmp(verb, "fps") == 0 && sscanf(arguments, "%u", &v[0]) == 1)
+    {
+        command.type = WorkerCommandSetFrameRate;
+        command.frameRate.fps = v[0];
+        valid = v[0] > 0;
+    }
+    else if (strcmp(verb, "exposure") == 0 && sscanf(arguments, "%d", &command.exposure.exposure) == 1)
+    {
+        command.type = WorkerCommandSetExposure;
+        valid = command.exposure.exposure >= WORKER_EXPOSURE_AUTO;
+    }
+    else if (strcmp(verb, "markers") == 0 && sscanf(arguments, "%u", &v[0]) == 1)
+    {
+        command.type = WorkerCommandSetMarkerCount;
+        command.markerCount.count = v[0];
+        valid = v[0] > 0 && v[0] <= WORKER_MAX_MARKERS;
+    }
+    else if (strcmp(verb, "roi") == 0 && sscanf(arguments, "%u", &v[0]) == 1)
+    {
+        command.type = WorkerCommandSetRoiMargin;
+        command.roiMargin.margin = v[0];
+        valid = true;
+    }
+    else if (strcmp(verb, "color") == 0 && sscanf(arguments, "%u:%u,%u,%u,%u,%u,%u", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) == 7)
+    {
+        command.type = WorkerCommandSetMarkerColor;
+        command.markerColor.marker = v[0];
+        valid = v[0] < WORKER_MAX_MARKERS;
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            command.markerColor.min[channel] = (uint8_t)v[1 + channel];
+            command.markerColor.max[channel] = (uint8_t)v[4 + channel];
+            valid = valid && v[1 + channel] <= UINT8_MAX && v[4 + channel] <= UINT8_MAX;
+        }
+    }
+    else if (strcmp(verb, "calibrate") == 0 && sscanf(arguments, "%u %u %u %u %u", &v[0], &v[1], &v[2], &v[3], &v[4]) == 5)
+    {
+        command.type = WorkerCommandCalibrateMarker;
+        command.calibration.marker = v[0];
+        command.calibration.x = (uint16_t)v[1];
+        command.calibration.y = (uint16_t)v[2];
+        command.calibration.width = (uint16_t)v[3];
+        command.calibration.height = (uint16_t)v[4];
+        valid = v[0] < WORKER_MAX_MARKERS && v[1] <= UINT16_MAX && v[2] <= UINT16_MAX &&
+            v[3] > 0 && v[3] <= UINT16_MAX && v[4] > 0 && v[4] <= UINT16_MAX;
+    }
+    else if (strcmp(verb, "stop") == 0)
+    {
+        // The worker exits cleanly, so the supervisor does not respawn it
+        command.type = WorkerCommandStop;
+        valid = true;
+    }
+    if (!valid)
+    {
+        fprintf(stderr, "Invalid command \"%s\", see --help\n", line);
+        return;
+    }
+
+    bool all = strcmp(target, "all") == 0;
+    char* end = NULL;
+    unsigned long camera_id = strtoul(target, &end, 10);
+    if (!all && (end == target || *end != '\0'))
+    {
+        fprintf(stderr, "Unknown camera \"%s\"\n", target);
+        free(shader.buffer);
+        return;
+    }
+    bool found = false;
+    for (uint32_t i = 0; i < monitor.camera_count; ++i)
+    {
+        if (!all && monitor.cameras[i].cameraID != camera_id)
+            continue;
+        found = true;
+        if (shader.length > 0)
+            send_worker_shader(i, &shader);
+        else
+            send_worker_command(i, &command);
+    }
+    if (!found)
+        fprintf(stderr, "No camera %s\n", target);
+    free(shader.buffer);
+}
+
+/**
+ * @brief Runs the commands typed on stdin since the last loop, without blocking.
+ */
+static void read_commands()
+{
+    struct pollfd input = { STDIN_FILENO, POLLIN, 0 };
+    while (!monitor.stdin_closed && poll(&input, 1, 0) > 0)
+    {
+        size_t capacity = sizeof(monitor.command_line) - 1 - monitor.command_length;
+        ssize_t count = read(STDIN_FILENO, monitor.command_line + monitor.command_length, capacity);
+        if (count < 0 && errno == EINTR)
+            continue;
+        // Detached from a terminal, e.g. stdin is /dev/null
+        if (count <= 0)
+        {
+            monitor.stdin_closed = true;
+            return;
+        }
+        monitor.command_length += (size_t)count;
+        char* start = monitor.command_line;
+        char* newline;
+        while ((newline = memchr(start, '\n', monitor.command_length - (size_t)(start - monitor.command_line))) != NULL)
+        {
+            *newline = '\0';
+            if (!monitor.command_dropped)
+                run_command(start);
+            monitor.command_dropped = false;
+            start = newline + 1;
+        }
+        monitor.command_length -= (size_t)(start - monitor.command_line);
+        memmove(monitor.command_line, start, monitor.command_length);
+        if (monitor.command_length == sizeof(monitor.command_line) - 1)
+        {
+            fprintf(stderr, "Command longer than %u characters dropped\n", MONITOR_COMMAND_LENGTH - 1);
+            monitor.command_length = 0;
+            monitor.command_dropped = true;
+        }
+    }
+}
+
+/**
+ * @brief Shows each camera's capture to output latency of the last window in the window title,
+ * or on stdout without a window.
+ */
+static void update_overlay(GLFWwindow* window, uint64_t nowNs)
+{
+    uint64_t elapsed = nowNs - monitor.overlay_ns;
+    if (elapsed < LATENCY_WINDOW_NS)
+        return;
+    monitor.overlay_ns = nowNs;
+    char text[512] = "FreeTrack";
+    size_t length = strlen(text);
+    for (uint32_t i = 0; i < monitor.camera_count && length < sizeof(text); ++i)
+    {
+        monitored_camera* camera = &monitor.monitored[i];
+        double preview_rate = camera->preview_count * 1e9 / elapsed;
+        camera->preview_count = 0;
+        LatencySummary total;
+        if (camera->latency == NULL || !ReadLatencySummary(camera->latency->board, LatencyStageCount, &total) || total.count == 0)
+            continue;
+        // A camera that stopped sending keeps its last window, it is not current anymore
+        if (nowNs - total.windowEndNs > 2 * LATENCY_WINDOW_NS)
+            continue;
+        length += (size_t)snprintf(text + length, sizeof(text) - length, " | camera %u p50 %.1f ms p99 %.1f ms",
+            monitor.cameras[i].cameraID, total.p50Ns / 1e6, total.p99Ns / 1e6);
+        if (camera->preview && length < sizeof(text))
+            length += (size_t)snprintf(text + length, sizeof(text) - length, " preview %.0f fps", preview_rate);
+    }
+    if (window)
+        glfwSetWindowTitle(window, text);
+    else if (length > strlen("FreeTrack"))
+        printf("Latency%s\n", text + strlen("FreeTrack"));
+}
+
+int main(int argc, const char* argv[argc])
+{
+    if (parse_arguments(argc, argv))
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = handle_quit_signal;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    int ret = 1;
+    // Without a display the monitor still supervises the cameras
+    GLFWwindow* window = NULL;
+    bool glfw = glfwInit();
+    if (glfw)
+    {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(width, height, "FreeTrack", NULL, NULL);
+    }
+    if (window == NULL)
+        fprintf(stderr, "No window, running headless\n");
+    if (monitor.output_host[0])
+    {
+        monitor.output = CreateCoordinateSender(monitor.output_host, monitor.output_port);
+        if (monitor.output == NULL)
+            goto cleanup;
+    }
+    if (monitor.listen_port)
+    {
+        monitor.receiver = CreateCoordinateReceiver(NULL, monitor.listen_port);
+        if (monitor.receiver == NULL)
+            goto cleanup;
+    }
+    if (monitor.shader_path)
+    {
+        if (!load_shader(monitor.shader_path, &monitor.shader))
+            goto cleanup;
+        watch_shader();
+    }
+    if (!start_workers())
+        goto cleanup;
+
+    while (!atomic_load(&quit) && !(window && glfwWindowShouldClose(window)))
+    {
+        PollSupervisor(monitor.supervisor, monotonic_ns());
+        for (uint32_t i = 0; i < monitor.camera_count; ++i)
+        {
+            update_ring(i);
+            read_ring(i);
+            update_shader(i);
+            update_preview(i, window, monotonic_ns());
+        }
+        read_receiver();
+        flush_packets();
+        read_commands();
+        read_shader_watch();
+        update_overlay(window, monotonic_ns());
+        if (window)
+            glfwWaitEventsTimeout(MONITOR_POLL_INTERVAL_S);
+        else
+            usleep((useconds_t)(MONITOR_POLL_INTERVAL_S * 1000000));
+    }
+    ret = 0;
+
+cleanup:
+    for (uint32_t i = 0; i < monitor.camera_count; ++i)
+    {
+        CloseCoordinateRing(monitor.monitored[i].ring);
+        DestroyPreviewReader(monitor.monitored[i].preview);
+        CloseWorkerControl(monitor.monitored[i].control);
+        DestroyLatencyRecorder(monitor.monitored[i].latency);
+    }
+    // Stops the workers for good, SIGKILL for any that ignores SIGTERM
+    DestroySupervisor(monitor.supervisor);
+    CloseCoordinateSocket(monitor.output);
+    CloseCoordinateSocket(monitor.receiver);
+    if (monitor.shader_watch != -1)
+        close(monitor.shader_watch);
+    free(monitor.shader.buffer);
+    if (window)
+        glfwDestroyWindow(window);
+    if (glfw)
+        glfwTerminate();
+    return ret;
+}
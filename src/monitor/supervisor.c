@@ -0,0 +1,323 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "supervisor.h"
+
+#define WORKER_EXECUTABLE_NAME "camera"
+#define WORKER_MAX_ARGUMENTS (32 + 2 * WORKER_MAX_MARKERS)
+
+static uint64_t MonotonicNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static const char* CaptureFormatName(WorkerCaptureFormat format)
+{
+    switch (format)
+    {
+        case WorkerCaptureYUYV:
+            return "yuyv";
+        case WorkerCaptureNV12:
+            return "nv12";
+        case WorkerCaptureH264:
+        default:
+            return "h264";
+    }
+}
+
+// Storage for the formatted arguments, filled before fork so the child only calls exec
+typedef struct WorkerArguments
+{
+    char numbers[10][24];
+    char colors[WORKER_MAX_MARKERS][48];
+    char* argv[WORKER_MAX_ARGUMENTS];
+} WorkerArguments;
+
+static void BuildWorkerArguments(const Supervisor supervisor, const SupervisedWorker* worker, WorkerArguments* arguments)
+{
+    const WorkerConfig* config = &worker->config;
+    const WorkerSettings* settings = &config->settings;
+    uint32_t argc = 0;
+    uint32_t number = 0;
+    char** argv = arguments->argv;
+#define WORKER_NUMBER_ARGUMENT(option, format, value) \
+    argv[argc++] = option; \
+    snprintf(arguments->numbers[number], sizeof(arguments->numbers[number]), format, value); \
+    argv[argc++] = arguments->numbers[number++];
+
+    argv[argc++] = (char*)supervisor->workerPath;
+    WORKER_NUMBER_ARGUMENT("--camera-id", "%u", config->cameraID);
+    argv[argc++] = "--device";
+    argv[argc++] = (char*)config->devicePath;
+    argv[argc++] = "--format";
+    argv[argc++] = (char*)CaptureFormatName(config->format);
+    WORKER_NUMBER_ARGUMENT("--width", "%u", settings->width);
+    WORKER_NUMBER_ARGUMENT("--height", "%u", settings->height);
+    WORKER_NUMBER_ARGUMENT("--fps", "%u", settings->fps);
+    WORKER_NUMBER_ARGUMENT("--exposure", "%d", settings->exposure);
+    WORKER_NUMBER_ARGUMENT("--markers", "%u", settings->markerCount);
+    WORKER_NUMBER_ARGUMENT("--roi-margin", "%u", settings->roiMargin);
+    WORKER_NUMBER_ARGUMENT("--heartbeat-fd", "%d", worker->heartbeatFd);
+#undef WORKER_NUMBER_ARGUMENT
+    for (uint32_t i = 0; i < settings->markerCount && i < WORKER_MAX_MARKERS; ++i)
+    {
+        const uint8_t* min = settings->markerMin[i];
+        const uint8_t* max = settings->markerMax[i];
+        if (min[0] > max[0] || min[1] > max[1] || min[2] > max[2])
+            continue;
+        snprintf(arguments->colors[i], sizeof(arguments->colors[i]), "%u:%u,%u,%u,%u,%u,%u", i, min[0], min[1], min[2], max[0], max[1], max[2]);
+        argv[argc++] = "--color";
+        argv[argc++] = arguments->colors[i];
+    }
+    argv[argc] = NULL;
+}
+
+static bool SpawnWorker(Supervisor supervisor, SupervisedWorker* worker, uint64_t nowNs)
+{
+    // Respawn with whatever the previous run last had working, including live reconfigurations
+    WorkerSettings published;
+    if (ReadWorkerSettings(worker->heartbeat, &published))
+        worker->config.settings = published;
+    atomic_store(&worker->heartbeat->lastBeatNs, 0);
+    atomic_store(&worker->heartbeat->frameCount, 0);
+    atomic_store(&worker->heartbeat->state, WorkerStateStarting);
+
+    WorkerArguments arguments;
+    BuildWorkerArguments(supervisor, worker, &arguments);
+    int cpu = worker->config.cpu;
+    int heartbeatFd = worker->heartbeatFd;
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        fprintf(stderr, "Failed to fork camera %u worker: %s\n", worker->config.cameraID, strerror(errno));
+        return false;
+    }
+    if (pid == 0)
+    {
+        // Workers must not outlive the supervisor and keep the device open
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent)
+            _exit(1);
+        // Only this worker's heartbeat survives the exec
+        fcntl(heartbeatFd, F_SETFD, 0);
+        if (cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        execv(arguments.argv[0], arguments.argv);
+        _exit(127);
+    }
+    worker->pid = pid;
+    worker->spawnNs = nowNs;
+    return true;
+}
+
+Supervisor CreateSupervisor(const char* workerPath)
+{
+    Supervisor supervisor = (Supervisor)calloc(sizeof(struct Supervisor), 1);
+    if (supervisor == NULL)
+        return NULL;
+    if (workerPath)
+    {
+        snprintf(supervisor->workerPath, sizeof(supervisor->workerPath), "%s", workerPath);
+        return supervisor;
+    }
+    // meson builds the camera worker into the same directory as the monitor
+    char executable[WORKER_PATH_LENGTH];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    char* slash = NULL;
+    if (length > 0)
+    {
+        executable[length] = '\0';
+        slash = strrchr(executable, '/');
+    }
+    if (slash == NULL)
+    {
+        snprintf(supervisor->workerPath, sizeof(supervisor->workerPath), "./%s", WORKER_EXECUTABLE_NAME);
+        return supervisor;
+    }
+    size_t directoryLength = (size_t)(slash + 1 - executable);
+    if (directoryLength + sizeof(WORKER_EXECUTABLE_NAME) > sizeof(supervisor->workerPath))
+    {
+        fprintf(stderr, "Camera worker path is too long\n");
+        free(supervisor);
+        return NULL;
+    }
+    memcpy(supervisor->workerPath, executable, directoryLength);
+    memcpy(supervisor->workerPath + directoryLength, WORKER_EXECUTABLE_NAME, sizeof(WORKER_EXECUTABLE_NAME));
+    return supervisor;
+}
+
+int AddSupervisedCamera(Supervisor supervisor, const WorkerConfig* config)
+{
+    if (supervisor == NULL || config == NULL || supervisor->workerCount == MAX_SUPERVISED_CAMERAS)
+        return -1;
+    SupervisedWorker* worker = &supervisor->workers[supervisor->workerCount];
+    memset(worker, 0, sizeof(*worker));
+    worker->config = *config;
+    worker->heartbeat = CreateWorkerHeartbeat(&worker->heartbeatFd);
+    if (worker->heartbeat == NULL)
+    {
+        fprintf(stderr, "Failed to create heartbeat for camera %u\n", config->cameraID);
+        return -1;
+    }
+    worker->backoffNs = WORKER_RESPAWN_BACKOFF_NS;
+    uint64_t now = MonotonicNs();
+    if (!SpawnWorker(supervisor, worker, now))
+        worker->nextSpawnNs = now + worker->backoffNs;
+    return (int)supervisor->workerCount++;
+}
+
+static void WorkerExited(SupervisedWorker* worker, int status, uint64_t nowNs)
+{
+    uint32_t state = atomic_load(&worker->heartbeat->state);
+    uint64_t frames = atomic_load(&worker->heartbeat->frameCount);
+    worker->pid = 0;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && state == WorkerStateStopped)
+    {
+        printf("Camera %u worker stopped\n", worker->config.cameraID);
+        worker->stopped = true;
+        return;
+    }
+    if (WIFSIGNALED(status))
+        fprintf(stderr, "Camera %u worker killed by signal %d after %lu frames\n", worker->config.cameraID, WTERMSIG(status), (unsigned long)frames);
+    else
+        fprintf(stderr, "Camera %u worker exited with %d after %lu frames\n", worker->config.cameraID, WEXITSTATUS(status), (unsigned long)frames);
+
+    if (frames > 0)
+    {
+        // It was tracking, bring it back right away
+        worker->backoffNs = WORKER_RESPAWN_BACKOFF_NS;
+        worker->nextSpawnNs = nowNs;
+    }
+    else
+    {
+        // Failing before the first frame, e.g. the device is gone, do not spin on it
+        worker->nextSpawnNs = nowNs + worker->backoffNs;
+        worker->backoffNs = worker->backoffNs * 2 > WORKER_RESPAWN_MAX_BACKOFF_NS ? WORKER_RESPAWN_MAX_BACKOFF_NS : worker->backoffNs * 2;
+    }
+}
+
+uint32_t PollSupervisor(Supervisor supervisor, uint64_t nowNs)
+{
+    uint32_t respawned = 0;
+    for (uint32_t i = 0; i < supervisor->workerCount; ++i)
+    {
+        SupervisedWorker* worker = &supervisor->workers[i];
+        if (worker->pid != 0)
+        {
+            int status = 0;
+            pid_t result = waitpid(worker->pid, &status, WNOHANG);
+            if (result == worker->pid || (result < 0 && errno == ECHILD))
+            {
+                WorkerExited(worker, status, nowNs);
+            }
+            else if (!worker->stopped)
+            {
+                uint32_t state = atomic_load(&worker->heartbeat->state);
+                uint64_t lastBeat = atomic_load_explicit(&worker->heartbeat->lastBeatNs, memory_order_acquire);
+                // Killed workers are reaped and respawned by a later poll, waiting here could block
+                // on a process stuck in the driver
+                if (state == WorkerStateStarting && nowNs - worker->spawnNs > WORKER_STARTUP_TIMEOUT_NS)
+                {
+                    fprintf(stderr, "Camera %u worker did not start in time, killing it\n", worker->config.cameraID);
+                    kill(worker->pid, SIGKILL);
+                }
+                else if (state == WorkerStateRunning && lastBeat != 0 && nowNs > lastBeat && nowNs - lastBeat > WORKER_STALL_TIMEOUT_NS)
+                {
+                    fprintf(stderr, "Camera %u worker stalled for %lu ms, killing it\n", worker->config.cameraID, (unsigned long)((nowNs - lastBeat) / 1000000));
+                    kill(worker->pid, SIGKILL);
+                }
+            }
+        }
+        if (worker->pid == 0 && !worker->stopped && nowNs >= worker->nextSpawnNs)
+        {
+            if (SpawnWorker(supervisor, worker, nowNs))
+            {
+                worker->restarts++;
+                respawned++;
+            }
+            else
+            {
+                worker->nextSpawnNs = nowNs + worker->backoffNs;
+            }
+        }
+    }
+    return respawned;
+}
+
+// Sends SIGTERM and waits, SIGKILL once the timeout passes, then waits up to WORKER_KILL_TIMEOUT_NS
+// for the kill to land. A worker stuck in uninterruptible sleep for longer keeps its pid, a later
+// PollSupervisor reaps it, or after DestroySupervisor it stays a zombie until the monitor exits.
+static void StopWorkers(Supervisor supervisor, uint32_t first, uint32_t count)
+{
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        supervisor->workers[i].stopped = true;
+        if (supervisor->workers[i].pid != 0)
+            kill(supervisor->workers[i].pid, SIGTERM);
+    }
+    uint64_t deadline = MonotonicNs() + WORKER_STOP_TIMEOUT_NS;
+    bool killed = false;
+    for (;;)
+    {
+        bool running = false;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            SupervisedWorker* worker = &supervisor->workers[i];
+            if (worker->pid != 0 && waitpid(worker->pid, NULL, WNOHANG) == 0)
+                running = true;
+            else
+                worker->pid = 0;
+        }
+        uint64_t now = MonotonicNs();
+        if (!running || (killed && now >= deadline))
+            return;
+        if (!killed && now >= deadline)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if (supervisor->workers[i].pid != 0)
+                    kill(supervisor->workers[i].pid, SIGKILL);
+            }
+            killed = true;
+            deadline = now + WORKER_KILL_TIMEOUT_NS;
+        }
+        usleep(10000);
+    }
+}
+
+void StopSupervisedCamera(Supervisor supervisor, uint32_t index)
+{
+    if (supervisor == NULL || index >= supervisor->workerCount)
+        return;
+    StopWorkers(supervisor, index, 1);
+}
+
+void DestroySupervisor(Supervisor supervisor)
+{
+    if (supervisor == NULL)
+        return;
+    StopWorkers(supervisor, 0, supervisor->workerCount);
+    for (uint32_t i = 0; i < supervisor->workerCount; ++i)
+    {
+        UnmapWorkerHeartbeat(supervisor->workers[i].heartbeat);
+        close(supervisor->workers[i].heartbeatFd);
+    }
+    free(supervisor);
+}
@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "latency.h"
+
+#define LATENCY_TOTAL LatencyStageCount
+
+static uint64_t MonotonicNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Log-linear buckets: exact below LATENCY_SUB_BUCKETS, then each power of two split evenly
+static uint32_t LatencyBucket(uint64_t ns)
+{
+    if (ns < LATENCY_SUB_BUCKETS)
+        return (uint32_t)ns;
+    if (ns > UINT32_MAX)
+        return LATENCY_BUCKET_COUNT - 1;
+    uint32_t exponent = 63 - (uint32_t)__builtin_clzll(ns);
+    uint32_t sub = (uint32_t)(ns >> (exponent - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+    return (exponent - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// Largest value of a bucket, percentiles err on the slow side
+static uint64_t LatencyBucketLimit(uint32_t bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS)
+        return bucket;
+    uint32_t shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lower + ((1ull << shift) - 1);
+}
+
+static uint64_t LatencyPercentile(const uint32_t* counts, uint32_t total, uint32_t percent, uint64_t maxNs)
+{
+    uint64_t rank = ((uint64_t)total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank && seen > 0)
+        {
+            uint64_t limit = LatencyBucketLimit(i);
+            return limit < maxNs ? limit : maxNs;
+        }
+    }
+    return maxNs;
+}
+
+void StampLatency(LatencyStamps* stamps, LatencyStage stage)
+{
+    stamps->stampNs[stage] = MonotonicNs();
+}
+
+uint64_t LatencyCaptureTimestamp(uint64_t seconds, uint64_t microseconds, bool monotonic)
+{
+    // Drivers on the realtime or a hardware clock cannot be compared with the other stamps
+    if (!monotonic || (seconds == 0 && microseconds == 0))
+        return 0;
+    return seconds * 1000000000ull + microseconds * 1000ull;
+}
+
+static LatencyBoard* MapLatencyBoard(uint32_t cameraID, bool writable, char* name, size_t nameSize)
+{
+    snprintf(name, nameSize, LATENCY_BOARD_NAME_FORMAT, cameraID);
+    int fd = writable ? shm_open(name, O_CREAT | O_RDWR, 0600) : shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat info;
+    bool sized = fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(LatencyBoard);
+    // Whichever of worker and monitor comes first sizes it, both write the same size
+    if (!sized && writable)
+        sized = ftruncate(fd, sizeof(LatencyBoard)) == 0;
+    void* mapping = sized ? mmap(NULL, sizeof(LatencyBoard), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    return mapping == MAP_FAILED ? NULL : (LatencyBoard*)mapping;
+}
+
+LatencyRecorder CreateLatencyRecorder(uint32_t cameraID, LatencyStage first, LatencyStage last, bool owner)
+{
+    if (first >= last || last >= LatencyStageCount)
+        return NULL;
+    LatencyRecorder recorder = (LatencyRecorder)calloc(sizeof(struct LatencyRecorder), 1);
+    if (recorder == NULL)
+        return NULL;
+    recorder->board = MapLatencyBoard(cameraID, true, recorder->name, sizeof(recorder->name));
+    if (recorder->board == NULL)
+    {
+        fprintf(stderr, "Failed to open latency board %s: %s\n", recorder->name, strerror(errno));
+        free(recorder);
+        return NULL;
+    }
+    recorder->owner = owner;
+    recorder->first = first;
+    recorder->last = last;
+    LatencyBoard* board = recorder->board;
+    board->version = LATENCY_BOARD_VERSION;
+    board->cameraID = cameraID;
+    atomic_store_explicit(&board->magic, LATENCY_BOARD_MAGIC, memory_order_release);
+    return recorder;
+}
+
+static void AddLatency(LatencyRecorder recorder, uint32_t row, uint64_t ns)
+{
+    recorder->counts[row][LatencyBucket(ns)]++;
+    if (ns > recorder->maxNs[row])
+        recorder->maxNs[row] = ns;
+}
+
+static void PublishLatencySummary(LatencySummary* summary, const uint32_t* counts, uint64_t maxNs, uint64_t windowEndNs)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+        count += counts[i];
+    uint32_t sequence = atomic_load_explicit(&summary->sequence, memory_order_relaxed);
+    atomic_store_explicit(&summary->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    summary->count = count;
+    summary->windowEndNs = windowEndNs;
+    summary->p50Ns = LatencyPercentile(counts, count, 50, maxNs);
+    summary->p90Ns = LatencyPercentile(counts, count, 90, maxNs);
+    summary->p99Ns = LatencyPercentile(counts, count, 99, maxNs);
+    summary->maxNs = maxNs;
+    atomic_store_explicit(&summary->sequence, sequence + 2, memory_order_release);
+}
+
+static void PublishLatencyWindow(LatencyRecorder recorder, uint64_t nowNs)
+{
+    LatencyBoard* board = recorder->board;
+    for (uint32_t stage = recorder->first + 1; stage <= recorder->last; ++stage)
+        PublishLatencySummary(&board->stages[stage], recorder->counts[stage], recorder->maxNs[stage], nowNs);
+    if (recorder->last == LatencyStageOutput)
+        PublishLatencySummary(&board->total, recorder->counts[LATENCY_TOTAL], recorder->maxNs[LATENCY_TOTAL], nowNs);
+    memset(recorder->counts, 0, sizeof(recorder->counts));
+    memset(recorder->maxNs, 0, sizeof(recorder->maxNs));
+    recorder->windowStartNs = nowNs;
+}
+
+void RecordFrameLatency(LatencyRecorder recorder, const LatencyStamps* stamps, uint64_t nowNs)
+{
+    if (recorder == NULL)
+        return;
+    if (recorder->windowStartNs == 0)
+        recorder->windowStartNs = nowNs;
+
+    // The first stage only anchors the next one, it belongs to the previous recorder
+    uint64_t previous = 0;
+    for (uint32_t stage = 0; stage <= recorder->first; ++stage)
+        previous = stamps->stampNs[stage] ? stamps->stampNs[stage] : previous;
+    for (uint32_t stage = recorder->first + 1; stage <= recorder->last; ++stage)
+    {
+        uint64_t stamp = stamps->stampNs[stage];
+        if (stamp == 0)
+            continue;
+        // A stamp before its predecessor means mixed clocks, drop it rather than wrap around
+        if (previous != 0 && stamp >= previous)
+            AddLatency(recorder, stage, stamp - previous);
+        previous = stamp;
+    }
+    uint64_t capture = stamps->stampNs[LatencyStageCapture];
+    uint64_t output = stamps->stampNs[LatencyStageOutput];
+    if (recorder->last == LatencyStageOutput && capture != 0 && output >= capture)
+        AddLatency(recorder, LATENCY_TOTAL, output - capture);
+
+    if (nowNs - recorder->windowStartNs >= LATENCY_WINDOW_NS)
+        PublishLatencyWindow(recorder, nowNs);
+}
+
+void DestroyLatencyRecorder(LatencyRecorder recorder)
+{
+    if (recorder == NULL)
+        return;
+    munmap(recorder->board, sizeof(LatencyBoard));
+    if (recorder->owner)
+        shm_unlink(recorder->name);
+    free(recorder);
+}
+
+const LatencyBoard* OpenLatencyBoard(uint32_t cameraID)
+{
+    char name[64];
+    LatencyBoard* board = MapLatencyBoard(cameraID, false, name, sizeof(name));
+    if (board == NULL)
+        return NULL;
+    if (atomic_load_explicit(&board->magic, memory_order_acquire) != LATENCY_BOARD_MAGIC || board->version != LATENCY_BOARD_VERSION)
+    {
+        munmap(board, sizeof(LatencyBoard));
+        return NULL;
+    }
+    return board;
+}
+
+bool ReadLatencySummary(const LatencyBoard* board, uint32_t stage, LatencySummary* out)
+{
+    if (stage > LatencyStageCount)
+        return false;
+    LatencySummary* summary = stage == LatencyStageCount ? (LatencySummary*)&board->total : (LatencySummary*)&board->stages[stage];
+    for (int attempt = 0; attempt < 1000; ++attempt)
+    {
+        uint32_t sequence = atomic_load_explicit(&summary->sequence, memory_order_acquire);
+        if (sequence & 1)
+            continue;
+        out->count = summary->count;
+        out->windowEndNs = summary->windowEndNs;
+        out->p50Ns = summary->p50Ns;
+        out->p90Ns = summary->p90Ns;
+        out->p99Ns = summary->p99Ns;
+        out->maxNs = summary->maxNs;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&summary->sequence, memory_order_relaxed) == sequence)
+        {
+            atomic_init(&out->sequence, sequence);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CloseLatencyBoard(const LatencyBoard* board)
+{
+    if (board)
+        munmap((void*)board, sizeof(LatencyBoard));
+}
+
+void LatencyStampsFromRecord(const CoordinateRecord* record, LatencyStamps* stamps)
+{
+    memset(stamps, 0, sizeof(*stamps));
+    stamps->stampNs[LatencyStageCapture] = record->timestampNs;
+    if (record->timestampNs != 0 && record->sendDelayNs != 0)
+        stamps->stampNs[LatencyStageSend] = record->timestampNs + record->sendDelayNs;
+}
+
+const char* LatencyStageName(uint32_t stage)
+{
+    static const char* names[LatencyStageCount + 1] = {
+        "capture", "dequeue", "decode", "convert", "track", "send", "receive", "fusion", "output", "total"
+    };
+    return stage <= LatencyStageCount ? names[stage] : "unknown";
+}
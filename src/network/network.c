@@ -0,0 +1,828 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include "network.h"
+
+#define COORDINATE_RING_MASK (COORDINATE_RING_CAPACITY - 1)
+_Static_assert((COORDINATE_RING_CAPACITY & COORDINATE_RING_MASK) == 0, "COORDINATE_RING_CAPACITY must be a power of two");
+
+// Shared between processes, so no FUTEX_PRIVATE_FLAG
+static int FutexWait(_Atomic uint32_t* word, uint32_t expected, const struct timespec* timeout)
+{
+    return (int)syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+static void FutexWake(_Atomic uint32_t* word)
+{
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static CoordinateRing MapCoordinateRing(const char* name, int fd, bool owner)
+{
+    void* mapping = mmap(NULL, sizeof(CoordinateRingShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed to map coordinate ring %s: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    CoordinateRing ring = (CoordinateRing)calloc(sizeof(struct CoordinateRing), 1);
+    ring->shared = (CoordinateRingShared*)mapping;
+    ring->fd = fd;
+    ring->owner = owner;
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    return ring;
+}
+
+CoordinateRing CreateCoordinateRing(const char* name)
+{
+    if (name == NULL || strlen(name) >= sizeof(((struct CoordinateRing*)0)->name))
+        return NULL;
+    // A worker that crashed leaves its object behind, start from a zeroed one
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to create coordinate ring %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(CoordinateRingShared)) != 0)
+    {
+        fprintf(stderr, "Failed to size coordinate ring %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    CoordinateRing ring = MapCoordinateRing(name, fd, true);
+    if (ring == NULL)
+    {
+        shm_unlink(name);
+        return NULL;
+    }
+    CoordinateRingShared* shared = ring->shared;
+    shared->capacity = COORDINATE_RING_CAPACITY;
+    shared->recordSize = sizeof(CoordinateRecord);
+    shared->version = COORDINATE_RING_VERSION;
+    // Published last, OpenCoordinateRing checks it before trusting the rest
+    atomic_store_explicit(&shared->magic, COORDINATE_RING_MAGIC, memory_order_release);
+    return ring;
+}
+
+CoordinateRing OpenCoordinateRing(const char* name)
+{
+    if (name == NULL || strlen(name) >= sizeof(((struct CoordinateRing*)0)->name))
+        return NULL;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CoordinateRingShared))
+    {
+        close(fd);
+        return NULL;
+    }
+    CoordinateRing ring = MapCoordinateRing(name, fd, false);
+    if (ring == NULL)
+        return NULL;
+    CoordinateRingShared* shared = ring->shared;
+    if (atomic_load_explicit(&shared->magic, memory_order_acquire) != COORDINATE_RING_MAGIC ||
+        shared->version != COORDINATE_RING_VERSION || shared->capacity != COORDINATE_RING_CAPACITY ||
+        shared->recordSize != sizeof(CoordinateRecord))
+    {
+        fprintf(stderr, "Coordinate ring %s has an incompatible layout\n", name);
+        CloseCoordinateRing(ring);
+        return NULL;
+    }
+    ring->cachedHead = atomic_load_explicit(&shared->head, memory_order_acquire);
+    return ring;
+}
+
+bool PushCoordinateRecords(CoordinateRing ring, uint32_t count, const CoordinateRecord* records)
+{
+    CoordinateRingShared* shared = ring->shared;
+    uint64_t head = atomic_load_explicit(&shared->head, memory_order_relaxed);
+    if (head + count - ring->cachedTail > COORDINATE_RING_CAPACITY)
+    {
+        // Only read the consumer's line when the cached tail says the ring may be full
+        ring->cachedTail = atomic_load_explicit(&shared->tail, memory_order_acquire);
+        if (head + count - ring->cachedTail > COORDINATE_RING_CAPACITY)
+        {
+            atomic_fetch_add_explicit(&shared->dropped, count, memory_order_relaxed);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i)
+        shared->records[(head + i) & COORDINATE_RING_MASK] = records[i];
+    atomic_store_explicit(&shared->head, head + count, memory_order_release);
+
+    // Pairs with the fence in WaitCoordinateRecords so either the consumer sees the new head
+    // or the producer sees it waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&shared->consumerWaiting, memory_order_relaxed))
+    {
+        atomic_fetch_add_explicit(&shared->wakeSequence, 1, memory_order_relaxed);
+        FutexWake(&shared->wakeSequence);
+    }
+    return true;
+}
+
+uint32_t PopCoordinateRecords(CoordinateRing ring, uint32_t maxCount, CoordinateRecord* out)
+{
+    CoordinateRingShared* shared = ring->shared;
+    uint64_t tail = atomic_load_explicit(&shared->tail, memory_order_relaxed);
+    if (ring->cachedHead == tail)
+    {
+        ring->cachedHead = atomic_load_explicit(&shared->head, memory_order_acquire);
+        if (ring->cachedHead == tail)
+            return 0;
+    }
+    uint64_t available = ring->cachedHead - tail;
+    uint32_t count = available < maxCount ? (uint32_t)available : maxCount;
+    for (uint32_t i = 0; i < count; ++i)
+        out[i] = shared->records[(tail + i) & COORDINATE_RING_MASK];
+    atomic_store_explicit(&shared->tail, tail + count, memory_order_release);
+    return count;
+}
+
+uint32_t WaitCoordinateRecords(CoordinateRing ring, uint32_t maxCount, CoordinateRecord* out, uint64_t timeoutNs)
+{
+    uint32_t count = PopCoordinateRecords(ring, maxCount, out);
+    if (count > 0 || timeoutNs == 0)
+        return count;
+    CoordinateRingShared* shared = ring->shared;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t deadlineNs = (uint64_t)deadline.tv_sec * 1000000000ull + (uint64_t)deadline.tv_nsec + timeoutNs;
+    if (deadlineNs < timeoutNs)
+        deadlineNs = UINT64_MAX;
+    for (;;)
+    {
+        uint32_t wake = atomic_load_explicit(&shared->wakeSequence, memory_order_relaxed);
+        atomic_store_explicit(&shared->consumerWaiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        count = PopCoordinateRecords(ring, maxCount, out);
+        if (count > 0)
+            break;
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t nowNs = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+        if (nowNs >= deadlineNs)
+            break;
+        if (timeoutNs == UINT64_MAX)
+        {
+            FutexWait(&shared->wakeSequence, wake, NULL);
+        }
+        else
+        {
+            // FUTEX_WAIT takes a relative timeout
+            uint64_t remaining = deadlineNs - nowNs;
+            struct timespec timeout = { (time_t)(remaining / 1000000000ull), (long)(remaining % 1000000000ull) };
+            FutexWait(&shared->wakeSequence, wake, &timeout);
+        }
+    }
+    atomic_store_explicit(&shared->consumerWaiting, 0, memory_order_relaxed);
+    return count;
+}
+
+void CloseCoordinateRing(CoordinateRing ring)
+{
+    if (ring == NULL)
+        return;
+    munmap(ring->shared, sizeof(CoordinateRingShared));
+    close(ring->fd);
+    if (ring->owner)
+        shm_unlink(ring->name);
+    free(ring);
+}
+
+CoordinationDatagram CoordinateRecordToDatagram(const CoordinateRecord* record)
+{
+    CoordinationDatagram datagram = {
+        .CameraID = record->cameraID,
+        .X = (uint32_t)(record->x + 0.5f),
+        .Y = (uint32_t)(record->y + 0.5f)
+    };
+    return datagram;
+}
+
+static void WriteU16(uint8_t* p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void WriteU32(uint8_t* p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void WriteU64(uint8_t* p, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void WriteF32(uint8_t* p, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    WriteU32(p, bits);
+}
+
+static uint16_t ReadU16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t ReadU32(const uint8_t* p)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= (uint32_t)p[i] << (8 * i);
+    return value;
+}
+
+static uint64_t ReadU64(const uint8_t* p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+        value |= (uint64_t)p[i] << (8 * i);
+    return value;
+}
+
+static float ReadF32(const uint8_t* p)
+{
+    uint32_t bits = ReadU32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+size_t EncodeCoordinatePacket(const CoordinatePacket* packet, uint8_t* buffer, size_t size)
+{
+    if (packet->markerCount > COORDINATE_PACKET_MAX_MARKERS)
+        return 0;
+    size_t packetSize = COORDINATE_PACKET_HEADER_SIZE + (size_t)packet->markerCount * COORDINATE_PACKET_MARKER_SIZE;
+    if (size < packetSize)
+        return 0;
+    WriteU16(buffer, COORDINATE_PACKET_MAGIC);
+    buffer[2] = COORDINATE_PACKET_VERSION;
+    buffer[3] = (uint8_t)packet->markerCount;
+    WriteU32(buffer + 4, packet->cameraID);
+    WriteU64(buffer + 8, packet->frameSequence);
+    WriteU64(buffer + 16, packet->timestampNs);
+    uint8_t* p = buffer + COORDINATE_PACKET_HEADER_SIZE;
+    for (uint32_t i = 0; i < packet->markerCount; ++i, p += COORDINATE_PACKET_MARKER_SIZE)
+    {
+        const CoordinatePacketMarker* marker = &packet->markers[i];
+        p[0] = marker->marker;
+        p[1] = marker->flags;
+        WriteU16(p + 2, 0);
+        WriteF32(p + 4, marker->x);
+        WriteF32(p + 8, marker->y);
+        WriteF32(p + 12, marker->confidence);
+    }
+    return packetSize;
+}
+
+bool DecodeCoordinatePacket(const uint8_t* buffer, size_t size, CoordinatePacket* packet)
+{
+    if (size < COORDINATE_PACKET_HEADER_SIZE || ReadU16(buffer) != COORDINATE_PACKET_MAGIC || buffer[2] != COORDINATE_PACKET_VERSION)
+        return false;
+    uint32_t markerCount = buffer[3];
+    if (markerCount > COORDINATE_PACKET_MAX_MARKERS || size != COORDINATE_PACKET_HEADER_SIZE + (size_t)markerCount * COORDINATE_PACKET_MARKER_SIZE)
+        return false;
+    packet->markerCount = markerCount;
+    packet->cameraID = ReadU32(buffer + 4);
+    packet->frameSequence = ReadU64(buffer + 8);
+    packet->timestampNs = ReadU64(buffer + 16);
+    const uint8_t* p = buffer + COORDINATE_PACKET_HEADER_SIZE;
+    for (uint32_t i = 0; i < markerCount; ++i, p += COORDINATE_PACKET_MARKER_SIZE)
+    {
+        CoordinatePacketMarker* marker = &packet->markers[i];
+        marker->marker = p[0];
+        marker->flags = p[1];
+        marker->x = ReadF32(p + 4);
+        marker->y = ReadF32(p + 8);
+        marker->confidence = ReadF32(p + 12);
+    }
+    return true;
+}
+
+static CoordinateSocket OpenCoordinateSocket(const char* host, uint16_t port, bool receiver)
+{
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = receiver ? AI_PASSIVE : 0;
+    struct addrinfo* addresses = NULL;
+    int error = getaddrinfo(host, service, &hints, &addresses);
+    if (error != 0)
+    {
+        fprintf(stderr, "Failed to resolve %s:%u: %s\n", host ? host : "*", port, gai_strerror(error));
+        return NULL;
+    }
+    int fd = -1;
+    for (struct addrinfo* address = addresses; address != NULL && fd < 0; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (receiver)
+        {
+            // Room for a burst from many cameras while the monitor renders a frame
+            int bufferSize = 1 << 20;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+        }
+        // Connecting the sender lets sendmmsg skip per-message addresses
+        if ((receiver ? bind(fd, address->ai_addr, address->ai_addrlen) : connect(fd, address->ai_addr, address->ai_addrlen)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to open coordinate socket for %s:%u: %s\n", host ? host : "*", port, strerror(errno));
+        return NULL;
+    }
+    CoordinateSocket coordinateSocket = (CoordinateSocket)calloc(sizeof(struct CoordinateSocket), 1);
+    coordinateSocket->fd = fd;
+    coordinateSocket->receiver = receiver;
+    return coordinateSocket;
+}
+
+CoordinateSocket CreateCoordinateSender(const char* host, uint16_t port)
+{
+    if (host == NULL || port == 0)
+        return NULL;
+    return OpenCoordinateSocket(host, port, false);
+}
+
+CoordinateSocket CreateCoordinateReceiver(const char* address, uint16_t port)
+{
+    return OpenCoordinateSocket(address, port, true);
+}
+
+uint16_t CoordinateSocketPort(CoordinateSocket coordinateSocket)
+{
+    struct sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (getsockname(coordinateSocket->fd, (struct sockaddr*)&address, &length) != 0)
+        return 0;
+    if (address.ss_family == AF_INET)
+        return ntohs(((struct sockaddr_in*)&address)->sin_port);
+    if (address.ss_family == AF_INET6)
+        return ntohs(((struct sockaddr_in6*)&address)->sin6_port);
+    return 0;
+}
+
+uint32_t SendCoordinatePackets(CoordinateSocket coordinateSocket, uint32_t count, const CoordinatePacket* packets)
+{
+    uint8_t buffers[COORDINATE_SOCKET_BATCH][COORDINATE_PACKET_MAX_SIZE];
+    struct iovec vectors[COORDINATE_SOCKET_BATCH];
+    struct mmsghdr messages[COORDINATE_SOCKET_BATCH];
+    uint32_t sent = 0;
+    while (sent < count)
+    {
+        uint32_t batch = 0;
+        for (; batch < COORDINATE_SOCKET_BATCH && sent + batch < count; ++batch)
+        {
+            size_t size = EncodeCoordinatePacket(&packets[sent + batch], buffers[batch], sizeof(buffers[batch]));
+            if (size == 0)
+                break;
+            vectors[batch] = (struct iovec){ buffers[batch], size };
+            memset(&messages[batch], 0, sizeof(messages[batch]));
+            messages[batch].msg_hdr.msg_iov = &vectors[batch];
+            messages[batch].msg_hdr.msg_iovlen = 1;
+        }
+        if (batch == 0)
+        {
+            fprintf(stderr, "Coordinate packet %u has too many markers\n", sent);
+            break;
+        }
+        int result = sendmmsg(coordinateSocket->fd, messages, batch, MSG_DONTWAIT);
+        if (result < 0)
+        {
+            // ECONNREFUSED only reports an earlier datagram nobody received, the monitor may start later
+            if (errno == EINTR || errno == ECONNREFUSED)
+                continue;
+            break;
+        }
+        sent += (uint32_t)result;
+        if ((uint32_t)result < batch)
+            break;
+    }
+    return sent;
+}
+
+static void TrackCoordinateSequence(CoordinateSocket coordinateSocket, const CoordinatePacket* packet)
+{
+    uint32_t camera = 0;
+    while (camera < coordinateSocket->followedCameras && coordinateSocket->cameraIDs[camera] != packet->cameraID)
+        ++camera;
+    if (camera == coordinateSocket->followedCameras)
+    {
+        if (camera == COORDINATE_RECEIVER_MAX_CAMERAS)
+            return;
+        coordinateSocket->cameraIDs[camera] = packet->cameraID;
+        coordinateSocket->followedCameras++;
+    }
+    else if (packet->frameSequence > coordinateSocket->nextSequence[camera])
+    {
+        coordinateSocket->lostPackets += packet->frameSequence - coordinateSocket->nextSequence[camera];
+    }
+    // A late or restarted sender moves the expectation without counting anything
+    coordinateSocket->nextSequence[camera] = packet->frameSequence + 1;
+}
+
+uint32_t ReceiveCoordinatePackets(CoordinateSocket coordinateSocket, uint32_t maxCount, CoordinatePacket* packets, int timeoutMs)
+{
+    if (maxCount == 0)
+        return 0;
+    // recvmmsg's own timeout is only checked between datagrams, poll for the first one instead
+    struct pollfd descriptor = { coordinateSocket->fd, POLLIN, 0 };
+    int ready;
+    do
+        ready = poll(&descriptor, 1, timeoutMs);
+    while (ready < 0 && errno == EINTR);
+    if (ready <= 0)
+        return 0;
+
+    uint8_t buffers[COORDINATE_SOCKET_BATCH][COORDINATE_PACKET_MAX_SIZE + 1];
+    struct iovec vectors[COORDINATE_SOCKET_BATCH];
+    struct mmsghdr messages[COORDINATE_SOCKET_BATCH];
+    uint32_t received = 0;
+    while (received < maxCount)
+    {
+        uint32_t batch = maxCount - received < COORDINATE_SOCKET_BATCH ? maxCount - received : COORDINATE_SOCKET_BATCH;
+        for (uint32_t i = 0; i < batch; ++i)
+        {
+            // One spare byte so oversized datagrams are truncated into an invalid length
+            vectors[i] = (struct iovec){ buffers[i], sizeof(buffers[i]) };
+            memset(&messages[i], 0, sizeof(messages[i]));
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        int result = recvmmsg(coordinateSocket->fd, messages, batch, MSG_DONTWAIT, NULL);
+        if (result <= 0)
+            break;
+        for (int i = 0; i < result; ++i)
+        {
+            CoordinatePacket* packet = &packets[received];
+            if (DecodeCoordinatePacket(buffers[i], messages[i].msg_len, packet))
+            {
+                TrackCoordinateSequence(coordinateSocket, packet);
+                ++received;
+            }
+            else
+            {
+                coordinateSocket->invalidPackets++;
+            }
+        }
+        if ((uint32_t)result < batch)
+            break;
+    }
+    return received;
+}
+
+void CloseCoordinateSocket(CoordinateSocket coordinateSocket)
+{
+    if (coordinateSocket == NULL)
+        return;
+    close(coordinateSocket->fd);
+    free(coordinateSocket);
+}
+
+uint32_t AbstractSocketAddress(const char* name, void* address)
+{
+    struct sockaddr_un* unixAddress = (struct sockaddr_un*)address;
+    size_t length = strlen(name);
+    if (length + 1 > sizeof(unixAddress->sun_path))
+        return 0;
+    memset(unixAddress, 0, sizeof(*unixAddress));
+    unixAddress->sun_family = AF_UNIX;
+    // Leading NUL selects the abstract namespace
+    memcpy(unixAddress->sun_path + 1, name, length);
+    return (uint32_t)(offsetof(struct sockaddr_un, sun_path) + 1 + length);
+}
+
+static WorkerControl OpenWorkerControl(const char* name, bool worker)
+{
+    struct sockaddr_un address;
+    socklen_t addressLength = name ? (socklen_t)AbstractSocketAddress(name, &address) : 0;
+    if (addressLength == 0)
+        return NULL;
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | (worker ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0)
+        return NULL;
+    // Abstract sockets have no file permissions, the worker checks the sender of every datagram instead
+    int passCredentials = 1;
+    if (worker && setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &passCredentials, sizeof(passCredentials)) != 0)
+    {
+        fprintf(stderr, "Failed to enable credentials on worker control %s: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if ((worker ? bind(fd, (struct sockaddr*)&address, addressLength) : connect(fd, (struct sockaddr*)&address, addressLength)) != 0)
+    {
+        if (worker)
+            fprintf(stderr, "Failed to bind worker control %s: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    WorkerControl control = (WorkerControl)calloc(sizeof(struct WorkerControl), 1);
+    if (control == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    control->fd = fd;
+    control->worker = worker;
+    if (worker)
+    {
+        // A received shader is swapped with the receive buffer, so both hold a whole shader
+        control->receiveBuffer = (uint8_t*)malloc(WORKER_MAX_SHADER_SIZE);
+        control->shader.buffer = (uint8_t*)malloc(WORKER_MAX_SHADER_SIZE);
+        if (control->receiveBuffer == NULL || control->shader.buffer == NULL)
+        {
+            CloseWorkerControl(control);
+            return NULL;
+        }
+    }
+    return control;
+}
+
+WorkerControl CreateWorkerControl(const char* name)
+{
+    return OpenWorkerControl(name, true);
+}
+
+WorkerControl ConnectWorkerControl(const char* name)
+{
+    return OpenWorkerControl(name, false);
+}
+
+bool SendWorkerCommand(WorkerControl control, const WorkerCommand* command)
+{
+    WorkerCommand message = *command;
+    message.version = WORKER_COMMAND_VERSION;
+    ssize_t sent;
+    do
+        sent = send(control->fd, &message, sizeof(message), 0);
+    while (sent < 0 && errno == EINTR);
+    return sent == (ssize_t)sizeof(message);
+}
+
+bool SendWorkerShader(WorkerControl control, uint32_t sequence, const UpdateGLSLCode* code)
+{
+    if (code == NULL || code->buffer == NULL || code->length == 0 || code->length > WORKER_MAX_SHADER_SIZE)
+        return false;
+    WorkerCommand header = { 0 };
+    header.version = WORKER_COMMAND_VERSION;
+    header.type = WorkerCommandUpdateShader;
+    header.sequence = sequence;
+    header.shader.length = (uint32_t)code->length;
+    header.shader.purpose = (uint32_t)code->purpose;
+    struct iovec parts[2] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = code->buffer, .iov_len = code->length }
+    };
+    struct msghdr message = { .msg_iov = parts, .msg_iovlen = 2 };
+    ssize_t sent;
+    do
+        sent = sendmsg(control->fd, &message, 0);
+    while (sent < 0 && errno == EINTR);
+    return sent == (ssize_t)(sizeof(header) + code->length);
+}
+
+/**
+ * @brief Whether a datagram received with SO_PASSCRED came from a process of the same user, the
+ * kernel fills in the sender's credentials and only privileged senders may claim other ones.
+ */
+static bool SentBySameUser(struct msghdr* message)
+{
+    if (message->msg_flags & MSG_CTRUNC)
+        return false;
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(message); header; header = CMSG_NXTHDR(message, header))
+    {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_CREDENTIALS || header->cmsg_len < CMSG_LEN(sizeof(struct ucred)))
+            continue;
+        struct ucred credentials;
+        memcpy(&credentials, CMSG_DATA(header), sizeof(credentials));
+        return credentials.uid == getuid();
+    }
+    return false;
+}
+
+uint32_t PollWorkerCommands(WorkerControl control, uint32_t maxCount, WorkerCommand* out)
+{
+    uint32_t count = 0;
+    while (count < maxCount)
+    {
+        // Commands are scattered into out, a shader payload behind the header into receiveBuffer
+        struct iovec parts[2] = {
+            { .iov_base = &out[count], .iov_len = sizeof(WorkerCommand) },
+            { .iov_base = control->receiveBuffer, .iov_len = control->receiveBuffer ? WORKER_MAX_SHADER_SIZE : 0 }
+        };
+        union
+        {
+            struct cmsghdr header;
+            uint8_t buffer[CMSG_SPACE(sizeof(struct ucred))];
+        } credentials;
+        struct msghdr message = { .msg_iov = parts, .msg_iovlen = 2, .msg_control = credentials.buffer, .msg_controllen = sizeof(credentials.buffer) };
+        ssize_t received = recvmsg(control->fd, &message, MSG_DONTWAIT);
+        if (received < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (!SentBySameUser(&message))
+        {
+            fprintf(stderr, "Dropped a worker command from another user\n");
+            continue;
+        }
+        if (received < (ssize_t)sizeof(WorkerCommand) || (message.msg_flags & MSG_TRUNC) || out[count].version != WORKER_COMMAND_VERSION)
+            continue;
+        size_t payload = (size_t)received - sizeof(WorkerCommand);
+        if (out[count].type == WorkerCommandUpdateShader)
+        {
+            if (payload == 0 || payload != out[count].shader.length)
+                continue;
+            uint8_t* previous = control->shader.buffer;
+            control->shader.buffer = control->receiveBuffer;
+            control->shader.length = payload;
+            control->shader.purpose = (GLSLPurpose)out[count].shader.purpose;
+            control->receiveBuffer = previous;
+        }
+        else if (payload != 0)
+            continue;
+        ++count;
+    }
+    return count;
+}
+
+const UpdateGLSLCode* WorkerControlShader(WorkerControl control)
+{
+    return control && control->shader.length > 0 ? &control->shader : NULL;
+}
+
+void CloseWorkerControl(WorkerControl control)
+{
+    if (control == NULL)
+        return;
+    close(control->fd);
+    free(control->receiveBuffer);
+    free(control->shader.buffer);
+    free(control);
+}
+
+uint32_t ApplyWorkerCommand(WorkerSettings* settings, const WorkerCommand* command)
+{
+    switch ((WorkerCommandType)command->type)
+    {
+        case WorkerCommandSetResolution:
+            if (command->resolution.width == 0 || command->resolution.height == 0 ||
+                (command->resolution.width == settings->width && command->resolution.height == settings->height))
+                return 0;
+            settings->width = command->resolution.width;
+            settings->height = command->resolution.height;
+            return WorkerChangedResolution;
+        case WorkerCommandSetFrameRate:
+            if (command->frameRate.fps == 0 || command->frameRate.fps == settings->fps)
+                return 0;
+            settings->fps = command->frameRate.fps;
+            return WorkerChangedFrameRate;
+        case WorkerCommandSetExposure:
+            if (command->exposure.exposure < WORKER_EXPOSURE_AUTO || command->exposure.exposure == settings->exposure)
+                return 0;
+            settings->exposure = command->exposure.exposure;
+            return WorkerChangedExposure;
+        case WorkerCommandSetMarkerColor:
+        {
+            uint32_t marker = command->markerColor.marker;
+            if (marker >= WORKER_MAX_MARKERS ||
+                (memcmp(settings->markerMin[marker], command->markerColor.min, 3) == 0 && memcmp(settings->markerMax[marker], command->markerColor.max, 3) == 0))
+                return 0;
+            memcpy(settings->markerMin[marker], command->markerColor.min, 3);
+            memcpy(settings->markerMax[marker], command->markerColor.max, 3);
+            return WorkerChangedMarkerColors;
+        }
+        case WorkerCommandSetMarkerCount:
+            if (command->markerCount.count == 0 || command->markerCount.count > WORKER_MAX_MARKERS || command->markerCount.count == settings->markerCount)
+                return 0;
+            settings->markerCount = command->markerCount.count;
+            return WorkerChangedMarkerCount;
+        case WorkerCommandSetRoiMargin:
+            if (command->roiMargin.margin == settings->roiMargin)
+                return 0;
+            settings->roiMargin = command->roiMargin.margin;
+            return WorkerChangedRoiMargin;
+        case WorkerCommandStop:
+            return WorkerChangedStop;
+        case WorkerCommandUpdateShader:
+            // The shader is not a setting, PollWorkerCommands kept it in the control
+            return command->shader.length > 0 ? WorkerChangedShader : 0;
+        case WorkerCommandCalibrateMarker:
+            if (command->calibration.marker >= WORKER_MAX_MARKERS || command->calibration.width == 0 || command->calibration.height == 0)
+                return 0;
+            return WorkerChangedCalibration;
+    }
+    return 0;
+}
+
+void ClearWorkerMarkerColors(WorkerSettings* settings)
+{
+    memset(settings->markerMin, 255, sizeof(settings->markerMin));
+    memset(settings->markerMax, 0, sizeof(settings->markerMax));
+}
+
+WorkerHeartbeat* CreateWorkerHeartbeat(int* outFd)
+{
+    int fd = memfd_create("vrwebtrack-heartbeat", MFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, sizeof(WorkerHeartbeat)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    WorkerHeartbeat* heartbeat = MapWorkerHeartbeat(fd);
+    if (heartbeat == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    *outFd = fd;
+    return heartbeat;
+}
+
+WorkerHeartbeat* MapWorkerHeartbeat(int fd)
+{
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(WorkerHeartbeat))
+        return NULL;
+    void* mapping = mmap(NULL, sizeof(WorkerHeartbeat), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return mapping == MAP_FAILED ? NULL : (WorkerHeartbeat*)mapping;
+}
+
+void UnmapWorkerHeartbeat(WorkerHeartbeat* heartbeat)
+{
+    if (heartbeat)
+        munmap(heartbeat, sizeof(WorkerHeartbeat));
+}
+
+void BeatWorkerHeartbeat(WorkerHeartbeat* heartbeat, uint64_t nowNs)
+{
+    atomic_fetch_add_explicit(&heartbeat->frameCount, 1, memory_order_relaxed);
+    atomic_store_explicit(&heartbeat->lastBeatNs, nowNs, memory_order_release);
+}
+
+void PublishWorkerSettings(WorkerHeartbeat* heartbeat, const WorkerSettings* settings)
+{
+    uint32_t sequence = atomic_load_explicit(&heartbeat->settingsSequence, memory_order_relaxed);
+    atomic_store_explicit(&heartbeat->settingsSequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    heartbeat->settings = *settings;
+    atomic_store_explicit(&heartbeat->settingsSequence, sequence + 2, memory_order_release);
+}
+
+bool ReadWorkerSettings(const WorkerHeartbeat* heartbeat, WorkerSettings* settings)
+{
+    WorkerHeartbeat* shared = (WorkerHeartbeat*)heartbeat;
+    // Bounded, a worker that died while publishing leaves the sequence odd forever
+    for (int attempt = 0; attempt < 1000; ++attempt)
+    {
+        uint32_t sequence = atomic_load_explicit(&shared->settingsSequence, memory_order_acquire);
+        if (sequence == 0)
+            return false;
+        if (sequence & 1)
+            continue;
+        *settings = shared->settings;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shared->settingsSequence, memory_order_relaxed) == sequence)
+            return true;
+    }
+    return false;
+}
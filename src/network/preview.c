@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "preview.h"
+
+#define PREVIEW_DESCRIPTOR_COUNT (1 + PREVIEW_SLOT_COUNT)
+
+// Sealed so the monitor's mappings cannot be truncated under it
+static int CreateSealedMemfd(const char* name, size_t size)
+{
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, (off_t)size) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+PreviewWriter CreatePreviewWriter(const char* socketName, uint32_t width, uint32_t height, uint32_t pixelFormat, uint32_t stride, size_t frameSize)
+{
+    struct sockaddr_un address;
+    socklen_t addressLength = socketName ? (socklen_t)AbstractSocketAddress(socketName, &address) : 0;
+    if (addressLength == 0 || frameSize == 0)
+        return NULL;
+    PreviewWriter writer = (PreviewWriter)calloc(sizeof(struct PreviewWriter), 1);
+    writer->info = (PreviewChannelInfo){ PREVIEW_CHANNEL_MAGIC, PREVIEW_CHANNEL_VERSION, width, height, pixelFormat, stride, frameSize, PREVIEW_SLOT_COUNT };
+    writer->listenFd = -1;
+    writer->controlFd = -1;
+    writer->writingSlot = PREVIEW_NO_SLOT;
+    for (uint32_t i = 0; i < PREVIEW_SLOT_COUNT; ++i)
+        writer->slotFds[i] = -1;
+
+    writer->controlFd = CreateSealedMemfd("vrwebtrack-preview-control", sizeof(PreviewShared));
+    void* control = writer->controlFd >= 0 ? mmap(NULL, sizeof(PreviewShared), PROT_READ | PROT_WRITE, MAP_SHARED, writer->controlFd, 0) : MAP_FAILED;
+    if (control == MAP_FAILED)
+        goto fail;
+    writer->shared = (PreviewShared*)control;
+    atomic_init(&writer->shared->latestSlot, PREVIEW_NO_SLOT);
+    atomic_init(&writer->shared->readerSlot, PREVIEW_NO_SLOT);
+    atomic_init(&writer->shared->intervalNs, PREVIEW_DEFAULT_INTERVAL_NS);
+    for (uint32_t i = 0; i < PREVIEW_SLOT_COUNT; ++i)
+    {
+        writer->slotFds[i] = CreateSealedMemfd("vrwebtrack-preview-slot", frameSize);
+        void* slot = writer->slotFds[i] >= 0 ? mmap(NULL, frameSize, PROT_READ | PROT_WRITE, MAP_SHARED, writer->slotFds[i], 0) : MAP_FAILED;
+        if (slot == MAP_FAILED)
+            goto fail;
+        writer->slots[i] = (uint8_t*)slot;
+    }
+
+    writer->listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (writer->listenFd < 0 || bind(writer->listenFd, (struct sockaddr*)&address, addressLength) != 0 || listen(writer->listenFd, 4) != 0)
+        goto fail;
+    return writer;
+
+fail:
+    fprintf(stderr, "Failed to create preview channel %s: %s\n", socketName, strerror(errno));
+    DestroyPreviewWriter(writer);
+    return NULL;
+}
+
+uint32_t ServePreviewClients(PreviewWriter writer)
+{
+    uint32_t served = 0;
+    for (;;)
+    {
+        int client = accept4(writer->listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0)
+            break;
+        // The abstract socket is reachable by every user, the frames only go to our own
+        struct ucred peer;
+        socklen_t peerLength = sizeof(peer);
+        if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &peerLength) != 0 || peerLength != sizeof(peer) || peer.uid != getuid())
+        {
+            fprintf(stderr, "Refused a preview connection from another user\n");
+            close(client);
+            continue;
+        }
+        int descriptors[PREVIEW_DESCRIPTOR_COUNT] = { writer->controlFd };
+        memcpy(descriptors + 1, writer->slotFds, sizeof(writer->slotFds));
+        union
+        {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(descriptors))];
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct iovec vector = { &writer->info, sizeof(writer->info) };
+        struct msghdr message = { 0 };
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+        memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+        if (sendmsg(client, &message, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)sizeof(writer->info))
+            ++served;
+        close(client);
+    }
+    return served;
+}
+
+uint8_t* BeginPreviewFrame(PreviewWriter writer, uint64_t nowNs)
+{
+    PreviewShared* shared = writer->shared;
+    uint64_t interval = atomic_load_explicit(&shared->intervalNs, memory_order_relaxed);
+    if (writer->lastPublishNs != 0 && nowNs - writer->lastPublishNs < interval)
+        return NULL;
+    uint32_t latest = atomic_load_explicit(&shared->latestSlot, memory_order_relaxed);
+    uint32_t reading = atomic_load_explicit(&shared->readerSlot, memory_order_relaxed);
+    uint32_t slot = 0;
+    while (slot == latest || slot == reading)
+        ++slot;
+    PreviewSlotState* state = &shared->slots[slot];
+    // Odd sequence marks the slot as being written, the fence keeps the data writes after it
+    atomic_store_explicit(&state->sequence, atomic_load_explicit(&state->sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    writer->writingSlot = slot;
+    writer->lastPublishNs = nowNs;
+    return writer->slots[slot];
+}
+
+void EndPreviewFrame(PreviewWriter writer, uint64_t frameNumber, uint64_t timestampNs)
+{
+    uint32_t slot = writer->writingSlot;
+    if (slot == PREVIEW_NO_SLOT)
+        return;
+    PreviewSlotState* state = &writer->shared->slots[slot];
+    state->frameNumber = frameNumber;
+    state->timestampNs = timestampNs;
+    atomic_store_explicit(&state->sequence, atomic_load_explicit(&state->sequence, memory_order_relaxed) + 1, memory_order_release);
+    atomic_store_explicit(&writer->shared->latestSlot, slot, memory_order_release);
+    writer->writingSlot = PREVIEW_NO_SLOT;
+}
+
+void DestroyPreviewWriter(PreviewWriter writer)
+{
+    if (writer == NULL)
+        return;
+    if (writer->listenFd >= 0)
+        close(writer->listenFd);
+    for (uint32_t i = 0; i < PREVIEW_SLOT_COUNT; ++i)
+    {
+        if (writer->slots[i])
+            munmap(writer->slots[i], writer->info.frameSize);
+        if (writer->slotFds[i] >= 0)
+            close(writer->slotFds[i]);
+    }
+    if (writer->shared)
+        munmap(writer->shared, sizeof(PreviewShared));
+    if (writer->controlFd >= 0)
+        close(writer->controlFd);
+    free(writer);
+}
+
+PreviewReader ConnectPreviewReader(const char* socketName)
+{
+    struct sockaddr_un address;
+    socklen_t addressLength = socketName ? (socklen_t)AbstractSocketAddress(socketName, &address) : 0;
+    if (addressLength == 0)
+        return NULL;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    if (connect(fd, (struct sockaddr*)&address, addressLength) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    PreviewReader reader = (PreviewReader)calloc(sizeof(struct PreviewReader), 1);
+    reader->controlFd = -1;
+    for (uint32_t i = 0; i < PREVIEW_SLOT_COUNT; ++i)
+        reader->slotFds[i] = -1;
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * PREVIEW_DESCRIPTOR_COUNT)];
+    } control;
+    struct iovec vector = { &reader->info, sizeof(reader->info) };
+    struct msghdr message = { 0 };
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    // Blocks until the worker loop gets to ServePreviewClients
+    struct timeval timeout = { PREVIEW_CONNECT_TIMEOUT_MS / 1000, (PREVIEW_CONNECT_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ssize_t received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    close(fd);
+    struct cmsghdr* header = received > 0 ? CMSG_FIRSTHDR(&message) : NULL;
+    if (header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS &&
+        header->cmsg_len == CMSG_LEN(sizeof(int) * PREVIEW_DESCRIPTOR_COUNT))
+    {
+        int descriptors[PREVIEW_DESCRIPTOR_COUNT];
+        memcpy(descriptors, CMSG_DATA(header), sizeof(descriptors));
+        reader->controlFd = descriptors[0];
+        memcpy(reader->slotFds, descriptors + 1, sizeof(reader->slotFds));
+    }
+    if (received != (ssize_t)sizeof(reader->info) || reader->controlFd < 0 || reader->info.magic != PREVIEW_CHANNEL_MAGIC ||
+        reader->info.version != PREVIEW_CHANNEL_VERSION || reader->info.slotCount != PREVIEW_SLOT_COUNT)
+    {
+        fprintf(stderr, "Preview channel %s sent an incompatible handshake\n", socketName);
+        DestroyPreviewReader(reader);
+        return NULL;
+    }
+
+    void* shared = mmap(NULL, sizeof(PreviewShared), PROT_READ | PROT_WRITE, MAP_SHARED, reader->controlFd, 0);
+    if (shared == MAP_FAILED)
+    {
+        DestroyPreviewReader(reader);
+        return NULL;
+    }
+    reader->shared = (PreviewShared*)shared;
+    for (uint32_t i = 0; i < PREVIEW_SLOT_COUNT; ++i)
+    {
+        void* slot = mmap(NULL, reader->info.frameSize, PROT_READ, MAP_SHARED, reader->slotFds[i], 0);
+        if (slot == MAP_FAILED)
+        {
+            DestroyPreviewReader(reader);
+            return NULL;
+        }
+        reader->slots[i] = (const uint8_t*)slot;
+    }
+    return reader;
+}
+
+bool AcquirePreviewFrame(PreviewReader reader, PreviewFrame* frame)
+{
+    PreviewShared* shared = reader->shared;
+    for (int attempt = 0; attempt < 4; ++attempt)
+    {
+        uint32_t slot = atomic_load_explicit(&shared->latestSlot, memory_order_acquire);
+        if (slot >= PREVIEW_SLOT_COUNT)
+            return false;
+        // Claim the slot first, then make sure the worker had not already started reusing it
+        atomic_store_explicit(&shared->readerSlot, slot, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        PreviewSlotState* state = &shared->slots[slot];
+        uint32_t sequence = atomic_load_explicit(&state->sequence, memory_order_acquire);
+        if ((sequence & 1) != 0 || atomic_load_explicit(&shared->latestSlot, memory_order_relaxed) != slot)
+            continue;
+        frame->frameNumber = state->frameNumber;
+        frame->timestampNs = state->timestampNs;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&state->sequence, memory_order_relaxed) != sequence)
+            continue;
+        if (frame->frameNumber < reader->nextFrameNumber)
+            break;
+        frame->data = reader->slots[slot];
+        frame->slot = slot;
+        frame->sequence = sequence;
+        reader->nextFrameNumber = frame->frameNumber + 1;
+        return true;
+    }
+    atomic_store_explicit(&shared->readerSlot, PREVIEW_NO_SLOT, memory_order_relaxed);
+    return false;
+}
+
+bool ReleasePreviewFrame(PreviewReader reader, const PreviewFrame* frame)
+{
+    PreviewShared* shared = reader->shared;
+    // Orders the reads of frame->data before the sequence check
+    atomic_thread_fence(memory_order_acquire);
+    bool intact = atomic_load_explicit(&shared->slots[frame->slot].sequence, memory_order_relaxed) == frame->sequence;
+    atomic_store_explicit(&shared->readerSlot, PREVIEW_NO_SLOT, memory_order_release);
+    return intact;
+}
+
+void SetPreviewInterval(PreviewReader reader, uint64_t intervalNs)
+{
+    atomic_store_explicit(&reader->shared->intervalNs, intervalNs, memory_order_relaxed);
+}
+
+void DestroyPreviewReader(PreviewReader reader)
+{
+    if (reader == NULL)
+        return;
+    for (uint32_t i = 0; i < PREVIEW_SLOT_COUNT; ++i)
+    {
+        if (reader->slots[i])
+            munmap((void*)reader->slots[i], reader->info.frameSize);
+        if (reader->slotFds[i] >= 0)
+            close(reader->slotFds[i]);
+    }
+    if (reader->shared)
+    {
+        atomic_store_explicit(&reader->shared->readerSlot, PREVIEW_NO_SLOT, memory_order_relaxed);
+        munmap(reader->shared, sizeof(PreviewShared));
+    }
+    if (reader->controlFd >= 0)
+        close(reader->controlFd);
+    free(reader);
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+#include "calibration.h"
+
+ColorCalibrator CreateColorCalibrator(ComputeApplication app, BlobTracker tracker, const void* spirv, size_t spirvSize)
+{
+    if (app == NULL || tracker == NULL || spirv == NULL || spirvSize == 0)
+        return NULL;
+    ColorCalibrator calibrator = (ColorCalibrator)calloc(sizeof(struct ColorCalibrator), 1);
+    calibrator->app = app;
+    calibrator->tracker = tracker;
+    calibrator->workgroupSize = RecommendedWorkgroupSize(app);
+    calibrator->histogramBuffer = CreateBuffer(app, "color_histograms", ReadAndWriteBufferType, sizeof(ColorHistogramGPU) * 2, 1);
+    Buffer buffers[TRACKING_FRAMES_IN_FLIGHT * 2];
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        buffers[i * 2] = tracker->frames[i].frameBuffer;
+        buffers[i * 2 + 1] = calibrator->histogramBuffer;
+    }
+    calibrator->descriptorPool = CreatePoolForDescriptors(app, TRACKING_FRAMES_IN_FLIGHT, TRACKING_FRAMES_IN_FLIGHT * 2, buffers);
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+        calibrator->descriptors[i] = CreateDescriptorsForBuffers(app, calibrator->descriptorPool, 2, &buffers[i * 2]);
+    calibrator->shaderModule = LoadShader(app, (void*)spirv, spirvSize);
+    SpecializationConstant constants[] = {
+        { WorkgroupSizeXConstantID, calibrator->workgroupSize },
+        { FrameWidthConstantID, tracker->width },
+        { FrameHeightConstantID, tracker->height },
+        { PixelFormatConstantID, (uint32_t)tracker->pixelFormat }
+    };
+    calibrator->pipeline = CreatePipelineWithConstants(app, calibrator->descriptors[0], calibrator->shaderModule, "main",
+        sizeof(constants) / sizeof(constants[0]), constants, sizeof(ColorHistogramPushConstants));
+    if (calibrator->pipeline == NULL)
+    {
+        DestroyColorCalibrator(calibrator);
+        return NULL;
+    }
+    calibrator->commandBuffer = CreateCommandBuffer(app);
+    return calibrator;
+}
+
+ComputeTicket RequestColorCalibration(ColorCalibrator calibrator, uint32_t frame, TrackingWindow region, uint32_t sampleStep)
+{
+    if (calibrator == NULL || frame >= TRACKING_FRAMES_IN_FLIGHT || !IsComputeTicketComplete(calibrator->app, calibrator->ticket))
+        return 0;
+    BlobTracker tracker = calibrator->tracker;
+    if (region.x >= tracker->width || region.y >= tracker->height || region.width == 0 || region.height == 0)
+        return 0;
+    if (region.width > tracker->width - region.x)
+        region.width = tracker->width - region.x;
+    if (region.height > tracker->height - region.y)
+        region.height = tracker->height - region.y;
+    ColorHistogramPushConstants pushConstants = {
+        .regionOrigin = { region.x, region.y },
+        .regionExtent = { region.width, region.height },
+        .sampleStep = sampleStep > 0 ? sampleStep : 1
+    };
+    uint32_t step = pushConstants.sampleStep;
+    uint64_t samples = (uint64_t)((tracker->width + step - 1) / step) * ((tracker->height + step - 1) / step);
+    uint64_t groupCount = (samples + calibrator->workgroupSize - 1) / calibrator->workgroupSize;
+    if (groupCount > COLOR_HISTOGRAM_MAX_WORKGROUPS)
+        groupCount = COLOR_HISTOGRAM_MAX_WORKGROUPS;
+
+    CommandBuffer cmdbuf = calibrator->commandBuffer;
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = calibrator->histogramBuffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    ResetCommand(cmdbuf);
+    BeginCommand(cmdbuf);
+    // The frame was made visible to compute by the upload barrier submitted ahead of the tracking work
+    vkCmdFillBuffer(cmdbuf->cmdbuffer, calibrator->histogramBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+    vkCmdPipelineBarrier(cmdbuf->cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, NULL, 1, &barrier, 0, NULL);
+    AddPushConstantsToCommandBufferQueue(cmdbuf, calibrator->pipeline, 0, sizeof(pushConstants), &pushConstants);
+    AddDispatch3DComputeShaderToCommandBufferQueue(cmdbuf, calibrator->pipeline, (uint32_t)groupCount, 1, 1, calibrator->descriptors[frame]);
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmdbuf->cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 0, NULL, 1, &barrier, 0, NULL);
+    EndCommand(cmdbuf);
+    calibrator->ticket = SubmitCommandBufferAsync(calibrator->app, cmdbuf);
+    // A dedicated transfer queue does not wait for compute, the uploader must
+    tracker->frames[frame].readTicket = calibrator->ticket;
+    return calibrator->ticket;
+}
+
+/**
+ * @brief Finds the bin interval maximizing the summed difference between the normalized region
+ * and background histograms, the maximum sum subarray of that difference.
+ */
+static void SeparatingInterval(const uint32_t* region, const uint32_t* frame, uint32_t regionPixels, uint32_t backgroundPixels,
+    uint8_t* outMin, uint8_t* outMax)
+{
+    double best = -1.0, current = 0.0;
+    uint32_t start = 0, bestStart = 0, bestEnd = COLOR_HISTOGRAM_CHANNEL_BINS - 1;
+    for (uint32_t bin = 0; bin < COLOR_HISTOGRAM_CHANNEL_BINS; ++bin)
+    {
+        double inside = regionPixels ? (double)region[bin] / regionPixels : 0.0;
+        double outside = backgroundPixels ? (double)(frame[bin] - region[bin]) / backgroundPixels : 0.0;
+        if (current <= 0.0)
+        {
+            current = 0.0;
+            start = bin;
+        }
+        current += inside - outside;
+        if (current > best)
+        {
+            best = current;
+            bestStart = start;
+            bestEnd = bin;
+        }
+    }
+    *outMin = (uint8_t)bestStart;
+    *outMax = (uint8_t)bestEnd;
+}
+
+ColorCalibrationResult DeriveColorCalibration(const ColorHistogramGPU* region, const ColorHistogramGPU* frame)
+{
+    ColorCalibrationResult result;
+    memset(&result, 0, sizeof(result));
+    result.regionPixels = region->pixelCount;
+    result.framePixels = frame->pixelCount;
+    uint32_t backgroundPixels = frame->pixelCount - region->pixelCount;
+    uint8_t minimums[3], maximums[3];
+    for (uint32_t channel = 0; channel < 3; ++channel)
+        SeparatingInterval(region->channels[channel], frame->channels[channel], region->pixelCount, backgroundPixels,
+            &minimums[channel], &maximums[channel]);
+    result.range = (MarkerColorRange){ minimums[0], minimums[1], minimums[2], maximums[0], maximums[1], maximums[2] };
+
+    // Channels are chosen independently, the joint histogram tells how the box performs as a whole.
+    // A cell counts as inside when its centre is.
+    uint32_t cellSize = COLOR_HISTOGRAM_CHANNEL_BINS / COLOR_HISTOGRAM_JOINT_LEVELS;
+    uint64_t regionInside = 0, frameInside = 0;
+    for (uint32_t cell = 0; cell < COLOR_HISTOGRAM_JOINT_BINS; ++cell)
+    {
+        uint32_t levels[3] = {
+            cell / (COLOR_HISTOGRAM_JOINT_LEVELS * COLOR_HISTOGRAM_JOINT_LEVELS),
+            (cell / COLOR_HISTOGRAM_JOINT_LEVELS) % COLOR_HISTOGRAM_JOINT_LEVELS,
+            cell % COLOR_HISTOGRAM_JOINT_LEVELS
+        };
+        bool inside = true;
+        for (uint32_t channel = 0; channel < 3 && inside; ++channel)
+        {
+            uint32_t centre = levels[channel] * cellSize + cellSize / 2;
+            inside = centre >= minimums[channel] && centre <= maximums[channel];
+        }
+        if (inside)
+        {
+            regionInside += region->joint[cell];
+            frameInside += frame->joint[cell];
+        }
+    }
+    if (region->pixelCount > 0)
+        result.regionCoverage = (float)((double)regionInside / region->pixelCount);
+    if (backgroundPixels > 0)
+        result.backgroundLeak = (float)((double)(frameInside - regionInside) / backgroundPixels);
+    return result;
+}
+
+bool GetColorCalibrationResult(ColorCalibrator calibrator, ColorCalibrationResult* out)
+{
+    if (calibrator == NULL || out == NULL || calibrator->ticket == 0)
+        return false;
+    if (!IsComputeTicketComplete(calibrator->app, calibrator->ticket))
+        return false;
+    const ColorHistogramGPU* histograms = (const ColorHistogramGPU*)calibrator->histogramBuffer->mapped;
+    *out = DeriveColorCalibration(&histograms[0], &histograms[1]);
+    return true;
+}
+
+void DestroyColorCalibrator(ColorCalibrator calibrator)
+{
+    if (calibrator == NULL)
+        return;
+    ComputeApplication app = calibrator->app;
+    WaitForComputeTicket(app, calibrator->ticket, UINT64_MAX);
+    if (calibrator->commandBuffer)
+        DestroyCommandBuffer(app, calibrator->commandBuffer);
+    DestroyPipeline(app, calibrator->pipeline);
+    if (calibrator->shaderModule)
+        vkDestroyShaderModule(app->device, calibrator->shaderModule, NULL);
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        if (calibrator->descriptors[i] == NULL)
+            continue;
+        vkDestroyDescriptorSetLayout(app->device, calibrator->descriptors[i]->layout, NULL);
+        free(calibrator->descriptors[i]->buffers);
+        free(calibrator->descriptors[i]);
+    }
+    if (calibrator->descriptorPool)
+        vkDestroyDescriptorPool(app->device, calibrator->descriptorPool, NULL);
+    DestroyBuffer(app, calibrator->histogramBuffer);
+    free(calibrator);
+}
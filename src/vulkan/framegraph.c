@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+#include "framegraph.h"
+
+// Longest run of independent passes sharing one barrier
+#define FRAME_GRAPH_MAX_RUN 16
+#define FRAME_GRAPH_WRITE_ACCESS (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+// Barriers for every buffer touched by a run of independent passes
+typedef struct FrameGraphBarrierBatch
+{
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+    uint32_t count;
+    VkBufferMemoryBarrier barriers[MAX_FRAME_GRAPH_ACCESSES * FRAME_GRAPH_MAX_RUN];
+} FrameGraphBarrierBatch;
+
+FrameGraph CreateFrameGraph(ComputeApplication app, uint32_t framesInFlight)
+{
+    if (app == NULL || framesInFlight == 0 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+        return NULL;
+    FrameGraph graph = (FrameGraph)calloc(sizeof(struct FrameGraph), 1);
+    if (graph == NULL)
+        return NULL;
+    graph->app = app;
+    graph->framesInFlight = framesInFlight;
+    graph->generation = 1;
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+        graph->commandBuffers[i] = CreateCommandBuffer(app);
+    return graph;
+}
+
+static FrameGraphBufferState* FindBufferState(FrameGraph graph, Buffer buffer)
+{
+    for (uint32_t i = 0; i < graph->bufferCount; ++i)
+    {
+        if (graph->buffers[i].buffer == buffer)
+            return &graph->buffers[i];
+    }
+    if (graph->bufferCount == graph->bufferCapacity)
+    {
+        graph->bufferCapacity = graph->bufferCapacity ? graph->bufferCapacity * 2 : 16;
+        graph->buffers = (FrameGraphBufferState*)realloc(graph->buffers, sizeof(FrameGraphBufferState) * graph->bufferCapacity);
+    }
+    FrameGraphBufferState* state = &graph->buffers[graph->bufferCount++];
+    memset(state, 0, sizeof(*state));
+    state->buffer = buffer;
+    return state;
+}
+
+bool FrameGraphAddPass(FrameGraph graph, const char* name, FrameGraphRecordCallback record, void* userData,
+    uint32_t accessCount, const FrameGraphBufferAccess* accesses)
+{
+    return FrameGraphAddFramePass(graph, name, record, userData, FRAME_GRAPH_ALL_FRAMES, accessCount, accesses);
+}
+
+bool FrameGraphAddFramePass(FrameGraph graph, const char* name, FrameGraphRecordCallback record, void* userData,
+    uint32_t frame, uint32_t accessCount, const FrameGraphBufferAccess* accesses)
+{
+    if (graph == NULL || accessCount > MAX_FRAME_GRAPH_ACCESSES || (accessCount > 0 && accesses == NULL))
+        return false;
+    if (frame != FRAME_GRAPH_ALL_FRAMES && frame >= graph->framesInFlight)
+        return false;
+    if (graph->passCount == graph->passCapacity)
+    {
+        graph->passCapacity = graph->passCapacity ? graph->passCapacity * 2 : 16;
+        graph->passes = (FrameGraphPass*)realloc(graph->passes, sizeof(FrameGraphPass) * graph->passCapacity);
+    }
+    FrameGraphPass* pass = &graph->passes[graph->passCount++];
+    memset(pass, 0, sizeof(*pass));
+    pass->name = name;
+    pass->record = record;
+    pass->userData = userData;
+    pass->frame = frame;
+    pass->accessCount = accessCount;
+    memcpy(pass->accesses, accesses, sizeof(FrameGraphBufferAccess) * accessCount);
+    for (uint32_t i = 0; i < accessCount; ++i)
+        FindBufferState(graph, accesses[i].buffer);
+    FrameGraphInvalidate(graph);
+    return true;
+}
+
+void FrameGraphInvalidate(FrameGraph graph)
+{
+    if (graph)
+        ++graph->generation;
+}
+
+/**
+ * @brief Computes the barrier an access needs against the current state of its buffer and
+ * advances the state. Returns false when no barrier is needed.
+ */
+static bool TrackAccess(FrameGraphBufferState* state, const FrameGraphBufferAccess* access, VkBufferMemoryBarrier* barrier,
+    VkPipelineStageFlags* srcStages)
+{
+    VkAccessFlags writeAccess = access->access & FRAME_GRAPH_WRITE_ACCESS;
+    VkAccessFlags readAccess = access->access & ~FRAME_GRAPH_WRITE_ACCESS;
+    VkPipelineStageFlags src = 0;
+    VkAccessFlags srcAccess = 0;
+
+    // Read after write, unless the write was already made visible to this stage and access
+    if (readAccess && state->writeAccess &&
+        ((readAccess & ~state->visibleAccess) || (access->stage & ~state->visibleStages)))
+    {
+        src |= state->writeStages;
+        srcAccess |= state->writeAccess;
+    }
+    // Write after write needs a memory dependency, write after read an execution dependency
+    if (writeAccess)
+    {
+        src |= state->writeStages | state->readStages;
+        srcAccess |= state->writeAccess;
+    }
+
+    if (writeAccess)
+    {
+        state->writeStages = access->stage;
+        state->writeAccess = writeAccess;
+        state->readStages = 0;
+        state->visibleStages = 0;
+        state->visibleAccess = 0;
+    }
+    else
+    {
+        state->readStages |= access->stage;
+        if (src)
+        {
+            state->visibleStages |= access->stage;
+            state->visibleAccess |= readAccess;
+        }
+    }
+
+    if (src == 0)
+        return false;
+    *barrier = (VkBufferMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = access->access,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = access->buffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    *srcStages = src;
+    return true;
+}
+
+static bool PassesShareBuffer(const FrameGraphPass* a, const FrameGraphPass* b)
+{
+    for (uint32_t i = 0; i < a->accessCount; ++i)
+    {
+        for (uint32_t j = 0; j < b->accessCount; ++j)
+        {
+            if (a->accesses[i].buffer == b->accesses[j].buffer)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool FrameGraphSetProfiler(FrameGraph graph, GpuProfiler profiler)
+{
+    if (graph == NULL || (profiler && profiler->framesInFlight < graph->framesInFlight))
+        return false;
+    graph->profiler = profiler;
+    FrameGraphInvalidate(graph);
+    return true;
+}
+
+static bool SameStage(const FrameGraphPass* a, const FrameGraphPass* b)
+{
+    return a->name == b->name || (a->name && b->name && strcmp(a->name, b->name) == 0);
+}
+
+/**
+ * @brief Index of the first pass at or after index that is recorded into the frame slot.
+ */
+static uint32_t NextPassInFrame(FrameGraph graph, uint32_t index, uint32_t frame)
+{
+    while (index < graph->passCount && graph->passes[index].frame != FRAME_GRAPH_ALL_FRAMES && graph->passes[index].frame != frame)
+        ++index;
+    return index;
+}
+
+/**
+ * @brief Walks every pass of a frame slot, emitting barriers and commands when cmdbuf is not NULL.
+ *
+ * Consecutive passes that touch disjoint buffers form a run, their barriers are issued
+ * together in front of the run. When profiling, runs also end where the pass name changes so
+ * the timestamps of a stage enclose its barrier and nothing of the next stage.
+ */
+static void WalkPasses(FrameGraph graph, CommandBuffer cmdbuf, uint32_t frame)
+{
+    uint32_t stage = INVALID_PROFILER_STAGE;
+    const FrameGraphPass* previousPass = NULL;
+    uint32_t runStart = NextPassInFrame(graph, 0, frame);
+    while (runStart < graph->passCount)
+    {
+        uint32_t runEnd = NextPassInFrame(graph, runStart + 1, frame);
+        uint32_t runLength = 1;
+        while (runEnd < graph->passCount && runLength < FRAME_GRAPH_MAX_RUN)
+        {
+            if (graph->profiler && !SameStage(&graph->passes[runStart], &graph->passes[runEnd]))
+                break;
+            bool independent = true;
+            for (uint32_t i = runStart; i < runEnd && independent; i = NextPassInFrame(graph, i + 1, frame))
+                independent = !PassesShareBuffer(&graph->passes[i], &graph->passes[runEnd]);
+            if (!independent)
+                break;
+            runEnd = NextPassInFrame(graph, runEnd + 1, frame);
+            ++runLength;
+        }
+
+        FrameGraphBarrierBatch batch = {0};
+        for (uint32_t p = runStart; p < runEnd; p = NextPassInFrame(graph, p + 1, frame))
+        {
+            const FrameGraphPass* pass = &graph->passes[p];
+            for (uint32_t a = 0; a < pass->accessCount; ++a)
+            {
+                VkPipelineStageFlags srcStages = 0;
+                FrameGraphBufferState* state = FindBufferState(graph, pass->accesses[a].buffer);
+                if (TrackAccess(state, &pass->accesses[a], &batch.barriers[batch.count], &srcStages))
+                {
+                    batch.srcStages |= srcStages;
+                    batch.dstStages |= pass->accesses[a].stage;
+                    ++batch.count;
+                }
+            }
+        }
+
+        if (cmdbuf != NULL)
+        {
+            if (graph->profiler && (previousPass == NULL || !SameStage(previousPass, &graph->passes[runStart])))
+            {
+                // Passes without commands, e.g. a host readback, are not worth a stage
+                GpuProfilerEndStage(graph->profiler, cmdbuf, frame, stage);
+                stage = graph->passes[runStart].record ? GpuProfilerStage(graph->profiler, graph->passes[runStart].name) : INVALID_PROFILER_STAGE;
+                GpuProfilerBeginStage(graph->profiler, cmdbuf, frame, stage);
+            }
+            if (batch.count > 0)
+                vkCmdPipelineBarrier(cmdbuf->cmdbuffer, batch.srcStages, batch.dstStages, 0, 0, NULL, batch.count, batch.barriers, 0, NULL);
+        }
+        for (uint32_t p = runStart; p < runEnd; p = NextPassInFrame(graph, p + 1, frame))
+        {
+            if (cmdbuf != NULL && graph->passes[p].record)
+                graph->passes[p].record(cmdbuf, graph->passes[p].userData);
+            previousPass = &graph->passes[p];
+        }
+        runStart = runEnd;
+    }
+    if (cmdbuf != NULL)
+        GpuProfilerEndStage(graph->profiler, cmdbuf, frame, stage);
+}
+
+static void RecordFrameGraph(FrameGraph graph, CommandBuffer cmdbuf, uint32_t frame)
+{
+    // Every tick runs the same passes, so the state left by the ticks before is the state this
+    // one starts from. Dry walks of every slot in submission order, ending with the slot
+    // submitted just before this one, yield it and the real walk then also emits the barriers
+    // against earlier ticks, e.g. a readback buffer written again next frame or a result buffer
+    // the next slot predicts from.
+    for (uint32_t i = 0; i < graph->bufferCount; ++i)
+    {
+        Buffer buffer = graph->buffers[i].buffer;
+        memset(&graph->buffers[i], 0, sizeof(FrameGraphBufferState));
+        graph->buffers[i].buffer = buffer;
+    }
+    for (uint32_t i = 0; i < graph->framesInFlight; ++i)
+        WalkPasses(graph, NULL, (frame + i) % graph->framesInFlight);
+
+    ResetCommand(cmdbuf);
+    BeginCommand(cmdbuf);
+    GpuProfilerResetFrame(graph->profiler, cmdbuf, frame);
+    WalkPasses(graph, cmdbuf, frame);
+    EndCommand(cmdbuf);
+}
+
+uint32_t FrameGraphAcquireFrame(FrameGraph graph)
+{
+    if (graph == NULL)
+        return 0;
+    uint32_t frame = graph->nextFrame;
+    if (!WaitForComputeTicket(graph->app, graph->tickets[frame], UINT64_MAX))
+        fprintf(stderr, "Frame graph submission %lu did not complete\n", (unsigned long)graph->tickets[frame]);
+    return frame;
+}
+
+ComputeTicket FrameGraphSubmit(FrameGraph graph)
+{
+    if (graph == NULL)
+        return 0;
+    uint32_t frame = FrameGraphAcquireFrame(graph);
+    graph->nextFrame = (graph->nextFrame + 1) % graph->framesInFlight;
+    CommandBuffer cmdbuf = graph->commandBuffers[frame];
+    GpuProfilerCollectFrame(graph->profiler, frame);
+    if (graph->recordedGeneration[frame] != graph->generation)
+    {
+        RecordFrameGraph(graph, cmdbuf, frame);
+        graph->recordedGeneration[frame] = graph->generation;
+    }
+    graph->tickets[frame] = SubmitCommandBufferAsync(graph->app, cmdbuf);
+    GpuProfilerFrameSubmitted(graph->profiler, frame);
+    return graph->tickets[frame];
+}
+
+void DestroyFrameGraph(FrameGraph graph)
+{
+    if (graph == NULL)
+        return;
+    for (uint32_t i = 0; i < graph->framesInFlight; ++i)
+    {
+        WaitForComputeTicket(graph->app, graph->tickets[i], UINT64_MAX);
+        DestroyCommandBuffer(graph->app, graph->commandBuffers[i]);
+    }
+    free(graph->passes);
+    free(graph->buffers);
+    free(graph);
+}
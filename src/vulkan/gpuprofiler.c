@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+#include "gpuprofiler.h"
+
+static uint64_t ValidBitsMask(uint32_t validBits)
+{
+    return validBits >= 64 ? UINT64_MAX : ((1ull << validBits) - 1);
+}
+
+static uint32_t QueueFamilyTimestampBits(ComputeApplication app, uint32_t queueFamilyIndex)
+{
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(app->physicalDevice, &count, NULL);
+    if (queueFamilyIndex >= count)
+        return 0;
+    VkQueueFamilyProperties* properties = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * count);
+    vkGetPhysicalDeviceQueueFamilyProperties(app->physicalDevice, &count, properties);
+    uint32_t bits = properties[queueFamilyIndex].timestampValidBits;
+    free(properties);
+    return bits;
+}
+
+GpuProfiler CreateGpuProfiler(ComputeApplication app, uint32_t framesInFlight)
+{
+    if (app == NULL || framesInFlight == 0 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+        return NULL;
+    GpuProfiler profiler = (GpuProfiler)calloc(sizeof(struct GpuProfiler), 1);
+    profiler->app = app;
+    profiler->framesInFlight = framesInFlight;
+    profiler->timestampPeriod = app->physicalDeviceProperties.limits.timestampPeriod;
+    uint32_t validBits = QueueFamilyTimestampBits(app, app->queueFamilyIndex);
+    profiler->timestampMask = ValidBitsMask(validBits);
+    uint32_t transferBits = QueueFamilyTimestampBits(app, app->transferQueueFamilyIndex);
+    profiler->transferTimestampMask = transferBits ? ValidBitsMask(transferBits) : 0;
+    if (validBits == 0 || profiler->timestampPeriod <= 0.0)
+    {
+        fprintf(stderr, "Compute queue does not support timestamps, GPU profiling is disabled\n");
+        return profiler;
+    }
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = framesInFlight * MAX_PROFILER_STAGES * 2,
+        .pipelineStatistics = 0
+    };
+    if (vkCreateQueryPool(app->device, &queryPoolCreateInfo, NULL, &profiler->queryPool) == VK_SUCCESS)
+        profiler->supported = true;
+    return profiler;
+}
+
+uint32_t GpuProfilerStage(GpuProfiler profiler, const char* name)
+{
+    if (profiler == NULL || name == NULL)
+        return INVALID_PROFILER_STAGE;
+    for (uint32_t i = 0; i < profiler->stageCount; ++i)
+    {
+        if (strcmp(profiler->stages[i].name, name) == 0)
+            return i;
+    }
+    if (profiler->stageCount >= MAX_PROFILER_STAGES)
+        return INVALID_PROFILER_STAGE;
+    profiler->stages[profiler->stageCount].name = name;
+    return profiler->stageCount++;
+}
+
+static uint32_t FirstQuery(GpuProfiler profiler, uint32_t frame, uint32_t stage)
+{
+    return (frame * MAX_PROFILER_STAGES + stage) * 2;
+}
+
+uint64_t GpuProfilerTicksToNanoseconds(GpuProfiler profiler, uint64_t begin, uint64_t end, uint64_t mask)
+{
+    // Counters narrower than 64 bits wrap, the masked difference stays correct across one wrap
+    uint64_t ticks = (end - begin) & mask;
+    return (uint64_t)((double)ticks * profiler->timestampPeriod);
+}
+
+void GpuProfilerAddSample(GpuProfiler profiler, uint32_t stage, uint64_t nanoseconds)
+{
+    if (profiler == NULL || stage >= profiler->stageCount)
+        return;
+    GpuProfilerStageStats* stats = &profiler->stages[stage];
+    stats->samples[stats->nextSample] = nanoseconds;
+    stats->nextSample = (stats->nextSample + 1) % PROFILER_HISTORY_LENGTH;
+    if (stats->sampleCount < PROFILER_HISTORY_LENGTH)
+        ++stats->sampleCount;
+    ++stats->totalSamples;
+}
+
+bool GpuProfilerCollectFrame(GpuProfiler profiler, uint32_t frame)
+{
+    if (profiler == NULL || !profiler->supported || frame >= profiler->framesInFlight)
+        return false;
+    if (!profiler->pending[frame])
+        return true;
+    uint32_t recorded = profiler->recordedStages[frame];
+    uint64_t durations[MAX_PROFILER_STAGES];
+    for (uint32_t stage = 0; stage < MAX_PROFILER_STAGES; ++stage)
+    {
+        if ((recorded & (1u << stage)) == 0)
+            continue;
+        // Value and availability word for the begin and end query
+        uint64_t results[4];
+        VkResult result = vkGetQueryPoolResults(profiler->app->device, profiler->queryPool, FirstQuery(profiler, frame, stage), 2,
+            sizeof(results), results, 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0 || results[3] == 0)
+            return false;
+        durations[stage] = GpuProfilerTicksToNanoseconds(profiler, results[0], results[2], profiler->timestampMask);
+    }
+    // Only publish complete frames so every stage has the same number of samples
+    for (uint32_t stage = 0; stage < MAX_PROFILER_STAGES; ++stage)
+    {
+        if (recorded & (1u << stage))
+            GpuProfilerAddSample(profiler, stage, durations[stage]);
+    }
+    profiler->pending[frame] = false;
+    return true;
+}
+
+void GpuProfilerCollect(GpuProfiler profiler)
+{
+    if (profiler == NULL)
+        return;
+    for (uint32_t frame = 0; frame < profiler->framesInFlight; ++frame)
+        GpuProfilerCollectFrame(profiler, frame);
+}
+
+void GpuProfilerResetFrame(GpuProfiler profiler, CommandBuffer cmdbuf, uint32_t frame)
+{
+    if (profiler == NULL || !profiler->supported || frame >= profiler->framesInFlight)
+        return;
+    profiler->recordedStages[frame] = 0;
+    vkCmdResetQueryPool(cmdbuf->cmdbuffer, profiler->queryPool, FirstQuery(profiler, frame, 0), MAX_PROFILER_STAGES * 2);
+}
+
+void GpuProfilerBeginStage(GpuProfiler profiler, CommandBuffer cmdbuf, uint32_t frame, uint32_t stage)
+{
+    if (profiler == NULL || !profiler->supported || frame >= profiler->framesInFlight || stage >= profiler->stageCount)
+        return;
+    if (profiler->recordedStages[frame] & (1u << stage))
+        return;
+    // Bottom of pipe waits for the preceding work, so begin to end covers only this stage
+    vkCmdWriteTimestamp(cmdbuf->cmdbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->queryPool, FirstQuery(profiler, frame, stage));
+}
+
+void GpuProfilerEndStage(GpuProfiler profiler, CommandBuffer cmdbuf, uint32_t frame, uint32_t stage)
+{
+    if (profiler == NULL || !profiler->supported || frame >= profiler->framesInFlight || stage >= profiler->stageCount)
+        return;
+    if (profiler->recordedStages[frame] & (1u << stage))
+        return;
+    vkCmdWriteTimestamp(cmdbuf->cmdbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->queryPool, FirstQuery(profiler, frame, stage) + 1);
+    profiler->recordedStages[frame] |= 1u << stage;
+}
+
+void GpuProfilerFrameSubmitted(GpuProfiler profiler, uint32_t frame)
+{
+    if (profiler == NULL || !profiler->supported || frame >= profiler->framesInFlight)
+        return;
+    profiler->pending[frame] = profiler->recordedStages[frame] != 0;
+}
+
+static int CompareSamples(const void* a, const void* b)
+{
+    uint64_t left = *(const uint64_t*)a, right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+bool GpuProfilerGetSummary(GpuProfiler profiler, uint32_t stage, GpuProfilerSummary* summary)
+{
+    if (profiler == NULL || stage >= profiler->stageCount || summary == NULL)
+        return false;
+    const GpuProfilerStageStats* stats = &profiler->stages[stage];
+    memset(summary, 0, sizeof(*summary));
+    if (stats->sampleCount == 0)
+        return false;
+    uint64_t sorted[PROFILER_HISTORY_LENGTH];
+    uint64_t total = 0;
+    memcpy(sorted, stats->samples, sizeof(uint64_t) * stats->sampleCount);
+    for (uint32_t i = 0; i < stats->sampleCount; ++i)
+        total += sorted[i];
+    qsort(sorted, stats->sampleCount, sizeof(uint64_t), CompareSamples);
+    summary->sampleCount = stats->sampleCount;
+    summary->lastNs = stats->samples[(stats->nextSample + PROFILER_HISTORY_LENGTH - 1) % PROFILER_HISTORY_LENGTH];
+    summary->minNs = sorted[0];
+    summary->maxNs = sorted[stats->sampleCount - 1];
+    summary->meanNs = total / stats->sampleCount;
+    summary->p95Ns = sorted[(stats->sampleCount - 1) * 95 / 100];
+    return true;
+}
+
+void PrintGpuProfilerStats(GpuProfiler profiler)
+{
+    if (profiler == NULL)
+        return;
+    printf("%-20s %8s %10s %10s %10s %10s\n", "Stage", "Samples", "Mean us", "P95 us", "Min us", "Max us");
+    for (uint32_t i = 0; i < profiler->stageCount; ++i)
+    {
+        GpuProfilerSummary summary;
+        if (!GpuProfilerGetSummary(profiler, i, &summary))
+            continue;
+        printf("%-20s %8u %10.1f %10.1f %10.1f %10.1f\n", profiler->stages[i].name, summary.sampleCount,
+            summary.meanNs / 1000.0, summary.p95Ns / 1000.0, summary.minNs / 1000.0, summary.maxNs / 1000.0);
+    }
+}
+
+void DestroyGpuProfiler(GpuProfiler profiler)
+{
+    if (profiler == NULL)
+        return;
+    if (profiler->queryPool)
+        vkDestroyQueryPool(profiler->app->device, profiler->queryPool, NULL);
+    free(profiler);
+}
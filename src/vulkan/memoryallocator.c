@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+#include "vulkanmanager.h"
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+MemoryAllocator CreateMemoryAllocator(ComputeApplication this, VkDeviceSize blockSize)
+{
+    if (this == NULL || this->device == NULL)
+        return NULL;
+    MemoryAllocator allocator = (MemoryAllocator)calloc(sizeof(struct MemoryAllocator), 1);
+    allocator->blockSize = blockSize > 0 ? blockSize : DEFAULT_MEMORY_BLOCK_SIZE;
+    vkGetPhysicalDeviceMemoryProperties(this->physicalDevice, &allocator->memoryProperties);
+    return allocator;
+}
+
+static MemoryBlock CreateMemoryBlock(ComputeApplication this, MemoryAllocator allocator, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+    if (allocator->blockCount >= this->physicalDeviceProperties.limits.maxMemoryAllocationCount &&
+        this->physicalDeviceProperties.limits.maxMemoryAllocationCount > 0)
+    {
+        fprintf(stderr, "Device memory allocation limit of %u reached\n", this->physicalDeviceProperties.limits.maxMemoryAllocationCount);
+        return NULL;
+    }
+    MemoryBlock block = (MemoryBlock)calloc(sizeof(struct MemoryBlock), 1);
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    VkMemoryAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = NULL,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    if (vkAllocateMemory(this->device, &allocateInfo, NULL, &block->memory) != VK_SUCCESS)
+    {
+        free(block);
+        return NULL;
+    }
+    // Host visible blocks stay mapped, a block may only be mapped once no matter how many buffers live in it
+    VkMemoryPropertyFlags flags = allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        VK_CHECK_RESULT(vkMapMemory(this->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+    block->next = allocator->blocks[memoryTypeIndex];
+    allocator->blocks[memoryTypeIndex] = block;
+    ++allocator->blockCount;
+    return block;
+}
+
+static void DestroyMemoryBlock(ComputeApplication this, MemoryAllocator allocator, MemoryBlock block)
+{
+    MemoryBlock* link = &allocator->blocks[block->memoryTypeIndex];
+    while (*link && *link != block)
+        link = &(*link)->next;
+    if (*link)
+        *link = block->next;
+    if (block->mapped)
+        vkUnmapMemory(this->device, block->memory);
+    vkFreeMemory(this->device, block->memory, NULL);
+    free(block->freeRanges);
+    free(block);
+    --allocator->blockCount;
+}
+
+static bool AllocateFromBlock(MemoryBlock block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* outOffset)
+{
+    // First fit in the free list, splitting the range around the aligned allocation
+    for (uint32_t i = 0; i < block->freeRangeCount; ++i)
+    {
+        MemoryFreeRange range = block->freeRanges[i];
+        VkDeviceSize offset = AlignUp(range.offset, alignment);
+        if (offset + size > range.offset + range.size)
+            continue;
+        VkDeviceSize headSize = offset - range.offset;
+        VkDeviceSize tailSize = range.offset + range.size - (offset + size);
+        if (headSize > 0 && tailSize > 0)
+        {
+            if (block->freeRangeCount == block->freeRangeCapacity)
+            {
+                block->freeRangeCapacity = block->freeRangeCapacity ? block->freeRangeCapacity * 2 : 8;
+                block->freeRanges = (MemoryFreeRange*)realloc(block->freeRanges, sizeof(MemoryFreeRange) * block->freeRangeCapacity);
+            }
+            memmove(&block->freeRanges[i + 2], &block->freeRanges[i + 1], sizeof(MemoryFreeRange) * (block->freeRangeCount - i - 1));
+            block->freeRanges[i].size = headSize;
+            block->freeRanges[i + 1] = (MemoryFreeRange){ offset + size, tailSize };
+            ++block->freeRangeCount;
+        }
+        else if (headSize > 0)
+            block->freeRanges[i].size = headSize;
+        else if (tailSize > 0)
+            block->freeRanges[i] = (MemoryFreeRange){ offset + size, tailSize };
+        else
+        {
+            memmove(&block->freeRanges[i], &block->freeRanges[i + 1], sizeof(MemoryFreeRange) * (block->freeRangeCount - i - 1));
+            --block->freeRangeCount;
+        }
+        *outOffset = offset;
+        return true;
+    }
+
+    // Otherwise bump the linear head, the alignment padding becomes a free range
+    VkDeviceSize offset = AlignUp(block->linearOffset, alignment);
+    if (offset + size > block->size)
+        return false;
+    if (offset > block->linearOffset)
+    {
+        if (block->freeRangeCount == block->freeRangeCapacity)
+        {
+            block->freeRangeCapacity = block->freeRangeCapacity ? block->freeRangeCapacity * 2 : 8;
+            block->freeRanges = (MemoryFreeRange*)realloc(block->freeRanges, sizeof(MemoryFreeRange) * block->freeRangeCapacity);
+        }
+        block->freeRanges[block->freeRangeCount++] = (MemoryFreeRange){ block->linearOffset, offset - block->linearOffset };
+    }
+    block->linearOffset = offset + size;
+    *outOffset = offset;
+    return true;
+}
+
+static void ReturnToBlock(MemoryBlock block, VkDeviceSize offset, VkDeviceSize size)
+{
+    // Insert sorted and merge with the neighbours
+    uint32_t index = 0;
+    while (index < block->freeRangeCount && block->freeRanges[index].offset < offset)
+        ++index;
+    bool mergePrevious = index > 0 && block->freeRanges[index - 1].offset + block->freeRanges[index - 1].size == offset;
+    bool mergeNext = index < block->freeRangeCount && offset + size == block->freeRanges[index].offset;
+    if (mergePrevious && mergeNext)
+    {
+        block->freeRanges[index - 1].size += size + block->freeRanges[index].size;
+        memmove(&block->freeRanges[index], &block->freeRanges[index + 1], sizeof(MemoryFreeRange) * (block->freeRangeCount - index - 1));
+        --block->freeRangeCount;
+    }
+    else if (mergePrevious)
+        block->freeRanges[index - 1].size += size;
+    else if (mergeNext)
+    {
+        block->freeRanges[index].offset = offset;
+        block->freeRanges[index].size += size;
+    }
+    else
+    {
+        if (block->freeRangeCount == block->freeRangeCapacity)
+        {
+            block->freeRangeCapacity = block->freeRangeCapacity ? block->freeRangeCapacity * 2 : 8;
+            block->freeRanges = (MemoryFreeRange*)realloc(block->freeRanges, sizeof(MemoryFreeRange) * block->freeRangeCapacity);
+        }
+        memmove(&block->freeRanges[index + 1], &block->freeRanges[index], sizeof(MemoryFreeRange) * (block->freeRangeCount - index));
+        block->freeRanges[index] = (MemoryFreeRange){ offset, size };
+        ++block->freeRangeCount;
+    }
+
+    // A free range touching the linear head is given back to it
+    if (block->freeRangeCount > 0)
+    {
+        MemoryFreeRange* last = &block->freeRanges[block->freeRangeCount - 1];
+        if (last->offset + last->size == block->linearOffset)
+        {
+            block->linearOffset = last->offset;
+            --block->freeRangeCount;
+        }
+    }
+}
+
+bool AllocateDeviceMemory(ComputeApplication this, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, MemoryAllocation* out)
+{
+    MemoryAllocator allocator = this->memoryAllocator;
+    memset(out, 0, sizeof(*out));
+    uint32_t memoryTypeIndex = RetrieveMemoryType(this, requirements.memoryTypeBits, properties);
+    if (allocator == NULL || memoryTypeIndex >= allocator->memoryProperties.memoryTypeCount)
+        return false;
+
+    VkDeviceSize offset = 0;
+    MemoryBlock block = NULL;
+    // Requests larger than half a block get a dedicated block so they do not strand the rest of one
+    if (requirements.size <= allocator->blockSize / 2)
+    {
+        for (block = allocator->blocks[memoryTypeIndex]; block; block = block->next)
+        {
+            if (!block->dedicated && AllocateFromBlock(block, requirements.size, requirements.alignment, &offset))
+                break;
+        }
+        if (block == NULL)
+        {
+            block = CreateMemoryBlock(this, allocator, memoryTypeIndex, allocator->blockSize);
+            if (block == NULL || !AllocateFromBlock(block, requirements.size, requirements.alignment, &offset))
+                return false;
+        }
+    }
+    else
+    {
+        block = CreateMemoryBlock(this, allocator, memoryTypeIndex, requirements.size);
+        if (block == NULL)
+            return false;
+        block->dedicated = true;
+        block->linearOffset = requirements.size;
+    }
+    ++block->liveAllocations;
+    out->block = block;
+    out->offset = offset;
+    out->size = requirements.size;
+    return true;
+}
+
+void FreeDeviceMemory(ComputeApplication this, MemoryAllocation* allocation)
+{
+    MemoryBlock block = allocation->block;
+    if (this == NULL || block == NULL)
+        return;
+    allocation->block = NULL;
+    if (--block->liveAllocations == 0)
+    {
+        // Keep one empty shared block per memory type around so per-frame create and destroy
+        // cycles do not turn into vkAllocateMemory calls
+        MemoryAllocator allocator = this->memoryAllocator;
+        bool otherBlocks = allocator->blocks[block->memoryTypeIndex] != block || block->next != NULL;
+        if (block->dedicated || otherBlocks)
+        {
+            DestroyMemoryBlock(this, allocator, block);
+            return;
+        }
+        block->linearOffset = 0;
+        block->freeRangeCount = 0;
+        return;
+    }
+    if (!block->dedicated)
+        ReturnToBlock(block, allocation->offset, allocation->size);
+}
+
+void DestroyMemoryAllocator(ComputeApplication this)
+{
+    MemoryAllocator allocator = this ? this->memoryAllocator : NULL;
+    if (allocator == NULL)
+        return;
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        while (allocator->blocks[i])
+        {
+            if (allocator->blocks[i]->liveAllocations > 0)
+                fprintf(stderr, "Freeing device memory block with %u live allocations\n", allocator->blocks[i]->liveAllocations);
+            DestroyMemoryBlock(this, allocator, allocator->blocks[i]);
+        }
+    }
+    free(allocator);
+    this->memoryAllocator = NULL;
+}
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vulkan/vulkan_core.h>
+#include "vulkanmanager.h"
+
+#define PIPELINE_CACHE_MAGIC 0x43505256u // "VRPC"
+#define PIPELINE_CACHE_FILE_VERSION 1u
+
+// Prepended to the driver blob so a cache from another device, driver or a torn write is never fed to the driver
+typedef struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t fileVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t deviceUUID[VK_UUID_SIZE];
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataChecksum;
+} PipelineCacheFileHeader;
+
+static uint64_t fnv1a64(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool MakeDirectory(const char* path)
+{
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+        return true;
+    return false;
+}
+
+static char* DefaultPipelineCachePath(ComputeApplication this)
+{
+    char directory[1024];
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cacheHome && cacheHome[0] != '\0')
+        snprintf(directory, sizeof(directory), "%s", cacheHome);
+    else if (home && home[0] != '\0')
+        snprintf(directory, sizeof(directory), "%s/.cache", home);
+    else
+        return NULL;
+    // The base directory need not exist yet either, e.g. a fresh XDG_CACHE_HOME
+    MakeDirectory(directory);
+
+    size_t length = strlen(directory);
+    snprintf(directory + length, sizeof(directory) - length, "/vrwebtrack");
+    if (!MakeDirectory(directory))
+    {
+        // Every ComputeApplication of the process ends up here, one message is enough
+        static atomic_bool reported;
+        if (!atomic_exchange(&reported, true))
+            fprintf(stderr, "Cannot create pipeline cache directory %s: %s, pipelines are compiled from scratch\n", directory, strerror(errno));
+        return NULL;
+    }
+
+    char uuidText[2 * VK_UUID_SIZE + 1];
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+        snprintf(uuidText + 2 * i, 3, "%02x", this->deviceUUID[i]);
+
+    size_t pathSize = strlen(directory) + sizeof(uuidText) + 64;
+    char* path = (char*)malloc(pathSize);
+    snprintf(path, pathSize, "%s/pipeline-%s-%08x.bin", directory, uuidText, this->physicalDeviceProperties.driverVersion);
+    return path;
+}
+
+/**
+ * @brief Loads and validates a cache file, returns the driver blob or NULL when the file is
+ * missing, truncated, corrupted or was produced by another device or driver version.
+ */
+static void* LoadPipelineCacheData(ComputeApplication this, const char* path, size_t* outSize)
+{
+    *outSize = 0;
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    PipelineCacheFileHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    const VkPhysicalDeviceProperties* properties = &this->physicalDeviceProperties;
+    if (header.magic != PIPELINE_CACHE_MAGIC || header.fileVersion != PIPELINE_CACHE_FILE_VERSION ||
+        header.vendorID != properties->vendorID || header.deviceID != properties->deviceID ||
+        header.driverVersion != properties->driverVersion ||
+        memcmp(header.deviceUUID, this->deviceUUID, VK_UUID_SIZE) != 0 ||
+        memcmp(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+        header.dataSize < sizeof(VkPipelineCacheHeaderVersionOne) || header.dataSize > (64u << 20))
+    {
+        #ifdef DEBUG_MODE
+        fprintf(stderr, "Discarding stale pipeline cache %s\n", path);
+        #endif
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t* data = (uint8_t*)malloc(header.dataSize);
+    if (data == NULL || fread(data, 1, header.dataSize, fp) != header.dataSize ||
+        fnv1a64(data, header.dataSize) != header.dataChecksum)
+    {
+        fprintf(stderr, "Discarding corrupted pipeline cache %s\n", path);
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    // The driver validates its own header as well, checking it here keeps bad blobs away from buggy drivers
+    VkPipelineCacheHeaderVersionOne driverHeader;
+    memcpy(&driverHeader, data, sizeof(driverHeader));
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.headerSize < sizeof(VkPipelineCacheHeaderVersionOne) ||
+        driverHeader.vendorID != properties->vendorID || driverHeader.deviceID != properties->deviceID ||
+        memcmp(driverHeader.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        free(data);
+        return NULL;
+    }
+
+    *outSize = header.dataSize;
+    return data;
+}
+
+void InitializePipelineCache(ComputeApplication this, const char* pipelineCachePath)
+{
+    if (this == NULL || this->device == NULL)
+        return;
+    if (pipelineCachePath && pipelineCachePath[0] != '\0')
+    {
+        size_t length = strlen(pipelineCachePath);
+        this->pipelineCachePath = (char*)malloc(length + 1);
+        memcpy(this->pipelineCachePath, pipelineCachePath, length + 1);
+    }
+    else
+        this->pipelineCachePath = DefaultPipelineCachePath(this);
+
+    size_t initialDataSize = 0;
+    void* initialData = NULL;
+    if (this->pipelineCachePath)
+        initialData = LoadPipelineCacheData(this, this->pipelineCachePath, &initialDataSize);
+
+    VkPipelineCacheCreateInfo cacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = initialDataSize,
+        .pInitialData = initialData
+    };
+    VkResult result = vkCreatePipelineCache(this->device, &cacheCreateInfo, NULL, &this->pipelineCache);
+    if (result != VK_SUCCESS && initialData)
+    {
+        // Start from an empty cache rather than failing startup over a rejected blob
+        cacheCreateInfo.initialDataSize = 0;
+        cacheCreateInfo.pInitialData = NULL;
+        result = vkCreatePipelineCache(this->device, &cacheCreateInfo, NULL, &this->pipelineCache);
+    }
+    if (result != VK_SUCCESS)
+        this->pipelineCache = VK_NULL_HANDLE;
+    free(initialData);
+}
+
+bool SavePipelineCache(ComputeApplication this)
+{
+    if (this == NULL || this->pipelineCache == VK_NULL_HANDLE || this->pipelineCachePath == NULL)
+        return false;
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(this->device, this->pipelineCache, &dataSize, NULL) != VK_SUCCESS || dataSize == 0)
+        return false;
+    uint8_t* data = (uint8_t*)malloc(dataSize);
+    if (data == NULL)
+        return false;
+    if (vkGetPipelineCacheData(this->device, this->pipelineCache, &dataSize, data) != VK_SUCCESS)
+    {
+        free(data);
+        return false;
+    }
+
+    PipelineCacheFileHeader header = {
+        .magic = PIPELINE_CACHE_MAGIC,
+        .fileVersion = PIPELINE_CACHE_FILE_VERSION,
+        .vendorID = this->physicalDeviceProperties.vendorID,
+        .deviceID = this->physicalDeviceProperties.deviceID,
+        .driverVersion = this->physicalDeviceProperties.driverVersion,
+        .dataSize = dataSize,
+        .dataChecksum = fnv1a64(data, dataSize)
+    };
+    memcpy(header.deviceUUID, this->deviceUUID, VK_UUID_SIZE);
+    memcpy(header.pipelineCacheUUID, this->physicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    // Write to a per-process temporary file and rename, so a worker killed mid-write never leaves a
+    // torn cache behind and workers shutting down together do not interleave their writes
+    size_t tempPathSize = strlen(this->pipelineCachePath) + 32;
+    char* tempPath = (char*)malloc(tempPathSize);
+    snprintf(tempPath, tempPathSize, "%s.%ld.tmp", this->pipelineCachePath, (long)getpid());
+    bool ok = false;
+    FILE* fp = fopen(tempPath, "wb");
+    if (fp)
+    {
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(data, 1, dataSize, fp) == dataSize;
+        ok = (fclose(fp) == 0) && ok;
+        if (ok)
+            ok = rename(tempPath, this->pipelineCachePath) == 0;
+        if (!ok)
+            remove(tempPath);
+    }
+    if (!ok)
+        fprintf(stderr, "Failed to save pipeline cache to %s\n", this->pipelineCachePath);
+    free(tempPath);
+    free(data);
+    return ok;
+}
+
+void DestroyPipelineCache(ComputeApplication this)
+{
+    if (this == NULL)
+        return;
+    if (this->pipelineCache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(this->device, this->pipelineCache, NULL);
+    this->pipelineCache = VK_NULL_HANDLE;
+    free(this->pipelineCachePath);
+    this->pipelineCachePath = NULL;
+}
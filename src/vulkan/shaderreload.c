@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+#ifdef HAVE_SHADERC
+#include <shaderc/shaderc.h>
+#endif
+#include "shaderreload.h"
+
+#define SPIRV_MAGIC 0x07230203u
+
+static bool IsSpirv(const uint8_t* code, size_t length)
+{
+    uint32_t magic = 0;
+    if (length < 20 || length % 4 != 0)
+        return false;
+    memcpy(&magic, code, sizeof(magic));
+    return magic == SPIRV_MAGIC;
+}
+
+/**
+ * @brief Compiles a GLSL compute shader, or copies the message when it already is SPIR-V.
+ *
+ * @return malloc'd SPIR-V words, NULL on failure.
+ */
+static uint32_t* CompileTrackingShader(ComputeApplication app, const uint8_t* source, size_t length, size_t* outSize)
+{
+    *outSize = 0;
+    if (IsSpirv(source, length))
+    {
+        uint32_t* code = (uint32_t*)malloc(length);
+        memcpy(code, source, length);
+        *outSize = length;
+        return code;
+    }
+#ifdef HAVE_SHADERC
+    shaderc_compiler_t compiler = shaderc_compiler_initialize();
+    shaderc_compile_options_t options = shaderc_compile_options_initialize();
+    if (compiler == NULL || options == NULL)
+    {
+        shaderc_compile_options_release(options);
+        shaderc_compiler_release(compiler);
+        return NULL;
+    }
+    // Subgroup operations need SPIR-V 1.3, the same target the build compiles the shipped shaders for
+    shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
+    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+    if (!app->subgroupArithmeticSupported)
+        shaderc_compile_options_add_macro_definition(options, "NO_SUBGROUP_ARITHMETIC", strlen("NO_SUBGROUP_ARITHMETIC"), "1", 1);
+    shaderc_compilation_result_t result = shaderc_compile_into_spv(compiler, (const char*)source, length,
+        shaderc_compute_shader, "blob_centroid.comp", "main", options);
+    uint32_t* code = NULL;
+    if (shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success)
+    {
+        *outSize = shaderc_result_get_length(result);
+        code = (uint32_t*)malloc(*outSize);
+        memcpy(code, shaderc_result_get_bytes(result), *outSize);
+    }
+    else
+        fprintf(stderr, "Tracking shader failed to compile:\n%s\n", shaderc_result_get_error_message(result));
+    shaderc_result_release(result);
+    shaderc_compile_options_release(options);
+    shaderc_compiler_release(compiler);
+    return code;
+#else
+    fprintf(stderr, "Built without shaderc, hot reloaded tracking shaders must be sent as SPIR-V\n");
+    return NULL;
+#endif
+}
+
+static void DestroyShaderReloadResult(ComputeApplication app, ShaderReloadResult result)
+{
+    if (result == NULL)
+        return;
+    for (uint32_t i = 0; i < result->pipelineCount; ++i)
+        DestroyPipeline(app, result->pipelines[i]);
+    free(result->pipelines);
+    free(result);
+}
+
+static ShaderReloadResult BuildShaderReload(ShaderReloader reloader, const uint8_t* source, size_t length)
+{
+    size_t spirvSize = 0;
+    uint32_t* spirv = CompileTrackingShader(reloader->app, source, length, &spirvSize);
+    if (spirv == NULL)
+        return NULL;
+    VkShaderModule shaderModule = LoadShader(reloader->app, spirv, spirvSize);
+    free(spirv);
+    if (shaderModule == VK_NULL_HANDLE)
+        return NULL;
+    ShaderReloadResult result = (ShaderReloadResult)calloc(sizeof(struct ShaderReloadResult), 1);
+    result->pipelines = (ComputePipeline*)calloc(sizeof(ComputePipeline), reloader->trackerCount);
+    result->pipelineCount = reloader->trackerCount;
+    for (uint32_t i = 0; i < reloader->trackerCount && result; ++i)
+    {
+        result->pipelines[i] = CreateBlobTrackerPipeline(reloader->app, reloader->trackers[i], shaderModule);
+        if (result->pipelines[i] == NULL)
+        {
+            DestroyShaderReloadResult(reloader->app, result);
+            result = NULL;
+        }
+    }
+    // Pipelines do not reference their module once created
+    if (shaderModule)
+        vkDestroyShaderModule(reloader->app->device, shaderModule, NULL);
+    return result;
+}
+
+static void* ShaderReloadThread(void* arg)
+{
+    ShaderReloader reloader = (ShaderReloader)arg;
+    pthread_mutex_lock(&reloader->mutex);
+    while (!reloader->stopping)
+    {
+        if (reloader->pendingSource == NULL)
+        {
+            pthread_cond_wait(&reloader->wake, &reloader->mutex);
+            continue;
+        }
+        uint8_t* source = reloader->pendingSource;
+        size_t length = reloader->pendingLength;
+        reloader->pendingSource = NULL;
+        pthread_mutex_unlock(&reloader->mutex);
+
+        ShaderReloadResult result = BuildShaderReload(reloader, source, length);
+        free(source);
+        if (result)
+        {
+            // A build the capture thread has not picked up yet was never used and can go right away
+            ShaderReloadResult unused = atomic_exchange_explicit(&reloader->ready, result, memory_order_acq_rel);
+            DestroyShaderReloadResult(reloader->app, unused);
+            atomic_fetch_add_explicit(&reloader->completedReloads, 1, memory_order_relaxed);
+        }
+        else
+            atomic_fetch_add_explicit(&reloader->failedReloads, 1, memory_order_relaxed);
+        pthread_mutex_lock(&reloader->mutex);
+    }
+    pthread_mutex_unlock(&reloader->mutex);
+    return NULL;
+}
+
+ShaderReloader CreateShaderReloader(ComputeApplication app, uint32_t trackerCount, BlobTracker* trackers)
+{
+    if (app == NULL || trackerCount == 0 || trackers == NULL)
+        return NULL;
+    ShaderReloader reloader = (ShaderReloader)calloc(sizeof(struct ShaderReloader), 1);
+    reloader->app = app;
+    reloader->trackerCount = trackerCount;
+    reloader->trackers = trackers;
+    atomic_init(&reloader->ready, NULL);
+    atomic_init(&reloader->completedReloads, 0);
+    atomic_init(&reloader->failedReloads, 0);
+    pthread_mutex_init(&reloader->mutex, NULL);
+    pthread_cond_init(&reloader->wake, NULL);
+    if (pthread_create(&reloader->thread, NULL, ShaderReloadThread, reloader) != 0)
+    {
+        fprintf(stderr, "Failed to start the shader reload thread\n");
+        pthread_cond_destroy(&reloader->wake);
+        pthread_mutex_destroy(&reloader->mutex);
+        free(reloader);
+        return NULL;
+    }
+    return reloader;
+}
+
+bool SubmitShaderReload(ShaderReloader reloader, const UpdateGLSLCode* message)
+{
+    if (reloader == NULL || message == NULL || message->purpose != UpdateTrackingCompute ||
+        message->buffer == NULL || message->length == 0)
+        return false;
+    uint8_t* source = (uint8_t*)malloc(message->length);
+    memcpy(source, message->buffer, message->length);
+    pthread_mutex_lock(&reloader->mutex);
+    free(reloader->pendingSource);
+    reloader->pendingSource = source;
+    reloader->pendingLength = message->length;
+    pthread_cond_signal(&reloader->wake);
+    pthread_mutex_unlock(&reloader->mutex);
+    return true;
+}
+
+static void ReleaseRetiredShaderReloads(ShaderReloader reloader)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < reloader->retiredCount; ++i)
+    {
+        if (IsComputeTicketComplete(reloader->app, reloader->retired[i].ticket))
+            DestroyShaderReloadResult(reloader->app, reloader->retired[i].result);
+        else
+            reloader->retired[kept++] = reloader->retired[i];
+    }
+    reloader->retiredCount = kept;
+}
+
+bool ApplyShaderReload(ShaderReloader reloader, FrameGraph graph)
+{
+    if (reloader == NULL)
+        return false;
+    ReleaseRetiredShaderReloads(reloader);
+    ShaderReloadResult result = atomic_exchange_explicit(&reloader->ready, NULL, memory_order_acq_rel);
+    if (result == NULL)
+        return false;
+
+    // Swap in place, the result then holds the replaced objects and is retired as a whole
+    for (uint32_t i = 0; i < reloader->trackerCount; ++i)
+    {
+        ComputePipeline previous = reloader->trackers[i]->pipeline;
+        reloader->trackers[i]->pipeline = result->pipelines[i];
+        result->pipelines[i] = previous;
+    }
+    FrameGraphInvalidate(graph);
+
+    if (reloader->retiredCount == MAX_RETIRED_SHADER_RELOADS)
+    {
+        // Reloads arriving faster than frames complete, only here does the capture thread wait
+        WaitForComputeTicket(reloader->app, reloader->retired[0].ticket, UINT64_MAX);
+        ReleaseRetiredShaderReloads(reloader);
+    }
+    reloader->retired[reloader->retiredCount].ticket = reloader->app->lastSubmittedTicket;
+    reloader->retired[reloader->retiredCount].result = result;
+    ++reloader->retiredCount;
+    return true;
+}
+
+void DestroyShaderReloader(ShaderReloader reloader)
+{
+    if (reloader == NULL)
+        return;
+    pthread_mutex_lock(&reloader->mutex);
+    reloader->stopping = true;
+    pthread_cond_signal(&reloader->wake);
+    pthread_mutex_unlock(&reloader->mutex);
+    pthread_join(reloader->thread, NULL);
+
+    for (uint32_t i = 0; i < reloader->retiredCount; ++i)
+    {
+        WaitForComputeTicket(reloader->app, reloader->retired[i].ticket, UINT64_MAX);
+        DestroyShaderReloadResult(reloader->app, reloader->retired[i].result);
+    }
+    DestroyShaderReloadResult(reloader->app, atomic_load(&reloader->ready));
+    free(reloader->pendingSource);
+    pthread_cond_destroy(&reloader->wake);
+    pthread_mutex_destroy(&reloader->mutex);
+    free(reloader);
+}
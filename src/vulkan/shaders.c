@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "shaders.h"
+
+// Generated by glslangValidator --vn at build time, each defines const uint32_t <name>_spirv[]
+#include "blob_centroid.spv.h"
+#include "blob_centroid_no_subgroup.spv.h"
+#include "roi_predict.spv.h"
+#include "color_histogram.spv.h"
+
+#define SPIRV_MAGIC 0x07230203u
+
+typedef struct BuiltinShaderEntry
+{
+    const char* name;
+    const uint32_t* code;
+    size_t size;
+} BuiltinShaderEntry;
+
+static const BuiltinShaderEntry builtinShaders[BUILTIN_SHADER_COUNT] = {
+    [BlobCentroidShader] = { "blob_centroid", blob_centroid_spirv, sizeof(blob_centroid_spirv) },
+    [BlobCentroidNoSubgroupShader] = { "blob_centroid_no_subgroup", blob_centroid_no_subgroup_spirv, sizeof(blob_centroid_no_subgroup_spirv) },
+    [RoiPredictShader] = { "roi_predict", roi_predict_spirv, sizeof(roi_predict_spirv) },
+    [ColorHistogramShader] = { "color_histogram", color_histogram_spirv, sizeof(color_histogram_spirv) }
+};
+
+static uint32_t* LoadShaderOverride(const char* directory, const char* name, size_t* outSize)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.spv", directory, name);
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    uint32_t* code = NULL;
+    long size = 0;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 20 && size % 4 == 0 && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        code = (uint32_t*)malloc((size_t)size);
+        if (fread(code, 1, (size_t)size, fp) != (size_t)size || code[0] != SPIRV_MAGIC)
+        {
+            free(code);
+            code = NULL;
+        }
+    }
+    fclose(fp);
+    if (code == NULL)
+    {
+        fprintf(stderr, "Ignoring malformed shader override %s\n", path);
+        return NULL;
+    }
+    #ifdef DEBUG_MODE
+    fprintf(stderr, "Using shader override %s\n", path);
+    #endif
+    *outSize = (size_t)size;
+    return code;
+}
+
+ShaderCode GetBuiltinShader(enum BuiltinShader shader)
+{
+    ShaderCode result = {0};
+    if ((unsigned)shader >= BUILTIN_SHADER_COUNT)
+        return result;
+    const BuiltinShaderEntry* entry = &builtinShaders[shader];
+    result.code = entry->code;
+    result.size = entry->size;
+
+    const char* directory = getenv(SHADER_DIRECTORY_ENVIRONMENT_VARIABLE);
+    if (directory && directory[0] != '\0')
+    {
+        size_t size = 0;
+        result.overrideCode = LoadShaderOverride(directory, entry->name, &size);
+        if (result.overrideCode)
+        {
+            result.code = result.overrideCode;
+            result.size = size;
+        }
+    }
+    return result;
+}
+
+enum BuiltinShader BlobCentroidShaderForDevice(ComputeApplication app)
+{
+    return (app && app->subgroupArithmeticSupported) ? BlobCentroidShader : BlobCentroidNoSubgroupShader;
+}
+
+void ReleaseShaderCode(ShaderCode* shader)
+{
+    if (shader == NULL)
+        return;
+    free(shader->overrideCode);
+    memset(shader, 0, sizeof(*shader));
+}
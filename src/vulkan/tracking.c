@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+#include "tracking.h"
+
+static uint32_t PackColor(uint8_t r, uint8_t g, uint8_t b)
+{
+    return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16);
+}
+
+size_t TrackingFrameSize(uint32_t width, uint32_t height, enum TrackingPixelFormat pixelFormat)
+{
+    size_t pixels = (size_t)width * height;
+    switch (pixelFormat)
+    {
+        case TrackingPixelFormatRGB24:
+            return pixels * 3;
+        case TrackingPixelFormatYUYV:
+            return (width % 2 == 0) ? pixels * 2 : 0;
+        case TrackingPixelFormatNV12:
+            return (width % 2 == 0 && height % 2 == 0) ? pixels + pixels / 2 : 0;
+    }
+    return 0;
+}
+
+static uint8_t ClampToByte(double value)
+{
+    if (value < 0.0)
+        return 0;
+    if (value > 255.0)
+        return 255;
+    return (uint8_t)(value + 0.5);
+}
+
+MarkerColorRange ConvertMarkerColorRangeToYUV(MarkerColorRange rgbRange)
+{
+    // The conversion is affine, so the extremes of the YUV box are reached at corners of the RGB box
+    MarkerColorRange yuvRange = { 255, 255, 255, 0, 0, 0 };
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        double r = (corner & 1) ? rgbRange.maxR : rgbRange.minR;
+        double g = (corner & 2) ? rgbRange.maxG : rgbRange.minG;
+        double b = (corner & 4) ? rgbRange.maxB : rgbRange.minB;
+        uint8_t y = ClampToByte(16.0 + (65.738 * r + 129.057 * g + 25.064 * b) / 256.0);
+        uint8_t u = ClampToByte(128.0 + (-37.945 * r - 74.494 * g + 112.439 * b) / 256.0);
+        uint8_t v = ClampToByte(128.0 + (112.439 * r - 94.154 * g - 18.285 * b) / 256.0);
+        if (y < yuvRange.minR) yuvRange.minR = y;
+        if (u < yuvRange.minG) yuvRange.minG = u;
+        if (v < yuvRange.minB) yuvRange.minB = v;
+        if (y > yuvRange.maxR) yuvRange.maxR = y;
+        if (u > yuvRange.maxG) yuvRange.maxG = u;
+        if (v > yuvRange.maxB) yuvRange.maxB = v;
+    }
+    return yuvRange;
+}
+
+static void FillTrackingSpecializationConstants(BlobTracker tracker, SpecializationConstant* constants)
+{
+    constants[0] = (SpecializationConstant){ WorkgroupSizeXConstantID, tracker->workgroupSizeX };
+    constants[1] = (SpecializationConstant){ WorkgroupSizeYConstantID, tracker->workgroupSizeY };
+    constants[2] = (SpecializationConstant){ MarkerCountConstantID, tracker->markerCount };
+    constants[3] = (SpecializationConstant){ FrameWidthConstantID, tracker->width };
+    constants[4] = (SpecializationConstant){ FrameHeightConstantID, tracker->height };
+    constants[5] = (SpecializationConstant){ PixelFormatConstantID, (uint32_t)tracker->pixelFormat };
+}
+
+ComputePipeline CreateBlobTrackerPipeline(ComputeApplication app, BlobTracker tracker, VkShaderModule shaderModule)
+{
+    if (app == NULL || tracker == NULL || shaderModule == VK_NULL_HANDLE)
+        return NULL;
+    SpecializationConstant constants[TRACKING_SPECIALIZATION_CONSTANT_COUNT];
+    FillTrackingSpecializationConstants(tracker, constants);
+    // Every slot's descriptor set layout is defined identically, so the pipeline binds any of them
+    return CreatePipelineWithConstants(app, tracker->frames[0].descriptors, shaderModule, "main",
+        TRACKING_SPECIALIZATION_CONSTANT_COUNT, constants, sizeof(TrackingPushConstants));
+}
+
+BlobTracker CreateBlobTracker(ComputeApplication app, uint32_t width, uint32_t height, enum TrackingPixelFormat pixelFormat, uint32_t markerCount,
+    const void* spirv, size_t spirvSize, const void* predictSpirv, size_t predictSpirvSize)
+{
+    if (app == NULL || spirv == NULL || spirvSize == 0 || width == 0 || height == 0 ||
+        markerCount == 0 || markerCount > MAX_TRACKING_MARKERS)
+        return NULL;
+    size_t frameSize = TrackingFrameSize(width, height, pixelFormat);
+    if (frameSize == 0)
+    {
+        fprintf(stderr, "Unsupported %ux%u frame for tracking pixel format %d\n", width, height, (int)pixelFormat);
+        return NULL;
+    }
+
+    BlobTracker tracker = (BlobTracker)calloc(sizeof(struct BlobTracker), 1);
+    tracker->width = width;
+    tracker->height = height;
+    tracker->markerCount = markerCount;
+    tracker->pixelFormat = pixelFormat;
+    tracker->frameSize = frameSize;
+    // 2D tiles 16 pixels wide keep rows of a tile within a few cache lines of the frame. The
+    // shader clears its shared accumulators with the first MAX_TRACKING_MARKERS lanes.
+    uint32_t workgroupSize = RecommendedWorkgroupSize(app);
+    if (workgroupSize < MAX_TRACKING_MARKERS)
+        workgroupSize = MAX_TRACKING_MARKERS;
+    tracker->workgroupSizeX = workgroupSize < 16 ? workgroupSize : 16;
+    tracker->workgroupSizeY = workgroupSize / tracker->workgroupSizeX;
+
+    // Round up to whole words, the shader reads the frame as uint
+    Buffer buffers[TRACKING_FRAMES_IN_FLIGHT * 6];
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        BlobTrackerFrame* frame = &tracker->frames[i];
+        frame->tracker = tracker;
+        frame->index = i;
+        frame->frameBuffer = CreateBuffer(app, "blob_frame", DeviceLocalBufferType, (frameSize + 3) & ~(size_t)3, 0);
+        frame->resultBuffer = CreateBuffer(app, "blob_results", ReadAndWriteBufferType, sizeof(MarkerResultGPU) * MAX_TRACKING_MARKERS, 1);
+        frame->windowBuffer = CreateBuffer(app, "blob_windows", DeviceLocalBufferType, sizeof(TrackingWindowGPU) * MAX_TRACKING_MARKERS, 2);
+        if (frame->frameBuffer == NULL || frame->resultBuffer == NULL || frame->windowBuffer == NULL)
+        {
+            DestroyBlobTracker(app, tracker);
+            return NULL;
+        }
+        buffers[i * 3] = frame->frameBuffer;
+        buffers[i * 3 + 1] = frame->resultBuffer;
+        buffers[i * 3 + 2] = frame->windowBuffer;
+    }
+    // The prediction of a slot reads the results of the slot submitted before it
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        uint32_t previous = (i + TRACKING_FRAMES_IN_FLIGHT - 1) % TRACKING_FRAMES_IN_FLIGHT;
+        Buffer* predictBuffers = &buffers[TRACKING_FRAMES_IN_FLIGHT * 3 + i * 3];
+        predictBuffers[0] = tracker->frames[i].frameBuffer;
+        predictBuffers[1] = tracker->frames[previous].resultBuffer;
+        predictBuffers[2] = tracker->frames[i].windowBuffer;
+    }
+    tracker->descriptorPool = CreatePoolForDescriptors(app, TRACKING_FRAMES_IN_FLIGHT * 2, TRACKING_FRAMES_IN_FLIGHT * 6, buffers);
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        tracker->frames[i].descriptors = CreateDescriptorsForBuffers(app, tracker->descriptorPool, 3, &buffers[i * 3]);
+        tracker->frames[i].predictDescriptors = CreateDescriptorsForBuffers(app, tracker->descriptorPool, 3, &buffers[TRACKING_FRAMES_IN_FLIGHT * 3 + i * 3]);
+    }
+    tracker->shaderModule = LoadShader(app, (void*)spirv, spirvSize);
+
+    // A zeroed result reads as "not found", so the first predicted windows cover the whole frame
+    MarkerResultGPU emptyResults[MAX_TRACKING_MARKERS];
+    memset(emptyResults, 0, sizeof(emptyResults));
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+        CopyDataToBuffer(app, tracker->frames[i].resultBuffer, sizeof(emptyResults), emptyResults);
+
+    SpecializationConstant constants[TRACKING_SPECIALIZATION_CONSTANT_COUNT];
+    FillTrackingSpecializationConstants(tracker, constants);
+    tracker->pipeline = CreateBlobTrackerPipeline(app, tracker, tracker->shaderModule);
+    if (predictSpirv != NULL && predictSpirvSize > 0)
+    {
+        // Same IDs but the pixel format, roi_predict.comp uses the workgroup size to compute group counts
+        tracker->predictShaderModule = LoadShader(app, (void*)predictSpirv, predictSpirvSize);
+        tracker->predictPipeline = CreatePipelineWithConstants(app, tracker->frames[0].predictDescriptors, tracker->predictShaderModule, "main",
+            TRACKING_SPECIALIZATION_CONSTANT_COUNT - 1, constants, sizeof(TrackingPredictPushConstants));
+    }
+    if (tracker->pipeline == NULL || (predictSpirv != NULL && tracker->predictPipeline == NULL))
+    {
+        DestroyBlobTracker(app, tracker);
+        return NULL;
+    }
+
+    // Ranges start empty (min above max) so unset markers never match
+    for (uint32_t i = 0; i < MAX_TRACKING_MARKERS; ++i)
+    {
+        tracker->pushConstants.colorMin[i] = PackColor(255, 255, 255);
+        tracker->pushConstants.colorMax[i] = 0;
+    }
+    return tracker;
+}
+
+bool SetBlobTrackerMarkerColor(BlobTracker tracker, uint32_t marker, MarkerColorRange range)
+{
+    if (tracker == NULL)
+        return false;
+    if (tracker->pixelFormat != TrackingPixelFormatRGB24)
+        range = ConvertMarkerColorRangeToYUV(range);
+    return SetBlobTrackerMarkerRange(tracker, marker, range);
+}
+
+bool SetBlobTrackerMarkerRange(BlobTracker tracker, uint32_t marker, MarkerColorRange range)
+{
+    if (tracker == NULL || marker >= tracker->markerCount)
+        return false;
+    tracker->pushConstants.colorMin[marker] = PackColor(range.minR, range.minG, range.minB);
+    tracker->pushConstants.colorMax[marker] = PackColor(range.maxR, range.maxG, range.maxB);
+    return true;
+}
+
+static void RecordBufferBarrier(VkCommandBuffer commandBuffer, Buffer buffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+    VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+{
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = buffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+static void RecordClearResults(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame)
+{
+    Buffer resultBuffer = tracker->frames[frame].resultBuffer;
+    vkCmdFillBuffer(cmdbuf->cmdbuffer, resultBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+    RecordBufferBarrier(cmdbuf->cmdbuffer, resultBuffer, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+static void RecordResultsToHost(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame)
+{
+    RecordBufferBarrier(cmdbuf->cmdbuffer, tracker->frames[frame].resultBuffer, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_HOST_READ_BIT | VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+static void RecordWindowDispatch(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame, TrackingWindow window, uint32_t markerMask)
+{
+    if (window.x >= tracker->width || window.y >= tracker->height || window.width == 0 || window.height == 0)
+        return;
+    if (window.width > tracker->width - window.x)
+        window.width = tracker->width - window.x;
+    if (window.height > tracker->height - window.y)
+        window.height = tracker->height - window.y;
+    tracker->pushConstants.windowOrigin[0] = window.x;
+    tracker->pushConstants.windowOrigin[1] = window.y;
+    tracker->pushConstants.windowExtent[0] = window.width;
+    tracker->pushConstants.windowExtent[1] = window.height;
+    tracker->pushConstants.markerMask = markerMask;
+    tracker->pushConstants.windowSlot = NO_TRACKING_WINDOW_SLOT;
+    AddPushConstantsToCommandBufferQueue(cmdbuf, tracker->pipeline, 0, sizeof(TrackingPushConstants), &tracker->pushConstants);
+    AddDispatch3DComputeShaderToCommandBufferQueue(cmdbuf, tracker->pipeline,
+        (window.width + tracker->workgroupSizeX - 1) / tracker->workgroupSizeX,
+        (window.height + tracker->workgroupSizeY - 1) / tracker->workgroupSizeY, 1, tracker->frames[frame].descriptors);
+}
+
+void RecordBlobTracking(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame)
+{
+    TrackingWindow window = { 0, 0, tracker->width, tracker->height };
+    uint32_t allMarkers = (1u << tracker->markerCount) - 1;
+    RecordBlobTrackingWindows(tracker, cmdbuf, frame, 1, &window, &allMarkers);
+}
+
+void RecordBlobTrackingWindows(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame, uint32_t windowCount, const TrackingWindow* windows, const uint32_t* markerMasks)
+{
+    if (frame >= TRACKING_FRAMES_IN_FLIGHT)
+        return;
+    // The results were last read by the prediction of the next slot or written by the host
+    RecordBufferBarrier(cmdbuf->cmdbuffer, tracker->frames[frame].resultBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_WRITE_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    RecordClearResults(tracker, cmdbuf, frame);
+    for (uint32_t i = 0; i < windowCount; ++i)
+        RecordWindowDispatch(tracker, cmdbuf, frame, windows[i], markerMasks[i]);
+    RecordResultsToHost(tracker, cmdbuf, frame);
+}
+
+static void RecordPredictWindows(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame)
+{
+    TrackingPredictPushConstants predictConstants = { tracker->predictMargin, tracker->predictMinimumSize };
+    AddPushConstantsToCommandBufferQueue(cmdbuf, tracker->predictPipeline, 0, sizeof(predictConstants), &predictConstants);
+    AddDispatchComputeShaderToCommandBufferQueue(cmdbuf, tracker->predictPipeline, 1, tracker->frames[frame].predictDescriptors);
+}
+
+static void RecordPredictedDispatches(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame)
+{
+    for (uint32_t marker = 0; marker < tracker->markerCount; ++marker)
+    {
+        tracker->pushConstants.markerMask = 1u << marker;
+        tracker->pushConstants.windowSlot = marker;
+        AddPushConstantsToCommandBufferQueue(cmdbuf, tracker->pipeline, 0, sizeof(TrackingPushConstants), &tracker->pushConstants);
+        AddDispatchIndirectComputeShaderToCommandBufferQueue(cmdbuf, tracker->pipeline, tracker->frames[frame].windowBuffer,
+            marker * sizeof(TrackingWindowGPU), tracker->frames[frame].descriptors);
+    }
+}
+
+void RecordBlobTrackingPredicted(BlobTracker tracker, CommandBuffer cmdbuf, uint32_t frame, uint32_t margin, uint32_t minimumSize)
+{
+    if (tracker->predictPipeline == NULL)
+    {
+        fprintf(stderr, "Blob tracker was created without the window prediction shader\n");
+        return;
+    }
+    if (frame >= TRACKING_FRAMES_IN_FLIGHT)
+        return;
+    tracker->predictMargin = margin;
+    tracker->predictMinimumSize = minimumSize;
+    VkCommandBuffer commandBuffer = cmdbuf->cmdbuffer;
+    BlobTrackerFrame* current = &tracker->frames[frame];
+    BlobTrackerFrame* previous = &tracker->frames[(frame + TRACKING_FRAMES_IN_FLIGHT - 1) % TRACKING_FRAMES_IN_FLIGHT];
+    // Results of the previous frame were last written by the reduction of the previous submission
+    RecordBufferBarrier(commandBuffer, previous->resultBuffer, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    // The windows were last read by the indirect dispatches of this slot's previous submission
+    RecordBufferBarrier(commandBuffer, current->windowBuffer, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    RecordPredictWindows(tracker, cmdbuf, frame);
+    RecordBufferBarrier(commandBuffer, current->windowBuffer, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    // The clear below must not overtake the prediction of the next slot still reading the results
+    RecordBufferBarrier(commandBuffer, current->resultBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    RecordClearResults(tracker, cmdbuf, frame);
+    RecordPredictedDispatches(tracker, cmdbuf, frame);
+    RecordResultsToHost(tracker, cmdbuf, frame);
+}
+
+static void PredictPass(CommandBuffer cmdbuf, void* userData)
+{
+    BlobTrackerFrame* frame = (BlobTrackerFrame*)userData;
+    if (frame->tracker->predictMargin > 0)
+        RecordPredictWindows(frame->tracker, cmdbuf, frame->index);
+}
+
+static void ClearPass(CommandBuffer cmdbuf, void* userData)
+{
+    BlobTrackerFrame* frame = (BlobTrackerFrame*)userData;
+    vkCmdFillBuffer(cmdbuf->cmdbuffer, frame->resultBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+}
+
+static void ReducePass(CommandBuffer cmdbuf, void* userData)
+{
+    BlobTrackerFrame* frame = (BlobTrackerFrame*)userData;
+    BlobTracker tracker = frame->tracker;
+    if (tracker->predictPipeline && tracker->predictMargin > 0)
+        RecordPredictedDispatches(tracker, cmdbuf, frame->index);
+    else
+    {
+        TrackingWindow window = { 0, 0, tracker->width, tracker->height };
+        RecordWindowDispatch(tracker, cmdbuf, frame->index, window, (1u << tracker->markerCount) - 1);
+    }
+}
+
+void SetBlobTrackerPrediction(BlobTracker tracker, uint32_t margin, uint32_t minimumSize)
+{
+    tracker->predictMargin = tracker->predictPipeline ? margin : 0;
+    tracker->predictMinimumSize = minimumSize;
+}
+
+bool AddBlobTrackersToFrameGraph(FrameGraph graph, uint32_t trackerCount, BlobTracker* trackers)
+{
+    if (graph == NULL || trackers == NULL || graph->framesInFlight != TRACKING_FRAMES_IN_FLIGHT)
+        return false;
+    // Added stage by stage rather than camera by camera, so each stage of all cameras forms one
+    // run of independent passes behind a single barrier
+    bool ok = true;
+    for (uint32_t frame = 0; frame < TRACKING_FRAMES_IN_FLIGHT; ++frame)
+    {
+        for (uint32_t i = 0; i < trackerCount; ++i)
+        {
+            BlobTracker tracker = trackers[i];
+            if (tracker->predictPipeline == NULL)
+                continue;
+            BlobTrackerFrame* previous = &tracker->frames[(frame + TRACKING_FRAMES_IN_FLIGHT - 1) % TRACKING_FRAMES_IN_FLIGHT];
+            FrameGraphBufferAccess accesses[] = {
+                { previous->resultBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT },
+                { tracker->frames[frame].windowBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT }
+            };
+            ok = FrameGraphAddFramePass(graph, "blob_predict", PredictPass, &tracker->frames[frame], frame, 2, accesses) && ok;
+        }
+        for (uint32_t i = 0; i < trackerCount; ++i)
+        {
+            FrameGraphBufferAccess accesses[] = {
+                { trackers[i]->frames[frame].resultBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT }
+            };
+            ok = FrameGraphAddFramePass(graph, "blob_clear", ClearPass, &trackers[i]->frames[frame], frame, 1, accesses) && ok;
+        }
+        for (uint32_t i = 0; i < trackerCount; ++i)
+        {
+            BlobTracker tracker = trackers[i];
+            BlobTrackerFrame* current = &tracker->frames[frame];
+            FrameGraphBufferAccess accesses[] = {
+                { current->frameBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT },
+                { current->resultBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+                { current->windowBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT }
+            };
+            ok = FrameGraphAddFramePass(graph, "blob_reduce", ReducePass, current, frame, tracker->predictPipeline ? 3 : 2, accesses) && ok;
+        }
+        for (uint32_t i = 0; i < trackerCount; ++i)
+        {
+            FrameGraphBufferAccess accesses[] = {
+                { trackers[i]->frames[frame].resultBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT }
+            };
+            ok = FrameGraphAddFramePass(graph, "blob_readback", NULL, NULL, frame, 1, accesses) && ok;
+        }
+    }
+    return ok;
+}
+
+TrackingWindow PredictTrackingWindow(uint32_t width, uint32_t height, const MarkerCentroid* previous, uint32_t margin, uint32_t minimumSize)
+{
+    TrackingWindow window = { 0, 0, width, height };
+    if (previous == NULL || !previous->found)
+        return window;
+    int64_t centerX = ((int64_t)previous->minX + previous->maxX + 1) / 2;
+    int64_t centerY = ((int64_t)previous->minY + previous->maxY + 1) / 2;
+    int64_t halfWidth = ((int64_t)previous->maxX + 1 - previous->minX) / 2 + margin;
+    int64_t halfHeight = ((int64_t)previous->maxY + 1 - previous->minY) / 2 + margin;
+    if (halfWidth < minimumSize / 2)
+        halfWidth = minimumSize / 2;
+    if (halfHeight < minimumSize / 2)
+        halfHeight = minimumSize / 2;
+    int64_t left = centerX - halfWidth < 0 ? 0 : centerX - halfWidth;
+    int64_t top = centerY - halfHeight < 0 ? 0 : centerY - halfHeight;
+    int64_t right = centerX + halfWidth > width ? width : centerX + halfWidth;
+    int64_t bottom = centerY + halfHeight > height ? height : centerY + halfHeight;
+    window.x = (uint32_t)left;
+    window.y = (uint32_t)top;
+    window.width = (uint32_t)(right - left);
+    window.height = (uint32_t)(bottom - top);
+    return window;
+}
+
+void ReadBlobTrackingResults(ComputeApplication app, BlobTracker tracker, uint32_t frame, MarkerCentroid* out)
+{
+    MarkerResultGPU results[MAX_TRACKING_MARKERS];
+    CopyBufferToData(app, tracker->frames[frame].resultBuffer, sizeof(results), results);
+    ConvertMarkerResults(results, tracker->markerCount, out);
+}
+
+void ConvertMarkerResults(const MarkerResultGPU* results, uint32_t markerCount, MarkerCentroid* out)
+{
+    for (uint32_t i = 0; i < markerCount; ++i)
+    {
+        const MarkerResultGPU* result = &results[i];
+        MarkerCentroid* centroid = &out[i];
+        memset(centroid, 0, sizeof(*centroid));
+        if (result->count == 0)
+            continue;
+        uint64_t sumX = ((uint64_t)result->sumXHigh << 32) | result->sumXLow;
+        uint64_t sumY = ((uint64_t)result->sumYHigh << 32) | result->sumYLow;
+        centroid->found = true;
+        centroid->pixelCount = result->count;
+        centroid->x = (float)((double)sumX / result->count);
+        centroid->y = (float)((double)sumY / result->count);
+        centroid->minX = ~result->invertedMinX;
+        centroid->minY = ~result->invertedMinY;
+        centroid->maxX = result->maxX;
+        centroid->maxY = result->maxY;
+    }
+}
+
+void DestroyBlobTracker(ComputeApplication app, BlobTracker tracker)
+{
+    if (app == NULL || tracker == NULL)
+        return;
+    DestroyPipeline(app, tracker->pipeline);
+    DestroyPipeline(app, tracker->predictPipeline);
+    if (tracker->shaderModule)
+        vkDestroyShaderModule(app->device, tracker->shaderModule, NULL);
+    if (tracker->predictShaderModule)
+        vkDestroyShaderModule(app->device, tracker->predictShaderModule, NULL);
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        BlobTrackerFrame* frame = &tracker->frames[i];
+        DescriptorSetForBuffers descriptors[2] = { frame->descriptors, frame->predictDescriptors };
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            if (descriptors[j] == NULL)
+                continue;
+            vkDestroyDescriptorSetLayout(app->device, descriptors[j]->layout, NULL);
+            free(descriptors[j]->buffers);
+            free(descriptors[j]);
+        }
+    }
+    if (tracker->descriptorPool)
+        vkDestroyDescriptorPool(app->device, tracker->descriptorPool, NULL);
+    for (uint32_t i = 0; i < TRACKING_FRAMES_IN_FLIGHT; ++i)
+    {
+        DestroyBuffer(app, tracker->frames[i].frameBuffer);
+        DestroyBuffer(app, tracker->frames[i].resultBuffer);
+        DestroyBuffer(app, tracker->frames[i].windowBuffer);
+    }
+    free(tracker);
+}
@@ -5,12 +5,61 @@
 #include <math.h>
 #include <assert.h>
 #include <string.h>
+#include <ctype.h>
 #include <vulkan/vulkan_core.h>
+#include "vulkanmanager.h"
+#include "gpuprofiler.h"
+
+static bool IsInstanceLayerAvailable(const char* layerName)
+{
+    uint32_t layerCount = 0;
+    if (vkEnumerateInstanceLayerProperties(&layerCount, NULL) != VK_SUCCESS || layerCount == 0)
+        return false;
+    VkLayerProperties layers[layerCount];
+    if (vkEnumerateInstanceLayerProperties(&layerCount, layers) != VK_SUCCESS)
+        return false;
+    for (uint32_t i = 0; i < layerCount; ++i)
+    {
+        if (strcmp(layers[i].layerName, layerName) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool IsInstanceExtensionAvailable(const char* extensionName)
+{
+    uint32_t extensionCount = 0;
+    if (vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, NULL) != VK_SUCCESS || extensionCount == 0)
+        return false;
+    VkExtensionProperties extensions[extensionCount];
+    if (vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, extensions) != VK_SUCCESS)
+        return false;
+    for (uint32_t i = 0; i < extensionCount; ++i)
+    {
+        if (strcmp(extensions[i].extensionName, extensionName) == 0)
+            return true;
+    }
+    return false;
+}
 
 void InitializeVulkanInstance(ComputeApplication this)
 {
-    const char* layers[] = { "VK_LAYER_KHRONOS_validation" };
-    const char* extensions[] = {"VK_EXT_debug_report", "VK_EXT_debug_utils"};
+    const char* requestedLayers[] = { "VK_LAYER_KHRONOS_validation" };
+    const char* requestedExtensions[] = {"VK_EXT_debug_report", "VK_EXT_debug_utils"};
+    // Build machines without the Vulkan SDK have no validation layer, only enable what exists
+    const char* layers[1];
+    const char* extensions[2];
+    uint32_t layerCount = 0, extensionCount = 0;
+    for (uint32_t i = 0; i < sizeof(requestedLayers) / sizeof(requestedLayers[0]); ++i)
+    {
+        if (IsInstanceLayerAvailable(requestedLayers[i]))
+            layers[layerCount++] = requestedLayers[i];
+    }
+    for (uint32_t i = 0; i < sizeof(requestedExtensions) / sizeof(requestedExtensions[0]); ++i)
+    {
+        if (IsInstanceExtensionAvailable(requestedExtensions[i]))
+            extensions[extensionCount++] = requestedExtensions[i];
+    }
     VkApplicationInfo applicationInfo = (VkApplicationInfo){
         .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
         .pApplicationName = "Example1",
@@ -23,19 +72,167 @@ void InitializeVulkanInstance(ComputeApplication this)
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
         .flags = 0,
         .pApplicationInfo = &applicationInfo,
-        .enabledLayerCount = 1,
+        .enabledLayerCount = layerCount,
         .ppEnabledLayerNames = layers,
-        .enabledExtensionCount = 2,
+        .enabledExtensionCount = extensionCount,
         .ppEnabledExtensionNames = extensions
     };
-    VK_CHECK_RESULT(vkCreateInstance(&createInfo, NULL, &this->instance));
+    // No loader or ICD is a normal condition on machines without a GPU driver, not a fatal one
+    VkResult result = vkCreateInstance(&createInfo, NULL, &this->instance);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create a Vulkan instance, VkResult %d\n", result);
+        this->instance = NULL;
+    }
+}
+
+static void FormatDeviceUUID(const uint8_t uuid[VK_UUID_SIZE], char out[2 * VK_UUID_SIZE + 1])
+{
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+        snprintf(out + 2 * i, 3, "%02x", uuid[i]);
+}
+
+// Compares a user supplied UUID against the device, dashes and letter case are ignored
+static bool MatchesDeviceUUID(const char* text, const uint8_t uuid[VK_UUID_SIZE])
+{
+    char expected[2 * VK_UUID_SIZE + 1];
+    FormatDeviceUUID(uuid, expected);
+    uint32_t matched = 0;
+    for (const char* c = text; *c; ++c)
+    {
+        if (*c == '-')
+            continue;
+        if (matched >= 2 * VK_UUID_SIZE || tolower((unsigned char)*c) != expected[matched])
+            return false;
+        ++matched;
+    }
+    return matched == 2 * VK_UUID_SIZE;
+}
+
+static bool ContainsIgnoringCase(const char* haystack, const char* needle)
+{
+    size_t needleLength = strlen(needle);
+    if (needleLength == 0)
+        return false;
+    for (; *haystack; ++haystack)
+    {
+        size_t i = 0;
+        while (i < needleLength && haystack[i] &&
+            tolower((unsigned char)haystack[i]) == tolower((unsigned char)needle[i]))
+            ++i;
+        if (i == needleLength)
+            return true;
+    }
+    return false;
+}
+
+static void QueryDeviceDetails(VkPhysicalDevice device, VkPhysicalDeviceProperties* properties, uint8_t deviceUUID[VK_UUID_SIZE], uint32_t* subgroupSize, bool* subgroupArithmetic)
+{
+    vkGetPhysicalDeviceProperties(device, properties);
+    memset(deviceUUID, 0, VK_UUID_SIZE);
+    *subgroupSize = 1;
+    *subgroupArithmetic = false;
+    if (properties->apiVersion < VK_API_VERSION_1_1)
+        return;
+
+    VkPhysicalDeviceSubgroupProperties subgroupProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+        .pNext = NULL
+    };
+    VkPhysicalDeviceIDProperties idProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+        .pNext = &subgroupProperties
+    };
+    VkPhysicalDeviceProperties2 properties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &idProperties
+    };
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+    memcpy(deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+    *subgroupSize = subgroupProperties.subgroupSize;
+    *subgroupArithmetic = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+        (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+}
+
+uint64_t ScorePhysicalDevice(VkPhysicalDevice device)
+{
+    uint32_t queueFamilyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies);
+
+    bool hasCompute = false, hasDedicatedCompute = false, hasDedicatedTransfer = false;
+    for (uint32_t i = 0; i < queueFamilyCount; ++i)
+    {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (queueFamilies[i].queueCount == 0)
+            continue;
+        if (flags & VK_QUEUE_COMPUTE_BIT)
+        {
+            hasCompute = true;
+            if (!(flags & VK_QUEUE_GRAPHICS_BIT))
+                hasDedicatedCompute = true;
+        }
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            hasDedicatedTransfer = true;
+    }
+    if (!hasCompute)
+        return 0;
+
+    VkPhysicalDeviceProperties properties;
+    uint8_t deviceUUID[VK_UUID_SIZE];
+    uint32_t subgroupSize;
+    bool subgroupArithmetic;
+    QueryDeviceDetails(device, &properties, deviceUUID, &subgroupSize, &subgroupArithmetic);
+
+    // Device type dominates, the remaining terms only break ties within a type
+    uint64_t score;
+    switch (properties.deviceType)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            score = 4000000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            score = 3000000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            score = 2000000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            score = 1000000;
+            break;
+        default:
+            score = 500000;
+            break;
+    }
+
+    if (subgroupArithmetic)
+        score += 100000;
+    score += subgroupSize > 128 ? 128 * 100 : subgroupSize * 100;
+    if (hasDedicatedCompute)
+        score += 5000;
+    if (hasDedicatedTransfer)
+        score += 2500;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+    VkDeviceSize deviceLocalBytes = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            deviceLocalBytes += memoryProperties.memoryHeaps[i].size;
+    }
+    VkDeviceSize deviceLocalMiB = deviceLocalBytes >> 20;
+    score += deviceLocalMiB > 65535 ? 65535 / 64 : deviceLocalMiB / 64;
+    return score;
 }
 
 void SelectPhysicalDevice(ComputeApplication this)
 {
-    uint32_t deviceCount;
-    VK_CHECK_RESULT(vkEnumeratePhysicalDevices(this->instance, &deviceCount, NULL));
-    if (deviceCount == 0)
+    uint32_t deviceCount = 0;
+    if (this->instance == NULL)
+        return;
+    if (vkEnumeratePhysicalDevices(this->instance, &deviceCount, NULL) != VK_SUCCESS || deviceCount == 0)
     {
         printf("could not find a device with vulkan support\n");
         return;
@@ -43,7 +240,64 @@ void SelectPhysicalDevice(ComputeApplication this)
 
     VkPhysicalDevice devices[deviceCount];
     VK_CHECK_RESULT(vkEnumeratePhysicalDevices(this->instance, &deviceCount, devices));
-    this->physicalDevice = devices[0];
+
+    const char* deviceOverride = this->deviceOverride;
+    if (deviceOverride == NULL || deviceOverride[0] == '\0')
+        deviceOverride = getenv("VRWEBTRACK_VULKAN_DEVICE");
+    bool forceCPUDevice = this->forceCPUDevice;
+    const char* cpuEnv = getenv("VRWEBTRACK_VULKAN_CPU");
+    if (cpuEnv && cpuEnv[0] != '\0' && strcmp(cpuEnv, "0") != 0)
+        forceCPUDevice = true;
+
+    VkPhysicalDevice selected = NULL;
+    uint64_t bestScore = 0;
+    for (uint32_t i = 0; i < deviceCount; ++i)
+    {
+        VkPhysicalDeviceProperties properties;
+        uint8_t deviceUUID[VK_UUID_SIZE];
+        uint32_t subgroupSize;
+        bool subgroupArithmetic;
+        QueryDeviceDetails(devices[i], &properties, deviceUUID, &subgroupSize, &subgroupArithmetic);
+        uint64_t score = ScorePhysicalDevice(devices[i]);
+        #ifdef DEBUG_MODE
+        char uuidText[2 * VK_UUID_SIZE + 1];
+        FormatDeviceUUID(deviceUUID, uuidText);
+        printf("Vulkan device #%u: %s (UUID %s) score %lu\n", i, properties.deviceName, uuidText, (unsigned long)score);
+        #endif
+        if (score == 0)
+            continue;
+        if (forceCPUDevice && properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU)
+            continue;
+        if (deviceOverride && deviceOverride[0] != '\0' &&
+            (MatchesDeviceUUID(deviceOverride, deviceUUID) || ContainsIgnoringCase(properties.deviceName, deviceOverride)))
+        {
+            selected = devices[i];
+            break;
+        }
+        if (score > bestScore)
+        {
+            bestScore = score;
+            selected = devices[i];
+        }
+    }
+
+    if (selected == NULL)
+    {
+        if (forceCPUDevice)
+            printf("could not find a CPU Vulkan implementation such as lavapipe\n");
+        else
+            printf("could not find a device with compute support\n");
+        return;
+    }
+
+    this->physicalDevice = selected;
+    uint8_t deviceUUID[VK_UUID_SIZE];
+    QueryDeviceDetails(selected, &this->physicalDeviceProperties, deviceUUID, &this->subgroupSize, &this->subgroupArithmeticSupported);
+    memcpy(this->deviceUUID, deviceUUID, VK_UUID_SIZE);
+    if (deviceOverride && deviceOverride[0] != '\0' &&
+        !MatchesDeviceUUID(deviceOverride, deviceUUID) && !ContainsIgnoringCase(this->physicalDeviceProperties.deviceName, deviceOverride))
+        printf("Vulkan device override \"%s\" did not match any device, using best scored device\n", deviceOverride);
+    printf("Using Vulkan device %s\n", this->physicalDeviceProperties.deviceName);
 }
 
 uint32_t getComputeQueueFamilyIndex(ComputeApplication this)
@@ -69,34 +323,115 @@ uint32_t getComputeQueueFamilyIndex(ComputeApplication this)
     if (i == queueFamilyCount)
     {
         printf("could not find a queue family that supports operations\n");
-        exit(1);
+        return INVALID_QUEUE_FAMILY_INDEX;
     }
 
     return i;
 }
 
+uint32_t getTransferQueueFamilyIndex(ComputeApplication this)
+{
+    uint32_t queueFamilyCount;
+
+    vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, NULL);
+
+    VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, queueFamilies);
+
+    // Dedicated transfer families are backed by the copy engines on discrete GPUs
+    for (uint32_t i = 0; i < queueFamilyCount; ++i)
+    {
+        VkQueueFamilyProperties props = queueFamilies[i];
+        if (props.queueCount > 0 && (props.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+            !(props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            return i;
+    }
+
+    // Any other family still lets uploads run beside compute work
+    for (uint32_t i = 0; i < queueFamilyCount; ++i)
+    {
+        VkQueueFamilyProperties props = queueFamilies[i];
+        if (i != this->queueFamilyIndex && props.queueCount > 0 &&
+            (props.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT)))
+            return i;
+    }
+
+    // Compute queues implicitly support transfer operations
+    return this->queueFamilyIndex;
+}
+
 void InitializeVulkanDevice(ComputeApplication this)
 {
+    if (this->physicalDevice == NULL)
+        return;
     this->queueFamilyIndex = getComputeQueueFamilyIndex(this);
+    if (this->queueFamilyIndex == INVALID_QUEUE_FAMILY_INDEX)
+        return;
+    this->transferQueueFamilyIndex = getTransferQueueFamilyIndex(this);
     float queuePriorities = 1.0;
-    VkDeviceQueueCreateInfo queueCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = this->queueFamilyIndex,
-        .queueCount = 1,
-        .pQueuePriorities = &queuePriorities
+    VkDeviceQueueCreateInfo queueCreateInfos[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = this->queueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriorities
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = this->transferQueueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriorities
+        }
     };
+    uint32_t queueCreateInfoCount = this->transferQueueFamilyIndex != this->queueFamilyIndex ? 2 : 1;
     VkPhysicalDeviceFeatures deviceFeatures = {0};
+
+    // Timeline semaphores are core in Vulkan 1.2, older devices fall back to pooled fences.
+    // Host query reset is core in 1.2 as well, without it uploads on a transfer only queue are
+    // not timed since that queue cannot reset queries.
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &deviceProperties);
+    VkPhysicalDeviceHostQueryResetFeatures hostQueryResetFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES,
+        .pNext = NULL,
+        .hostQueryReset = VK_FALSE
+    };
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .pNext = &hostQueryResetFeatures,
+        .timelineSemaphore = VK_FALSE
+    };
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+    {
+        VkPhysicalDeviceFeatures2 features2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &timelineFeatures
+        };
+        vkGetPhysicalDeviceFeatures2(this->physicalDevice, &features2);
+    }
+    this->timelineSemaphoreSupported = timelineFeatures.timelineSemaphore == VK_TRUE;
+    this->hostQueryResetSupported = hostQueryResetFeatures.hostQueryReset == VK_TRUE;
+
+    // Features the device lacks stay VK_FALSE in the chain and are not enabled
     VkDeviceCreateInfo deviceCreateInfo = (VkDeviceCreateInfo){
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = deviceProperties.apiVersion >= VK_API_VERSION_1_2 ? &timelineFeatures : NULL,
         .enabledLayerCount = 0,
         .ppEnabledLayerNames = NULL,
-        .pQueueCreateInfos = &queueCreateInfo,
-        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos = queueCreateInfos,
+        .queueCreateInfoCount = queueCreateInfoCount,
         .pEnabledFeatures = &deviceFeatures
     };
 
-    VK_CHECK_RESULT(vkCreateDevice(this->physicalDevice, &deviceCreateInfo, NULL, &this->device));
+    VkResult result = vkCreateDevice(this->physicalDevice, &deviceCreateInfo, NULL, &this->device);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create the Vulkan device, VkResult %d\n", result);
+        this->device = NULL;
+        return;
+    }
     vkGetDeviceQueue(this->device, this->queueFamilyIndex, 0, &this->queue);
+    vkGetDeviceQueue(this->device, this->transferQueueFamilyIndex, 0, &this->transferQueue);
 }
 
 uint32_t RetrieveMemoryType(ComputeApplication this, uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
@@ -115,18 +450,82 @@ uint32_t RetrieveMemoryType(ComputeApplication this, uint32_t memoryTypeBits, Vk
     return -1;
 }
 
+void InitializeSubmissionTracking(ComputeApplication this)
+{
+    if (this->timelineSemaphoreSupported)
+    {
+        VkSemaphoreTypeCreateInfo typeCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = NULL,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &typeCreateInfo,
+            .flags = 0
+        };
+        VK_CHECK_RESULT(vkCreateSemaphore(this->device, &semaphoreCreateInfo, NULL, &this->timelineSemaphore));
+        return;
+    }
+
+    // Fences start signaled so the first pass through the pool never waits
+    VkFenceCreateInfo fenceCreateInfo = (VkFenceCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        .pNext = NULL
+    };
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        VK_CHECK_RESULT(vkCreateFence(this->device, &fenceCreateInfo, NULL, &this->submitFences[i]));
+        this->submitFenceTickets[i] = 0;
+    }
+}
+
 void CleanUpVulkan(ComputeApplication this)
 {
+    vkDeviceWaitIdle(this->device);
+    SavePipelineCache(this);
+    DestroyPipelineCache(this);
+    if (this->timelineSemaphore)
+        vkDestroySemaphore(this->device, this->timelineSemaphore, NULL);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        if (this->submitFences[i])
+            vkDestroyFence(this->device, this->submitFences[i], NULL);
+    }
+    DestroyMemoryAllocator(this);
     vkDestroyDevice(this->device, NULL);
     vkDestroyInstance(this->instance, NULL);
 }
 
 ComputeApplication initializeComputeApplication()
+{
+    return initializeComputeApplicationWithInfo(NULL);
+}
+
+ComputeApplication initializeComputeApplicationWithInfo(const ComputeApplicationCreateInfo* info)
 {
     ComputeApplication this = (ComputeApplication)calloc(sizeof(struct ComputeApplication), 1);
+    if (info)
+    {
+        this->deviceOverride = info->deviceOverride;
+        this->forceCPUDevice = info->forceCPUDevice;
+    }
     InitializeVulkanInstance(this);
     SelectPhysicalDevice(this);
     InitializeVulkanDevice(this);
+    if (this->device == NULL)
+    {
+        // Callers fall back to the CPU compute backend instead of the worker exiting
+        if (this->instance)
+            vkDestroyInstance(this->instance, NULL);
+        free(this);
+        return NULL;
+    }
+    InitializeSubmissionTracking(this);
+    this->memoryAllocator = CreateMemoryAllocator(this, 0);
+    InitializePipelineCache(this, info ? info->pipelineCachePath : NULL);
     return this;
 }
 
@@ -142,7 +541,7 @@ VkDescriptorPool CreatePoolForDescriptors(ComputeApplication this, size_t numOfD
             ++uniformBufferCount;
         if (bufferInfos[i]->typeOfBuffer == ReadOnlyDynamicBufferType)
             ++dynamicUniformBufferCount;
-        if (bufferInfos[i]->typeOfBuffer == ReadAndWriteBufferType)
+        if (bufferInfos[i]->typeOfBuffer == ReadAndWriteBufferType || bufferInfos[i]->typeOfBuffer == DeviceLocalBufferType)
             ++storageBufferCount;
         if (bufferInfos[i]->typeOfBuffer == ReadAndWriteDynamicBufferType)
             ++dynamicStorageBufferCount;
@@ -198,7 +597,7 @@ DescriptorSetForBuffers CreateDescriptorsForBuffers(ComputeApplication this, VkD
             bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         else if (bufferInfos[i]->typeOfBuffer == ReadOnlyDynamicBufferType)
             bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        else if (bufferInfos[i]->typeOfBuffer == ReadAndWriteBufferType)
+        else if (bufferInfos[i]->typeOfBuffer == ReadAndWriteBufferType || bufferInfos[i]->typeOfBuffer == DeviceLocalBufferType)
             bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         else if (bufferInfos[i]->typeOfBuffer == ReadAndWriteDynamicBufferType)
             bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
@@ -252,28 +651,45 @@ DescriptorSetForBuffers CreateDescriptorsForBuffers(ComputeApplication this, VkD
     return output;
 }
 
-Buffer CreateBuffer(ComputeApplication this, const char* name, enum ComputeBufferType typeOfBuffer, size_t size, uint64_t binding)
+bool GetBufferUsageAndMemoryProperties(enum ComputeBufferType typeOfBuffer, VkBufferUsageFlags* usage, VkMemoryPropertyFlags* properties)
 {
-    if (size <= 0 || this == NULL)
-        return NULL;
-    enum VkBufferUsageFlagBits usageFlag = {0};
+    VkBufferUsageFlags usageFlag = 0;
+    VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     if (typeOfBuffer == ReadOnlyBufferType)
         usageFlag = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
     else if (typeOfBuffer == ReadOnlyDynamicBufferType)
         usageFlag = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
     else if (typeOfBuffer == ReadAndWriteBufferType)
-        usageFlag = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        usageFlag = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
     else if (typeOfBuffer == ReadAndWriteDynamicBufferType)
         usageFlag = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    else if (typeOfBuffer == DeviceLocalBufferType)
+    {
+        usageFlag = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+    else if (typeOfBuffer == StagingBufferType)
+        usageFlag = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
     else
-        return NULL; // Invalid buffer
+        return false; // Invalid buffer
+    *usage = usageFlag;
+    *properties = memoryProperties;
+    return true;
+}
+
+Buffer CreateBuffer(ComputeApplication this, const char* name, enum ComputeBufferType typeOfBuffer, size_t size, uint64_t binding)
+{
+    VkBufferUsageFlags usageFlag = 0;
+    VkMemoryPropertyFlags memoryProperties;
+    if (size <= 0 || this == NULL || !GetBufferUsageAndMemoryProperties(typeOfBuffer, &usageFlag, &memoryProperties))
+        return NULL;
     Buffer buffer = (Buffer)calloc(sizeof(struct Buffer), 1);
     buffer->name = name;
     buffer->typeOfBuffer = typeOfBuffer;
     buffer->size = size;
     buffer->binding = binding;
     
-    uint32_t queueIdx = getComputeQueueFamilyIndex(this);
+    uint32_t queueIdx = this->queueFamilyIndex;
     VkBufferCreateInfo bufferCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .pNext = NULL,
@@ -285,22 +701,32 @@ Buffer CreateBuffer(ComputeApplication this, const char* name, enum ComputeBuffe
         .size = size
     };
     VK_CHECK_RESULT(vkCreateBuffer(this->device, &bufferCreateInfo, NULL, &buffer->buffer));
-    
     VkMemoryRequirements memoryRequirements;
     vkGetBufferMemoryRequirements(this->device, buffer->buffer, &memoryRequirements);
-    VkMemoryAllocateInfo allocateInfo = (VkMemoryAllocateInfo){
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .pNext = NULL,
-        .memoryTypeIndex = RetrieveMemoryType(this, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-    };
-
-    VK_CHECK_RESULT(vkAllocateMemory(this->device, &allocateInfo, NULL, &buffer->memory));
-    VK_CHECK_RESULT(vkBindBufferMemory(this->device, buffer->buffer, buffer->memory, 0));
-    
+    if (!AllocateDeviceMemory(this, memoryRequirements, memoryProperties, &buffer->allocation))
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes of device memory for buffer %s\n", (unsigned long)memoryRequirements.size, name);
+        vkDestroyBuffer(this->device, buffer->buffer, NULL);
+        free(buffer);
+        return NULL;
+    }
+    MemoryBlock block = buffer->allocation.block;
+    buffer->memory = block->memory;
+    buffer->memoryOffset = buffer->allocation.offset;
+    buffer->mapped = block->mapped ? (uint8_t*)block->mapped + buffer->allocation.offset : NULL;
+    VK_CHECK_RESULT(vkBindBufferMemory(this->device, buffer->buffer, block->memory, buffer->allocation.offset));
     return buffer;
 }
 
+void DestroyBuffer(ComputeApplication this, Buffer buffer)
+{
+    if (this == NULL || buffer == NULL)
+        return;
+    vkDestroyBuffer(this->device, buffer->buffer, NULL);
+    FreeDeviceMemory(this, &buffer->allocation);
+    free(buffer);
+}
+
 VkShaderModule LoadShader(ComputeApplication this, void* shaderCode, size_t sharderCodeSize)
 {
     if (shaderCode == NULL || sharderCodeSize <= 0)
@@ -313,28 +739,78 @@ VkShaderModule LoadShader(ComputeApplication this, void* shaderCode, size_t shar
         .pNext = NULL
     };
     VkShaderModule shader = {0};
-    VK_CHECK_RESULT(vkCreateShaderModule(this->device, &shaderInfo, NULL, &shader));
+    VkResult result = vkCreateShaderModule(this->device, &shaderInfo, NULL, &shader);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create the shader module, VkResult %d\n", result);
+        return VK_NULL_HANDLE;
+    }
     return shader;
 }
 
 ComputePipeline CreatePipeline(ComputeApplication this, DescriptorSetForBuffers descSetForBuffs, VkShaderModule shaderModule, const char* mainShaderFunction)
 {
+    return CreatePipelineWithConstants(this, descSetForBuffs, shaderModule, mainShaderFunction, 0, NULL, 0);
+}
+
+ComputePipeline CreatePipelineWithConstants(ComputeApplication this, DescriptorSetForBuffers descSetForBuffs, VkShaderModule shaderModule, const char* mainShaderFunction,
+    uint32_t specializationCount, const SpecializationConstant* specializationConstants, uint32_t pushConstantSize)
+{
+    if (this == NULL || descSetForBuffs == NULL || shaderModule == NULL)
+        return NULL;
+    if (specializationCount > 0 && specializationConstants == NULL)
+        return NULL;
+    if (pushConstantSize % 4 != 0 || pushConstantSize > this->physicalDeviceProperties.limits.maxPushConstantsSize)
+    {
+        fprintf(stderr, "Push constant size %u must be a multiple of 4 and at most %u bytes\n",
+            pushConstantSize, this->physicalDeviceProperties.limits.maxPushConstantsSize);
+        return NULL;
+    }
     if (mainShaderFunction == NULL)
         mainShaderFunction = "main";
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = pushConstantSize
+    };
     VkPipelineLayoutCreateInfo pipelineCreate = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = NULL,
         .pSetLayouts = &descSetForBuffs->layout,
         .setLayoutCount = 1,
         .flags = 0,
-        .pPushConstantRanges = NULL,
-        .pushConstantRangeCount = 0,
+        .pPushConstantRanges = pushConstantSize > 0 ? &pushConstantRange : NULL,
+        .pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0,
         
     };
     ComputePipeline pipeline = (ComputePipeline)calloc(sizeof(struct ComputePipeline), 1);
     pipeline->descriptorSetLayout = descSetForBuffs->layout;
     pipeline->shaderModule = shaderModule;
-    VK_CHECK_RESULT(vkCreatePipelineLayout(this->device, &pipelineCreate, NULL, &pipeline->pipelineLayout));
+    pipeline->pushConstantSize = pushConstantSize;
+    VkResult result = vkCreatePipelineLayout(this->device, &pipelineCreate, NULL, &pipeline->pipelineLayout);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create the pipeline layout, VkResult %d\n", result);
+        free(pipeline);
+        return NULL;
+    }
+
+    // Every constant is a 32-bit scalar laid out back to back
+    VkSpecializationMapEntry mapEntries[specializationCount > 0 ? specializationCount : 1];
+    uint32_t specializationData[specializationCount > 0 ? specializationCount : 1];
+    for (uint32_t i = 0; i < specializationCount; ++i)
+    {
+        mapEntries[i].constantID = specializationConstants[i].constantID;
+        mapEntries[i].offset = i * sizeof(uint32_t);
+        mapEntries[i].size = sizeof(uint32_t);
+        specializationData[i] = specializationConstants[i].value;
+    }
+    VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = specializationCount,
+        .pMapEntries = mapEntries,
+        .dataSize = specializationCount * sizeof(uint32_t),
+        .pData = specializationData
+    };
     VkPipelineShaderStageCreateInfo shaderStage = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
         .stage = VK_SHADER_STAGE_COMPUTE_BIT,
@@ -342,25 +818,58 @@ ComputePipeline CreatePipeline(ComputeApplication this, DescriptorSetForBuffers
         .pName = mainShaderFunction,
         .flags = 0,
         .pNext = NULL,
-        .pSpecializationInfo = NULL
+        .pSpecializationInfo = specializationCount > 0 ? &specializationInfo : NULL
     };
     VkComputePipelineCreateInfo computeCreate = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
         .stage = shaderStage,
         .layout = pipeline->pipelineLayout
     };
-    VK_CHECK_RESULT(vkCreateComputePipelines(this->device, VK_NULL_HANDLE, 1, &computeCreate, NULL, &pipeline->computePipeline));
+    // A hot reloaded shader may be rejected, which must not take the worker down
+    result = vkCreateComputePipelines(this->device, this->pipelineCache, 1, &computeCreate, NULL, &pipeline->computePipeline);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create the compute pipeline, VkResult %d\n", result);
+        vkDestroyPipelineLayout(this->device, pipeline->pipelineLayout, NULL);
+        free(pipeline);
+        return NULL;
+    }
     return pipeline;
 }
 
+void DestroyPipeline(ComputeApplication this, ComputePipeline pipeline)
+{
+    if (this == NULL || pipeline == NULL)
+        return;
+    vkDestroyPipeline(this->device, pipeline->computePipeline, NULL);
+    vkDestroyPipelineLayout(this->device, pipeline->pipelineLayout, NULL);
+    free(pipeline);
+}
+
+uint32_t RecommendedWorkgroupSize(ComputeApplication this)
+{
+    // A few subgroups per workgroup keeps shared memory reductions short while hiding latency
+    uint32_t size = this->subgroupSize > 0 ? this->subgroupSize : 32;
+    while (size < 128)
+        size *= 2;
+    uint32_t maxInvocations = this->physicalDeviceProperties.limits.maxComputeWorkGroupInvocations;
+    if (maxInvocations > 0)
+    {
+        while (size > maxInvocations && size > 1)
+            size /= 2;
+    }
+    return size;
+}
+
 CommandBuffer CreateCommandBuffer(ComputeApplication this)
 {
     CommandBuffer cmdbuf = (CommandBuffer)calloc(sizeof(struct CommandBuffer), 1);
     VkCommandPoolCreateInfo commandPoolCreateInfo = (VkCommandPoolCreateInfo){
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = 0,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
         .queueFamilyIndex = this->queueFamilyIndex
     };
+    cmdbuf->device = this->device;
     VK_CHECK_RESULT(vkCreateCommandPool(this->device, &commandPoolCreateInfo, NULL, &cmdbuf->pool));
     
     VkCommandBufferAllocateInfo allocInfo = {
@@ -390,45 +899,443 @@ void EndCommand(CommandBuffer cmdbuf)
     VK_CHECK_RESULT(vkEndCommandBuffer(cmdbuf->cmdbuffer));
 }
 
+void ResetCommand(CommandBuffer cmdbuf)
+{
+    // The pool owns this single command buffer, resetting the pool recycles its memory in one go
+    VK_CHECK_RESULT(vkResetCommandPool(cmdbuf->device, cmdbuf->pool, 0));
+}
+
+void DestroyCommandBuffer(ComputeApplication this, CommandBuffer cmdbuf)
+{
+    if (this == NULL || cmdbuf == NULL)
+        return;
+    vkDestroyCommandPool(this->device, cmdbuf->pool, NULL);
+    free(cmdbuf);
+}
+
 void AddDispatchComputeShaderToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, uint64_t workgroupSize, DescriptorSetForBuffers descSetForBuffs)
 {
+    AddDispatch3DComputeShaderToCommandBufferQueue(cmdbuf, pipeline, workgroupSize, 1, 1, descSetForBuffs);
+}
+
+void AddDispatch3DComputeShaderToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, DescriptorSetForBuffers descSetForBuffs)
+{
+    if (groupCountX == 0 || groupCountY == 0 || groupCountZ == 0)
+        return;
+    vkCmdBindPipeline(cmdbuf->cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->computePipeline);
+    vkCmdBindDescriptorSets(cmdbuf->cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipelineLayout, 0, 1, &descSetForBuffs->descriptorSet, 0, NULL);
+    vkCmdDispatch(cmdbuf->cmdbuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+void AddDispatchIndirectComputeShaderToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, Buffer argumentBuffer, size_t argumentOffset, DescriptorSetForBuffers descSetForBuffs)
+{
+    if (argumentOffset % 4 != 0 || argumentOffset + sizeof(VkDispatchIndirectCommand) > argumentBuffer->size)
+    {
+        fprintf(stderr, "Indirect dispatch arguments at offset %zu do not fit in buffer %s\n", argumentOffset, argumentBuffer->name);
+        return;
+    }
     vkCmdBindPipeline(cmdbuf->cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->computePipeline);
     vkCmdBindDescriptorSets(cmdbuf->cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipelineLayout, 0, 1, &descSetForBuffs->descriptorSet, 0, NULL);
-    vkCmdDispatch(cmdbuf->cmdbuffer, workgroupSize, 1, 1);
+    vkCmdDispatchIndirect(cmdbuf->cmdbuffer, argumentBuffer->buffer, argumentOffset);
+}
+
+void AddCopyBufferToCommandBufferQueue(CommandBuffer cmdbuf, Buffer src, Buffer dst, size_t size)
+{
+    VkBufferCopy region = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = size
+    };
+    vkCmdCopyBuffer(cmdbuf->cmdbuffer, src->buffer, dst->buffer, 1, &region);
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = dst->buffer,
+        .offset = 0,
+        .size = size
+    };
+    vkCmdPipelineBarrier(cmdbuf->cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+void AddPushConstantsToCommandBufferQueue(CommandBuffer cmdbuf, ComputePipeline pipeline, uint32_t offset, uint32_t size, const void* data)
+{
+    if (offset + size > pipeline->pushConstantSize)
+    {
+        fprintf(stderr, "Push constant range %u..%u exceeds the %u bytes declared by the pipeline\n",
+            offset, offset + size, pipeline->pushConstantSize);
+        return;
+    }
+    vkCmdPushConstants(cmdbuf->cmdbuffer, pipeline->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, offset, size, data);
 }
 
 void CopyDataToBuffer(ComputeApplication this, Buffer dst, size_t dataLen, void* src)
 {
-    void *mappedMemory = NULL;
-    VK_CHECK_RESULT(vkMapMemory(this->device, dst->memory, 0, VK_WHOLE_SIZE, 0, &mappedMemory));
-    memcpy(mappedMemory, src, dataLen);
-    vkUnmapMemory(this->device, dst->memory);
+    // Device local memory is only mapped on unified memory devices where it is also host visible
+    if (dst->mapped == NULL)
+    {
+        fprintf(stderr, "Device local buffer %s cannot be mapped, upload through a staging ring instead\n", dst->name);
+        return;
+    }
+    memcpy(dst->mapped, src, dataLen);
 }
 
 void CopyBufferToData(ComputeApplication this, Buffer src, size_t dataLen, void* dst)
 {
-    void *mappedMemory = NULL;
-    VK_CHECK_RESULT(vkMapMemory(this->device, src->memory, 0, VK_WHOLE_SIZE, 0, &mappedMemory));
-    memcpy(dst, mappedMemory, dataLen);
-    vkUnmapMemory(this->device, src->memory);
+    if (src->mapped == NULL)
+    {
+        fprintf(stderr, "Device local buffer %s cannot be mapped, copy it into a host visible buffer first\n", src->name);
+        return;
+    }
+    memcpy(dst, src->mapped, dataLen);
 }
 
 void ExecuteCommandBufferSync(ComputeApplication this, CommandBuffer cmdbuf)
 {
-    VkFence fence;
-    VkFenceCreateInfo fenceCreateInfo = (VkFenceCreateInfo){
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = 0,
-        .pNext = NULL
-    };
+    ComputeTicket ticket = SubmitCommandBufferAsync(this, cmdbuf);
+    if (!WaitForComputeTicket(this, ticket, 100000000000))
+        fprintf(stderr, "Timed out waiting for compute submission %lu\n", (unsigned long)ticket);
+}
+
+ComputeTicket SubmitCommandBufferAsync(ComputeApplication this, CommandBuffer cmdbuf)
+{
+    ComputeTicket ticket = this->lastSubmittedTicket + 1;
+
+    // Acquire command buffers of pending uploads run ahead of the caller's work
+    VkCommandBuffer commandBuffers[MAX_PENDING_UPLOADS + 1];
+    VkSemaphore waitSemaphores[MAX_PENDING_UPLOADS];
+    VkPipelineStageFlags waitStages[MAX_PENDING_UPLOADS];
+    uint32_t commandBufferCount = 0, waitSemaphoreCount = 0;
+    bool crossFamily = this->transferQueueFamilyIndex != this->queueFamilyIndex;
+    for (uint32_t i = 0; i < this->pendingUploadCount; ++i)
+    {
+        commandBuffers[commandBufferCount++] = this->pendingUploads[i]->acquireCommandBuffer;
+        if (crossFamily)
+        {
+            waitSemaphores[waitSemaphoreCount] = this->pendingUploads[i]->uploadSemaphore;
+            waitStages[waitSemaphoreCount++] = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+    }
+    commandBuffers[commandBufferCount++] = cmdbuf->cmdbuffer;
+
     VkSubmitInfo cmdSubmitInfo = (VkSubmitInfo){
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuf->cmdbuffer
+        .waitSemaphoreCount = waitSemaphoreCount,
+        .pWaitSemaphores = waitSemaphores,
+        .pWaitDstStageMask = waitStages,
+        .commandBufferCount = commandBufferCount,
+        .pCommandBuffers = commandBuffers
     };
-    
-    VK_CHECK_RESULT(vkCreateFence(this->device, &fenceCreateInfo, NULL, &fence));
-    VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &cmdSubmitInfo, fence));
-    VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
-    vkDestroyFence(this->device, fence, NULL);
+
+    if (this->timelineSemaphoreSupported)
+    {
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreValueCount = 0,
+            .pWaitSemaphoreValues = NULL,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &ticket
+        };
+        cmdSubmitInfo.pNext = &timelineSubmitInfo;
+        cmdSubmitInfo.signalSemaphoreCount = 1;
+        cmdSubmitInfo.pSignalSemaphores = &this->timelineSemaphore;
+        VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &cmdSubmitInfo, VK_NULL_HANDLE));
+    }
+    else
+    {
+        // Reusing a fence means the submission it tracked has to finish first
+        uint32_t fenceIndex = ticket % MAX_FRAMES_IN_FLIGHT;
+        WaitForComputeTicket(this, this->submitFenceTickets[fenceIndex], UINT64_MAX);
+        VK_CHECK_RESULT(vkResetFences(this->device, 1, &this->submitFences[fenceIndex]));
+        this->submitFenceTickets[fenceIndex] = ticket;
+        VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &cmdSubmitInfo, this->submitFences[fenceIndex]));
+    }
+    this->lastSubmittedTicket = ticket;
+
+    for (uint32_t i = 0; i < this->pendingUploadCount; ++i)
+    {
+        this->pendingUploads[i]->inFlight = false;
+        this->pendingUploads[i]->consumerTicket = ticket;
+    }
+    this->pendingUploadCount = 0;
+    return ticket;
+}
+
+bool IsComputeTicketComplete(ComputeApplication this, ComputeTicket ticket)
+{
+    if (ticket <= this->lastCompletedTicket)
+        return true;
+    // Nothing signals a ticket that was never submitted
+    if (ticket > this->lastSubmittedTicket)
+        return false;
+    if (this->timelineSemaphoreSupported)
+    {
+        uint64_t value = 0;
+        VK_CHECK_RESULT(vkGetSemaphoreCounterValue(this->device, this->timelineSemaphore, &value));
+        if (value > this->lastCompletedTicket)
+            this->lastCompletedTicket = value;
+        return ticket <= this->lastCompletedTicket;
+    }
+
+    // A fence recycled for a newer ticket was waited on before reuse
+    uint32_t fenceIndex = ticket % MAX_FRAMES_IN_FLIGHT;
+    if (this->submitFenceTickets[fenceIndex] != ticket)
+        return true;
+    if (vkGetFenceStatus(this->device, this->submitFences[fenceIndex]) != VK_SUCCESS)
+        return false;
+    // Fence signals cover all earlier submissions on the queue
+    this->lastCompletedTicket = ticket;
+    return true;
+}
+
+bool WaitForComputeTicket(ComputeApplication this, ComputeTicket ticket, uint64_t timeoutNanoseconds)
+{
+    if (IsComputeTicketComplete(this, ticket))
+        return true;
+    // Waiting on an unsubmitted ticket would never finish
+    if (ticket > this->lastSubmittedTicket)
+        return false;
+    VkResult result;
+    if (this->timelineSemaphoreSupported)
+    {
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .semaphoreCount = 1,
+            .pSemaphores = &this->timelineSemaphore,
+            .pValues = &ticket
+        };
+        result = vkWaitSemaphores(this->device, &waitInfo, timeoutNanoseconds);
+    }
+    else
+    {
+        uint32_t fenceIndex = ticket % MAX_FRAMES_IN_FLIGHT;
+        result = vkWaitForFences(this->device, 1, &this->submitFences[fenceIndex], VK_TRUE, timeoutNanoseconds);
+    }
+    if (result != VK_SUCCESS)
+        return false;
+    if (ticket > this->lastCompletedTicket)
+        this->lastCompletedTicket = ticket;
+    return true;
+}
+
+StagingRing CreateStagingRing(ComputeApplication this, size_t slotSize, uint32_t slotCount)
+{
+    if (this == NULL || slotSize <= 0 || slotCount <= 0)
+        return NULL;
+    StagingRing ring = (StagingRing)calloc(sizeof(struct StagingRing), 1);
+    if (ring == NULL)
+        return NULL;
+    ring->slotSize = slotSize;
+    ring->slotCount = slotCount;
+    ring->stagingBuffer = CreateBuffer(this, "StagingRing", StagingBufferType, slotSize * slotCount, 0);
+    if (ring->stagingBuffer == NULL)
+    {
+        fprintf(stderr, "Failed to create a staging ring of %u slots of %lu bytes\n", slotCount, (unsigned long)slotSize);
+        free(ring);
+        return NULL;
+    }
+    // Staging memory stays mapped for the lifetime of the ring
+    ring->mappedMemory = ring->stagingBuffer->mapped;
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = (VkCommandPoolCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = this->queueFamilyIndex
+    };
+    VK_CHECK_RESULT(vkCreateCommandPool(this->device, &commandPoolCreateInfo, NULL, &ring->acquirePool));
+    commandPoolCreateInfo.queueFamilyIndex = this->transferQueueFamilyIndex;
+    VK_CHECK_RESULT(vkCreateCommandPool(this->device, &commandPoolCreateInfo, NULL, &ring->transferPool));
+
+    ring->slots = (struct StagingRingSlot*)calloc(sizeof(struct StagingRingSlot), slotCount);
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    for (uint32_t i = 0; i < slotCount; ++i)
+    {
+        StagingRingSlot slot = &ring->slots[i];
+        slot->offset = (VkDeviceSize)slotSize * i;
+        VkCommandBufferAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = ring->acquirePool,
+            .pNext = NULL,
+            .commandBufferCount = 1,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
+        };
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &allocInfo, &slot->acquireCommandBuffer));
+        allocInfo.commandPool = ring->transferPool;
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &allocInfo, &slot->transferCommandBuffer));
+        VK_CHECK_RESULT(vkCreateSemaphore(this->device, &semaphoreCreateInfo, NULL, &slot->uploadSemaphore));
+    }
+    return ring;
+}
+
+bool StagingRingUpload(ComputeApplication this, StagingRing ring, Buffer dst, size_t dstOffset, size_t dataLen, const void* src)
+{
+    if (this == NULL || ring == NULL || dst == NULL || src == NULL || dataLen <= 0)
+        return false;
+    if (dataLen > ring->slotSize)
+    {
+        fprintf(stderr, "Upload of %zu bytes exceeds staging slot size of %zu bytes\n", dataLen, (size_t)ring->slotSize);
+        return false;
+    }
+    StagingRingSlot slot = &ring->slots[ring->nextSlot];
+    if (slot->inFlight || this->pendingUploadCount >= MAX_PENDING_UPLOADS ||
+        !IsComputeTicketComplete(this, slot->consumerTicket))
+    {
+        fprintf(stderr, "Staging ring is exhausted, submit or wait for pending compute work before uploading more\n");
+        return false;
+    }
+    ring->nextSlot = (ring->nextSlot + 1) % ring->slotCount;
+    uint32_t slotIndex = (uint32_t)(slot - ring->slots);
+    if (slot->timed)
+    {
+        // The consumer completed, so the copy that preceded it has written both timestamps
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(this->device, ring->timestampPool, slotIndex * 2, 2, sizeof(timestamps), timestamps,
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        {
+            uint64_t mask = slot->timedOnTransferQueue ? ring->profiler->transferTimestampMask : ring->profiler->timestampMask;
+            GpuProfilerAddSample(ring->profiler, ring->profilerStage, GpuProfilerTicksToNanoseconds(ring->profiler, timestamps[0], timestamps[1], mask));
+        }
+        slot->timed = false;
+    }
+
+    // Memory is host coherent so no flush is needed before the copy
+    memcpy((uint8_t*)ring->mappedMemory + slot->offset, src, dataLen);
+
+    VkCommandBufferBeginInfo beginInfo = (VkCommandBufferBeginInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pNext = NULL,
+        .pInheritanceInfo = NULL
+    };
+    VkBufferCopy region = {
+        .srcOffset = slot->offset,
+        .dstOffset = dstOffset,
+        .size = dataLen
+    };
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = dst->buffer,
+        .offset = dstOffset,
+        .size = dataLen
+    };
+    VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    if (this->transferQueueFamilyIndex != this->queueFamilyIndex)
+    {
+        // Release ownership on the transfer queue, the access masks of a release are ignored on the destination side
+        barrier.srcQueueFamilyIndex = this->transferQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = this->queueFamilyIndex;
+        VkBufferMemoryBarrier release = barrier;
+        release.dstAccessMask = 0;
+        // A transfer only queue cannot record query resets, the slot's queries are idle since
+        // its consumer completed so they are reset from the host instead
+        bool timed = ring->timestampPool && ring->profiler->transferTimestampMask != 0 && this->hostQueryResetSupported;
+        if (timed)
+            vkResetQueryPool(this->device, ring->timestampPool, slotIndex * 2, 2);
+        VK_CHECK_RESULT(vkBeginCommandBuffer(slot->transferCommandBuffer, &beginInfo));
+        if (timed)
+            vkCmdWriteTimestamp(slot->transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ring->timestampPool, slotIndex * 2);
+        vkCmdCopyBuffer(slot->transferCommandBuffer, ring->stagingBuffer->buffer, dst->buffer, 1, &region);
+        if (timed)
+            vkCmdWriteTimestamp(slot->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, ring->timestampPool, slotIndex * 2 + 1);
+        slot->timed = timed;
+        slot->timedOnTransferQueue = true;
+        vkCmdPipelineBarrier(slot->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, NULL, 1, &release, 0, NULL);
+        VK_CHECK_RESULT(vkEndCommandBuffer(slot->transferCommandBuffer));
+
+        VkSubmitInfo submitInfo = (VkSubmitInfo){
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &slot->transferCommandBuffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &slot->uploadSemaphore
+        };
+        VK_CHECK_RESULT(vkQueueSubmit(this->transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+        // Matching acquire, chained to the semaphore wait stage of the compute submission
+        VkBufferMemoryBarrier acquire = barrier;
+        acquire.srcAccessMask = 0;
+        VK_CHECK_RESULT(vkBeginCommandBuffer(slot->acquireCommandBuffer, &beginInfo));
+        vkCmdPipelineBarrier(slot->acquireCommandBuffer, consumerStages, consumerStages,
+            0, 0, NULL, 1, &acquire, 0, NULL);
+        VK_CHECK_RESULT(vkEndCommandBuffer(slot->acquireCommandBuffer));
+    }
+    else
+    {
+        bool timed = ring->timestampPool != VK_NULL_HANDLE;
+        VK_CHECK_RESULT(vkBeginCommandBuffer(slot->acquireCommandBuffer, &beginInfo));
+        // Earlier submissions may still be reading the previous contents, e.g. the calibration histogram
+        vkCmdPipelineBarrier(slot->acquireCommandBuffer, consumerStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+        if (timed)
+        {
+            vkCmdResetQueryPool(slot->acquireCommandBuffer, ring->timestampPool, slotIndex * 2, 2);
+            vkCmdWriteTimestamp(slot->acquireCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ring->timestampPool, slotIndex * 2);
+        }
+        vkCmdCopyBuffer(slot->acquireCommandBuffer, ring->stagingBuffer->buffer, dst->buffer, 1, &region);
+        if (timed)
+            vkCmdWriteTimestamp(slot->acquireCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, ring->timestampPool, slotIndex * 2 + 1);
+        slot->timed = timed;
+        slot->timedOnTransferQueue = false;
+        vkCmdPipelineBarrier(slot->acquireCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, consumerStages,
+            0, 0, NULL, 1, &barrier, 0, NULL);
+        VK_CHECK_RESULT(vkEndCommandBuffer(slot->acquireCommandBuffer));
+    }
+
+    slot->inFlight = true;
+    this->pendingUploads[this->pendingUploadCount++] = slot;
+    return true;
+}
+
+void StagingRingSetProfiler(ComputeApplication this, StagingRing ring, GpuProfiler profiler)
+{
+    if (this == NULL || ring == NULL || profiler == NULL || !profiler->supported || ring->timestampPool)
+        return;
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = ring->slotCount * 2,
+        .pipelineStatistics = 0
+    };
+    if (vkCreateQueryPool(this->device, &queryPoolCreateInfo, NULL, &ring->timestampPool) != VK_SUCCESS)
+    {
+        ring->timestampPool = VK_NULL_HANDLE;
+        return;
+    }
+    ring->profiler = profiler;
+    ring->profilerStage = GpuProfilerStage(profiler, "upload");
+}
+
+void DestroyStagingRing(ComputeApplication this, StagingRing ring)
+{
+    if (this == NULL || ring == NULL)
+        return;
+    for (uint32_t i = 0; i < ring->slotCount; ++i)
+        vkDestroySemaphore(this->device, ring->slots[i].uploadSemaphore, NULL);
+    vkDestroyCommandPool(this->device, ring->transferPool, NULL);
+    vkDestroyCommandPool(this->device, ring->acquirePool, NULL);
+    if (ring->timestampPool)
+        vkDestroyQueryPool(this->device, ring->timestampPool, NULL);
+    DestroyBuffer(this, ring->stagingBuffer);
+    free(ring->slots);
+    free(ring);
 }
@@ -1,5 +1,189 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+#include <time.h>
 #include "camera.h"
 
+#define TEST_FAKE_DRIVER "vrwebtrack-fake"
+#define TEST_FAKE_BUFFER_SIZE 614400
+#define TEST_PROBE_TIMEOUT_MS 500
+#define TEST_SLOW_PROBE_MS 100
+
+// Probes that got as far as requesting buffers, cached devices never do
+static atomic_int test_fake_probes;
+
+// Temporary file, so the tests never collide with each other or with a previous run
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int make_temp_path(char* path, size_t size)
+{
+    const char* directory = getenv("TMPDIR");
+    snprintf(path, size, "%s/vrwebtrack-test-XXXXXX", directory && directory[0] != '\0' ? directory : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief Creates a directory for fake video nodes and points the camera library at it.
+ */
+static int make_fake_device_directory(char* path, size_t size)
+{
+    const char* directory = getenv("TMPDIR");
+    snprintf(path, size, "%s/vrwebtrack-test-XXXXXX", directory && directory[0] != '\0' ? directory : "/tmp");
+    if (mkdtemp(path) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv(CAMERA_DEVICE_DIRECTORY_ENVIRONMENT_VARIABLE, path, 1);
+    return 0;
+}
+
+/**
+ * @brief Adds a fake video node, a regular file holding the bus it reports and how long listing
+ * its formats takes. Renamed into place so it appears in a single inotify event.
+ */
+static int add_fake_device(const char* directory, const char* name, const char* bus, uint32_t delay_ms)
+{
+    char temporary[512];
+    char path[512];
+    snprintf(temporary, sizeof(temporary), "%s/.%s", directory, name);
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE* file = fopen(temporary, "w");
+    if (file == NULL)
+        return 1;
+    fprintf(file, "%s %u\n", bus, delay_ms);
+    fclose(file);
+    return rename(temporary, path);
+}
+
+static int move_fake_device(const char* directory, const char* from, const char* to)
+{
+    char from_path[512];
+    char to_path[512];
+    snprintf(from_path, sizeof(from_path), "%s/%s", directory, from);
+    snprintf(to_path, sizeof(to_path), "%s/%s", directory, to);
+    return rename(from_path, to_path);
+}
+
+static void remove_fake_device(const char* directory, const char* name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    unlink(path);
+}
+
+static void remove_fake_device_directory(const char* directory, const char* const* names, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        remove_fake_device(directory, names[i]);
+    rmdir(directory);
+    unsetenv(CAMERA_DEVICE_DIRECTORY_ENVIRONMENT_VARIABLE);
+}
+
+static int fake_ioctl(int fd, unsigned long request, void* argument)
+{
+    switch (request)
+    {
+    case VIDIOC_QUERYCAP:
+    {
+        char content[128] = { 0 };
+        char bus[32] = { 0 };
+        if (pread(fd, content, sizeof(content) - 1, 0) <= 0 || sscanf(content, "%31s", bus) != 1)
+            break;
+        struct v4l2_capability* cap = (struct v4l2_capability*)argument;
+        memset(cap, 0, sizeof(*cap));
+        snprintf((char*)cap->driver, sizeof(cap->driver), TEST_FAKE_DRIVER);
+        snprintf((char*)cap->card, sizeof(cap->card), "Fake Camera");
+        snprintf((char*)cap->bus_info, sizeof(cap->bus_info), "%s", bus);
+        cap->version = 0x060100;
+        cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+        cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+        return 0;
+    }
+    case VIDIOC_REQBUFS:
+    {
+        struct v4l2_requestbuffers* req = (struct v4l2_requestbuffers*)argument;
+        if (req->count)
+        {
+            atomic_fetch_add(&test_fake_probes, 1);
+            req->count = 2;
+        }
+        return 0;
+    }
+    case VIDIOC_QUERYBUF:
+        ((struct v4l2_buffer*)argument)->length = TEST_FAKE_BUFFER_SIZE;
+        return 0;
+    case VIDIOC_ENUM_FMT:
+    {
+        struct v4l2_fmtdesc* format = (struct v4l2_fmtdesc*)argument;
+        if (format->index != 0)
+            break;
+        char content[128] = { 0 };
+        unsigned delay_ms = 0;
+        // A driver stuck in an ioctl, e.g. a half enumerated USB device that still answers VIDIOC_QUERYCAP
+        if (pread(fd, content, sizeof(content) - 1, 0) > 0 && sscanf(content, "%*s %u", &delay_ms) == 1 && delay_ms)
+            usleep(delay_ms * 1000);
+        format->pixelformat = V4L2_PIX_FMT_YUYV;
+        return 0;
+    }
+    case VIDIOC_ENUM_FRAMESIZES:
+    {
+        struct v4l2_frmsizeenum* size = (struct v4l2_frmsizeenum*)argument;
+        if (size->index != 0)
+            break;
+        size->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+        size->discrete.width = 640;
+        size->discrete.height = 480;
+        return 0;
+    }
+    case VIDIOC_ENUM_FRAMEINTERVALS:
+    {
+        struct v4l2_frmivalenum* interval = (struct v4l2_frmivalenum*)argument;
+        if (interval->index != 0)
+            break;
+        interval->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+        interval->discrete = (struct v4l2_fract){ 1, 60 };
+        return 0;
+    }
+    case VIDIOC_G_PARM:
+        ((struct v4l2_streamparm*)argument)->parm.capture.timeperframe = (struct v4l2_fract){ 1, 60 };
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+// The test executable links with -Wl,--wrap=ioctl, fake nodes are regular files and get answered
+// here, real devices still reach the driver
+int __real_ioctl(int fd, unsigned long request, ...);
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    va_list arguments;
+    va_start(arguments, request);
+    void* argument = va_arg(arguments, void*);
+    va_end(arguments);
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+        return fake_ioctl(fd, request, argument);
+    return __real_ioctl(fd, request, argument);
+}
+
 int test_list_all_camera_devices()
 {
     int ret = 0;
@@ -15,6 +199,429 @@ int test_list_all_camera_devices()
     return ret;
 }
 
+static camera_desc* make_test_camera(const char* serial, uint32_t format_count)
+{
+    camera_desc* camera = (camera_desc*)calloc(1, sizeof(camera_desc));
+    camera->device_id.card = strdup("Test Camera");
+    camera->device_id.device_name = strdup("Test Camera");
+    camera->device_id.driver_info = strdup("uvcvideo");
+    camera->device_id.version = strdup("6.1.0");
+    camera->device_id.bus = strdup("usb-0000:00:14.0-1");
+    camera->device_id.serial_number = serial ? strdup(serial) : NULL;
+    camera->device_id.devPath = strdup("video0");
+    camera->device_id.capabilities = 0x84200001;
+    camera->capabilities.can_capture = true;
+    camera->capabilities.supports_streaming = true;
+    camera->controls.brightness = -12;
+    camera->controls.gain = 100;
+    camera->io_method = camera_io_method_MMAP;
+    camera->formats_count = format_count;
+    camera->formats = (camera_format*)calloc(format_count, sizeof(camera_format));
+    for (uint32_t i = 0; i < format_count; ++i)
+    {
+        camera->formats[i].pixel_format = i ? camera_pixel_format_YUYV : camera_pixel_format_H264;
+        camera->formats[i].width = 640 * (i + 1);
+        camera->formats[i].height = 480 * (i + 1);
+        camera->formats[i].fps_count = i + 1;
+        camera->formats[i].fps = (frame_rate_fraction*)calloc(i + 1, sizeof(frame_rate_fraction));
+        for (uint32_t j = 0; j <= i; ++j)
+            camera->formats[i].fps[j] = (frame_rate_fraction){ 1, 30 * (j + 1) };
+    }
+    camera->buffers_count = 2;
+    camera->buffers = (camera_buffer_description*)calloc(2, sizeof(camera_buffer_description));
+    camera->buffers[0].buffer_size = camera->buffers[1].buffer_size = 614400;
+    camera->streaming_params.frame_interval = 1.0 / 60;
+    camera->streaming_params.capture_time_per_frame = 60;
+    return camera;
+}
+
+static int compare_flat_camera(const camera_flat_list* flat, uint32_t index, const camera_desc* camera)
+{
+    const camera_flat_desc* desc = camera_flat_list_camera(flat, index);
+    const char* serial = camera_flat_string(flat, desc->serial_number_offset);
+    if (strcmp(camera_flat_string(flat, desc->card_offset), camera->device_id.card) != 0 ||
+        strcmp(camera_flat_string(flat, desc->bus_offset), camera->device_id.bus) != 0 ||
+        (serial == NULL) != (camera->device_id.serial_number == NULL) ||
+        (serial && strcmp(serial, camera->device_id.serial_number) != 0) ||
+        camera_flat_string(flat, desc->manufacturer_offset) != NULL ||
+        desc->capabilities != camera->device_id.capabilities ||
+        desc->capability_flags != (camera_flat_capability_CAPTURE | camera_flat_capability_STREAMING) ||
+        memcmp(&desc->controls, &camera->controls, sizeof(camera_controls)) != 0 ||
+        desc->streaming_params.capture_time_per_frame != camera->streaming_params.capture_time_per_frame ||
+        desc->formats_count != camera->formats_count || desc->buffers_count != camera->buffers_count ||
+        camera_flat_desc_buffers(flat, desc)[1].buffer_size != camera->buffers[1].buffer_size || desc->tuning_count != 0)
+    {
+        printf("Camera %u differs after flattening\n", index);
+        return 1;
+    }
+    const camera_flat_format* formats = camera_flat_desc_formats(flat, desc);
+    for (uint32_t i = 0; i < desc->formats_count; ++i)
+    {
+        const camera_format* format = &camera->formats[i];
+        if (formats[i].pixel_format != (uint32_t)format->pixel_format || formats[i].width != format->width ||
+            formats[i].fps_count != format->fps_count ||
+            memcmp(camera_flat_format_fps(flat, &formats[i]), format->fps, format->fps_count * sizeof(frame_rate_fraction)) != 0)
+        {
+            printf("Camera %u format %u differs after flattening\n", index, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int test_flat_camera_list()
+{
+    camera_desc* cameras[2] = { make_test_camera("A1B2C3", 3), make_test_camera(NULL, 1) };
+    camera_list list = { cameras, 2, 2 };
+    size_t size = camera_list_flat_size(&list);
+    uint64_t* storage = (uint64_t*)calloc(size / sizeof(uint64_t) + 1, sizeof(uint64_t));
+    int ret = 0;
+    if (size == 0 || flatten_camera_list(&list, storage, size - 1) != 0 || flatten_camera_list(&list, storage, size) != size)
+    {
+        printf("Failed to flatten %zu bytes\n", size);
+        ret = 1;
+    }
+    const camera_flat_list* flat = ret ? NULL : camera_flat_list_view(storage, size);
+    if (!ret && (flat == NULL || flat->camera_count != 2))
+    {
+        printf("Flat list did not validate\n");
+        ret = 1;
+    }
+    for (uint32_t i = 0; !ret && i < 2; ++i)
+        ret = compare_flat_camera(flat, i, cameras[i]);
+
+    // Through a cache file, then reading it in place from the mapping
+    char cache_path[256];
+    size_t mapped_size = 0;
+    const camera_flat_list* mapped = NULL;
+    if (!ret && make_temp_path(cache_path, sizeof(cache_path)))
+        ret = 1;
+    else if (!ret)
+    {
+        if (write_camera_flat_list(cache_path, flat) || (mapped = map_camera_flat_list(cache_path, &mapped_size)) == NULL ||
+            mapped_size != size || memcmp(mapped, flat, size) != 0)
+        {
+            printf("Cache file round trip failed\n");
+            ret = 1;
+        }
+        unmap_camera_flat_list(mapped, mapped_size);
+        unlink(cache_path);
+    }
+
+    // Corrupt blobs must be rejected rather than read out of bounds
+    if (!ret)
+    {
+        camera_flat_desc* desc = (camera_flat_desc*)((uint8_t*)storage + flat->cameras_offset);
+        uint32_t formats_offset = desc->formats_offset;
+        desc->formats_offset = (uint32_t)size;
+        if (camera_flat_list_view(storage, size) != NULL || camera_flat_list_view(storage, size / 2) != NULL)
+        {
+            printf("Corrupt flat list validated\n");
+            ret = 1;
+        }
+        desc->formats_offset = formats_offset;
+    }
+    free(storage);
+    free_camera_desc(cameras[0]);
+    free_camera_desc(cameras[1]);
+    return ret;
+}
+
+typedef struct
+{
+    camera_pixel_format pixel_format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps_count;
+    frame_rate_fraction fps[3];
+} test_mode_size;
+
+// Linear scan reference for camera_fastest_mode
+static const camera_mode* linear_fastest_mode(const camera_mode_table* table, camera_pixel_format format, uint32_t min_width, uint32_t min_height)
+{
+    uint32_t count = 0;
+    const camera_mode* modes = camera_format_modes(table, format, &count);
+    const camera_mode* best = NULL;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (modes[i].width < min_width || modes[i].height < min_height)
+            continue;
+        double fps = camera_mode_fps(&modes[i]);
+        if (best == NULL || fps > camera_mode_fps(best) ||
+            (fps == camera_mode_fps(best) && (uint32_t)modes[i].width * modes[i].height < (uint32_t)best->width * best->height))
+            best = &modes[i];
+    }
+    return best;
+}
+
+static int check_mode(const camera_mode* mode, uint32_t width, uint32_t height, double fps, const char* query)
+{
+    if (mode == NULL || mode->width != width || mode->height != height || camera_mode_fps(mode) != fps)
+    {
+        printf("%s: expected %ux%u at %.0f fps\n", query, width, height, fps);
+        return 1;
+    }
+    return 0;
+}
+
+int test_camera_mode_table()
+{
+    static const test_mode_size sizes[] = {
+        { camera_pixel_format_MJPEG, 1920, 1080, 2, { { 1, 30 }, { 1, 15 } } },
+        { camera_pixel_format_MJPEG, 1280, 720, 2, { { 1, 60 }, { 1, 30 } } },
+        { camera_pixel_format_MJPEG, 640, 480, 3, { { 1, 30 }, { 1, 120 }, { 1, 60 } } },
+        { camera_pixel_format_MJPEG, 320, 240, 2, { { 2, 60 }, { 1, 30 } } },
+        { camera_pixel_format_MJPEG, 800, 240, 1, { { 1, 100 } } },
+        { camera_pixel_format_YUYV, 640, 480, 1, { { 1, 60 } } },
+        { camera_pixel_format_YUYV, 320, 240, 1, { { 1, 60 } } },
+        { camera_pixel_format_YUYV, 70000, 240, 1, { { 1, 60 } } },
+    };
+    uint32_t size_count = sizeof(sizes) / sizeof(sizes[0]);
+    camera_desc* camera = make_test_camera("A1B2C3", 0);
+    free(camera->formats);
+    camera->formats = (camera_format*)calloc(size_count, sizeof(camera_format));
+    camera->formats_count = size_count;
+    for (uint32_t i = 0; i < size_count; ++i)
+    {
+        camera->formats[i] = (camera_format){ sizes[i].pixel_format, sizes[i].width, sizes[i].height, sizes[i].fps_count, NULL };
+        camera->formats[i].fps = (frame_rate_fraction*)calloc(sizes[i].fps_count, sizeof(frame_rate_fraction));
+        memcpy(camera->formats[i].fps, sizes[i].fps, sizes[i].fps_count * sizeof(frame_rate_fraction));
+    }
+    camera->modes = build_camera_mode_table(camera->formats, camera->formats_count);
+    const camera_mode_table* table = camera->modes;
+    uint32_t mjpeg_count = 0;
+    if (table == NULL || table->mode_count != 11 || camera_format_modes(table, camera_pixel_format_MJPEG, &mjpeg_count) == NULL || mjpeg_count != 9 ||
+        !camera_mode_table_valid(table, table->size))
+    {
+        printf("Mode table has the wrong modes\n");
+        free_camera_desc(camera);
+        return 1;
+    }
+
+    int ret = check_mode(camera_fastest_mode(table, camera_pixel_format_MJPEG, 0, 0), 640, 480, 120, "Fastest MJPEG") |
+        check_mode(camera_fastest_mode(table, camera_pixel_format_MJPEG, 641, 0), 800, 240, 100, "Fastest MJPEG wider than 640") |
+        check_mode(camera_fastest_mode(table, camera_pixel_format_MJPEG, 641, 481), 1280, 720, 60, "Fastest MJPEG larger than 640x480") |
+        check_mode(camera_fastest_mode(table, camera_pixel_format_YUYV, 0, 0), 320, 240, 60, "Smallest of the fastest YUYV") |
+        check_mode(find_camera_mode(table, camera_pixel_format_MJPEG, 640, 480, 50), 640, 480, 60, "MJPEG 640x480 at 50 fps") |
+        check_mode(find_camera_mode(table, camera_pixel_format_MJPEG, 640, 480, 0), 640, 480, 30, "Slowest MJPEG 640x480") |
+        check_mode(find_camera_mode(table, camera_pixel_format_MJPEG, 320, 240, 30), 320, 240, 30, "Deduplicated MJPEG 320x240");
+    if (camera_fastest_mode(table, camera_pixel_format_MJPEG, 1921, 0) != NULL || camera_fastest_mode(table, camera_pixel_format_H264, 0, 0) != NULL ||
+        find_camera_mode(table, camera_pixel_format_MJPEG, 640, 480, 121) != NULL || find_camera_mode(table, camera_pixel_format_MJPEG, 640, 360, 0) != NULL)
+    {
+        printf("Unsupported modes were found\n");
+        ret = 1;
+    }
+    for (uint32_t width = 0; width <= 2000 && !ret; width += 40)
+    {
+        for (uint32_t height = 0; height <= 1100 && !ret; height += 20)
+        {
+            if (camera_fastest_mode(table, camera_pixel_format_MJPEG, width, height) != linear_fastest_mode(table, camera_pixel_format_MJPEG, width, height))
+            {
+                printf("Fastest mode at %ux%u disagrees with a linear search\n", width, height);
+                ret = 1;
+            }
+        }
+    }
+
+    // The table travels verbatim through the flat list and must still answer there
+    camera_desc* cameras[1] = { camera };
+    camera_list list = { cameras, 1, 1 };
+    size_t size = camera_list_flat_size(&list);
+    uint64_t* storage = (uint64_t*)calloc(size / sizeof(uint64_t) + 1, sizeof(uint64_t));
+    const camera_flat_list* flat = flatten_camera_list(&list, storage, size) == size ? camera_flat_list_view(storage, size) : NULL;
+    const camera_mode_table* flat_table = flat ? camera_flat_desc_modes(flat, camera_flat_list_camera(flat, 0)) : NULL;
+    camera_desc* restored = flat ? camera_desc_from_flat(flat, camera_flat_list_camera(flat, 0)) : NULL;
+    if (!ret && (flat_table == NULL || memcmp(flat_table, table, table->size) != 0 || restored == NULL || restored->modes == NULL ||
+        memcmp(restored->modes, table, table->size) != 0 ||
+        check_mode(camera_fastest_mode(flat_table, camera_pixel_format_MJPEG, 641, 481), 1280, 720, 60, "Fastest flat MJPEG larger than 640x480")))
+    {
+        printf("Mode table did not survive flattening\n");
+        ret = 1;
+    }
+    if (!ret)
+    {
+        // A grid entry pointing at another format's mode must be rejected
+        uint16_t* fastest = (uint16_t*)((uint8_t*)flat_table + flat_table->fastest_offset);
+        uint16_t saved = fastest[0];
+        fastest[0] = (uint16_t)flat_table->mode_count;
+        if (camera_flat_list_view(storage, size) != NULL)
+        {
+            printf("Corrupt mode table validated\n");
+            ret = 1;
+        }
+        fastest[0] = saved;
+    }
+    free_camera_desc(restored);
+    free(storage);
+    free_camera_desc(camera);
+    return ret;
+}
+
+typedef struct
+{
+    int added;
+    int removed;
+    char last_path[32];
+} test_hotplug_events;
+
+static void count_hotplug_event(const camera_desc* camera, bool added, void* user_data)
+{
+    test_hotplug_events* events = (test_hotplug_events*)user_data;
+    if (added)
+        events->added++;
+    else
+        events->removed++;
+    snprintf(events->last_path, sizeof(events->last_path), "%s", camera->device_id.devPath);
+}
+
+static int check_enumerator(const char* step, camera_enumerator* enumerator, int changes, int expected_changes, int expected_probes,
+    const test_hotplug_events* events, int added, int removed, const char* last_path)
+{
+    int probes = atomic_exchange(&test_fake_probes, 0);
+    if (changes != expected_changes || probes != expected_probes || events->added != added || events->removed != removed ||
+        (last_path && strcmp(events->last_path, last_path) != 0))
+    {
+        printf("%s: %d changes, %d probes, %d added and %d removed last %s, expected %d, %d, %d and %d last %s\n", step,
+            changes, probes, events->added, events->removed, events->last_path, expected_changes, expected_probes, added, removed,
+            last_path ? last_path : "any");
+        return 1;
+    }
+    const camera_list* devices = camera_enumerator_devices(enumerator);
+    for (size_t i = 0; i < devices->count; ++i)
+    {
+        const camera_desc* camera = devices->cameras[i];
+        if (strcmp(camera->device_id.driver_info, TEST_FAKE_DRIVER) != 0 || camera->formats_count != 1 || camera->formats[0].width != 640 ||
+            camera->buffers_count != 2 || camera->buffers[0].buffer_size != TEST_FAKE_BUFFER_SIZE || camera->modes == NULL)
+        {
+            printf("%s: %s described incompletely\n", step, camera->device_id.devPath);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int test_camera_enumerator()
+{
+    static const char* const names[] = { "video90", "video91", "video92" };
+    char directory[256];
+    char cache_path[256];
+    if (make_fake_device_directory(directory, sizeof(directory)))
+        return 1;
+    if (make_temp_path(cache_path, sizeof(cache_path)) || add_fake_device(directory, "video90", "usb-fake-1", 0))
+    {
+        remove_fake_device_directory(directory, names, 3);
+        return 1;
+    }
+
+    int ret = 0;
+    test_hotplug_events events = { 0 };
+    atomic_store(&test_fake_probes, 0);
+    // The second run starts from the cache the first one saved and must not probe again
+    for (int run = 0; run < 2 && !ret; ++run)
+    {
+        camera_enumerator* enumerator = create_camera_enumerator(cache_path, count_hotplug_event, &events);
+        if (enumerator == NULL || camera_enumerator_devices(enumerator)->count != 1)
+        {
+            printf("Run %d: the fake device was not enumerated\n", run);
+            ret = 1;
+        }
+        if (!ret)
+            ret = check_enumerator(run ? "Cached run" : "First run", enumerator, 0, 0, run ? 0 : 1, &events, 0, 0, NULL);
+        destroy_camera_enumerator(enumerator);
+    }
+
+    camera_enumerator* enumerator = ret ? NULL : create_camera_enumerator(cache_path, count_hotplug_event, &events);
+    if (!ret && (enumerator == NULL || camera_enumerator_fd(enumerator) == -1))
+    {
+        printf("Cannot watch %s\n", directory);
+        ret = 1;
+    }
+    atomic_store(&test_fake_probes, 0);
+    // A new device is probed once, one renumbered to another node is recognised from the cache
+    if (!ret)
+        ret = add_fake_device(directory, "video91", "usb-fake-2", 0) ||
+            check_enumerator("Plugged in", enumerator, poll_camera_enumerator(enumerator), 1, 1, &events, 1, 0, "video91");
+    if (!ret)
+        ret = move_fake_device(directory, "video90", "video92") ||
+            check_enumerator("Renumbered", enumerator, poll_camera_enumerator(enumerator), 2, 0, &events, 2, 1, "video92");
+    if (!ret)
+    {
+        remove_fake_device(directory, "video91");
+        ret = check_enumerator("Unplugged", enumerator, poll_camera_enumerator(enumerator), 1, 0, &events, 2, 2, "video91");
+    }
+    if (!ret)
+        ret = check_enumerator("No events", enumerator, poll_camera_enumerator(enumerator), 0, 0, &events, 2, 2, NULL);
+    if (!ret)
+        ret = check_enumerator("Refreshed", enumerator, refresh_camera_enumerator(enumerator), 0, 0, &events, 2, 2, NULL);
+    if (!ret && (camera_enumerator_devices(enumerator)->count != 1 ||
+        strcmp(camera_enumerator_devices(enumerator)->cameras[0]->device_id.devPath, "video92") != 0))
+    {
+        printf("Expected only video92 to be plugged in\n");
+        ret = 1;
+    }
+    destroy_camera_enumerator(enumerator);
+    unlink(cache_path);
+    remove_fake_device_directory(directory, names, 3);
+    return ret;
+}
+
+int test_camera_probe_timeout()
+{
+    static const char* const names[] = { "video90", "video91", "video92", "video93" };
+    char directory[256];
+    if (make_fake_device_directory(directory, sizeof(directory)))
+        return 1;
+    int ret = 0;
+    if (add_fake_device(directory, "video90", "usb-fake-1", 0) || add_fake_device(directory, "video92", "usb-fake-3", TEST_SLOW_PROBE_MS) ||
+        add_fake_device(directory, "video93", "usb-fake-4", 0))
+        ret = 1;
+
+    // Plugged in while the enumerator runs, it is given up on after the default timeout
+    test_hotplug_events events = { 0 };
+    camera_enumerator* enumerator = ret ? NULL : create_camera_enumerator(NULL, count_hotplug_event, &events);
+    if (!ret && (enumerator == NULL || camera_enumerator_devices(enumerator)->count != 3 || camera_enumerator_fd(enumerator) == -1))
+    {
+        printf("The fake devices were not enumerated\n");
+        ret = 1;
+    }
+    uint64_t start = monotonic_ns();
+    if (!ret && add_fake_device(directory, "video91", "usb-fake-2", CAMERA_PROBE_TIMEOUT_MS + 2 * TEST_PROBE_TIMEOUT_MS))
+        ret = 1;
+    if (!ret && (poll_camera_enumerator(enumerator) != 0 || events.added != 0 || camera_enumerator_devices(enumerator)->count != 3))
+    {
+        printf("The hanging device was added\n");
+        ret = 1;
+    }
+    uint64_t elapsed_ms = (monotonic_ns() - start) / 1000000;
+    if (!ret && elapsed_ms >= CAMERA_PROBE_TIMEOUT_MS + TEST_PROBE_TIMEOUT_MS)
+    {
+        printf("Hotplug waited %lu ms for the hanging device\n", (unsigned long)elapsed_ms);
+        ret = 1;
+    }
+    destroy_camera_enumerator(enumerator);
+
+    // Two threads for four devices: the scan ends once the hanging one overran its timeout and
+    // the rest are listed in node order, not in the order their probes finished
+    start = monotonic_ns();
+    camera_list* list = ret ? NULL : list_all_camera_devices_parallel(2, TEST_PROBE_TIMEOUT_MS);
+    elapsed_ms = (monotonic_ns() - start) / 1000000;
+    if (!ret && (list == NULL || list->count != 3 || strcmp(list->cameras[0]->device_id.devPath, "video90") != 0 ||
+        strcmp(list->cameras[1]->device_id.devPath, "video92") != 0 || strcmp(list->cameras[2]->device_id.devPath, "video93") != 0))
+    {
+        printf("Expected video90, video92 and video93 in order\n");
+        ret = 1;
+    }
+    if (!ret && elapsed_ms >= 2 * TEST_PROBE_TIMEOUT_MS)
+    {
+        printf("The scan waited %lu ms for the hanging device\n", (unsigned long)elapsed_ms);
+        ret = 1;
+    }
+    free_camera_list(list);
+    // The abandoned probe threads keep their descriptors, removing the nodes does not disturb them
+    remove_fake_device_directory(directory, names, 4);
+    return ret;
+}
+
 int main(int argc, char* argv[argc])
 {
     if (argc > 0)
@@ -25,6 +632,22 @@ int main(int argc, char* argv[argc])
             {
                 return test_list_all_camera_devices();
             }
+            if (strcmp(argv[i], "test_flat_camera_list") == 0)
+            {
+                return test_flat_camera_list();
+            }
+            if (strcmp(argv[i], "test_camera_enumerator") == 0)
+            {
+                return test_camera_enumerator();
+            }
+            if (strcmp(argv[i], "test_camera_mode_table") == 0)
+            {
+                return test_camera_mode_table();
+            }
+            if (strcmp(argv[i], "test_camera_probe_timeout") == 0)
+            {
+                return test_camera_probe_timeout();
+            }
         }
     }
     else
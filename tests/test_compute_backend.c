@@ -0,0 +1,450 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "computebackend.h"
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 48
+#define TEST_THREADS "3"
+#define TEST_ROI_MARGIN 2
+
+// Marker 1's range contains marker 0's, red pixels must still only count for marker 0
+static const MarkerColorRange test_red_range = { 200, 0, 0, 255, 50, 50 };
+static const MarkerColorRange test_wide_range = { 150, 0, 0, 255, 50, 100 };
+static const uint8_t test_red[3] = { 230, 20, 20 };
+static const uint8_t test_purple[3] = { 170, 10, 80 };
+
+static void set_pixel(uint8_t* frame, uint32_t x, uint32_t y, const uint8_t color[3])
+{
+    memcpy(frame + ((size_t)y * TEST_WIDTH + x) * 3, color, 3);
+}
+
+// A 2x2 red block at (10, 10) and an L of purple pixels around (41, 30)
+static void draw_markers(uint8_t* frame)
+{
+    memset(frame, 0, TEST_WIDTH * TEST_HEIGHT * 3);
+    set_pixel(frame, 10, 10, test_red);
+    set_pixel(frame, 11, 10, test_red);
+    set_pixel(frame, 10, 11, test_red);
+    set_pixel(frame, 11, 11, test_red);
+    set_pixel(frame, 40, 30, test_purple);
+    set_pixel(frame, 41, 30, test_purple);
+    set_pixel(frame, 41, 31, test_purple);
+}
+
+static int check_centroid(const char* label, const MarkerCentroid* centroid, uint32_t count, float x, float y,
+    uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY)
+{
+    if (!centroid->found || centroid->pixelCount != count || fabsf(centroid->x - x) > 1e-4f || fabsf(centroid->y - y) > 1e-4f ||
+        centroid->minX != minX || centroid->minY != minY || centroid->maxX != maxX || centroid->maxY != maxY)
+    {
+        printf("%s: got %u pixels at (%f, %f) in [%u, %u]-[%u, %u], expected %u at (%f, %f) in [%u, %u]-[%u, %u]\n",
+            label, centroid->pixelCount, centroid->x, centroid->y, centroid->minX, centroid->minY, centroid->maxX, centroid->maxY,
+            count, x, y, minX, minY, maxX, maxY);
+        return 1;
+    }
+    return 0;
+}
+
+static BackendTracker create_test_tracker(ComputeBackend* backend, enum TrackingPixelFormat pixelFormat)
+{
+    // Several threads so the rows are split into bands and the partial sums merged
+    setenv(COMPUTE_THREADS_ENVIRONMENT_VARIABLE, TEST_THREADS, 1);
+    *backend = CreateComputeBackend(ComputeBackendCPU, NULL);
+    BackendTracker tracker = CreateBackendTracker(*backend, TEST_WIDTH, TEST_HEIGHT, pixelFormat, 2);
+    if (tracker)
+    {
+        // Converted with ConvertMarkerColorRangeToYUV for YUV frames
+        BackendTrackerSetMarkerColor(tracker, 0, test_red_range);
+        BackendTrackerSetMarkerColor(tracker, 1, test_wide_range);
+    }
+    return tracker;
+}
+
+// A 2x2 red block at (10, 10) and a 4x2 purple block at (40, 30), aligned so every pair and 2x2
+// block of pixels sharing chroma has a single colour
+static void draw_aligned_markers(uint8_t* frame)
+{
+    memset(frame, 0, TEST_WIDTH * TEST_HEIGHT * 3);
+    for (uint32_t y = 0; y < 2; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            if (x < 2)
+                set_pixel(frame, 10 + x, 10 + y, test_red);
+            set_pixel(frame, 40 + x, 30 + y, test_purple);
+        }
+    }
+}
+
+/**
+ * @brief Encodes an RGB frame as BT.601 limited range YUYV or NV12, chroma taken from the first
+ * pixel sharing it, which is exact for frames drawn by draw_aligned_markers.
+ */
+static size_t encode_yuv_frame(const uint8_t* rgb, enum TrackingPixelFormat pixelFormat, uint8_t* out)
+{
+    for (uint32_t y = 0; y < TEST_HEIGHT; ++y)
+    {
+        for (uint32_t x = 0; x < TEST_WIDTH; ++x)
+        {
+            const uint8_t* pixel = rgb + ((size_t)y * TEST_WIDTH + x) * 3;
+            // The YUV box of a single colour is that colour's YUV value
+            MarkerColorRange yuv = ConvertMarkerColorRangeToYUV((MarkerColorRange){ pixel[0], pixel[1], pixel[2], pixel[0], pixel[1], pixel[2] });
+            if (pixelFormat == TrackingPixelFormatYUYV)
+            {
+                uint8_t* pair = out + ((size_t)y * TEST_WIDTH + (x & ~1u)) * 2;
+                pair[(x & 1) * 2] = yuv.minR;
+                if ((x & 1) == 0)
+                {
+                    pair[1] = yuv.minG;
+                    pair[3] = yuv.minB;
+                }
+            }
+            else
+            {
+                out[(size_t)y * TEST_WIDTH + x] = yuv.minR;
+                if ((x & 1) == 0 && (y & 1) == 0)
+                {
+                    uint8_t* chroma = out + (size_t)TEST_WIDTH * TEST_HEIGHT + (size_t)(y / 2) * TEST_WIDTH + x;
+                    chroma[0] = yuv.minG;
+                    chroma[1] = yuv.minB;
+                }
+            }
+        }
+    }
+    return TrackingFrameSize(TEST_WIDTH, TEST_HEIGHT, pixelFormat);
+}
+
+int test_cpu_backend_first_match()
+{
+    ComputeBackend backend = NULL;
+    BackendTracker tracker = create_test_tracker(&backend, TrackingPixelFormatRGB24);
+    if (!tracker)
+    {
+        printf("Failed to create the CPU tracker\n");
+        DestroyComputeBackend(backend);
+        return 1;
+    }
+    static uint8_t frame[TEST_WIDTH * TEST_HEIGHT * 3];
+    draw_markers(frame);
+    set_pixel(frame, 60, 45, test_red);
+
+    int ret = 0;
+    MarkerCentroid centroids[2];
+    if (!BackendTrackerSubmitFrame(tracker, frame, sizeof(frame)) || !BackendTrackerCollectResults(tracker, true, centroids))
+    {
+        printf("Failed to track the frame\n");
+        ret = 1;
+    }
+    // Red: (10 + 11 + 10 + 11 + 60) / 5, (10 + 10 + 11 + 11 + 45) / 5. Purple: 122 / 3, 91 / 3.
+    if (!ret)
+        ret |= check_centroid("Marker 0", &centroids[0], 5, 20.4f, 17.4f, 10, 10, 60, 45);
+    if (!ret)
+        ret |= check_centroid("Marker 1", &centroids[1], 3, 122.0f / 3.0f, 91.0f / 3.0f, 40, 30, 41, 31);
+    DestroyBackendTracker(tracker);
+    DestroyComputeBackend(backend);
+    return ret;
+}
+
+int test_cpu_backend_predicted_windows()
+{
+    ComputeBackend backend = NULL;
+    BackendTracker tracker = create_test_tracker(&backend, TrackingPixelFormatRGB24);
+    if (!tracker)
+    {
+        printf("Failed to create the CPU tracker\n");
+        DestroyComputeBackend(backend);
+        return 1;
+    }
+    static uint8_t first[TEST_WIDTH * TEST_HEIGHT * 3];
+    static uint8_t second[TEST_WIDTH * TEST_HEIGHT * 3];
+    draw_markers(first);
+    draw_markers(second);
+    // Inside marker 1's window but red, so it belongs to marker 0, whose window does not contain it
+    set_pixel(second, 42, 32, test_red);
+    // Outside every window
+    set_pixel(second, 60, 45, test_red);
+
+    int ret = 0;
+    MarkerCentroid centroids[2];
+    if (!BackendTrackerSubmitFrame(tracker, first, sizeof(first)))
+        ret = 1;
+    // The margin applies from the next frame, its windows are predicted from the first one:
+    // marker 0 centred on (11, 11) and marker 1 on (41, 31), both grown to the 16 pixel minimum
+    BackendTrackerSetRoiMargin(tracker, TEST_ROI_MARGIN);
+    if (!BackendTrackerSubmitFrame(tracker, second, sizeof(second)))
+        ret = 1;
+    if (!ret && BackendTrackerSubmitFrame(tracker, second, sizeof(second)))
+    {
+        printf("Submitted more than %u frames in flight\n", TRACKING_FRAMES_IN_FLIGHT);
+        ret = 1;
+    }
+    if (ret)
+        printf("Failed to submit the frames\n");
+
+    // Collected in submission order
+    if (!ret && !BackendTrackerCollectResults(tracker, true, centroids))
+        ret = 1;
+    if (!ret)
+        ret |= check_centroid("First frame marker 0", &centroids[0], 4, 10.5f, 10.5f, 10, 10, 11, 11);
+    if (!ret)
+        ret |= check_centroid("First frame marker 1", &centroids[1], 3, 122.0f / 3.0f, 91.0f / 3.0f, 40, 30, 41, 31);
+    if (!ret && !BackendTrackerCollectResults(tracker, true, centroids))
+        ret = 1;
+    if (!ret)
+        ret |= check_centroid("Second frame marker 0", &centroids[0], 4, 10.5f, 10.5f, 10, 10, 11, 11);
+    if (!ret)
+        ret |= check_centroid("Second frame marker 1", &centroids[1], 3, 122.0f / 3.0f, 91.0f / 3.0f, 40, 30, 41, 31);
+    if (!ret && BackendTrackerCollectResults(tracker, false, centroids))
+    {
+        printf("Collected a frame that was never submitted\n");
+        ret = 1;
+    }
+
+    // Back to whole frames, both stray red pixels count for marker 0 again
+    BackendTrackerSetRoiMargin(tracker, 0);
+    if (!ret && (!BackendTrackerSubmitFrame(tracker, second, sizeof(second)) || !BackendTrackerCollectResults(tracker, true, centroids)))
+        ret = 1;
+    // (10 + 11 + 10 + 11 + 42 + 60) / 6, (10 + 10 + 11 + 11 + 32 + 45) / 6
+    if (!ret)
+        ret |= check_centroid("Whole frame marker 0", &centroids[0], 6, 24.0f, 119.0f / 6.0f, 10, 10, 60, 45);
+    DestroyBackendTracker(tracker);
+    DestroyComputeBackend(backend);
+    return ret;
+}
+
+int test_cpu_backend_yuv_formats()
+{
+    static const enum TrackingPixelFormat formats[] = { TrackingPixelFormatRGB24, TrackingPixelFormatYUYV, TrackingPixelFormatNV12 };
+    static const char* names[] = { "RGB24", "YUYV", "NV12" };
+    static uint8_t rgb[TEST_WIDTH * TEST_HEIGHT * 3];
+    static uint8_t yuv[TEST_WIDTH * TEST_HEIGHT * 2];
+    draw_aligned_markers(rgb);
+    int ret = 0;
+    for (uint32_t f = 0; f < 3 && !ret; ++f)
+    {
+        ComputeBackend backend = NULL;
+        BackendTracker tracker = create_test_tracker(&backend, formats[f]);
+        if (!tracker)
+        {
+            printf("Failed to create the %s tracker\n", names[f]);
+            DestroyComputeBackend(backend);
+            return 1;
+        }
+        const uint8_t* frame = rgb;
+        size_t frameSize = sizeof(rgb);
+        if (formats[f] != TrackingPixelFormatRGB24)
+        {
+            frameSize = encode_yuv_frame(rgb, formats[f], yuv);
+            frame = yuv;
+        }
+        MarkerCentroid centroids[2];
+        if (!BackendTrackerSubmitFrame(tracker, frame, frameSize) || !BackendTrackerCollectResults(tracker, true, centroids))
+        {
+            printf("Failed to track the %s frame\n", names[f]);
+            ret = 1;
+        }
+        // Every format finds the centroids of the RGB frame, purple stays outside red's YUV box
+        char label[64];
+        snprintf(label, sizeof(label), "%s marker 0", names[f]);
+        if (!ret)
+            ret |= check_centroid(label, &centroids[0], 4, 10.5f, 10.5f, 10, 10, 11, 11);
+        snprintf(label, sizeof(label), "%s marker 1", names[f]);
+        if (!ret)
+            ret |= check_centroid(label, &centroids[1], 8, 41.5f, 30.5f, 40, 30, 43, 31);
+        DestroyBackendTracker(tracker);
+        DestroyComputeBackend(backend);
+    }
+    return ret;
+}
+
+static uint32_t joint_cell(const uint8_t color[3])
+{
+    return ((uint32_t)(color[0] >> 5) * COLOR_HISTOGRAM_JOINT_LEVELS + (color[1] >> 5)) * COLOR_HISTOGRAM_JOINT_LEVELS + (color[2] >> 5);
+}
+
+// Adds count samples of a colour to a histogram
+static void add_samples(ColorHistogramGPU* histogram, const uint8_t color[3], uint32_t count)
+{
+    histogram->pixelCount += count;
+    for (uint32_t c = 0; c < 3; ++c)
+        histogram->channels[c][color[c]] += count;
+    histogram->joint[joint_cell(color)] += count;
+}
+
+static int check_range(const char* label, MarkerColorRange range, MarkerColorRange expected)
+{
+    if (memcmp(&range, &expected, sizeof(range)) != 0)
+    {
+        printf("%s: got %u,%u,%u-%u,%u,%u, expected %u,%u,%u-%u,%u,%u\n", label,
+            range.minR, range.minG, range.minB, range.maxR, range.maxG, range.maxB,
+            expected.minR, expected.minG, expected.minB, expected.maxR, expected.maxG, expected.maxB);
+        return 1;
+    }
+    return 0;
+}
+
+int test_color_calibration_thresholds()
+{
+    static ColorHistogramGPU histograms[2];
+    ColorHistogramGPU* region = &histograms[0];
+    ColorHistogramGPU* frame = &histograms[1];
+    // 100 region samples: the first channel spread over 200-209, the second over 40-49 but
+    // twice as often at 49 and never at 45, the third always 144
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        uint8_t color[3] = { (uint8_t)(200 + i), (uint8_t)(40 + i), 144 };
+        if (i == 5)
+            color[1] = 49;
+        add_samples(region, color, 10);
+    }
+    *frame = *region;
+    // 1000 background samples: mostly black, 200 sharing the first channel's 209 and 5 sharing
+    // 205, 45 and 144
+    add_samples(frame, (const uint8_t[3]){ 0, 0, 0 }, 795);
+    add_samples(frame, (const uint8_t[3]){ 209, 0, 0 }, 200);
+    add_samples(frame, (const uint8_t[3]){ 205, 45, 144 }, 5);
+
+    ColorCalibrationResult result = DeriveColorCalibration(region, frame);
+    int ret = 0;
+    if (result.regionPixels != 100 || result.framePixels != 1100)
+    {
+        printf("Got %u region and %u frame samples, expected 100 and 1100\n", result.regionPixels, result.framePixels);
+        ret = 1;
+    }
+    // 209 is 10% of the region but 20% of the background, so it is cut. 205 and the empty 45 cost
+    // less than the bins around them gain, so the intervals bridge them.
+    ret |= check_range("Calibrated range", result.range, (MarkerColorRange){ 200, 40, 144, 208, 49, 144 });
+    // Every region sample shares the joint cell centred on (208, 48, 144), so do the 5 leaking ones
+    if (fabsf(result.regionCoverage - 1.0f) > 1e-6f || fabsf(result.backgroundLeak - 0.005f) > 1e-6f)
+    {
+        printf("Got %f coverage and %f leak, expected 1 and 0.005\n", result.regionCoverage, result.backgroundLeak);
+        ret = 1;
+    }
+    return ret;
+}
+
+int test_cpu_backend_histograms()
+{
+    ComputeBackend backend = NULL;
+    BackendTracker tracker = create_test_tracker(&backend, TrackingPixelFormatRGB24);
+    if (!tracker)
+    {
+        printf("Failed to create the CPU tracker\n");
+        DestroyComputeBackend(backend);
+        return 1;
+    }
+    static uint8_t frame[TEST_WIDTH * TEST_HEIGHT * 3];
+    static ColorHistogramGPU histograms[2];
+    draw_markers(frame);
+    // Around the red block, the purple marker is background
+    TrackingWindow region = { 8, 8, 6, 6 };
+
+    int ret = 0;
+    MarkerCentroid centroids[2];
+    if (BackendTrackerRequestHistograms(tracker, region, 1))
+    {
+        printf("Requested histograms before a frame was submitted\n");
+        ret = 1;
+    }
+    if (!ret && (!BackendTrackerSubmitFrame(tracker, frame, sizeof(frame)) || !BackendTrackerCollectResults(tracker, true, centroids)))
+    {
+        printf("Failed to track the frame\n");
+        ret = 1;
+    }
+    if (!ret && BackendTrackerCollectHistograms(tracker, false, histograms))
+    {
+        printf("Collected histograms that were never requested\n");
+        ret = 1;
+    }
+    if (!ret && (!BackendTrackerRequestHistograms(tracker, region, 1) || BackendTrackerRequestHistograms(tracker, region, 1)))
+    {
+        printf("Expected the first request to succeed and the second to wait for its collection\n");
+        ret = 1;
+    }
+    if (!ret && !BackendTrackerCollectHistograms(tracker, false, histograms))
+    {
+        printf("Failed to collect the histograms\n");
+        ret = 1;
+    }
+    if (!ret)
+    {
+        // Bands of 3 threads are merged, the frame histogram includes the region
+        const uint32_t black = TEST_WIDTH * TEST_HEIGHT - 7;
+        if (histograms[0].pixelCount != 36 || histograms[0].channels[0][230] != 4 || histograms[0].channels[0][0] != 32 ||
+            histograms[0].joint[joint_cell(test_red)] != 4 ||
+            histograms[1].pixelCount != TEST_WIDTH * TEST_HEIGHT || histograms[1].channels[0][230] != 4 || histograms[1].channels[0][170] != 3 ||
+            histograms[1].channels[0][0] != black || histograms[1].channels[2][80] != 3 || histograms[1].joint[joint_cell(test_purple)] != 3 ||
+            histograms[1].joint[0] != black)
+        {
+            printf("Wrong whole sample histograms: %u region samples with %u red, %u frame samples with %u red and %u purple\n",
+                histograms[0].pixelCount, histograms[0].channels[0][230], histograms[1].pixelCount, histograms[1].channels[0][230],
+                histograms[1].channels[0][170]);
+            ret = 1;
+        }
+    }
+
+    // The derived range keeps only the red block, applied to the tracker it finds it again
+    ColorCalibrationResult result = DeriveColorCalibration(&histograms[0], &histograms[1]);
+    if (!ret)
+        ret |= check_range("Calibrated red", result.range, (MarkerColorRange){ 230, 20, 20, 230, 20, 20 });
+    BackendTrackerSetMarkerRange(tracker, 0, result.range);
+    if (!ret && (!BackendTrackerSubmitFrame(tracker, frame, sizeof(frame)) || !BackendTrackerCollectResults(tracker, true, centroids)))
+        ret = 1;
+    if (!ret)
+        ret |= check_centroid("Calibrated marker 0", &centroids[0], 4, 10.5f, 10.5f, 10, 10, 11, 11);
+
+    // Every other column and row, on the same grid as color_histogram.comp: only (10, 10) of the block
+    if (!ret && !BackendTrackerComputeHistograms(tracker, region, 2, histograms))
+    {
+        printf("Failed to compute the sampled histograms\n");
+        ret = 1;
+    }
+    if (!ret && (histograms[0].pixelCount != 9 || histograms[0].channels[0][230] != 1 ||
+        histograms[1].pixelCount != (TEST_WIDTH / 2) * (TEST_HEIGHT / 2) || histograms[1].channels[0][170] != 1))
+    {
+        printf("Wrong sampled histograms: %u region samples with %u red, %u frame samples with %u purple\n",
+            histograms[0].pixelCount, histograms[0].channels[0][230], histograms[1].pixelCount, histograms[1].channels[0][170]);
+        ret = 1;
+    }
+    DestroyBackendTracker(tracker);
+    DestroyComputeBackend(backend);
+    return ret;
+}
+
+int main(int argc, const char* argv[argc])
+{
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "test_cpu_backend_first_match") == 0)
+            {
+                return test_cpu_backend_first_match();
+            }
+            if (strcmp(argv[i], "test_cpu_backend_predicted_windows") == 0)
+            {
+                return test_cpu_backend_predicted_windows();
+            }
+            if (strcmp(argv[i], "test_cpu_backend_yuv_formats") == 0)
+            {
+                return test_cpu_backend_yuv_formats();
+            }
+            if (strcmp(argv[i], "test_color_calibration_thresholds") == 0)
+            {
+                return test_color_calibration_thresholds();
+            }
+            if (strcmp(argv[i], "test_cpu_backend_histograms") == 0)
+            {
+                return test_cpu_backend_histograms();
+            }
+        }
+    }
+    else
+    {
+        printf("Please specify which test to run.\n");
+    }
+    return 0;
+}
@@ -0,0 +1,730 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "network.h"
+#include "preview.h"
+#include "supervisor.h"
+#include "latency.h"
+
+#define TEST_RING_NAME "/vrwebtrack-test-coordinates"
+#define TEST_WAKEUP_ROUNDS 1000
+#define TEST_PREVIEW_SOCKET "vrwebtrack-test-preview"
+#define TEST_PREVIEW_FRAMES 100
+#define TEST_CONTROL_NAME "vrwebtrack-test-control"
+#define TEST_SHADER_SIZE (64 * 1024)
+// nobody
+#define TEST_OTHER_USER 65534
+#define TEST_SUPERVISOR_WORKER "/bin/false"
+#define TEST_LATENCY_CAMERA 4000000000u
+#define TEST_LATENCY_FRAMES 200
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static CoordinateRecord make_record(uint64_t sequence, uint32_t marker)
+{
+    CoordinateRecord record = { 0 };
+    record.frameSequence = sequence;
+    record.timestampNs = monotonic_ns();
+    record.cameraID = 3;
+    record.marker = marker;
+    record.flags = CoordinateRecordFound;
+    record.x = (float)sequence + 0.25f;
+    record.y = (float)marker;
+    return record;
+}
+
+int test_coordinate_ring()
+{
+    int ret = 0;
+    CoordinateRing producer = CreateCoordinateRing(TEST_RING_NAME);
+    CoordinateRing consumer = OpenCoordinateRing(TEST_RING_NAME);
+    if (!producer || !consumer)
+    {
+        printf("Failed to create or open the ring\n");
+        CloseCoordinateRing(consumer);
+        CloseCoordinateRing(producer);
+        return 1;
+    }
+
+    CoordinateRecord out[COORDINATE_RING_CAPACITY];
+    if (PopCoordinateRecords(consumer, COORDINATE_RING_CAPACITY, out) != 0)
+    {
+        printf("New ring is not empty\n");
+        ret = 1;
+    }
+
+    // Fill the ring one frame of 8 markers at a time, the last frame must not fit
+    uint64_t sequence = 0;
+    CoordinateRecord frame[8];
+    while (!ret)
+    {
+        for (uint32_t i = 0; i < 8; ++i)
+            frame[i] = make_record(sequence, i);
+        if (!PushCoordinateRecords(producer, 8, frame))
+            break;
+        ++sequence;
+    }
+    if (!ret && sequence != COORDINATE_RING_CAPACITY / 8)
+    {
+        printf("Ring accepted %lu frames, expected %d\n", (unsigned long)sequence, COORDINATE_RING_CAPACITY / 8);
+        ret = 1;
+    }
+    if (!ret && atomic_load(&producer->shared->dropped) != 8)
+    {
+        printf("Rejected frame was not counted as dropped\n");
+        ret = 1;
+    }
+
+    // Records come out in order across the wrap around
+    uint64_t expected = 0;
+    for (int round = 0; !ret && round < 3; ++round)
+    {
+        uint32_t count = PopCoordinateRecords(consumer, 100, out);
+        for (uint32_t i = 0; !ret && i < count; ++i, ++expected)
+        {
+            if (out[i].frameSequence != expected / 8 || out[i].marker != expected % 8 || out[i].x != (float)(expected / 8) + 0.25f)
+            {
+                printf("Record %lu out of order\n", (unsigned long)expected);
+                ret = 1;
+            }
+        }
+        for (uint32_t i = 0; i < 8; ++i)
+            frame[i] = make_record(sequence, i);
+        if (!ret && !PushCoordinateRecords(producer, 8, frame))
+        {
+            printf("Push failed after the consumer made room\n");
+            ret = 1;
+        }
+        ++sequence;
+    }
+    if (!ret && CoordinateRecordToDatagram(&out[0]).CameraID != 3)
+    {
+        printf("Datagram conversion lost the camera\n");
+        ret = 1;
+    }
+
+    CloseCoordinateRing(consumer);
+    CloseCoordinateRing(producer);
+    if (!ret && OpenCoordinateRing(TEST_RING_NAME) != NULL)
+    {
+        printf("Ring still exists after its creator closed it\n");
+        ret = 1;
+    }
+    return ret;
+}
+
+int test_coordinate_ring_wakeup()
+{
+    CoordinateRing consumer = CreateCoordinateRing(TEST_RING_NAME);
+    if (!consumer)
+        return 1;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        // Producer process, paced so the consumer is asleep on the futex for every record
+        CoordinateRing producer = OpenCoordinateRing(TEST_RING_NAME);
+        if (!producer)
+            _exit(1);
+        for (uint64_t i = 0; i < TEST_WAKEUP_ROUNDS; ++i)
+        {
+            usleep(200);
+            CoordinateRecord record = make_record(i, 0);
+            record.flags |= CoordinateRecordEndOfFrame;
+            PushCoordinateRecords(producer, 1, &record);
+        }
+        CloseCoordinateRing(producer);
+        _exit(0);
+    }
+
+    int ret = 0;
+    uint64_t* latencies = (uint64_t*)malloc(sizeof(uint64_t) * TEST_WAKEUP_ROUNDS);
+    uint32_t received = 0;
+    while (received < TEST_WAKEUP_ROUNDS)
+    {
+        CoordinateRecord record;
+        if (WaitCoordinateRecords(consumer, 1, &record, 2000000000ull) == 0)
+        {
+            printf("Timed out after %u records\n", received);
+            ret = 1;
+            break;
+        }
+        latencies[received++] = monotonic_ns() - record.timestampNs;
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        ret = 1;
+
+    if (received > 0)
+    {
+        // Insertion sort, small enough
+        for (uint32_t i = 1; i < received; ++i)
+        {
+            uint64_t value = latencies[i];
+            uint32_t j = i;
+            for (; j > 0 && latencies[j - 1] > value; --j)
+                latencies[j] = latencies[j - 1];
+            latencies[j] = value;
+        }
+        printf("Wakeup latency p50 %.1f us, p99 %.1f us\n", latencies[received / 2] / 1000.0, latencies[received * 99 / 100] / 1000.0);
+    }
+    free(latencies);
+    CloseCoordinateRing(consumer);
+    return ret;
+}
+
+int test_coordinate_packets_loopback()
+{
+    CoordinateSocket receiver = CreateCoordinateReceiver("127.0.0.1", 0);
+    CoordinateSocket sender = receiver ? CreateCoordinateSender("127.0.0.1", CoordinateSocketPort(receiver)) : NULL;
+    if (!receiver || !sender)
+    {
+        printf("Failed to open loopback sockets\n");
+        CloseCoordinateSocket(sender);
+        CloseCoordinateSocket(receiver);
+        return 1;
+    }
+
+    // Four cameras, sixteen frames each, camera 2 skips frame 5
+    CoordinatePacket packets[64];
+    uint32_t count = 0;
+    for (uint32_t frame = 0; frame < 16; ++frame)
+    {
+        for (uint32_t camera = 0; camera < 4; ++camera)
+        {
+            if (camera == 2 && frame == 5)
+                continue;
+            CoordinatePacket* packet = &packets[count++];
+            memset(packet, 0, sizeof(*packet));
+            packet->cameraID = camera;
+            packet->frameSequence = frame;
+            packet->timestampNs = monotonic_ns();
+            packet->markerCount = camera + 1;
+            for (uint32_t m = 0; m < packet->markerCount; ++m)
+                packet->markers[m] = (CoordinatePacketMarker){ (uint8_t)m, CoordinateRecordFound, frame + 0.5f, m + 0.125f, 0.75f };
+        }
+    }
+
+    int ret = 0;
+    if (SendCoordinatePackets(sender, count, packets) != count)
+    {
+        printf("Not every packet was sent\n");
+        ret = 1;
+    }
+    // A datagram from something else on the port
+    uint8_t garbage[8] = { 0 };
+    send(sender->fd, garbage, sizeof(garbage), 0);
+
+    CoordinatePacket received[80];
+    // Markers are compared with memcmp, padding included
+    memset(received, 0, sizeof(received));
+    uint32_t receivedCount = 0;
+    while (!ret && receivedCount < count)
+    {
+        uint32_t batch = ReceiveCoordinatePackets(receiver, 80 - receivedCount, received + receivedCount, 1000);
+        if (batch == 0)
+            break;
+        receivedCount += batch;
+    }
+    ReceiveCoordinatePackets(receiver, 80 - receivedCount, received + receivedCount, 100);
+    if (!ret && receivedCount != count)
+    {
+        printf("Received %u of %u packets\n", receivedCount, count);
+        ret = 1;
+    }
+    for (uint32_t i = 0; !ret && i < receivedCount; ++i)
+    {
+        const CoordinatePacket* a = &packets[i];
+        const CoordinatePacket* b = &received[i];
+        if (a->cameraID != b->cameraID || a->frameSequence != b->frameSequence || a->timestampNs != b->timestampNs ||
+            a->markerCount != b->markerCount || memcmp(a->markers, b->markers, sizeof(a->markers[0]) * a->markerCount) != 0)
+        {
+            printf("Packet %u differs after the round trip\n", i);
+            ret = 1;
+        }
+    }
+    if (!ret && (receiver->lostPackets != 1 || receiver->invalidPackets != 1))
+    {
+        printf("Expected 1 lost and 1 invalid packet, got %lu and %lu\n", (unsigned long)receiver->lostPackets, (unsigned long)receiver->invalidPackets);
+        ret = 1;
+    }
+    CloseCoordinateSocket(sender);
+    CloseCoordinateSocket(receiver);
+    return ret;
+}
+
+int test_preview_channel()
+{
+    const uint32_t width = 320, height = 240;
+    const size_t frameSize = (size_t)width * height * 3;
+    PreviewWriter writer = CreatePreviewWriter(TEST_PREVIEW_SOCKET, width, height, 0, width * 3, frameSize);
+    if (!writer)
+        return 1;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        // Monitor process, every intact frame must be filled with its frame number
+        PreviewReader reader = ConnectPreviewReader(TEST_PREVIEW_SOCKET);
+        if (!reader || reader->info.width != width || reader->info.frameSize != frameSize)
+            _exit(1);
+        SetPreviewInterval(reader, 0);
+        uint32_t intact = 0;
+        uint64_t lastFrame = 0;
+        uint64_t deadline = monotonic_ns() + 5000000000ull;
+        while (lastFrame + 1 < TEST_PREVIEW_FRAMES && monotonic_ns() < deadline)
+        {
+            PreviewFrame frame;
+            if (!AcquirePreviewFrame(reader, &frame))
+                continue;
+            uint8_t expected = (uint8_t)frame.frameNumber;
+            bool matches = frame.data[0] == expected && frame.data[frameSize / 2] == expected && frame.data[frameSize - 1] == expected;
+            if (ReleasePreviewFrame(reader, &frame))
+            {
+                if (!matches)
+                    _exit(2);
+                ++intact;
+            }
+            lastFrame = frame.frameNumber;
+        }
+        DestroyPreviewReader(reader);
+        _exit(intact > 0 ? 0 : 3);
+    }
+
+    // Worker process, serves the monitor and publishes frames until it exits
+    int status = 0;
+    uint64_t frameNumber = 0;
+    while (waitpid(child, &status, WNOHANG) == 0)
+    {
+        ServePreviewClients(writer);
+        if (frameNumber + 1 < TEST_PREVIEW_FRAMES)
+        {
+            uint8_t* slot = BeginPreviewFrame(writer, monotonic_ns());
+            if (slot)
+            {
+                ++frameNumber;
+                memset(slot, (uint8_t)frameNumber, frameSize);
+                EndPreviewFrame(writer, frameNumber, monotonic_ns());
+            }
+        }
+        usleep(1000);
+    }
+    DestroyPreviewWriter(writer);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        printf("Preview reader failed with status %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+    return 0;
+}
+
+int test_worker_control()
+{
+    WorkerControl worker = CreateWorkerControl(TEST_CONTROL_NAME);
+    WorkerControl monitor = worker ? ConnectWorkerControl(TEST_CONTROL_NAME) : NULL;
+    if (!worker || !monitor)
+    {
+        printf("Failed to open the control channel\n");
+        CloseWorkerControl(monitor);
+        CloseWorkerControl(worker);
+        return 1;
+    }
+
+    // A burst between two frames, the second resolution and a repeated colour fold away
+    WorkerCommand commands[5] = { 0 };
+    commands[0].type = WorkerCommandSetResolution;
+    commands[0].resolution.width = 1280;
+    commands[0].resolution.height = 720;
+    commands[1].type = WorkerCommandSetResolution;
+    commands[1].resolution.width = 640;
+    commands[1].resolution.height = 480;
+    commands[2].type = WorkerCommandSetMarkerColor;
+    commands[2].markerColor.marker = 1;
+    commands[2].markerColor.max[0] = 255;
+    commands[3] = commands[2];
+    commands[4].type = WorkerCommandSetExposure;
+    commands[4].exposure.exposure = 156;
+    int ret = 0;
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        commands[i].sequence = i;
+        if (!SendWorkerCommand(monitor, &commands[i]))
+            ret = 1;
+    }
+
+    WorkerCommand received[8];
+    uint32_t count = PollWorkerCommands(worker, 8, received);
+    if (!ret && count != 5)
+    {
+        printf("Received %u of 5 commands\n", count);
+        ret = 1;
+    }
+    WorkerSettings settings = { 0 };
+    settings.width = 640;
+    settings.height = 480;
+    settings.fps = 60;
+    settings.markerCount = 2;
+    uint32_t changes = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        changes |= ApplyWorkerCommand(&settings, &received[i]);
+    // 1280x720 then back to 640x480 still reports a change, the capture checks the final values
+    if (!ret && (changes != (WorkerChangedResolution | WorkerChangedMarkerColors | WorkerChangedExposure) ||
+        settings.width != 640 || settings.exposure != 156 || settings.markerMax[1][0] != 255))
+    {
+        printf("Unexpected settings after folding, changes 0x%x\n", changes);
+        ret = 1;
+    }
+    if (!ret && PollWorkerCommands(worker, 8, received) != 0)
+    {
+        printf("Commands delivered twice\n");
+        ret = 1;
+    }
+    CloseWorkerControl(monitor);
+    CloseWorkerControl(worker);
+    return ret;
+}
+
+// Needs root to connect as another user, skipped otherwise
+int test_preview_channel_other_user()
+{
+    if (getuid() != 0)
+    {
+        printf("Not running as root, skipping\n");
+        return 77;
+    }
+    PreviewWriter writer = CreatePreviewWriter(TEST_PREVIEW_SOCKET, 320, 240, 0, 320 * 3, 320 * 240 * 3);
+    if (!writer)
+        return 1;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        if (setgid(TEST_OTHER_USER) != 0 || setuid(TEST_OTHER_USER) != 0)
+            _exit(2);
+        PreviewReader reader = ConnectPreviewReader(TEST_PREVIEW_SOCKET);
+        _exit(reader ? 1 : 0);
+    }
+    // Serve until the child gave up, ConnectPreviewReader waits PREVIEW_CONNECT_TIMEOUT_MS at most
+    int status = 0;
+    uint32_t served = 0;
+    uint64_t deadline = monotonic_ns() + 5000000000ull;
+    while (child > 0 && waitpid(child, &status, WNOHANG) == 0 && monotonic_ns() < deadline)
+    {
+        served += ServePreviewClients(writer);
+        usleep(1000);
+    }
+    int ret = 0;
+    if (child < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || served != 0)
+    {
+        printf("Preview descriptors were handed to another user, child status 0x%x, served %u\n", status, served);
+        ret = 1;
+    }
+    DestroyPreviewWriter(writer);
+    return ret;
+}
+
+// Needs root to send as another user, skipped otherwise
+int test_worker_control_other_user()
+{
+    if (getuid() != 0)
+    {
+        printf("Not running as root, skipping\n");
+        return 77;
+    }
+    WorkerControl worker = CreateWorkerControl(TEST_CONTROL_NAME);
+    if (!worker)
+    {
+        printf("Failed to open the control channel\n");
+        return 1;
+    }
+    pid_t child = fork();
+    if (child == 0)
+    {
+        if (setgid(TEST_OTHER_USER) != 0 || setuid(TEST_OTHER_USER) != 0)
+            _exit(1);
+        WorkerControl monitor = ConnectWorkerControl(TEST_CONTROL_NAME);
+        WorkerCommand command = { 0 };
+        command.type = WorkerCommandStop;
+        bool sent = monitor && SendWorkerCommand(monitor, &command);
+        CloseWorkerControl(monitor);
+        _exit(sent ? 0 : 1);
+    }
+    int status = 0;
+    int ret = 0;
+    if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        printf("Failed to send as another user\n");
+        ret = 1;
+    }
+    WorkerCommand received[8];
+    if (!ret && PollWorkerCommands(worker, 8, received) != 0)
+    {
+        printf("Accepted a command from another user\n");
+        ret = 1;
+    }
+
+    // The same user still gets through
+    WorkerControl monitor = ConnectWorkerControl(TEST_CONTROL_NAME);
+    WorkerCommand command = { 0 };
+    command.type = WorkerCommandStop;
+    if (!ret && (!monitor || !SendWorkerCommand(monitor, &command) || PollWorkerCommands(worker, 8, received) != 1))
+    {
+        printf("Dropped a command from the same user\n");
+        ret = 1;
+    }
+    CloseWorkerControl(monitor);
+    CloseWorkerControl(worker);
+    return ret;
+}
+
+int test_worker_shader()
+{
+    WorkerControl worker = CreateWorkerControl(TEST_CONTROL_NAME);
+    WorkerControl monitor = worker ? ConnectWorkerControl(TEST_CONTROL_NAME) : NULL;
+    if (!worker || !monitor)
+    {
+        printf("Failed to open the control channel\n");
+        CloseWorkerControl(monitor);
+        CloseWorkerControl(worker);
+        return 1;
+    }
+
+    // Two edits and a header claiming a shader without one, only the last edit survives
+    static uint8_t first[] = "#version 450\nvoid main() {}\n";
+    static uint8_t second[TEST_SHADER_SIZE];
+    for (uint32_t i = 0; i < TEST_SHADER_SIZE; ++i)
+        second[i] = (uint8_t)(i * 7);
+    UpdateGLSLCode code = { sizeof(first), first, UpdateTrackingCompute };
+    int ret = SendWorkerShader(monitor, 1, &code) ? 0 : 1;
+    code.length = TEST_SHADER_SIZE;
+    code.buffer = second;
+    if (!SendWorkerShader(monitor, 2, &code))
+        ret = 1;
+    WorkerCommand empty = { 0 };
+    empty.type = WorkerCommandUpdateShader;
+    empty.shader.length = 16;
+    if (!SendWorkerCommand(monitor, &empty))
+        ret = 1;
+    code.length = WORKER_MAX_SHADER_SIZE + 1;
+    if (SendWorkerShader(monitor, 4, &code))
+    {
+        printf("Oversized shader was sent\n");
+        ret = 1;
+    }
+
+    WorkerCommand received[8];
+    uint32_t count = PollWorkerCommands(worker, 8, received);
+    WorkerSettings settings = { 0 };
+    uint32_t changes = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        changes |= ApplyWorkerCommand(&settings, &received[i]);
+    const UpdateGLSLCode* shader = WorkerControlShader(worker);
+    if (!ret && (count != 2 || changes != WorkerChangedShader))
+    {
+        printf("Received %u shader commands, changes 0x%x\n", count, changes);
+        ret = 1;
+    }
+    if (!ret && (shader == NULL || shader->length != TEST_SHADER_SIZE || shader->purpose != UpdateTrackingCompute ||
+        memcmp(shader->buffer, second, TEST_SHADER_SIZE) != 0))
+    {
+        printf("Latest shader was not kept\n");
+        ret = 1;
+    }
+    CloseWorkerControl(monitor);
+    CloseWorkerControl(worker);
+    return ret;
+}
+
+int test_supervisor_respawn()
+{
+    // A worker that dies before its first frame, like one whose device is gone
+    Supervisor supervisor = CreateSupervisor(TEST_SUPERVISOR_WORKER);
+    WorkerConfig config = { 0 };
+    config.cameraID = 3;
+    snprintf(config.devicePath, sizeof(config.devicePath), "/dev/video-missing");
+    config.cpu = WORKER_NO_CPU;
+    config.settings.width = 640;
+    config.settings.height = 480;
+    config.settings.fps = 60;
+    int index = supervisor ? AddSupervisedCamera(supervisor, &config) : -1;
+    if (index < 0)
+    {
+        printf("Failed to add the camera\n");
+        DestroySupervisor(supervisor);
+        return 1;
+    }
+    SupervisedWorker* worker = &supervisor->workers[index];
+
+    // Settings a previous run switched to live must survive the respawn
+    WorkerSettings published = config.settings;
+    published.fps = 90;
+    PublishWorkerSettings(worker->heartbeat, &published);
+
+    uint64_t start = monotonic_ns();
+    while (monotonic_ns() - start < 500000000ull)
+    {
+        PollSupervisor(supervisor, monotonic_ns());
+        usleep(1000);
+    }
+    int ret = 0;
+    // 100 + 200 ms of backoff fit in the window, 400 more would not
+    if (worker->restarts < 2 || worker->restarts > 3 || worker->backoffNs <= WORKER_RESPAWN_BACKOFF_NS)
+    {
+        printf("Unexpected respawns %u with backoff %lu ns\n", worker->restarts, (unsigned long)worker->backoffNs);
+        ret = 1;
+    }
+    if (worker->config.settings.fps != 90)
+    {
+        printf("Respawned with %u fps instead of the published 90\n", worker->config.settings.fps);
+        ret = 1;
+    }
+    StopSupervisedCamera(supervisor, (uint32_t)index);
+    if (!ret && (worker->pid != 0 || !worker->stopped || PollSupervisor(supervisor, monotonic_ns() + WORKER_RESPAWN_MAX_BACKOFF_NS) != 0))
+    {
+        printf("Stopped worker was respawned\n");
+        ret = 1;
+    }
+    DestroySupervisor(supervisor);
+    return ret;
+}
+
+int test_latency_budget()
+{
+    // The worker and the monitor each record their share of the same camera's board
+    LatencyRecorder worker = CreateLatencyRecorder(TEST_LATENCY_CAMERA, LatencyStageCapture, LatencyStageSend, false);
+    LatencyRecorder monitor = worker ? CreateLatencyRecorder(TEST_LATENCY_CAMERA, LatencyStageSend, LatencyStageOutput, true) : NULL;
+    const LatencyBoard* board = monitor ? OpenLatencyBoard(TEST_LATENCY_CAMERA) : NULL;
+    if (!board)
+    {
+        printf("Failed to open the latency board\n");
+        DestroyLatencyRecorder(monitor);
+        DestroyLatencyRecorder(worker);
+        return 1;
+    }
+
+    // Raw capture frames, 10 ms apart, every 100th one stuck 5 ms longer in the tracker, which
+    // only shows in the maximum of a window of 100 frames
+    uint64_t start = 1000000000ull;
+    for (uint32_t i = 0; i <= TEST_LATENCY_FRAMES; ++i)
+    {
+        uint64_t capture = start + i * 10000000ull;
+        LatencyStamps stamps = { 0 };
+        stamps.stampNs[LatencyStageCapture] = capture;
+        stamps.stampNs[LatencyStageDequeue] = capture + 1000000;
+        stamps.stampNs[LatencyStageTrack] = stamps.stampNs[LatencyStageDequeue] + (i % 100 == 99 ? 7000000 : 2000000);
+        stamps.stampNs[LatencyStageSend] = stamps.stampNs[LatencyStageTrack] + 20000;
+        RecordFrameLatency(worker, &stamps, stamps.stampNs[LatencyStageSend]);
+
+        CoordinateRecord record = make_record(i, 0);
+        record.timestampNs = capture;
+        record.sendDelayNs = (uint32_t)(stamps.stampNs[LatencyStageSend] - capture);
+        LatencyStamps received;
+        LatencyStampsFromRecord(&record, &received);
+        received.stampNs[LatencyStageReceive] = received.stampNs[LatencyStageSend] + 5000;
+        received.stampNs[LatencyStageFusion] = received.stampNs[LatencyStageReceive] + 100000;
+        received.stampNs[LatencyStageOutput] = received.stampNs[LatencyStageFusion] + 50000;
+        RecordFrameLatency(monitor, &received, received.stampNs[LatencyStageOutput]);
+    }
+
+    int ret = 0;
+    LatencySummary summary;
+    struct
+    {
+        uint32_t stage;
+        uint64_t p50Ns;
+        uint64_t maxNs;
+        uint32_t count;
+    } expected[] = {
+        { LatencyStageDequeue, 1000000, 1000000, 100 },
+        { LatencyStageDecode, 0, 0, 0 },
+        { LatencyStageTrack, 2000000, 7000000, 100 },
+        { LatencyStageReceive, 5000, 5000, 100 },
+        { LatencyStageOutput, 50000, 50000, 100 },
+        { LatencyStageCount, 3175000, 8175000, 100 },
+    };
+    for (uint32_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
+    {
+        if (!ReadLatencySummary(board, expected[i].stage, &summary))
+        {
+            printf("Failed to read the %s summary\n", LatencyStageName(expected[i].stage));
+            ret = 1;
+            continue;
+        }
+        // Percentiles are bucket limits, at most one bucket above the true value
+        if (summary.count < expected[i].count || summary.count > expected[i].count + 1 ||
+            summary.p50Ns < expected[i].p50Ns || summary.p50Ns > expected[i].p50Ns + expected[i].p50Ns / 8 ||
+            summary.maxNs != expected[i].maxNs)
+        {
+            printf("Stage %s: %u frames, p50 %lu ns, max %lu ns\n", LatencyStageName(expected[i].stage), summary.count,
+                (unsigned long)summary.p50Ns, (unsigned long)summary.maxNs);
+            ret = 1;
+        }
+    }
+    CloseLatencyBoard(board);
+    DestroyLatencyRecorder(monitor);
+    DestroyLatencyRecorder(worker);
+    return ret;
+}
+
+int main(int argc, char* argv[argc])
+{
+    if (argc > 0)
+    {
+        for (int i = 0; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "test_coordinate_ring") == 0)
+            {
+                return test_coordinate_ring();
+            }
+            if (strcmp(argv[i], "test_coordinate_ring_wakeup") == 0)
+            {
+                return test_coordinate_ring_wakeup();
+            }
+            if (strcmp(argv[i], "test_coordinate_packets_loopback") == 0)
+            {
+                return test_coordinate_packets_loopback();
+            }
+            if (strcmp(argv[i], "test_preview_channel") == 0)
+            {
+                return test_preview_channel();
+            }
+            if (strcmp(argv[i], "test_worker_control") == 0)
+            {
+                return test_worker_control();
+            }
+            if (strcmp(argv[i], "test_preview_channel_other_user") == 0)
+            {
+                return test_preview_channel_other_user();
+            }
+            if (strcmp(argv[i], "test_worker_control_other_user") == 0)
+            {
+                return test_worker_control_other_user();
+            }
+            if (strcmp(argv[i], "test_worker_shader") == 0)
+            {
+                return test_worker_shader();
+            }
+            if (strcmp(argv[i], "test_supervisor_respawn") == 0)
+            {
+                return test_supervisor_respawn();
+            }
+            if (strcmp(argv[i], "test_latency_budget") == 0)
+            {
+                return test_latency_budget();
+            }
+        }
+    }
+    else
+    {
+        printf("Please specify which test to run.\n");
+    }
+    return 0;
+}
@@ -0,0 +1,970 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "vulkanmanager.h"
+#include "framegraph.h"
+#include "gpuprofiler.h"
+#include "shaders.h"
+#include "computebackend.h"
+
+// Exit code meson reports as a skipped test, used when the machine has no Vulkan device.
+// Set VRWEBTRACK_VULKAN_CPU=1 to run the tests on lavapipe.
+#define TEST_SKIP 77
+#define TEST_BUFFER_SIZE 4096
+#define TEST_SUBMISSIONS (2 * MAX_FRAMES_IN_FLIGHT + 1)
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 48
+
+// Temporary file for the pipeline cache, so the tests never touch the user's cache directory
+static int make_temp_path(char* path, size_t size)
+{
+    const char* directory = getenv("TMPDIR");
+    snprintf(path, size, "%s/vrwebtrack-test-XXXXXX", directory && directory[0] != '\0' ? directory : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+static ComputeApplication create_test_application(const char* pipelineCachePath)
+{
+    ComputeApplicationCreateInfo info = {
+        .deviceOverride = NULL,
+        .forceCPUDevice = false,
+        .pipelineCachePath = pipelineCachePath
+    };
+    ComputeApplication app = initializeComputeApplicationWithInfo(&info);
+    if (app == NULL)
+        printf("No usable Vulkan device, skipping\n");
+    return app;
+}
+
+static void destroy_test_application(ComputeApplication app)
+{
+    CleanUpVulkan(app);
+    free(app);
+}
+
+static CommandBuffer create_empty_command_buffer(ComputeApplication app)
+{
+    CommandBuffer cmdbuf = CreateCommandBuffer(app);
+    BeginCommand(cmdbuf);
+    EndCommand(cmdbuf);
+    return cmdbuf;
+}
+
+int test_vulkan_tickets()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplication app = create_test_application(cachePath);
+    if (app == NULL)
+    {
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+
+    int ret = 0;
+    // Ticket 0 is what an unused frame slot holds, waiting on it must not block
+    if (!IsComputeTicketComplete(app, 0) || !WaitForComputeTicket(app, 0, 0))
+    {
+        printf("Ticket 0 is not complete\n");
+        ret = 1;
+    }
+    ComputeTicket unsubmitted = app->lastSubmittedTicket + 1;
+    if (IsComputeTicketComplete(app, unsubmitted) || WaitForComputeTicket(app, unsubmitted, 0))
+    {
+        printf("Ticket %lu completed before it was submitted\n", (unsigned long)unsubmitted);
+        ret = 1;
+    }
+
+    // Two command buffers in turns, more submissions than the fence pool holds
+    CommandBuffer cmdbufs[2] = { create_empty_command_buffer(app), create_empty_command_buffer(app) };
+    ComputeTicket tickets[TEST_SUBMISSIONS] = { 0 };
+    for (uint32_t i = 0; i < TEST_SUBMISSIONS && !ret; ++i)
+    {
+        // A command buffer may only be resubmitted once its previous submission completed
+        if (i >= 2 && !WaitForComputeTicket(app, tickets[i - 2], UINT64_MAX))
+        {
+            printf("Waiting for ticket %lu failed\n", (unsigned long)tickets[i - 2]);
+            ret = 1;
+            break;
+        }
+        tickets[i] = SubmitCommandBufferAsync(app, cmdbufs[i % 2]);
+        if (tickets[i] == 0 || (i > 0 && tickets[i] <= tickets[i - 1]))
+        {
+            printf("Submission %u returned ticket %lu after %lu\n", i, (unsigned long)tickets[i], i > 0 ? (unsigned long)tickets[i - 1] : 0ul);
+            ret = 1;
+        }
+    }
+    if (!ret && !WaitForComputeTicket(app, tickets[TEST_SUBMISSIONS - 1], UINT64_MAX))
+    {
+        printf("Waiting for the last ticket failed\n");
+        ret = 1;
+    }
+    // Completing a ticket completes every earlier one
+    for (uint32_t i = 0; i < TEST_SUBMISSIONS && !ret; ++i)
+    {
+        if (!IsComputeTicketComplete(app, tickets[i]))
+        {
+            printf("Ticket %lu is not complete after a later ticket completed\n", (unsigned long)tickets[i]);
+            ret = 1;
+        }
+    }
+    if (!ret && app->lastCompletedTicket < tickets[TEST_SUBMISSIONS - 1])
+    {
+        printf("Last completed ticket %lu is behind %lu\n", (unsigned long)app->lastCompletedTicket, (unsigned long)tickets[TEST_SUBMISSIONS - 1]);
+        ret = 1;
+    }
+    DestroyCommandBuffer(app, cmdbufs[0]);
+    DestroyCommandBuffer(app, cmdbufs[1]);
+    destroy_test_application(app);
+    unlink(cachePath);
+    return ret;
+}
+
+int test_vulkan_memory_allocator()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplication app = create_test_application(cachePath);
+    if (app == NULL)
+    {
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+
+    int ret = 0;
+    MemoryAllocator allocator = app->memoryAllocator;
+    // Whole pages, so no alignment padding sits between neighbouring sub-allocations
+    Buffer buffers[4];
+    for (uint32_t i = 0; i < 4; ++i)
+        buffers[i] = CreateBuffer(app, "test", ReadAndWriteBufferType, TEST_BUFFER_SIZE, i);
+    MemoryBlock block = buffers[0] ? buffers[0]->allocation.block : NULL;
+    uint32_t sharedBlockCount = allocator->blockCount;
+    for (uint32_t i = 0; i < 4 && !ret; ++i)
+    {
+        if (buffers[i] == NULL || buffers[i]->mapped == NULL || buffers[i]->allocation.block != block || buffers[i]->memory != block->memory)
+        {
+            printf("Buffer %u is not a mapped sub-allocation of the shared block\n", i);
+            ret = 1;
+        }
+    }
+    if (!ret && block->liveAllocations != 4)
+    {
+        printf("Shared block holds %u allocations, expected 4\n", block->liveAllocations);
+        ret = 1;
+    }
+    // Sub-allocations must not overlap, fill each and check none was overwritten
+    for (uint32_t i = 0; i < 4 && !ret; ++i)
+        memset(buffers[i]->mapped, 0x10 + i, TEST_BUFFER_SIZE);
+    for (uint32_t i = 0; i < 4 && !ret; ++i)
+    {
+        const uint8_t* bytes = (const uint8_t*)buffers[i]->mapped;
+        for (uint32_t j = 0; j < TEST_BUFFER_SIZE; ++j)
+        {
+            if (bytes[j] != 0x10 + i)
+            {
+                printf("Buffer %u byte %u was overwritten with 0x%02x\n", i, j, bytes[j]);
+                ret = 1;
+                break;
+            }
+        }
+    }
+
+    // Freeing two neighbours coalesces them, a buffer of both sizes fits where the first was
+    VkDeviceSize freedOffset = ret ? 0 : buffers[1]->allocation.offset;
+    if (!ret)
+    {
+        DestroyBuffer(app, buffers[1]);
+        DestroyBuffer(app, buffers[2]);
+        buffers[1] = buffers[2] = NULL;
+        if (block->liveAllocations != 2 || block->freeRangeCount != 1 || block->freeRanges[0].offset != freedOffset ||
+            block->freeRanges[0].size < 2 * TEST_BUFFER_SIZE)
+        {
+            printf("Freed ranges were not coalesced: %u live allocations, %u free ranges\n", block->liveAllocations, block->freeRangeCount);
+            ret = 1;
+        }
+    }
+    if (!ret)
+    {
+        buffers[1] = CreateBuffer(app, "test", ReadAndWriteBufferType, 2 * TEST_BUFFER_SIZE, 1);
+        if (buffers[1] == NULL || buffers[1]->allocation.block != block || buffers[1]->allocation.offset != freedOffset)
+        {
+            printf("Freed range at %lu was not reused\n", (unsigned long)freedOffset);
+            ret = 1;
+        }
+    }
+
+    // Requests over half a block get their own block, returned as soon as the buffer goes
+    if (!ret)
+    {
+        Buffer large = CreateBuffer(app, "large", ReadAndWriteBufferType, allocator->blockSize / 2 + 1, 4);
+        if (large == NULL || !large->allocation.block->dedicated || large->memory == block->memory || allocator->blockCount != sharedBlockCount + 1)
+        {
+            printf("Large buffer did not get a dedicated block\n");
+            ret = 1;
+        }
+        DestroyBuffer(app, large);
+        if (!ret && allocator->blockCount != sharedBlockCount)
+        {
+            printf("Dedicated block was not freed\n");
+            ret = 1;
+        }
+    }
+
+    // The last shared block of a memory type is kept around empty for the next frame's buffers
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if (buffers[i])
+            DestroyBuffer(app, buffers[i]);
+    }
+    if (!ret && (allocator->blockCount != sharedBlockCount || block->liveAllocations != 0 || block->linearOffset != 0))
+    {
+        printf("Empty shared block was freed or not reset\n");
+        ret = 1;
+    }
+    destroy_test_application(app);
+    unlink(cachePath);
+    return ret;
+}
+
+static void fill_pattern(uint8_t* data, size_t size, uint8_t seed)
+{
+    for (size_t i = 0; i < size; ++i)
+        data[i] = (uint8_t)(seed + i * 7);
+}
+
+static int read_back(ComputeApplication app, CommandBuffer cmdbuf, Buffer src, Buffer readback, uint8_t* out)
+{
+    ResetCommand(cmdbuf);
+    BeginCommand(cmdbuf);
+    AddCopyBufferToCommandBufferQueue(cmdbuf, src, readback, TEST_BUFFER_SIZE);
+    EndCommand(cmdbuf);
+    ComputeTicket ticket = SubmitCommandBufferAsync(app, cmdbuf);
+    if (!WaitForComputeTicket(app, ticket, UINT64_MAX))
+        return 1;
+    CopyBufferToData(app, readback, TEST_BUFFER_SIZE, out);
+    return 0;
+}
+
+int test_vulkan_staging_ring()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplication app = create_test_application(cachePath);
+    if (app == NULL)
+    {
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+
+    int ret = 0;
+    Buffer deviceBuffer = CreateBuffer(app, "device", DeviceLocalBufferType, TEST_BUFFER_SIZE, 0);
+    Buffer readback = CreateBuffer(app, "readback", ReadAndWriteBufferType, TEST_BUFFER_SIZE, 1);
+    StagingRing ring = CreateStagingRing(app, TEST_BUFFER_SIZE, 2);
+    CommandBuffer cmdbuf = CreateCommandBuffer(app);
+    static uint8_t first[TEST_BUFFER_SIZE], second[TEST_BUFFER_SIZE], expected[TEST_BUFFER_SIZE], result[TEST_BUFFER_SIZE];
+    fill_pattern(first, sizeof(first), 1);
+    fill_pattern(second, sizeof(second), 2);
+    if (deviceBuffer == NULL || readback == NULL || ring == NULL)
+    {
+        printf("Failed to create the buffers or the staging ring\n");
+        ret = 1;
+    }
+
+    // The upload is submitted ahead of the next compute submission, which sees the data
+    if (!ret && (!StagingRingUpload(app, ring, deviceBuffer, 0, TEST_BUFFER_SIZE, first) ||
+        read_back(app, cmdbuf, deviceBuffer, readback, result) || memcmp(result, first, TEST_BUFFER_SIZE) != 0))
+    {
+        printf("Whole buffer upload did not arrive\n");
+        ret = 1;
+    }
+    if (!ret && StagingRingUpload(app, ring, deviceBuffer, 0, TEST_BUFFER_SIZE + 1, first))
+    {
+        printf("Upload larger than a slot was accepted\n");
+        ret = 1;
+    }
+
+    // Both slots are free again, a third upload before any submission finds the ring full
+    if (!ret && (!StagingRingUpload(app, ring, deviceBuffer, 0, TEST_BUFFER_SIZE / 2, second) ||
+        !StagingRingUpload(app, ring, deviceBuffer, TEST_BUFFER_SIZE / 2, TEST_BUFFER_SIZE / 2, second + TEST_BUFFER_SIZE / 2)))
+    {
+        printf("Uploads into both slots failed\n");
+        ret = 1;
+    }
+    if (!ret && StagingRingUpload(app, ring, deviceBuffer, 0, TEST_BUFFER_SIZE, first))
+    {
+        printf("Upload into a slot still in flight was accepted\n");
+        ret = 1;
+    }
+    memcpy(expected, second, TEST_BUFFER_SIZE);
+    if (!ret && (read_back(app, cmdbuf, deviceBuffer, readback, result) || memcmp(result, expected, TEST_BUFFER_SIZE) != 0))
+    {
+        printf("Uploads at an offset did not arrive\n");
+        ret = 1;
+    }
+    // The consumer completed, so the slots are reusable
+    if (!ret && !StagingRingUpload(app, ring, deviceBuffer, 0, TEST_BUFFER_SIZE, first))
+    {
+        printf("Slot was not released after its consumer completed\n");
+        ret = 1;
+    }
+    if (!ret && (read_back(app, cmdbuf, deviceBuffer, readback, result) || memcmp(result, first, TEST_BUFFER_SIZE) != 0))
+    {
+        printf("Upload into a reused slot did not arrive\n");
+        ret = 1;
+    }
+
+    DestroyCommandBuffer(app, cmdbuf);
+    DestroyStagingRing(app, ring);
+    DestroyBuffer(app, readback);
+    DestroyBuffer(app, deviceBuffer);
+    destroy_test_application(app);
+    unlink(cachePath);
+    return ret;
+}
+
+typedef struct TestFillPass
+{
+    Buffer buffer;
+    uint32_t value;
+} TestFillPass;
+
+typedef struct TestCopyPass
+{
+    Buffer src;
+    Buffer dst;
+} TestCopyPass;
+
+static void record_fill(CommandBuffer cmdbuf, void* userData)
+{
+    TestFillPass* pass = (TestFillPass*)userData;
+    vkCmdFillBuffer(cmdbuf->cmdbuffer, pass->buffer->buffer, 0, VK_WHOLE_SIZE, pass->value);
+}
+
+static void record_copy(CommandBuffer cmdbuf, void* userData)
+{
+    TestCopyPass* pass = (TestCopyPass*)userData;
+    VkBufferCopy region = { .srcOffset = 0, .dstOffset = 0, .size = TEST_BUFFER_SIZE };
+    vkCmdCopyBuffer(cmdbuf->cmdbuffer, pass->src->buffer, pass->dst->buffer, 1, &region);
+}
+
+static int check_words(const Buffer buffer, uint32_t value)
+{
+    const uint32_t* words = (const uint32_t*)buffer->mapped;
+    for (uint32_t i = 0; i < TEST_BUFFER_SIZE / sizeof(uint32_t); ++i)
+    {
+        if (words[i] != value)
+        {
+            printf("%s word %u is 0x%08x, expected 0x%08x\n", buffer->name, i, words[i], value);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Builds a two slot graph that fills a shared device buffer and copies it into a host
+ * visible buffer per slot, the fill of one slot has to wait for the copy of the other.
+ */
+static FrameGraph create_test_graph(ComputeApplication app, TestFillPass* fill, TestCopyPass copies[2], Buffer readbacks[2])
+{
+    FrameGraph graph = CreateFrameGraph(app, 2);
+    if (graph == NULL)
+        return NULL;
+    FrameGraphBufferAccess fillAccess = { fill->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+    bool ok = FrameGraphAddPass(graph, "fill", record_fill, fill, 1, &fillAccess);
+    for (uint32_t frame = 0; frame < 2; ++frame)
+    {
+        copies[frame] = (TestCopyPass){ fill->buffer, readbacks[frame] };
+        FrameGraphBufferAccess copyAccesses[2] = {
+            { fill->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT },
+            { readbacks[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT }
+        };
+        FrameGraphBufferAccess hostAccess = { readbacks[frame], VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT };
+        ok = ok && FrameGraphAddFramePass(graph, "copy", record_copy, &copies[frame], frame, 2, copyAccesses) &&
+            FrameGraphAddFramePass(graph, "readback", NULL, NULL, frame, 1, &hostAccess);
+    }
+    if (!ok)
+    {
+        DestroyFrameGraph(graph);
+        return NULL;
+    }
+    return graph;
+}
+
+static int submit_and_check(FrameGraph graph, uint32_t expectedFrame, Buffer readbacks[2], uint32_t value)
+{
+    uint32_t frame = FrameGraphAcquireFrame(graph);
+    if (frame != expectedFrame)
+    {
+        printf("Acquired frame slot %u, expected %u\n", frame, expectedFrame);
+        return 1;
+    }
+    ComputeTicket ticket = FrameGraphSubmit(graph);
+    if (!WaitForComputeTicket(graph->app, ticket, UINT64_MAX))
+    {
+        printf("Frame graph submission %lu did not complete\n", (unsigned long)ticket);
+        return 1;
+    }
+    return check_words(readbacks[frame], value);
+}
+
+int test_vulkan_frame_graph()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplication app = create_test_application(cachePath);
+    if (app == NULL)
+    {
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+
+    int ret = 0;
+    TestFillPass fill = { CreateBuffer(app, "shared", DeviceLocalBufferType, TEST_BUFFER_SIZE, 0), 0x11111111u };
+    Buffer readbacks[2] = {
+        CreateBuffer(app, "readback 0", ReadAndWriteBufferType, TEST_BUFFER_SIZE, 1),
+        CreateBuffer(app, "readback 1", ReadAndWriteBufferType, TEST_BUFFER_SIZE, 2)
+    };
+    TestCopyPass copies[2];
+    FrameGraph graph = create_test_graph(app, &fill, copies, readbacks);
+    if (graph == NULL)
+    {
+        printf("Failed to create the frame graph\n");
+        ret = 1;
+    }
+    FrameGraphBufferAccess access = { fill.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+    if (!ret && (FrameGraphAddFramePass(graph, "out of range", NULL, NULL, 2, 1, &access) ||
+        FrameGraphAddPass(graph, "too many accesses", NULL, NULL, MAX_FRAME_GRAPH_ACCESSES + 1, &access)))
+    {
+        printf("Frame graph accepted an invalid pass\n");
+        ret = 1;
+    }
+
+    // Slots alternate and each slot is recorded on first use
+    if (!ret)
+        ret = submit_and_check(graph, 0, readbacks, 0x11111111u);
+    if (!ret)
+        ret = submit_and_check(graph, 1, readbacks, 0x11111111u);
+    // Recorded commands are resubmitted as is until the graph is invalidated
+    fill.value = 0x22222222u;
+    if (!ret)
+        ret = submit_and_check(graph, 0, readbacks, 0x11111111u);
+    FrameGraphInvalidate(graph);
+    if (!ret)
+        ret = submit_and_check(graph, 1, readbacks, 0x22222222u);
+    if (!ret)
+        ret = submit_and_check(graph, 0, readbacks, 0x22222222u);
+
+    DestroyFrameGraph(graph);
+    DestroyBuffer(app, readbacks[0]);
+    DestroyBuffer(app, readbacks[1]);
+    DestroyBuffer(app, fill.buffer);
+    destroy_test_application(app);
+    unlink(cachePath);
+    return ret;
+}
+
+int test_vulkan_gpu_profiler()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplication app = create_test_application(cachePath);
+    if (app == NULL)
+    {
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+    GpuProfiler profiler = CreateGpuProfiler(app, 2);
+    if (profiler == NULL || !profiler->supported)
+    {
+        printf("Device has no timestamp queries, skipping\n");
+        DestroyGpuProfiler(profiler);
+        destroy_test_application(app);
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+
+    int ret = 0;
+    TestFillPass fill = { CreateBuffer(app, "shared", DeviceLocalBufferType, TEST_BUFFER_SIZE, 0), 0x33333333u };
+    Buffer readbacks[2] = {
+        CreateBuffer(app, "readback 0", ReadAndWriteBufferType, TEST_BUFFER_SIZE, 1),
+        CreateBuffer(app, "readback 1", ReadAndWriteBufferType, TEST_BUFFER_SIZE, 2)
+    };
+    TestCopyPass copies[2];
+    FrameGraph graph = create_test_graph(app, &fill, copies, readbacks);
+    if (graph == NULL || !FrameGraphSetProfiler(graph, profiler))
+    {
+        printf("Failed to create the profiled frame graph\n");
+        ret = 1;
+    }
+    for (uint32_t i = 0; i < TEST_SUBMISSIONS && !ret; ++i)
+        ret = submit_and_check(graph, i % 2, readbacks, 0x33333333u);
+    // Every submission of every slot yields one sample per timed pass, a pass without commands is not timed
+    GpuProfilerCollect(profiler);
+    const char* stages[2] = { "fill", "copy" };
+    for (uint32_t i = 0; i < 2 && !ret; ++i)
+    {
+        GpuProfilerSummary summary = { 0 };
+        if (!GpuProfilerGetSummary(profiler, GpuProfilerStage(profiler, stages[i]), &summary) || summary.sampleCount != TEST_SUBMISSIONS)
+        {
+            printf("Stage %s has %u samples, expected %u\n", stages[i], summary.sampleCount, TEST_SUBMISSIONS);
+            ret = 1;
+        }
+    }
+    if (!ret && profiler->stageCount != 2)
+    {
+        printf("Profiler has %u stages, expected 2\n", profiler->stageCount);
+        ret = 1;
+    }
+
+    DestroyFrameGraph(graph);
+    DestroyGpuProfiler(profiler);
+    DestroyBuffer(app, readbacks[0]);
+    DestroyBuffer(app, readbacks[1]);
+    DestroyBuffer(app, fill.buffer);
+    destroy_test_application(app);
+    unlink(cachePath);
+    return ret;
+}
+
+// Statistics only, runs without a device
+int test_gpu_profiler_statistics()
+{
+    struct GpuProfiler profiler;
+    memset(&profiler, 0, sizeof(profiler));
+    profiler.timestampPeriod = 2.0;
+    uint32_t stage = GpuProfilerStage(&profiler, "stage");
+    if (stage != 0 || GpuProfilerStage(&profiler, "stage") != stage)
+    {
+        printf("Stage was registered twice\n");
+        return 1;
+    }
+    // 200 samples of 1 to 200 ns, the window keeps the last PROFILER_HISTORY_LENGTH of them
+    for (uint64_t i = 1; i <= 200; ++i)
+        GpuProfilerAddSample(&profiler, stage, i);
+    GpuProfilerSummary summary;
+    uint64_t first = 200 - PROFILER_HISTORY_LENGTH + 1;
+    if (!GpuProfilerGetSummary(&profiler, stage, &summary) || summary.sampleCount != PROFILER_HISTORY_LENGTH ||
+        summary.lastNs != 200 || summary.minNs != first || summary.maxNs != 200 ||
+        summary.meanNs != (first + 200) / 2 || summary.p95Ns != first + (PROFILER_HISTORY_LENGTH - 1) * 95 / 100)
+    {
+        printf("Got %u samples, last %lu, min %lu, max %lu, mean %lu, p95 %lu\n", summary.sampleCount, (unsigned long)summary.lastNs,
+            (unsigned long)summary.minNs, (unsigned long)summary.maxNs, (unsigned long)summary.meanNs, (unsigned long)summary.p95Ns);
+        return 1;
+    }
+    // A 36-bit counter wrapping between the two timestamps
+    uint64_t mask = (1ull << 36) - 1;
+    uint64_t nanoseconds = GpuProfilerTicksToNanoseconds(&profiler, mask - 9, 5, mask);
+    if (nanoseconds != 30)
+    {
+        printf("Wrapped timestamps gave %lu ns, expected 30\n", (unsigned long)nanoseconds);
+        return 1;
+    }
+    return 0;
+}
+
+static size_t pipeline_cache_data_size(ComputeApplication app)
+{
+    size_t size = 0;
+    if (vkGetPipelineCacheData(app->device, app->pipelineCache, &size, NULL) != VK_SUCCESS)
+        return 0;
+    return size;
+}
+
+// Builds the tracker pipelines so the driver has something to cache
+static int create_test_pipelines(ComputeApplication app)
+{
+    ShaderCode shader = GetBuiltinShader(BlobCentroidShaderForDevice(app));
+    BlobTracker tracker = CreateBlobTracker(app, TEST_WIDTH, TEST_HEIGHT, TrackingPixelFormatRGB24, 2, shader.code, shader.size, NULL, 0);
+    ReleaseShaderCode(&shader);
+    if (tracker == NULL)
+    {
+        printf("Failed to create the blob tracker\n");
+        return 1;
+    }
+    DestroyBlobTracker(app, tracker);
+    return 0;
+}
+
+static long file_size(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+static int corrupt_file(const char* path, bool shorten)
+{
+    long size = file_size(path);
+    if (size <= 0)
+        return 1;
+    if (shorten)
+        return truncate(path, size - 1) != 0;
+    // Flip the last byte of the driver blob, covered by the checksum
+    FILE* fp = fopen(path, "r+b");
+    if (fp == NULL)
+        return 1;
+    fseek(fp, size - 1, SEEK_SET);
+    int byte = fgetc(fp);
+    fseek(fp, size - 1, SEEK_SET);
+    fputc(byte ^ 0xFF, fp);
+    return fclose(fp) != 0;
+}
+
+int test_vulkan_pipeline_cache()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    // An empty file is ignored like a missing one
+    ComputeApplication app = create_test_application(cachePath);
+    if (app == NULL)
+    {
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+    size_t emptyDataSize = pipeline_cache_data_size(app);
+    int ret = create_test_pipelines(app);
+    size_t savedDataSize = pipeline_cache_data_size(app);
+    destroy_test_application(app);
+    long savedFileSize = file_size(cachePath);
+    if (!ret && (savedDataSize == 0 || savedFileSize <= (long)savedDataSize))
+    {
+        printf("Pipeline cache of %zu bytes was saved as %ld bytes\n", savedDataSize, savedFileSize);
+        ret = 1;
+    }
+    long headerSize = savedFileSize - (long)savedDataSize;
+
+    // A valid file is handed to the driver
+    app = ret ? NULL : create_test_application(cachePath);
+    if (!ret && (app == NULL || pipeline_cache_data_size(app) != savedDataSize))
+    {
+        printf("Saved pipeline cache was not loaded\n");
+        ret = 1;
+    }
+    if (app)
+        destroy_test_application(app);
+
+    // Damaged files are discarded, the device still comes up and the file is rewritten whole
+    for (int truncated = 0; truncated < 2 && !ret; ++truncated)
+    {
+        if (corrupt_file(cachePath, truncated))
+        {
+            printf("Failed to damage %s\n", cachePath);
+            ret = 1;
+            break;
+        }
+        app = create_test_application(cachePath);
+        if (app == NULL)
+        {
+            printf("Device did not come up with a %s pipeline cache\n", truncated ? "truncated" : "corrupted");
+            ret = 1;
+            break;
+        }
+        size_t dataSize = pipeline_cache_data_size(app);
+        if (dataSize != emptyDataSize)
+        {
+            printf("%s pipeline cache was loaded\n", truncated ? "Truncated" : "Corrupted");
+            ret = 1;
+        }
+        ret |= create_test_pipelines(app);
+        dataSize = pipeline_cache_data_size(app);
+        destroy_test_application(app);
+        if (!ret && file_size(cachePath) != headerSize + (long)dataSize)
+        {
+            printf("Pipeline cache was not rewritten after discarding a damaged file\n");
+            ret = 1;
+        }
+    }
+    unlink(cachePath);
+    return ret;
+}
+
+static void draw_test_markers(uint8_t* frame, uint32_t shift)
+{
+    static const uint8_t red[3] = { 230, 20, 20 };
+    static const uint8_t purple[3] = { 170, 10, 80 };
+    memset(frame, 0, TEST_WIDTH * TEST_HEIGHT * 3);
+    for (uint32_t y = 8; y < 14; ++y)
+    {
+        for (uint32_t x = 8 + shift; x < 12 + shift + (y & 1); ++x)
+            memcpy(frame + ((size_t)y * TEST_WIDTH + x) * 3, red, 3);
+    }
+    for (uint32_t i = 0; i < 5; ++i)
+        memcpy(frame + ((size_t)(30 + i) * TEST_WIDTH + 40 + shift + i / 2) * 3, purple, 3);
+    // A stray red pixel, only inside the whole frame window
+    memcpy(frame + ((size_t)45 * TEST_WIDTH + 60) * 3, red, 3);
+}
+
+static BackendTracker create_backend_tracker(ComputeBackend backend, enum TrackingPixelFormat pixelFormat)
+{
+    BackendTracker tracker = CreateBackendTracker(backend, TEST_WIDTH, TEST_HEIGHT, pixelFormat, 2);
+    if (tracker)
+    {
+        // Marker 1's range contains marker 0's, red belongs to marker 0 on both backends.
+        // Converted with ConvertMarkerColorRangeToYUV for YUV frames.
+        BackendTrackerSetMarkerColor(tracker, 0, (MarkerColorRange){ 200, 0, 0, 255, 50, 50 });
+        BackendTrackerSetMarkerColor(tracker, 1, (MarkerColorRange){ 150, 0, 0, 255, 50, 100 });
+    }
+    return tracker;
+}
+
+// A 2x2 red block at (10, 10) and a 4x2 purple block at (40, 30), aligned so every pair and 2x2
+// block of pixels sharing chroma has a single colour
+static void draw_aligned_markers(uint8_t* frame)
+{
+    static const uint8_t red[3] = { 230, 20, 20 };
+    static const uint8_t purple[3] = { 170, 10, 80 };
+    memset(frame, 0, TEST_WIDTH * TEST_HEIGHT * 3);
+    for (uint32_t y = 0; y < 2; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            if (x < 2)
+                memcpy(frame + ((size_t)(10 + y) * TEST_WIDTH + 10 + x) * 3, red, 3);
+            memcpy(frame + ((size_t)(30 + y) * TEST_WIDTH + 40 + x) * 3, purple, 3);
+        }
+    }
+}
+
+/**
+ * @brief Encodes an RGB frame as BT.601 limited range YUYV or NV12, chroma taken from the first
+ * pixel sharing it, which is exact for frames drawn by draw_aligned_markers.
+ */
+static size_t encode_yuv_frame(const uint8_t* rgb, enum TrackingPixelFormat pixelFormat, uint8_t* out)
+{
+    for (uint32_t y = 0; y < TEST_HEIGHT; ++y)
+    {
+        for (uint32_t x = 0; x < TEST_WIDTH; ++x)
+        {
+            const uint8_t* pixel = rgb + ((size_t)y * TEST_WIDTH + x) * 3;
+            // The YUV box of a single colour is that colour's YUV value
+            MarkerColorRange yuv = ConvertMarkerColorRangeToYUV((MarkerColorRange){ pixel[0], pixel[1], pixel[2], pixel[0], pixel[1], pixel[2] });
+            if (pixelFormat == TrackingPixelFormatYUYV)
+            {
+                uint8_t* pair = out + ((size_t)y * TEST_WIDTH + (x & ~1u)) * 2;
+                pair[(x & 1) * 2] = yuv.minR;
+                if ((x & 1) == 0)
+                {
+                    pair[1] = yuv.minG;
+                    pair[3] = yuv.minB;
+                }
+            }
+            else
+            {
+                out[(size_t)y * TEST_WIDTH + x] = yuv.minR;
+                if ((x & 1) == 0 && (y & 1) == 0)
+                {
+                    uint8_t* chroma = out + (size_t)TEST_WIDTH * TEST_HEIGHT + (size_t)(y / 2) * TEST_WIDTH + x;
+                    chroma[0] = yuv.minG;
+                    chroma[1] = yuv.minB;
+                }
+            }
+        }
+    }
+    return TrackingFrameSize(TEST_WIDTH, TEST_HEIGHT, pixelFormat);
+}
+
+static int compare_centroids(uint32_t frame, uint32_t marker, const MarkerCentroid* vulkan, const MarkerCentroid* cpu)
+{
+    if (vulkan->found != cpu->found || vulkan->pixelCount != cpu->pixelCount ||
+        fabsf(vulkan->x - cpu->x) > 1e-3f || fabsf(vulkan->y - cpu->y) > 1e-3f ||
+        vulkan->minX != cpu->minX || vulkan->minY != cpu->minY || vulkan->maxX != cpu->maxX || vulkan->maxY != cpu->maxY)
+    {
+        printf("Frame %u marker %u: Vulkan %u pixels at (%f, %f) in [%u, %u]-[%u, %u], CPU %u at (%f, %f) in [%u, %u]-[%u, %u]\n",
+            frame, marker, vulkan->pixelCount, vulkan->x, vulkan->y, vulkan->minX, vulkan->minY, vulkan->maxX, vulkan->maxY,
+            cpu->pixelCount, cpu->x, cpu->y, cpu->minX, cpu->minY, cpu->maxX, cpu->maxY);
+        return 1;
+    }
+    return 0;
+}
+
+int test_vulkan_backend_matches_cpu()
+{
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplicationCreateInfo info = { .deviceOverride = NULL, .forceCPUDevice = false, .pipelineCachePath = cachePath };
+    ComputeBackend vulkanBackend = CreateComputeBackend(ComputeBackendVulkan, &info);
+    if (vulkanBackend == NULL)
+    {
+        printf("No usable Vulkan device, skipping\n");
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+    ComputeBackend cpuBackend = CreateComputeBackend(ComputeBackendCPU, NULL);
+    BackendTracker trackers[2] = { create_backend_tracker(vulkanBackend, TrackingPixelFormatRGB24), cpuBackend ? create_backend_tracker(cpuBackend, TrackingPixelFormatRGB24) : NULL };
+    int ret = 0;
+    if (trackers[0] == NULL || trackers[1] == NULL)
+    {
+        printf("Failed to create the trackers\n");
+        ret = 1;
+    }
+
+    // Whole frames first, then windows predicted from the previous frame as the markers move
+    static uint8_t frame[TEST_WIDTH * TEST_HEIGHT * 3];
+    for (uint32_t i = 0; i < 4 && !ret; ++i)
+    {
+        if (i == 1)
+        {
+            BackendTrackerSetRoiMargin(trackers[0], 4);
+            BackendTrackerSetRoiMargin(trackers[1], 4);
+        }
+        draw_test_markers(frame, i);
+        MarkerCentroid centroids[2][2];
+        for (uint32_t t = 0; t < 2 && !ret; ++t)
+        {
+            if (!BackendTrackerSubmitFrame(trackers[t], frame, sizeof(frame)) || !BackendTrackerCollectResults(trackers[t], true, centroids[t]))
+            {
+                printf("Failed to track frame %u on the %s backend\n", i, t == 0 ? "Vulkan" : "CPU");
+                ret = 1;
+            }
+        }
+        for (uint32_t marker = 0; marker < 2 && !ret; ++marker)
+            ret = compare_centroids(i, marker, &centroids[0][marker], &centroids[1][marker]);
+    }
+
+    DestroyBackendTracker(trackers[0]);
+    DestroyBackendTracker(trackers[1]);
+    DestroyComputeBackend(vulkanBackend);
+    DestroyComputeBackend(cpuBackend);
+    unlink(cachePath);
+    return ret;
+}
+
+int test_vulkan_backend_yuv_formats()
+{
+    static const enum TrackingPixelFormat formats[] = { TrackingPixelFormatRGB24, TrackingPixelFormatYUYV, TrackingPixelFormatNV12 };
+    static const char* names[] = { "RGB24", "YUYV", "NV12" };
+    // The centroids of draw_aligned_markers' blocks
+    static const MarkerCentroid expected[2] = {
+        { .found = true, .pixelCount = 4, .x = 10.5f, .y = 10.5f, .minX = 10, .minY = 10, .maxX = 11, .maxY = 11 },
+        { .found = true, .pixelCount = 8, .x = 41.5f, .y = 30.5f, .minX = 40, .minY = 30, .maxX = 43, .maxY = 31 },
+    };
+    char cachePath[256];
+    if (make_temp_path(cachePath, sizeof(cachePath)))
+        return 1;
+    ComputeApplicationCreateInfo info = { .deviceOverride = NULL, .forceCPUDevice = false, .pipelineCachePath = cachePath };
+    ComputeBackend vulkanBackend = CreateComputeBackend(ComputeBackendVulkan, &info);
+    if (vulkanBackend == NULL)
+    {
+        printf("No usable Vulkan device, skipping\n");
+        unlink(cachePath);
+        return TEST_SKIP;
+    }
+    ComputeBackend cpuBackend = CreateComputeBackend(ComputeBackendCPU, NULL);
+    static uint8_t rgb[TEST_WIDTH * TEST_HEIGHT * 3];
+    static uint8_t yuv[TEST_WIDTH * TEST_HEIGHT * 2];
+    draw_aligned_markers(rgb);
+    int ret = cpuBackend ? 0 : 1;
+    for (uint32_t f = 0; f < 3 && !ret; ++f)
+    {
+        BackendTracker trackers[2] = { create_backend_tracker(vulkanBackend, formats[f]), create_backend_tracker(cpuBackend, formats[f]) };
+        if (trackers[0] == NULL || trackers[1] == NULL)
+        {
+            printf("Failed to create the %s trackers\n", names[f]);
+            ret = 1;
+        }
+        const uint8_t* frame = rgb;
+        size_t frameSize = sizeof(rgb);
+        if (formats[f] != TrackingPixelFormatRGB24)
+        {
+            frameSize = encode_yuv_frame(rgb, formats[f], yuv);
+            frame = yuv;
+        }
+        MarkerCentroid centroids[2][2];
+        for (uint32_t t = 0; t < 2 && !ret; ++t)
+        {
+            if (!BackendTrackerSubmitFrame(trackers[t], frame, frameSize) || !BackendTrackerCollectResults(trackers[t], true, centroids[t]))
+            {
+                printf("Failed to track the %s frame on the %s backend\n", names[f], t == 0 ? "Vulkan" : "CPU");
+                ret = 1;
+            }
+        }
+        // Both backends find the RGB centroids in every format, so the shader unpacks YUV like the CPU
+        for (uint32_t marker = 0; marker < 2 && !ret; ++marker)
+        {
+            ret = compare_centroids(f, marker, &centroids[0][marker], &centroids[1][marker]) ||
+                  compare_centroids(f, marker, &centroids[0][marker], &expected[marker]);
+            if (ret)
+                printf("%s frame marker %u differs from the RGB centroid\n", names[f], marker);
+        }
+        DestroyBackendTracker(trackers[0]);
+        DestroyBackendTracker(trackers[1]);
+    }
+
+    DestroyComputeBackend(vulkanBackend);
+    DestroyComputeBackend(cpuBackend);
+    unlink(cachePath);
+    return ret;
+}
+
+int main(int argc, const char* argv[argc])
+{
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "test_vulkan_tickets") == 0)
+            {
+                return test_vulkan_tickets();
+            }
+            if (strcmp(argv[i], "test_vulkan_memory_allocator") == 0)
+            {
+                return test_vulkan_memory_allocator();
+            }
+            if (strcmp(argv[i], "test_vulkan_staging_ring") == 0)
+            {
+                return test_vulkan_staging_ring();
+            }
+            if (strcmp(argv[i], "test_vulkan_frame_graph") == 0)
+            {
+                return test_vulkan_frame_graph();
+            }
+            if (strcmp(argv[i], "test_vulkan_gpu_profiler") == 0)
+            {
+                return test_vulkan_gpu_profiler();
+            }
+            if (strcmp(argv[i], "test_gpu_profiler_statistics") == 0)
+            {
+                return test_gpu_profiler_statistics();
+            }
+            if (strcmp(argv[i], "test_vulkan_pipeline_cache") == 0)
+            {
+                return test_vulkan_pipeline_cache();
+            }
+            if (strcmp(argv[i], "test_vulkan_backend_matches_cpu") == 0)
+            {
+                return test_vulkan_backend_matches_cpu();
+            }
+            if (strcmp(argv[i], "test_vulkan_backend_yuv_formats") == 0)
+            {
+                return test_vulkan_backend_yuv_formats();
+            }
+        }
+    }
+    else
+    {
+        printf("Please specify which test to run.\n");
+    }
+    return 0;
+}